@@ -23,7 +23,7 @@ DEPENDPATH += .
 INCLUDEPATH += .
 #CONFIG += release
 DEFINES -= UNICODE
-QT += widgets core gui
+QT += widgets core gui concurrent network
 VERSION = 1.0
 VERSTR = '\\"$${VERSION}\\"'
 DEFINES += VER=\"$${VERSTR}\"
@@ -43,7 +43,32 @@ HEADERS += disk.h\
            settingsmanager.h \
            userinterface.h \
            argsmanager.h \
-           common.h
+           common.h \
+           imagingjob.h \
+           imageprefetcher.h \
+           jobscheduler.h \
+           batchrunner.h \
+           checkpointjournal.h \
+           rescuemap.h \
+           chunkmanifest.h \
+           backupreader.h \
+           partitiontable.h \
+           filesystemscanner.h \
+           bmapfile.h \
+           zeroscan.h \
+           diskerror.h \
+           jobstats.h \
+           tracer.h \
+           probes.h \
+           metrics.h \
+           metricsserver.h \
+           throughputestimator.h \
+           throughputgraph.h \
+           devicebackend.h \
+           deviceenumerator.h \
+           windowsdevicebackend.h \
+           sysfsdevicebackend.h \
+           retryrunner.h
 
 FORMS += mainwindow.ui
 
@@ -55,7 +80,30 @@ SOURCES += disk.cpp\
            elapsedtimer.cpp \
            driveio.cpp \
            settingsmanager.cpp \
-           argsmanager.cpp
+           argsmanager.cpp \
+           imagingjob.cpp \
+           imageprefetcher.cpp \
+           jobscheduler.cpp \
+           batchrunner.cpp \
+           checkpointjournal.cpp \
+           rescuemap.cpp \
+           chunkmanifest.cpp \
+           backupreader.cpp \
+           partitiontable.cpp \
+           filesystemscanner.cpp \
+           bmapfile.cpp \
+           zeroscan.cpp \
+           diskerror.cpp \
+           jobstats.cpp \
+           tracer.cpp \
+           metrics.cpp \
+           metricsserver.cpp \
+           throughputestimator.cpp \
+           throughputgraph.cpp \
+           deviceenumerator.cpp \
+           windowsdevicebackend.cpp \
+           sysfsdevicebackend.cpp \
+           retryrunner.cpp
 
 RESOURCES += gui_icons.qrc translations.qrc
 
@@ -14,19 +14,22 @@ QMap<ArgID, Arg> BuildAllArgData()
    Arg Image = {
                 'i',
       "Image",
-      "The image file to read into/write from."
+      "The image file to read into/write from.",
+      true
    };
 
    Arg Volume = {
                  'v',
       "volume",
-      "The volume to read from/write to."
+      "The volume to read from/write to.",
+      true
    };
 
    Arg Drive = {
                 'd',
       "drive",
-      "Same as -v. If both -v and -d are specified, -v is ignored."
+      "Same as -v. If both -v and -d are specified, -v is ignored.",
+      true
    };
 
    Arg SkipConfirmation = {
@@ -38,13 +41,15 @@ QMap<ArgID, Arg> BuildAllArgData()
    Arg Hash = {
                'x',
       "hash",
-      "Hash algorthm to use. If -f no hash algorithm is specified, SHA256 will be used. Options are MD5, SHA1, and SHA256."
+      "Hash algorthm to use. If -f no hash algorithm is specified, SHA256 will be used. Options are MD5, SHA1, and SHA256.",
+      true
    };
 
    Arg WriteHashToFile = {
                           'f',
       "write-hash-to-file",
-      "The generated has will be written to this file."
+      "The generated has will be written to this file.",
+      true
    };
 
    Arg Write = {
@@ -74,7 +79,8 @@ QMap<ArgID, Arg> BuildAllArgData()
    Arg WriteOut = {
                    'o',
       "write-out",
-      "Write all output from this command run to a specified file. If -q is not specified, output will still print to the shell."
+      "Write all output from this command run to a specified file. If -q is not specified, output will still print to the shell.",
+      true
    };
 
    Arg Quiet = {
@@ -89,6 +95,138 @@ QMap<ArgID, Arg> BuildAllArgData()
       "Verbose output (mostly for debugging)"
    };
 
+   Arg Jobs = {
+               'j',
+      "jobs",
+      "Run the read, write and verify jobs listed in this JSON file, printing one JSON result line per job.",
+      true
+   };
+
+   Arg Clone = {
+                'c',
+      "clone",
+      "Clone the drive given with -d (or the file given with -i) to these comma-separated drives or files.",
+      true
+   };
+
+   Arg VerifyClone = {
+                      '\0',
+      "verify-clone",
+      "After cloning, read every target back and compare it against the hash of the source."
+   };
+
+   Arg Resume = {
+                 'R',
+      "resume",
+      "Keep a checkpoint journal next to the image while reading or writing, and continue an interrupted run from it."
+   };
+
+   Arg Rescue = {
+                 '\0',
+      "rescue",
+      "Read a failing drive into the image, skipping unreadable areas and recording progress in a map file next to the image."
+   };
+
+   Arg Retries = {
+                  '\0',
+      "retries",
+      "How often a failed read or write of a chunk is retried, with growing pauses, before smaller transfers are tried (default 3).",
+      true
+   };
+
+   Arg StallTimeout = {
+                       '\0',
+      "stall-timeout",
+      "Milliseconds a single read or write may take before it counts as stalled (default 30000, 0 disables the check).",
+      true
+   };
+
+   Arg OnStall = {
+                  '\0',
+      "on-stall",
+      "What to do about a stalled read or write: report (default), retry or cancel.",
+      true
+   };
+
+   Arg Differential = {
+                       '\0',
+      "differential",
+      "When writing, read the device first and only write the chunks that differ from the image."
+   };
+
+   Arg Base = {
+               '\0',
+      "base",
+      "When writing, the image (or its .manifest file) already on the device; only the chunks the new image changes are written.",
+      true
+   };
+
+   Arg SpotCheck = {
+                    '\0',
+      "spot-check",
+      "With --base, first check a few chunks of the device against the base image."
+   };
+
+   Arg Incremental = {
+                      '\0',
+      "incremental",
+      "When reading, store only the chunks that changed since this earlier backup, plus a manifest referring to it.",
+      true
+   };
+
+   Arg SkipFree = {
+                   '\0',
+      "skip-free",
+      "When reading, skip the free space of FAT, exFAT and ext filesystems; the image is sparse and gets a .bmap."
+   };
+
+   Arg PartitionsOnly = {
+                         '\0',
+      "partitions-only",
+      "When writing, only write the partition tables, the boot area and the partitions, not the gaps between them."
+   };
+
+   Arg Trim = {
+               '\0',
+      "trim",
+      "When reading, stop at the end of the partitions and cut the image after its last non-zero sector."
+   };
+
+   Arg StatsOut = {
+                   '\0',
+      "stats-out",
+      "Collect read and write latency histograms, stage busy times and throughput every 100 ms, and save them to this JSON file.",
+      true
+   };
+
+   Arg TraceOut = {
+                   '\0',
+      "trace-out",
+      "Record every read, write, flush, compare, hash and buffer wait, and save them to this file as a Chrome trace for Perfetto.",
+      true
+   };
+
+   Arg Progress = {
+                   '\0',
+      "progress",
+      "Report progress as a machine-readable stream; the only format is \"jsonl\" (one JSON object per line).",
+      true
+   };
+
+   Arg ProgressFd = {
+                     '\0',
+      "progress-fd",
+      "Write the --progress stream to this file descriptor instead of stdout.",
+      true
+   };
+
+   Arg MetricsPort = {
+                      '\0',
+      "metrics-port",
+      "Serve OpenMetrics (Prometheus) counters on http://127.0.0.1:<port>/metrics while the jobs run.",
+      true
+   };
+
    Arg Help = {
       '\n',
       "help",
@@ -109,6 +247,26 @@ QMap<ArgID, Arg> BuildAllArgData()
    data[ArgID::WriteOut] = WriteOut;
    data[ArgID::Quiet] = Quiet;
    data[ArgID::Verbose] = Verbose;
+   data[ArgID::Jobs] = Jobs;
+   data[ArgID::Clone] = Clone;
+   data[ArgID::VerifyClone] = VerifyClone;
+   data[ArgID::Resume] = Resume;
+   data[ArgID::Rescue] = Rescue;
+   data[ArgID::Retries] = Retries;
+   data[ArgID::StallTimeout] = StallTimeout;
+   data[ArgID::OnStall] = OnStall;
+   data[ArgID::Differential] = Differential;
+   data[ArgID::Base] = Base;
+   data[ArgID::SpotCheck] = SpotCheck;
+   data[ArgID::Incremental] = Incremental;
+   data[ArgID::SkipFree] = SkipFree;
+   data[ArgID::PartitionsOnly] = PartitionsOnly;
+   data[ArgID::Trim] = Trim;
+   data[ArgID::StatsOut] = StatsOut;
+   data[ArgID::TraceOut] = TraceOut;
+   data[ArgID::Progress] = Progress;
+   data[ArgID::ProgressFd] = ProgressFd;
+   data[ArgID::MetricsPort] = MetricsPort;
    data[ArgID::Help] = Help;
 
    return data;
@@ -136,11 +294,21 @@ void ArgsManager::ParseArgs(int argc, char* argv[])
    for(const auto& pair : std::as_const(AllArgData).asKeyValueRange())
    {
       const Arg arg = pair.second;
-      const QString argStr(QString(arg.Short) + "," + arg.Long);
+      const QString argStr = (arg.Short == '\0') ? arg.Long : (QString(arg.Short) + "," + arg.Long);
 
-      options.add_options()
-         (argStr.toStdString().c_str(),
-          arg.Description.toStdString().c_str());
+      if(arg.TakesValue)
+      {
+         options.add_options()
+            (argStr.toStdString().c_str(),
+             arg.Description.toStdString().c_str(),
+             cxxopts::value<std::string>());
+      }
+      else
+      {
+         options.add_options()
+            (argStr.toStdString().c_str(),
+             arg.Description.toStdString().c_str());
+      }
    }
 
    auto args = options.parse(argc, argv);
@@ -151,7 +319,9 @@ void ArgsManager::ParseArgs(int argc, char* argv[])
       const std::string argLong = pair.second.Long.toStdString();
       if(args.count(argLong) > 0)
       {
-         ParsedArgs[id] = QVariant(QString::fromStdString(args[argLong].as<std::string>()));
+         ParsedArgs[id] = pair.second.TakesValue ?
+                             QVariant(QString::fromStdString(args[argLong].as<std::string>())) :
+                             QVariant(args[argLong].as<bool>());
       }
    }
 }
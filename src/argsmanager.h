@@ -10,6 +10,7 @@ struct Arg
    char Short;
    QString Long;
    QString Description;
+   bool TakesValue = false;
 };
 
 enum class ArgID: int
@@ -29,6 +30,26 @@ enum class ArgID: int
    WriteOut,
    Quiet,
    Verbose,
+   Jobs,
+   Clone,
+   VerifyClone,
+   Resume,
+   Rescue,
+   Retries,
+   StallTimeout,
+   OnStall,
+   Differential,
+   Base,
+   SpotCheck,
+   Incremental,
+   SkipFree,
+   PartitionsOnly,
+   Trim,
+   StatsOut,
+   TraceOut,
+   Progress,
+   ProgressFd,
+   MetricsPort,
    Help
 };
 
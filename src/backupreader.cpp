@@ -0,0 +1,112 @@
+#include "backupreader.h"
+#include <cstring>
+
+namespace {
+// Guards against a chain of backups that (by mistake) ends up referring to itself
+const int MAX_CHAIN_DEPTH = 256;
+}
+
+BackupReader::BackupReader()
+   : File()
+   , Manifest()
+   , Incremental(false)
+   , Base()
+{}
+
+BackupReader::~BackupReader()
+{}
+
+bool BackupReader::IsIncremental(const QString& imageFilePath)
+{
+   ChunkManifest manifest;
+   return manifest.Load(ChunkManifest::PathForImage(imageFilePath)) && manifest.IsIncremental();
+}
+
+bool BackupReader::Open(const QString& imageFilePath)
+{
+   return Open(imageFilePath, 0);
+}
+
+bool BackupReader::Open(const QString& imageFilePath, const int depth)
+{
+   File.setFileName(imageFilePath);
+   if((depth > MAX_CHAIN_DEPTH) || !File.open(QIODevice::ReadOnly))
+   {
+      return false;
+   }
+
+   Incremental = Manifest.Load(ChunkManifest::PathForImage(imageFilePath)) && Manifest.IsIncremental();
+   if(!Incremental)
+   {
+      return true;
+   }
+
+   Base.reset(new BackupReader());
+   return Base->Open(Manifest.GetBaseImagePath(), depth + 1);
+}
+
+qint64 BackupReader::GetTotalBytes() const
+{
+   return Incremental ? Manifest.GetTotalBytes() : File.size();
+}
+
+bool BackupReader::Read(const qint64 offset, char* data, const qint64 numBytes)
+{
+   if(!Incremental)
+   {
+      if(!File.seek(offset))
+      {
+         return false;
+      }
+
+      const qint64 bytesRead = File.read(data, numBytes);
+      if(bytesRead < 0)
+      {
+         return false;
+      }
+      memset(data + bytesRead, 0, numBytes - bytesRead);
+      return true;
+   }
+
+   // Split the request at chunk boundaries and take each piece from wherever that chunk lives
+   const qint64 chunkBytes = Manifest.GetChunkBytes();
+   qint64 done = 0;
+   while(done < numBytes)
+   {
+      const qint64 position = offset + done;
+      const int chunk = position / chunkBytes;
+      const qint64 inChunk = position % chunkBytes;
+      const qint64 pieceBytes = qMin(numBytes - done, chunkBytes - inChunk);
+
+      if(chunk >= Manifest.GetChunkCount())
+      {
+         memset(data + done, 0, numBytes - done);
+         return true;
+      }
+
+      const int slot = Manifest.GetStoredSlot(chunk);
+      if(slot < 0)
+      {
+         if(!Base->Read(position, data + done, pieceBytes))
+         {
+            return false;
+         }
+      }
+      else
+      {
+         if(!File.seek(slot * chunkBytes + inChunk))
+         {
+            return false;
+         }
+
+         const qint64 bytesRead = File.read(data + done, pieceBytes);
+         if(bytesRead < 0)
+         {
+            return false;
+         }
+         memset(data + done + bytesRead, 0, pieceBytes - bytesRead);
+      }
+      done += pieceBytes;
+   }
+   return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "chunkmanifest.h"
+#include <QString>
+#include <QFile>
+#include <QScopedPointer>
+
+// Reads the full image behind an incremental backup: chunks stored in the
+// backup file itself come from there, everything else from its base, which
+// may in turn be an incremental backup. A plain image is read as is.
+class BackupReader
+{
+public:
+   BackupReader();
+   ~BackupReader();
+
+   static bool IsIncremental(const QString& imageFilePath);
+
+   bool Open(const QString& imageFilePath);
+   qint64 GetTotalBytes() const;
+
+   // Reads numBytes at offset of the reconstructed image; anything past its end reads as zeros
+   bool Read(const qint64 offset, char* data, const qint64 numBytes);
+
+private:
+   bool Open(const QString& imageFilePath, const int depth);
+
+   QFile File;
+   ChunkManifest Manifest;
+   bool Incremental;
+   QScopedPointer<BackupReader> Base;
+};
@@ -0,0 +1,916 @@
+#include "batchrunner.h"
+#include "backupreader.h"
+#include "diskerror.h"
+#include "tracer.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QCryptographicHash>
+#include <iostream>
+
+namespace {
+const qint64 DEFAULT_PREFETCH_BYTES = 256ll * 1024 * 1024;
+// Enough for a supervisor to show live progress without flooding its pipe
+const int PROGRESS_INTERVAL_MS = 1000;
+
+int HashAlgorithmFromName(const QString& name)
+{
+   const QString upper = name.toUpper();
+   if(upper == "MD5")
+   {
+      return QCryptographicHash::Md5;
+   }
+   if(upper == "SHA1")
+   {
+      return QCryptographicHash::Sha1;
+   }
+   if(upper == "SHA256")
+   {
+      return QCryptographicHash::Sha256;
+   }
+   return -1;
+}
+
+StallPolicy::Action StallActionFromName(const QString& name, const StallPolicy::Action fallback)
+{
+   const QString lower = name.toLower();
+   if(lower == "report")
+   {
+      return StallPolicy::Action::Report;
+   }
+   if(lower == "retry")
+   {
+      return StallPolicy::Action::Retry;
+   }
+   if(lower == "cancel")
+   {
+      return StallPolicy::Action::Cancel;
+   }
+   return fallback;
+}
+
+// Optional per-job "retry" and "stall" settings; false if they cannot be used
+bool ParseErrorHandling(const QJsonObject& object, JobOptions* options, QString* errorMessage)
+{
+   const QJsonObject retry = object.value("retry").toObject();
+   RetryPolicy& policy = options->Retry;
+   policy.MaxRetries = retry.value("count").toInt(policy.MaxRetries);
+   policy.InitialBackoffMs = retry.value("backoffMs").toInt(policy.InitialBackoffMs);
+   policy.MaxBackoffMs = retry.value("maxBackoffMs").toInt(policy.MaxBackoffMs);
+   policy.FallbackSectors = retry.value("fallbackSectors").toInt((int)policy.FallbackSectors);
+
+   const QJsonObject stall = object.value("stall").toObject();
+   options->Stall.TimeoutMs = stall.value("timeoutMs").toInt(options->Stall.TimeoutMs);
+   options->Stall.OnStall = StallActionFromName(stall.value("action").toString(), options->Stall.OnStall);
+
+   *errorMessage = policy.Validate();
+   return errorMessage->isEmpty();
+}
+
+bool SetErrorHandlingFromArgs(const ArgsManager& args, JobOptions* options, QString* errorMessage)
+{
+   const QVariant retries = args.GetArgValue(ArgID::Retries);
+   if(!retries.isNull())
+   {
+      bool valid = false;
+      options->Retry.MaxRetries = retries.toString().toInt(&valid);
+      if(!valid)
+      {
+         *errorMessage = QString("Invalid retry count \"%1\".").arg(retries.toString());
+         return false;
+      }
+   }
+
+   const QVariant stallTimeout = args.GetArgValue(ArgID::StallTimeout);
+   if(!stallTimeout.isNull())
+   {
+      options->Stall.TimeoutMs = stallTimeout.toInt();
+   }
+   options->Stall.OnStall = StallActionFromName(args.GetArgValue(ArgID::OnStall).toString(),
+                                                options->Stall.OnStall);
+
+   *errorMessage = options->Retry.Validate();
+   return errorMessage->isEmpty();
+}
+
+QString JobTypeName(const JobType type)
+{
+   switch(type)
+   {
+   case JobType::Read:
+      return "read";
+   case JobType::Write:
+      return "write";
+   case JobType::Verify:
+      return "verify";
+   case JobType::Clone:
+      return "clone";
+   case JobType::Rescue:
+      return "rescue";
+   }
+   return "unknown";
+}
+
+QString StatusName(const Status status)
+{
+   switch(status)
+   {
+   case Status::Idle:
+      return "idle";
+   case Status::Reading:
+      return "reading";
+   case Status::Writing:
+      return "writing";
+   case Status::Verifying:
+      return "verifying";
+   case Status::Exit:
+      return "exit";
+   case Status::Canceled:
+      return "cancelled";
+   }
+   return "unknown";
+}
+
+// What a job writes to or reads from, as shown in progress lines
+QString JobDevice(const JobOptions& options)
+{
+   if(options.Type == JobType::Clone)
+   {
+      return options.CloneTargets.join(',');
+   }
+   return (options.DriveLetter != ' ') ? QString("%1:").arg(options.DriveLetter) : options.ImageFilePath;
+}
+
+QString JobErrorName(const JobError error)
+{
+   switch(error)
+   {
+   case JobError::None:
+      return "none";
+   case JobError::NoLockOnVolume:
+      return "no-lock-on-volume";
+   case JobError::FailedToUnmountVolume:
+      return "failed-to-unmount-volume";
+   case JobError::NotEnoughSpaceOnDisk:
+      return "not-enough-space-on-disk";
+   case JobError::NotEnoughSpaceOnVolume:
+      return "not-enough-space-on-volume";
+   case JobError::ImageFileContainsNoData:
+      return "image-file-contains-no-data";
+   case JobError::VerifyMismatch:
+      return "verify-mismatch";
+   case JobError::BaseImageMismatch:
+      return "base-image-mismatch";
+   case JobError::UnspecifiedIOError:
+      return "io-error";
+   }
+   return "unknown";
+}
+}
+
+BatchRunner::BatchRunner(QObject* parent)
+   : QObject(parent)
+   , Scheduler()
+   , Jobs()
+   , JobIndexById()
+   , PrefetchBytes(DEFAULT_PREFETCH_BYTES)
+   , StatsOutPath()
+   , TraceOutPath()
+   , ProgressFile()
+   , ProgressFd(-1)
+   , ProgressTimer(this)
+   , MetricsEndpoint(&Scheduler, this)
+   , DiskErrorCount(0)
+   , StallCount(0)
+   , ExitCode(0)
+{
+   ProgressTimer.setInterval(PROGRESS_INTERVAL_MS);
+   connect(&ProgressTimer, &QTimer::timeout, this, &BatchRunner::WriteProgress);
+
+   connect(&Scheduler, &JobScheduler::JobStarted,
+           this, &BatchRunner::HandleJobStarted);
+   connect(&Scheduler, &JobScheduler::JobFailed,
+           this, &BatchRunner::HandleJobFailed);
+   connect(&Scheduler, &JobScheduler::JobGeneratedHash,
+           this, &BatchRunner::HandleJobGeneratedHash);
+   connect(&Scheduler, &JobScheduler::JobSummary,
+           this, &BatchRunner::HandleJobSummary);
+   connect(&Scheduler, &JobScheduler::JobStalled,
+           this, &BatchRunner::HandleJobStalled);
+   connect(DiskErrorQueue::Instance(), &DiskErrorQueue::ErrorsPosted,
+           this, &BatchRunner::HandleDiskErrors);
+   connect(&Scheduler, &JobScheduler::JobFinished,
+           this, &BatchRunner::HandleJobFinished);
+   connect(&Scheduler, &JobScheduler::AllJobsFinished,
+           this, &BatchRunner::HandleAllJobsFinished);
+}
+
+BatchRunner::~BatchRunner()
+{}
+
+bool BatchRunner::LoadJobFile(const QString& filePath, QString* errorMessage)
+{
+   QFile file(filePath);
+   if(!file.open(QIODevice::ReadOnly))
+   {
+      *errorMessage = QString("Cannot open job file %1: %2").arg(filePath, file.errorString());
+      return false;
+   }
+
+   QJsonParseError parseError;
+   const QJsonDocument doc = QJsonDocument::fromJson(file.readAll(), &parseError);
+   if(doc.isNull())
+   {
+      *errorMessage = QString("Cannot parse job file %1: %2").arg(filePath, parseError.errorString());
+      return false;
+   }
+
+   // Either a bare array of jobs, or an object with a "jobs" array and batch-wide settings
+   QJsonArray jobs;
+   if(doc.isArray())
+   {
+      jobs = doc.array();
+   }
+   else
+   {
+      const QJsonObject root = doc.object();
+      jobs = root.value("jobs").toArray();
+      if(root.contains("prefetchMiB"))
+      {
+         PrefetchBytes = (qint64)root.value("prefetchMiB").toInt() * 1024 * 1024;
+      }
+      if(root.contains("maxConcurrentJobs"))
+      {
+         Scheduler.SetMaxConcurrentIO(root.value("maxConcurrentJobs").toInt());
+      }
+      if(root.contains("memoryBudgetMiB"))
+      {
+         Scheduler.SetMemoryBudget((qint64)root.value("memoryBudgetMiB").toInt() * 1024 * 1024);
+      }
+      if(root.contains("metricsPort") && !ServeMetrics(root.value("metricsPort").toInt(), errorMessage))
+      {
+         return false;
+      }
+      if(root.contains("statsOut"))
+      {
+         SetStatsOutPath(root.value("statsOut").toString());
+      }
+      if(root.contains("traceOut"))
+      {
+         SetTraceOutPath(root.value("traceOut").toString());
+      }
+   }
+
+   if(jobs.isEmpty())
+   {
+      *errorMessage = QString("Job file %1 contains no jobs.").arg(filePath);
+      return false;
+   }
+
+   for(int i = 0; i < jobs.size(); i++)
+   {
+      if(!ParseJob(jobs.at(i).toObject(), i, errorMessage))
+      {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+bool BatchRunner::ParseJob(const QJsonObject& object, const int index, QString* errorMessage)
+{
+   JobOptions options;
+
+   const QString type = object.value("type").toString().toLower();
+   if(type == "read")
+   {
+      options.Type = JobType::Read;
+   }
+   else if(type == "write")
+   {
+      options.Type = JobType::Write;
+   }
+   else if(type == "verify")
+   {
+      options.Type = JobType::Verify;
+   }
+   else if(type == "rescue")
+   {
+      options.Type = JobType::Rescue;
+   }
+   else if(type == "clone")
+   {
+      return ParseCloneJob(object, index, errorMessage);
+   }
+   else
+   {
+      *errorMessage = QString("Job %1: unknown type \"%2\".").arg(index + 1).arg(type);
+      return false;
+   }
+
+   const QString drive = object.value("drive").toString();
+   options.ImageFilePath = object.value("image").toString();
+   if(drive.isEmpty() || options.ImageFilePath.isEmpty())
+   {
+      *errorMessage = QString("Job %1: both \"drive\" and \"image\" are required.").arg(index + 1);
+      return false;
+   }
+   options.DriveLetter = drive.at(0).toUpper().toLatin1();
+
+   if(object.contains("hash"))
+   {
+      options.HashAlgorithm = HashAlgorithmFromName(object.value("hash").toString());
+      if(options.HashAlgorithm < 0)
+      {
+         *errorMessage = QString("Job %1: unknown hash \"%2\".").arg(index + 1).arg(object.value("hash").toString());
+         return false;
+      }
+   }
+
+   options.ReadOnlyPartitions = object.value("readOnlyAllocatedPartitions").toBool(false);
+   options.TruncateToDevice = object.value("truncate").toBool(false);
+   options.DifferentialWrite = object.value("differential").toBool(false);
+   options.BaseImagePath = object.value("base").toString();
+   options.SpotCheckBase = object.value("spotCheck").toBool(false);
+   options.IncrementalBase = object.value("incremental").toString();
+   options.SkipFreeBlocks = object.value("skipFreeBlocks").toBool(false);
+   options.WritePartitionsOnly = object.value("partitionsOnly").toBool(false);
+   options.TrimTrailingZeros = object.value("trim").toBool(false);
+   options.Resumable = object.value("resume").toBool(false);
+   QString retryError;
+   if(!ParseErrorHandling(object, &options, &retryError))
+   {
+      *errorMessage = QString("Job %1: %2").arg(index + 1).arg(retryError);
+      return false;
+   }
+
+   AddJob(options, object.value("name").toString());
+   return true;
+}
+
+bool BatchRunner::ParseCloneJob(const QJsonObject& object, const int index, QString* errorMessage)
+{
+   JobOptions options;
+   options.Type = JobType::Clone;
+
+   if(!SetCloneSource(object.value("source").toString(), &options))
+   {
+      *errorMessage = QString("Job %1: clone needs a \"source\" drive or file.").arg(index + 1);
+      return false;
+   }
+
+   for(const QJsonValue& target : object.value("targets").toArray())
+   {
+      options.CloneTargets.append(target.toString());
+   }
+   if(options.CloneTargets.isEmpty() || options.CloneTargets.contains(QString()))
+   {
+      *errorMessage = QString("Job %1: clone needs a list of \"targets\".").arg(index + 1);
+      return false;
+   }
+
+   if(object.contains("hash"))
+   {
+      options.HashAlgorithm = HashAlgorithmFromName(object.value("hash").toString());
+      if(options.HashAlgorithm < 0)
+      {
+         *errorMessage = QString("Job %1: unknown hash \"%2\".").arg(index + 1).arg(object.value("hash").toString());
+         return false;
+      }
+   }
+   options.VerifyClone = object.value("verify").toBool(false);
+   QString retryError;
+   if(!ParseErrorHandling(object, &options, &retryError))
+   {
+      *errorMessage = QString("Job %1: %2").arg(index + 1).arg(retryError);
+      return false;
+   }
+
+   AddJob(options, object.value("name").toString());
+   return true;
+}
+
+bool BatchRunner::SetCloneSource(const QString& source, JobOptions* options)
+{
+   if(source.isEmpty())
+   {
+      return false;
+   }
+
+   if(ImagingJob::IsDriveName(source))
+   {
+      options->DriveLetter = source.at(0).toUpper().toLatin1();
+   }
+   else
+   {
+      options->DriveLetter = ' ';
+      options->ImageFilePath = source;
+   }
+   return true;
+}
+
+bool BatchRunner::AddJobFromArgs(const ArgsManager& args, QString* errorMessage)
+{
+   JobOptions options;
+
+   const QString cloneTargets = args.GetArgValue(ArgID::Clone).toString();
+   if(!cloneTargets.isEmpty())
+   {
+      options.Type = JobType::Clone;
+      options.CloneTargets = cloneTargets.split(',', Qt::SkipEmptyParts);
+      options.VerifyClone = args.GetArgValue(ArgID::VerifyClone).toBool();
+
+      const QString drive = args.GetArgValue(ArgID::Drive).toString();
+      if(!SetCloneSource(drive.isEmpty() ? args.GetArgValue(ArgID::Image).toString() : drive, &options))
+      {
+         *errorMessage = "Cloning needs a source drive (-d) or file (-i).";
+         return false;
+      }
+
+      const QVariant hash = args.GetArgValue(ArgID::Hash);
+      options.HashAlgorithm = hash.isNull() ? -1 : HashAlgorithmFromName(hash.toString());
+      if(!SetErrorHandlingFromArgs(args, &options, errorMessage))
+      {
+         return false;
+      }
+      AddJob(options);
+      return true;
+   }
+
+   if(args.GetArgValue(ArgID::Write).toBool())
+   {
+      options.Type = JobType::Write;
+   }
+   else if(args.GetArgValue(ArgID::Rescue).toBool())
+   {
+      options.Type = JobType::Rescue;
+   }
+   else if(args.GetArgValue(ArgID::Read).toBool())
+   {
+      options.Type = JobType::Read;
+   }
+   else if(args.GetArgValue(ArgID::VerifyOnly).toBool())
+   {
+      options.Type = JobType::Verify;
+   }
+   else
+   {
+      *errorMessage = "One of --read, --write, --verify-only, --rescue or --jobs is required in headless mode.";
+      return false;
+   }
+
+   QString drive = args.GetArgValue(ArgID::Drive).toString();
+   if(drive.isEmpty())
+   {
+      drive = args.GetArgValue(ArgID::Volume).toString();
+   }
+   options.ImageFilePath = args.GetArgValue(ArgID::Image).toString();
+   if(drive.isEmpty() || options.ImageFilePath.isEmpty())
+   {
+      *errorMessage = "Both an image (-i) and a drive (-d) are required.";
+      return false;
+   }
+   options.DriveLetter = drive.at(0).toUpper().toLatin1();
+
+   const QVariant hash = args.GetArgValue(ArgID::Hash);
+   if(!hash.isNull())
+   {
+      options.HashAlgorithm = HashAlgorithmFromName(hash.toString());
+      if(options.HashAlgorithm < 0)
+      {
+         *errorMessage = QString("Unknown hash algorithm \"%1\".").arg(hash.toString());
+         return false;
+      }
+   }
+
+   options.ReadOnlyPartitions = args.GetArgValue(ArgID::ReadOnlyAllocatedPartitions).toBool();
+   // There is nobody to confirm truncating an oversized image in headless mode
+   options.TruncateToDevice = args.GetArgValue(ArgID::SkipConfirmation).toBool();
+   options.Resumable = args.GetArgValue(ArgID::Resume).toBool();
+   options.DifferentialWrite = args.GetArgValue(ArgID::Differential).toBool();
+   options.BaseImagePath = args.GetArgValue(ArgID::Base).toString();
+   options.SpotCheckBase = args.GetArgValue(ArgID::SpotCheck).toBool();
+   options.IncrementalBase = args.GetArgValue(ArgID::Incremental).toString();
+   options.SkipFreeBlocks = args.GetArgValue(ArgID::SkipFree).toBool();
+   options.WritePartitionsOnly = args.GetArgValue(ArgID::PartitionsOnly).toBool();
+   options.TrimTrailingZeros = args.GetArgValue(ArgID::Trim).toBool();
+   if(!SetErrorHandlingFromArgs(args, &options, errorMessage))
+   {
+      return false;
+   }
+
+   AddJob(options);
+   return true;
+}
+
+void BatchRunner::AddJob(const JobOptions& options, const QString& name)
+{
+   BatchJob job;
+   job.Name = name;
+   job.Options = options;
+   Jobs.append(job);
+}
+
+void BatchRunner::SetStatsOutPath(const QString& filePath)
+{
+   StatsOutPath = filePath;
+}
+
+void BatchRunner::SetTraceOutPath(const QString& filePath)
+{
+   TraceOutPath = filePath;
+}
+
+bool BatchRunner::ServeMetrics(const quint16 port, QString* errorMessage)
+{
+   return MetricsEndpoint.Listen(port, errorMessage);
+}
+
+bool BatchRunner::SetProgressStream(const int fd, QString* errorMessage)
+{
+   if(!ProgressFile.open(fd, QIODevice::WriteOnly | QIODevice::Unbuffered, QFileDevice::DontCloseHandle))
+   {
+      *errorMessage = QString("Cannot write progress to file descriptor %1: %2").arg(fd).arg(ProgressFile.errorString());
+      return false;
+   }
+   ProgressFd = fd;
+   return true;
+}
+
+void BatchRunner::Start()
+{
+   if(Jobs.isEmpty())
+   {
+      if(ProgressFile.isOpen())
+      {
+         WriteProgressSummary();
+      }
+      emit Finished(ExitCode);
+      return;
+   }
+
+   if(!TraceOutPath.isEmpty())
+   {
+      Tracer::Enable();
+   }
+   if(ProgressFile.isOpen())
+   {
+      ProgressTimer.start();
+   }
+
+   for(int i = 0; i < Jobs.size(); i++)
+   {
+      BatchJob& job = Jobs[i];
+      job.Options.CollectStats = job.Options.CollectStats || !StatsOutPath.isEmpty();
+      // Delta and partitions-only writes read only parts of the image, so streaming
+      // all of it would be wasted. An incremental backup is not a sequential image file either.
+      if((job.Options.Type == JobType::Write) && job.Options.BaseImagePath.isEmpty() &&
+         !job.Options.WritePartitionsOnly && !BackupReader::IsIncremental(job.Options.ImageFilePath))
+      {
+         job.Options.Prefetcher.reset(new ImagePrefetcher(job.Options.ImageFilePath, PrefetchBytes, &Scheduler));
+      }
+   }
+
+   // Job ids must be known before the scheduler reports anything about them,
+   // and those reports are queued to this thread, so map them as we submit.
+   for(int i = 0; i < Jobs.size(); i++)
+   {
+      Jobs[i].Timer.start();
+      Jobs[i].JobId = Scheduler.Submit(Jobs[i].Options);
+      JobIndexById[Jobs[i].JobId] = i;
+   }
+}
+
+void BatchRunner::HandleJobStarted(const int jobId, const unsigned long long totalSectors)
+{
+   Q_UNUSED(totalSectors);
+   const int index = JobIndexById.value(jobId, -1);
+   if(index < 0)
+   {
+      return;
+   }
+
+   BatchJob& job = Jobs[index];
+   if(job.Started)
+   {
+      // A later pass, e.g. the verify pass of a clone: the time and the rates
+      // measured so far carry on, only the phase starts over
+      const ImagingJob* imagingJob = Scheduler.GetJob(jobId);
+      if(imagingJob != nullptr)
+      {
+         unsigned long long sectorsDone, sectors, sectorSize;
+         imagingJob->GetProgress(&sectorsDone, &sectors, &sectorSize);
+         const ThroughputEstimator::Phase phase = (imagingJob->GetStatus() == Status::Verifying) ?
+                                                     ThroughputEstimator::Phase::Verify :
+                                                     ThroughputEstimator::Phase::Transfer;
+         job.Estimator.AddSample(job.Timer.elapsed(), sectorsDone * sectorSize, sectors * sectorSize, phase);
+      }
+      return;
+   }
+
+   job.Started = true;
+   job.Timer.start();
+   job.Running = true;
+   // Only a clone has a verify pass within the same job
+   job.Estimator.Reset((job.Options.Type == JobType::Clone) && job.Options.VerifyClone);
+   PrefetchNextWrite(index);
+}
+
+void BatchRunner::HandleJobFailed(const int jobId, const JobError error)
+{
+   const int index = JobIndexById.value(jobId, -1);
+   if(index >= 0)
+   {
+      Jobs[index].Error = error;
+   }
+}
+
+void BatchRunner::HandleJobGeneratedHash(const int jobId, const QString hashString)
+{
+   const int index = JobIndexById.value(jobId, -1);
+   if(index >= 0)
+   {
+      Jobs[index].Hash = hashString;
+   }
+}
+
+void BatchRunner::HandleJobSummary(const int jobId, const QString key, const QVariant value)
+{
+   const int index = JobIndexById.value(jobId, -1);
+   if(index >= 0)
+   {
+      Jobs[index].Summary[key] = QJsonValue::fromVariant(value);
+   }
+}
+
+void BatchRunner::HandleJobStalled(const int jobId, const qint64 offset, const qint64 ageMs)
+{
+   // Reported right away on stderr; stdout only carries the result lines
+   const int index = JobIndexById.value(jobId, -1);
+   StallCount++;
+   std::cerr << QString("Job %1: a transfer at offset %2 has not completed for %3 s.")
+                   .arg(index + 1).arg(offset).arg(ageMs / 1000.0, 0, 'f', 1).toStdString() << std::endl;
+}
+
+void BatchRunner::HandleDiskErrors()
+{
+   // Each error on one stderr line; the result line of a failed job carries its last one as well
+   for(const DiskError& error : DiskErrorQueue::Instance()->TakeAll())
+   {
+      DiskErrorCount++;
+      std::cerr << QString("%1: %2").arg(error.Title(), error.Message()).replace('\n', ' ').toStdString() << std::endl;
+   }
+}
+
+void BatchRunner::HandleJobFinished(const int jobId, const bool succeeded, const bool cancelled)
+{
+   const int index = JobIndexById.value(jobId, -1);
+   if(index < 0)
+   {
+      return;
+   }
+
+   BatchJob& job = Jobs[index];
+   job.ElapsedMs = job.Timer.elapsed();
+   job.Running = false;
+   // Progress is only published through the job's counters, so take it once at the end
+   const ImagingJob* imagingJob = Scheduler.GetJob(jobId);
+   if(imagingJob != nullptr)
+   {
+      unsigned long long sectorsDone, totalSectors, sectorSize;
+      imagingJob->GetProgress(&sectorsDone, &totalSectors, &sectorSize);
+      job.BytesDone = sectorsDone * sectorSize;
+      if(imagingJob->GetStats() != nullptr)
+      {
+         job.Stats = imagingJob->GetStats()->ToJson();
+      }
+   }
+   // Drop our reference so the prefetched data is freed with the job
+   job.Options.Prefetcher.reset();
+
+   if(!succeeded)
+   {
+      ExitCode = 1;
+   }
+   WriteResult(job, succeeded, cancelled);
+   WriteStats();
+}
+
+void BatchRunner::HandleAllJobsFinished()
+{
+   if(ProgressFile.isOpen())
+   {
+      ProgressTimer.stop();
+      WriteProgressSummary();
+   }
+   if(!TraceOutPath.isEmpty())
+   {
+      Tracer::Disable();
+      if(!Tracer::Save(TraceOutPath))
+      {
+         std::cerr << QString("Cannot write the trace to %1.").arg(TraceOutPath).toStdString() << std::endl;
+      }
+   }
+   emit Finished(ExitCode);
+}
+
+void BatchRunner::PrefetchNextWrite(const int afterIndex)
+{
+   for(int i = afterIndex + 1; i < Jobs.size(); i++)
+   {
+      if(Jobs[i].Options.Prefetcher)
+      {
+         Jobs[i].Options.Prefetcher->Start();
+         return;
+      }
+   }
+}
+
+void BatchRunner::WriteResult(BatchJob& job, const bool succeeded, const bool cancelled)
+{
+   QJsonObject result;
+   result["job"] = JobIndexById.value(job.JobId) + 1;
+   if(!job.Name.isEmpty())
+   {
+      result["name"] = job.Name;
+   }
+   result["type"] = JobTypeName(job.Options.Type);
+   if(job.Options.DriveLetter != ' ')
+   {
+      result["drive"] = QString(QChar(job.Options.DriveLetter));
+   }
+   if(!job.Options.ImageFilePath.isEmpty())
+   {
+      result["image"] = job.Options.ImageFilePath;
+   }
+   if(!job.Options.CloneTargets.isEmpty())
+   {
+      result["targets"] = QJsonArray::fromStringList(job.Options.CloneTargets);
+   }
+   result["result"] = succeeded ? "succeeded" : (cancelled ? "cancelled" : "failed");
+   result["error"] = JobErrorName(job.Error);
+   result["bytes"] = (qint64)job.BytesDone;
+   result["seconds"] = job.ElapsedMs / 1000.0;
+   if(!job.Hash.isEmpty())
+   {
+      result["hash"] = job.Hash;
+   }
+   if(!job.Summary.isEmpty())
+   {
+      result["summary"] = job.Summary;
+   }
+
+   // Kept for the final summary of the progress stream
+   job.Result = result;
+
+   // A stream on stdout gets the result as one of its events, so every line
+   // there is an event; one elsewhere gets it as well, for its own readers
+   if(ProgressFile.isOpen())
+   {
+      QJsonObject event = result;
+      event["event"] = "result";
+      WriteProgressLine(event);
+   }
+   if(ProgressFd != 1)
+   {
+      std::cout << QJsonDocument(result).toJson(QJsonDocument::Compact).toStdString() << std::endl;
+   }
+}
+
+void BatchRunner::WriteProgress()
+{
+   for(BatchJob& job : Jobs)
+   {
+      const ImagingJob* imagingJob = job.Running ? Scheduler.GetJob(job.JobId) : nullptr;
+      if(imagingJob == nullptr)
+      {
+         continue;
+      }
+
+      unsigned long long sectorsDone, totalSectors, sectorSize;
+      imagingJob->GetProgress(&sectorsDone, &totalSectors, &sectorSize);
+      const qint64 bytes = sectorsDone * sectorSize;
+      const qint64 total = totalSectors * sectorSize;
+      const qint64 elapsedMs = job.Timer.elapsed();
+      const Status status = imagingJob->GetStatus();
+      ThroughputEstimator::Phase phase = ThroughputEstimator::Phase::Transfer;
+      if(status == Status::Verifying)
+      {
+         phase = ThroughputEstimator::Phase::Verify;
+      }
+      else if(bytes >= total)
+      {
+         phase = ThroughputEstimator::Phase::Flush;
+      }
+      job.Estimator.AddSample(elapsedMs, bytes, total, phase);
+      const double averageRate = (elapsedMs > 0) ? bytes * 1000.0 / elapsedMs : 0.0;
+      const qint64 remainingMs = job.Estimator.GetRemainingMs();
+
+      QJsonObject progress;
+      progress["event"] = "progress";
+      progress["job"] = JobIndexById.value(job.JobId) + 1;
+      if(!job.Name.isEmpty())
+      {
+         progress["name"] = job.Name;
+      }
+      progress["stage"] = StatusName(status);
+      progress["device"] = JobDevice(job.Options);
+      progress["bytes"] = bytes;
+      progress["total"] = total;
+      progress["bytesPerSecond"] = qRound64(job.Estimator.GetRate());
+      progress["averageBytesPerSecond"] = qRound64(averageRate);
+      // Left out for the first seconds of every phase, while the rate is not yet meaningful
+      if(remainingMs >= 0)
+      {
+         progress["etaSeconds"] = qRound64(remainingMs / 1000.0);
+      }
+      WriteProgressLine(progress);
+   }
+}
+
+void BatchRunner::WriteProgressLine(const QJsonObject& object)
+{
+   ProgressFile.write(QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n');
+}
+
+void BatchRunner::WriteProgressSummary()
+{
+   int succeeded = 0;
+   int failed = 0;
+   int cancelled = 0;
+   int retries = 0;
+   int verifyMismatches = 0;
+   QJsonObject hashes;
+   QJsonArray results;
+   for(const BatchJob& job : std::as_const(Jobs))
+   {
+      const QString result = job.Result.value("result").toString();
+      succeeded += (result == "succeeded") ? 1 : 0;
+      failed += (result == "failed") ? 1 : 0;
+      cancelled += (result == "cancelled") ? 1 : 0;
+      retries += job.Summary.value("retries").toInt();
+      verifyMismatches += (job.Error == JobError::VerifyMismatch) ? 1 : 0;
+      if(!job.Hash.isEmpty())
+      {
+         hashes[QString::number(JobIndexById.value(job.JobId) + 1)] = job.Hash;
+      }
+      results.append(job.Result);
+   }
+
+   QJsonObject errors;
+   errors["disk"] = DiskErrorCount;
+   errors["stalls"] = StallCount;
+   errors["retries"] = retries;
+   errors["verifyMismatches"] = verifyMismatches;
+
+   QJsonObject summary;
+   summary["event"] = "summary";
+   summary["exitCode"] = ExitCode;
+   summary["jobs"] = Jobs.size();
+   summary["succeeded"] = succeeded;
+   summary["failed"] = failed;
+   summary["cancelled"] = cancelled;
+   summary["errors"] = errors;
+   summary["hashes"] = hashes;
+   summary["results"] = results;
+   WriteProgressLine(summary);
+}
+
+void BatchRunner::WriteStats()
+{
+   if(StatsOutPath.isEmpty())
+   {
+      return;
+   }
+
+   // Rewritten after every job, so the file always covers the jobs finished so far
+   QJsonArray jobs;
+   for(const BatchJob& job : std::as_const(Jobs))
+   {
+      if(job.Stats.isEmpty())
+      {
+         continue;
+      }
+
+      QJsonObject entry;
+      entry["job"] = JobIndexById.value(job.JobId) + 1;
+      if(!job.Name.isEmpty())
+      {
+         entry["name"] = job.Name;
+      }
+      entry["type"] = JobTypeName(job.Options.Type);
+      entry["bytes"] = (qint64)job.BytesDone;
+      entry["stats"] = job.Stats;
+      jobs.append(entry);
+   }
+
+   QJsonObject root;
+   root["jobs"] = jobs;
+   QSaveFile file(StatsOutPath);
+   if(!file.open(QIODevice::WriteOnly) || (file.write(QJsonDocument(root).toJson()) < 0) || !file.commit())
+   {
+      std::cerr << QString("Cannot write the stats to %1.").arg(StatsOutPath).toStdString() << std::endl;
+   }
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "common.h"
+#include "jobscheduler.h"
+#include "argsmanager.h"
+#include "metricsserver.h"
+#include "throughputestimator.h"
+#include <QObject>
+#include <QList>
+#include <QMap>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QFile>
+#include <QTimer>
+
+// Headless front end: runs a list of jobs (from a --jobs file or from the
+// command line) through a JobScheduler and prints one JSON result line per
+// job. While a job runs, the image of the next write job is prefetched.
+// Optionally a JSON-lines progress stream reports every running job once a
+// second and ends with a summary of the whole batch.
+class BatchRunner : public QObject
+{
+   Q_OBJECT
+
+public:
+   explicit BatchRunner(QObject* parent = nullptr);
+   ~BatchRunner();
+
+   bool LoadJobFile(const QString& filePath, QString* errorMessage);
+   bool AddJobFromArgs(const ArgsManager& args, QString* errorMessage);
+   void AddJob(const JobOptions& options, const QString& name = QString());
+   // Collect stats for every job and save them here after each job finishes
+   void SetStatsOutPath(const QString& filePath);
+   // Trace all jobs and save the trace here once the batch is done
+   void SetTraceOutPath(const QString& filePath);
+   // Write the JSON-lines progress stream to this file descriptor (1 for stdout)
+   bool SetProgressStream(const int fd, QString* errorMessage);
+   // Serve OpenMetrics on http://127.0.0.1:<port>/metrics while the batch runs
+   bool ServeMetrics(const quint16 port, QString* errorMessage);
+
+   void Start();
+
+signals:
+   void Finished(const int exitCode);
+
+private slots:
+   void HandleJobStarted(const int jobId, const unsigned long long totalSectors);
+   void HandleJobFailed(const int jobId, const JobError error);
+   void HandleJobGeneratedHash(const int jobId, const QString hashString);
+   void HandleJobSummary(const int jobId, const QString key, const QVariant value);
+   void HandleJobStalled(const int jobId, const qint64 offset, const qint64 ageMs);
+   void HandleDiskErrors();
+   void HandleJobFinished(const int jobId, const bool succeeded, const bool cancelled);
+   void HandleAllJobsFinished();
+   void WriteProgress();
+
+private:
+   struct BatchJob
+   {
+      QString Name;
+      JobOptions Options;
+      int JobId = 0;
+      JobError Error = JobError::None;
+      QString Hash;
+      QJsonObject Summary;
+      unsigned long long BytesDone = 0ull;
+      QElapsedTimer Timer;
+      qint64 ElapsedMs = 0;
+      QJsonObject Stats;
+      QJsonObject Result;
+      bool Running = false;
+      // Set by the first Started; a job that makes several passes sends one per pass
+      bool Started = false;
+      ThroughputEstimator Estimator;
+   };
+
+   bool ParseJob(const QJsonObject& object, const int index, QString* errorMessage);
+   bool ParseCloneJob(const QJsonObject& object, const int index, QString* errorMessage);
+   static bool SetCloneSource(const QString& source, JobOptions* options);
+   void PrefetchNextWrite(const int afterIndex);
+   void WriteResult(BatchJob& job, const bool succeeded, const bool cancelled);
+   void WriteStats();
+   void WriteProgressLine(const QJsonObject& object);
+   void WriteProgressSummary();
+
+   JobScheduler Scheduler;
+   QList<BatchJob> Jobs;
+   QMap<int, int> JobIndexById;
+   qint64 PrefetchBytes;
+   QString StatsOutPath;
+   QString TraceOutPath;
+   QFile ProgressFile;
+   // -1 while there is no progress stream
+   int ProgressFd;
+   QTimer ProgressTimer;
+   MetricsServer MetricsEndpoint;
+   int DiskErrorCount;
+   int StallCount;
+   int ExitCode;
+};
@@ -0,0 +1,75 @@
+#include "bmapfile.h"
+#include <QSaveFile>
+#include <QCryptographicHash>
+
+namespace {
+const qint64 BMAP_BLOCK_BYTES = 4096;
+// The file checksum is taken with its own field set to this
+const QString BMAP_CHECKSUM_PLACEHOLDER = QString(64, QChar('0'));
+}
+
+QString BmapFile::PathForImage(const QString& imageFilePath)
+{
+   return imageFilePath + ".bmap";
+}
+
+bool BmapFile::Save(const QString& bmapPath, const qint64 imageBytes, const QList<QPair<qint64, qint64>>& mappedRanges)
+{
+   // Block ranges are inclusive; neighbouring byte ranges may end up in the same block
+   QList<QPair<qint64, qint64>> blocks;
+   qint64 mappedBlocks = 0;
+   for(const QPair<qint64, qint64>& range : mappedRanges)
+   {
+      const qint64 first = range.first / BMAP_BLOCK_BYTES;
+      const qint64 last = (range.second + BMAP_BLOCK_BYTES - 1) / BMAP_BLOCK_BYTES - 1;
+      if(last < first)
+      {
+         continue;
+      }
+      if(!blocks.isEmpty() && (first <= blocks.last().second + 1))
+      {
+         mappedBlocks += qMax(0ll, last - blocks.last().second);
+         blocks.last().second = qMax(blocks.last().second, last);
+         continue;
+      }
+      blocks.append(qMakePair(first, last));
+      mappedBlocks += last - first + 1;
+   }
+
+   QString blockMap;
+   for(const QPair<qint64, qint64>& range : blocks)
+   {
+      blockMap += (range.first == range.second) ?
+                     QString("        <Range> %1 </Range>\n").arg(range.first) :
+                     QString("        <Range> %1-%2 </Range>\n").arg(range.first).arg(range.second);
+   }
+
+   QString text = QString("<?xml version=\"1.0\" ?>\n"
+                          "<bmap version=\"2.0\">\n"
+                          "    <ImageSize> %1 </ImageSize>\n"
+                          "    <BlockSize> %2 </BlockSize>\n"
+                          "    <BlocksCount> %3 </BlocksCount>\n"
+                          "    <MappedBlocksCount> %4 </MappedBlocksCount>\n"
+                          "    <ChecksumType> sha256 </ChecksumType>\n"
+                          "    <BmapFileChecksum> %5 </BmapFileChecksum>\n"
+                          "    <BlockMap>\n"
+                          "%6"
+                          "    </BlockMap>\n"
+                          "</bmap>\n")
+                     .arg(imageBytes)
+                     .arg(BMAP_BLOCK_BYTES)
+                     .arg((imageBytes + BMAP_BLOCK_BYTES - 1) / BMAP_BLOCK_BYTES)
+                     .arg(mappedBlocks)
+                     .arg(BMAP_CHECKSUM_PLACEHOLDER)
+                     .arg(blockMap);
+   const QByteArray checksum = QCryptographicHash::hash(text.toUtf8(), QCryptographicHash::Sha256).toHex();
+   text.replace(BMAP_CHECKSUM_PLACEHOLDER, QString(checksum));
+
+   QSaveFile file(bmapPath);
+   if(!file.open(QIODevice::WriteOnly))
+   {
+      return false;
+   }
+   file.write(text.toUtf8());
+   return file.commit();
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <QString>
+#include <QList>
+#include <QPair>
+
+// Block map of an image in the XML format of bmaptool (version 2.0), saved
+// next to it (image name + ".bmap"). It lists the parts of the image that
+// hold data, so tools that understand it only need to write those.
+class BmapFile
+{
+public:
+   static QString PathForImage(const QString& imageFilePath);
+
+   // mappedRanges are sorted [start, end) byte ranges; they are widened to whole blocks
+   static bool Save(const QString& bmapPath, const qint64 imageBytes, const QList<QPair<qint64, qint64>>& mappedRanges);
+};
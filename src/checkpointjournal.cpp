@@ -0,0 +1,172 @@
+#include "checkpointjournal.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+
+namespace {
+const int JOURNAL_VERSION = 1;
+// 64 MiB with 512 byte sectors; a multiple of the job's transfer size so that
+// chunk boundaries always fall between two transfers
+const unsigned long long JOURNAL_CHUNK_SECTORS = 128ull * 1024ull;
+const QCryptographicHash::Algorithm JOURNAL_HASH = QCryptographicHash::Md5;
+}
+
+CheckpointJournal::CheckpointJournal(const QString& imageFilePath)
+   : JournalPath(PathForImage(imageFilePath))
+   , Type(JobType::Read)
+   , SectorSize(0ull)
+   , TotalSectors(0ull)
+   , SourceStamp(0)
+   , HighWaterSector(0ull)
+   , ChunkHashes()
+   , CurrentChunk(JOURNAL_HASH)
+{}
+
+QString CheckpointJournal::PathForImage(const QString& imageFilePath)
+{
+   return imageFilePath + ".journal";
+}
+
+bool CheckpointJournal::Load()
+{
+   QFile file(JournalPath);
+   if(!file.open(QIODevice::ReadOnly))
+   {
+      return false;
+   }
+
+   const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+   if(root.value("version").toInt() != JOURNAL_VERSION ||
+      (unsigned long long)root.value("chunkSectors").toInteger() != JOURNAL_CHUNK_SECTORS)
+   {
+      return false;
+   }
+
+   Type = (JobType)root.value("type").toInt();
+   SectorSize = root.value("sectorSize").toInteger();
+   TotalSectors = root.value("totalSectors").toInteger();
+   SourceStamp = root.value("sourceStamp").toInteger();
+   HighWaterSector = root.value("highWater").toInteger();
+
+   ChunkHashes.clear();
+   for(const QJsonValue& hash : root.value("chunks").toArray())
+   {
+      ChunkHashes.append(QByteArray::fromHex(hash.toString().toLatin1()));
+   }
+
+   // Never trust a high-water mark that runs past the hashes backing it
+   const unsigned long long hashedSectors = ChunkHashes.size() * JOURNAL_CHUNK_SECTORS;
+   if(HighWaterSector > hashedSectors)
+   {
+      HighWaterSector = hashedSectors;
+   }
+   if(HighWaterSector > TotalSectors)
+   {
+      HighWaterSector = TotalSectors;
+   }
+
+   CurrentChunk.reset();
+   return true;
+}
+
+bool CheckpointJournal::Save()
+{
+   QJsonArray chunks;
+   for(const QByteArray& hash : ChunkHashes)
+   {
+      chunks.append(QString(hash.toHex()));
+   }
+
+   QJsonObject root;
+   root["version"] = JOURNAL_VERSION;
+   root["type"] = (int)Type;
+   root["sectorSize"] = (qint64)SectorSize;
+   root["totalSectors"] = (qint64)TotalSectors;
+   root["sourceStamp"] = SourceStamp;
+   root["chunkSectors"] = (qint64)JOURNAL_CHUNK_SECTORS;
+   root["highWater"] = (qint64)HighWaterSector;
+   root["chunks"] = chunks;
+
+   // QSaveFile replaces the old journal atomically, so a crash mid-save
+   // leaves the previous checkpoint intact
+   QSaveFile file(JournalPath);
+   if(!file.open(QIODevice::WriteOnly))
+   {
+      return false;
+   }
+   file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+   return file.commit();
+}
+
+void CheckpointJournal::Remove()
+{
+   QFile::remove(JournalPath);
+}
+
+bool CheckpointJournal::Matches(const JobType type, const unsigned long long sectorSize,
+                                const unsigned long long totalSectors, const qint64 sourceStamp) const
+{
+   return (Type == type) && (SectorSize == sectorSize) &&
+          (TotalSectors == totalSectors) && (SourceStamp == sourceStamp);
+}
+
+void CheckpointJournal::Reset(const JobType type, const unsigned long long sectorSize,
+                              const unsigned long long totalSectors, const qint64 sourceStamp)
+{
+   Type = type;
+   SectorSize = sectorSize;
+   TotalSectors = totalSectors;
+   SourceStamp = sourceStamp;
+   HighWaterSector = 0ull;
+   ChunkHashes.clear();
+   CurrentChunk.reset();
+}
+
+unsigned long long CheckpointJournal::GetChunkSectors() const
+{
+   return JOURNAL_CHUNK_SECTORS;
+}
+
+unsigned long long CheckpointJournal::GetHighWaterSector() const
+{
+   return HighWaterSector;
+}
+
+int CheckpointJournal::GetCompletedChunks() const
+{
+   return HighWaterSector / JOURNAL_CHUNK_SECTORS;
+}
+
+const QByteArray& CheckpointJournal::GetChunkHash(const int chunk) const
+{
+   return ChunkHashes.at(chunk);
+}
+
+void CheckpointJournal::Truncate(const int chunk)
+{
+   while(ChunkHashes.size() > chunk)
+   {
+      ChunkHashes.removeLast();
+   }
+   HighWaterSector = chunk * JOURNAL_CHUNK_SECTORS;
+   CurrentChunk.reset();
+}
+
+void CheckpointJournal::AddData(const char* data, const qint64 numBytes)
+{
+   CurrentChunk.addData(QByteArrayView(data, numBytes));
+}
+
+void CheckpointJournal::CompleteChunk(const unsigned long long highWaterSector)
+{
+   ChunkHashes.append(CurrentChunk.result());
+   CurrentChunk.reset();
+   HighWaterSector = highWaterSector;
+}
+
+QCryptographicHash::Algorithm CheckpointJournal::GetHashAlgorithm()
+{
+   return JOURNAL_HASH;
+}
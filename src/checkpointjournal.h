@@ -0,0 +1,52 @@
+#pragma once
+
+#include "common.h"
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QCryptographicHash>
+
+// Small file kept next to an image while a resumable read or write runs. It
+// records the last sector known to be durably on the destination (the
+// high-water mark, only advanced after a flush) and a hash per completed
+// chunk, so an interrupted run can check the tail and continue from there.
+class CheckpointJournal
+{
+public:
+   explicit CheckpointJournal(const QString& imageFilePath);
+
+   static QString PathForImage(const QString& imageFilePath);
+
+   bool Load();
+   bool Save();
+   void Remove();
+
+   // The journal only applies to the same kind of job over the same source
+   bool Matches(const JobType type, const unsigned long long sectorSize,
+                const unsigned long long totalSectors, const qint64 sourceStamp) const;
+   void Reset(const JobType type, const unsigned long long sectorSize,
+              const unsigned long long totalSectors, const qint64 sourceStamp);
+
+   unsigned long long GetChunkSectors() const;
+   unsigned long long GetHighWaterSector() const;
+   int GetCompletedChunks() const;
+   const QByteArray& GetChunkHash(const int chunk) const;
+
+   // Forget chunk and everything after it
+   void Truncate(const int chunk);
+
+   void AddData(const char* data, const qint64 numBytes);
+   void CompleteChunk(const unsigned long long highWaterSector);
+
+   static QCryptographicHash::Algorithm GetHashAlgorithm();
+
+private:
+   const QString JournalPath;
+   JobType Type;
+   unsigned long long SectorSize;
+   unsigned long long TotalSectors;
+   qint64 SourceStamp;
+   unsigned long long HighWaterSector;
+   QList<QByteArray> ChunkHashes;
+   QCryptographicHash CurrentChunk;
+};
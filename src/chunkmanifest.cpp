@@ -0,0 +1,266 @@
+#include "chunkmanifest.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QCryptographicHash>
+#include <QtConcurrent>
+
+namespace {
+const int MANIFEST_VERSION = 1;
+// A multiple of every sector size in use, so chunks can be written to devices as is
+const qint64 DEFAULT_CHUNK_BYTES = 1024ll * 1024;
+const QCryptographicHash::Algorithm MANIFEST_HASH = QCryptographicHash::Sha256;
+
+qint64 FileStamp(const QString& filePath)
+{
+   return QFileInfo(filePath).lastModified().toMSecsSinceEpoch();
+}
+}
+
+ChunkManifest::ChunkManifest()
+   : ChunkBytes(DEFAULT_CHUNK_BYTES)
+   , TotalBytes(0)
+   , SourceStamp(0)
+   , ChunkHashes()
+   , BaseImagePath()
+   , StoredSlots()
+{}
+
+QString ChunkManifest::PathForImage(const QString& imageFilePath)
+{
+   return imageFilePath + ".manifest";
+}
+
+bool ChunkManifest::Load(const QString& manifestPath)
+{
+   QFile file(manifestPath);
+   if(!file.open(QIODevice::ReadOnly))
+   {
+      return false;
+   }
+
+   const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+   if((root.value("version").toInt() != MANIFEST_VERSION) || (root.value("chunkBytes").toInteger() <= 0))
+   {
+      return false;
+   }
+
+   ChunkBytes = root.value("chunkBytes").toInteger();
+   TotalBytes = root.value("totalBytes").toInteger();
+   SourceStamp = root.value("sourceStamp").toInteger();
+
+   ChunkHashes.clear();
+   for(const QJsonValue& hash : root.value("chunks").toArray())
+   {
+      ChunkHashes.append(QByteArray::fromHex(hash.toString().toLatin1()));
+   }
+
+   BaseImagePath.clear();
+   StoredSlots.clear();
+   if(root.contains("base"))
+   {
+      BaseImagePath = QFileInfo(manifestPath).dir().absoluteFilePath(root.value("base").toString());
+      for(const QJsonValue& slot : root.value("stored").toArray())
+      {
+         StoredSlots.append(slot.toInt(-1));
+      }
+      if(StoredSlots.size() != ChunkHashes.size())
+      {
+         return false;
+      }
+   }
+
+   return ChunkHashes.size() == (TotalBytes + ChunkBytes - 1) / ChunkBytes;
+}
+
+bool ChunkManifest::Save(const QString& manifestPath) const
+{
+   QJsonArray chunks;
+   for(const QByteArray& hash : ChunkHashes)
+   {
+      chunks.append(QString(hash.toHex()));
+   }
+
+   QJsonObject root;
+   root["version"] = MANIFEST_VERSION;
+   root["hash"] = "sha256";
+   root["chunkBytes"] = ChunkBytes;
+   root["totalBytes"] = TotalBytes;
+   root["sourceStamp"] = SourceStamp;
+   root["chunks"] = chunks;
+   if(IsIncremental())
+   {
+      QJsonArray stored;
+      for(const int slot : StoredSlots)
+      {
+         stored.append(slot);
+      }
+      root["base"] = QFileInfo(manifestPath).dir().relativeFilePath(BaseImagePath);
+      root["stored"] = stored;
+   }
+
+   QSaveFile file(manifestPath);
+   if(!file.open(QIODevice::WriteOnly))
+   {
+      return false;
+   }
+   file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+   return file.commit();
+}
+
+bool ChunkManifest::BuildFromFile(const QString& filePath, const qint64 chunkBytes, QThreadPool* pool,
+                                  const std::atomic<bool>* cancelled)
+{
+   const QFileInfo info(filePath);
+   if(!info.exists() || (chunkBytes <= 0))
+   {
+      return false;
+   }
+
+   ChunkBytes = chunkBytes;
+   TotalBytes = info.size();
+   SourceStamp = FileStamp(filePath);
+   BaseImagePath.clear();
+   StoredSlots.clear();
+
+   QList<int> chunks;
+   for(int i = 0; (qint64)i * ChunkBytes < TotalBytes; i++)
+   {
+      chunks.append(i);
+   }
+
+   // Each worker reads through its own file handle
+   ChunkHashes = QtConcurrent::blockingMapped(pool, chunks, [&](const int chunk) -> QByteArray {
+      QFile file(filePath);
+      if((cancelled && *cancelled) || !file.open(QIODevice::ReadOnly) || !file.seek(chunk * ChunkBytes))
+      {
+         return QByteArray();
+      }
+
+      const QByteArray data = file.read(ChunkBytes);
+      return (data.size() == GetChunkSize(chunk)) ? HashChunk(data.constData(), data.size()) : QByteArray();
+   });
+
+   return !ChunkHashes.contains(QByteArray());
+}
+
+bool ChunkManifest::LoadOrBuildForImage(const QString& path, const qint64 chunkBytes, QThreadPool* pool,
+                                        const std::atomic<bool>* cancelled)
+{
+   if(path.endsWith(".manifest", Qt::CaseInsensitive))
+   {
+      return Load(path);
+   }
+
+   // An incremental backup cannot be rehashed from its file, which only holds the changed chunks
+   const QString manifestPath = PathForImage(path);
+   if(Load(manifestPath) && (ChunkBytes == chunkBytes) && (IsIncremental() || DescribesFile(path)))
+   {
+      return true;
+   }
+   if(IsIncremental())
+   {
+      return false;
+   }
+
+   if(!BuildFromFile(path, chunkBytes, pool, cancelled))
+   {
+      return false;
+   }
+
+   // Only a cache; failing to store it does not matter
+   Save(manifestPath);
+   return true;
+}
+
+bool ChunkManifest::DescribesFile(const QString& filePath) const
+{
+   const QFileInfo info(filePath);
+   return info.exists() && (info.size() == TotalBytes) && (FileStamp(filePath) == SourceStamp);
+}
+
+void ChunkManifest::StartIncremental(const QString& baseImagePath, const qint64 chunkBytes, const qint64 totalBytes)
+{
+   ChunkBytes = chunkBytes;
+   TotalBytes = totalBytes;
+   SourceStamp = 0;
+   ChunkHashes.clear();
+   BaseImagePath = QFileInfo(baseImagePath).absoluteFilePath();
+   StoredSlots.clear();
+}
+
+void ChunkManifest::AddChunk(const QByteArray& hash, const int storedSlot)
+{
+   ChunkHashes.append(hash);
+   StoredSlots.append(storedSlot);
+}
+
+bool ChunkManifest::IsIncremental() const
+{
+   return !BaseImagePath.isEmpty();
+}
+
+const QString& ChunkManifest::GetBaseImagePath() const
+{
+   return BaseImagePath;
+}
+
+int ChunkManifest::GetStoredSlot(const int chunk) const
+{
+   // A full image stores every chunk in place
+   return IsIncremental() ? StoredSlots.at(chunk) : chunk;
+}
+
+qint64 ChunkManifest::GetChunkBytes() const
+{
+   return ChunkBytes;
+}
+
+qint64 ChunkManifest::GetTotalBytes() const
+{
+   return TotalBytes;
+}
+
+int ChunkManifest::GetChunkCount() const
+{
+   return ChunkHashes.size();
+}
+
+qint64 ChunkManifest::GetChunkSize(const int chunk) const
+{
+   return qMin(ChunkBytes, TotalBytes - chunk * ChunkBytes);
+}
+
+const QByteArray& ChunkManifest::GetChunkHash(const int chunk) const
+{
+   return ChunkHashes.at(chunk);
+}
+
+QList<int> ChunkManifest::ChangedSince(const ChunkManifest& base) const
+{
+   QList<int> changed;
+   for(int i = 0; i < ChunkHashes.size(); i++)
+   {
+      if((base.ChunkBytes != ChunkBytes) || (i >= base.ChunkHashes.size()) ||
+         (base.GetChunkSize(i) != GetChunkSize(i)) || (base.ChunkHashes.at(i) != ChunkHashes.at(i)))
+      {
+         changed.append(i);
+      }
+   }
+   return changed;
+}
+
+QByteArray ChunkManifest::HashChunk(const char* data, const qint64 numBytes)
+{
+   return QCryptographicHash::hash(QByteArrayView(data, numBytes), MANIFEST_HASH);
+}
+
+qint64 ChunkManifest::GetDefaultChunkBytes()
+{
+   return DEFAULT_CHUNK_BYTES;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QThreadPool>
+#include <atomic>
+
+// A hash per fixed-size chunk of an image, kept as a small JSON file next to
+// it (image name + ".manifest"). Comparing the manifests of two builds gives
+// the chunks that changed between them without reading either image again.
+//
+// The manifest of an incremental backup also names the backup it is based on
+// and, per chunk, the slot in the backup file holding it, or -1 if the chunk
+// is unchanged and has to be taken from the base.
+class ChunkManifest
+{
+public:
+   ChunkManifest();
+
+   static QString PathForImage(const QString& imageFilePath);
+
+   bool Load(const QString& manifestPath);
+   bool Save(const QString& manifestPath) const;
+
+   // Hashes every chunk of a file in parallel on pool
+   bool BuildFromFile(const QString& filePath, const qint64 chunkBytes, QThreadPool* pool,
+                      const std::atomic<bool>* cancelled = nullptr);
+   // Loads the manifest saved next to an image if it is still up to date,
+   // otherwise builds one and saves it for next time. A path ending in
+   // ".manifest" is loaded as is.
+   bool LoadOrBuildForImage(const QString& path, const qint64 chunkBytes, QThreadPool* pool,
+                            const std::atomic<bool>* cancelled = nullptr);
+
+   // True if the manifest was built from this file as it is now
+   bool DescribesFile(const QString& filePath) const;
+
+   // Starts an empty incremental manifest; chunks are then added in order
+   void StartIncremental(const QString& baseImagePath, const qint64 chunkBytes, const qint64 totalBytes);
+   void AddChunk(const QByteArray& hash, const int storedSlot);
+   bool IsIncremental() const;
+   const QString& GetBaseImagePath() const;
+   int GetStoredSlot(const int chunk) const;
+
+   qint64 GetChunkBytes() const;
+   qint64 GetTotalBytes() const;
+   int GetChunkCount() const;
+   qint64 GetChunkSize(const int chunk) const;
+   const QByteArray& GetChunkHash(const int chunk) const;
+
+   // Chunks that are missing from base or hash differently there
+   QList<int> ChangedSince(const ChunkManifest& base) const;
+
+   static QByteArray HashChunk(const char* data, const qint64 numBytes);
+   static qint64 GetDefaultChunkBytes();
+
+private:
+   qint64 ChunkBytes;
+   qint64 TotalBytes;
+   qint64 SourceStamp;
+   QList<QByteArray> ChunkHashes;
+   // Incremental backups only; the base path is absolute in memory and stored
+   // relative to the manifest, so a folder of backups can be moved as a whole
+   QString BaseImagePath;
+   QList<int> StoredSlots;
+};
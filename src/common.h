@@ -8,3 +8,23 @@ enum class Status : int {
     Exit,
     Canceled
 };
+
+enum class JobType : int {
+    Read = 0,
+    Write,
+    Verify,
+    Clone,
+    Rescue
+};
+
+enum class JobError : int {
+    None = 0,
+    NoLockOnVolume,
+    FailedToUnmountVolume,
+    NotEnoughSpaceOnDisk,
+    NotEnoughSpaceOnVolume,
+    ImageFileContainsNoData,
+    VerifyMismatch,
+    BaseImageMismatch,
+    UnspecifiedIOError
+};
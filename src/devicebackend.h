@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QString>
+#include <QList>
+
+// A drive that can be picked as the source or target of a job
+struct DeviceInfo
+{
+   // Stays the same for as long as the same medium is attached, so probe
+   // results can be cached under it
+   QString Identity;
+   // What the user picks from, e.g. "[E:\]" or "/dev/sdb"
+   QString Name;
+   // Filled in by Probe where the backend knows them; 0 and empty otherwise
+   qint64 SizeBytes = 0;
+   QString Model;
+};
+
+// Where DeviceEnumerator gets its drives from. ListCandidates runs on the
+// enumerator's thread and must not touch the hardware, only cheap OS
+// bookkeeping. Probe may take as long as the device does and runs on a pool
+// thread, several at once, so it must not change the backend.
+class DeviceBackend
+{
+public:
+   virtual ~DeviceBackend() = default;
+
+   // Every drive that might be usable, with Identity and Name filled in
+   virtual QList<DeviceInfo> ListCandidates() const = 0;
+   // Returns false if the drive is not one we image, e.g. a system disk or an
+   // empty card reader slot
+   virtual bool Probe(DeviceInfo* device) const = 0;
+};
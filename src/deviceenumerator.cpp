@@ -0,0 +1,198 @@
+#include "deviceenumerator.h"
+#include <QTimer>
+#include <QSet>
+#include <algorithm>
+
+namespace {
+// A probe that takes longer leaves its drive out of the list until it answers
+const int PROBE_TIMEOUT_MS = 3000;
+// Results this young are used without probing again; one insertion sends a
+// burst of device change messages, and each of them asks for a refresh
+const qint64 RESULT_MAX_AGE_MS = 2000;
+// One per drive letter, with room for probes stuck on a hung device
+const int MAX_PROBE_THREADS = 32;
+
+bool SameDevices(const QList<DeviceInfo>& a, const QList<DeviceInfo>& b)
+{
+   if(a.size() != b.size())
+   {
+      return false;
+   }
+   for(int i = 0; i < a.size(); i++)
+   {
+      if((a.at(i).Identity != b.at(i).Identity) || (a.at(i).Name != b.at(i).Name))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+}
+
+DeviceEnumerator::DeviceEnumerator(DeviceBackend* backend, QObject* parent)
+   : QObject(parent)
+   , State(new ProbeState())
+   , Cache()
+   , Reported()
+   , ProbeCount(0)
+   , Pool(new QThreadPool())
+{
+   State->Backend.reset(backend);
+   State->Owner = this;
+   Pool->setObjectName("Probe");
+   Pool->setMaxThreadCount(MAX_PROBE_THREADS);
+}
+
+DeviceEnumerator::~DeviceEnumerator()
+{
+   // Once this returns, no probe posts to this object any more
+   {
+      QMutexLocker locker(&State->Lock);
+      State->Owner = nullptr;
+   }
+
+   // Probes that have not started yet are not worth running. One that is
+   // running may be stuck on a hung device for good, so the pool and its
+   // threads are left behind rather than waited for.
+   Pool->clear();
+   if(Pool->waitForDone(0))
+   {
+      delete Pool;
+   }
+   else
+   {
+      qWarning("Leaving %d device probes behind that have not finished", Pool->activeThreadCount());
+   }
+}
+
+QList<DeviceInfo> DeviceEnumerator::GetDevices() const
+{
+   return Reported;
+}
+
+void DeviceEnumerator::Refresh()
+{
+   const QList<DeviceInfo> candidates = State->Backend->ListCandidates();
+
+   // Forget drives that are gone; a probe of one that is still running is
+   // dropped when it comes back
+   QSet<QString> listed;
+   for(const DeviceInfo& candidate : candidates)
+   {
+      listed.insert(candidate.Identity);
+   }
+   for(auto it = Cache.begin(); it != Cache.end();)
+   {
+      if(!listed.contains(it.key()))
+      {
+         it = Cache.erase(it);
+      }
+      else
+      {
+         ++it;
+      }
+   }
+
+   for(const DeviceInfo& candidate : candidates)
+   {
+      const auto cached = Cache.constFind(candidate.Identity);
+      if(cached == Cache.constEnd())
+      {
+         StartProbe(candidate);
+      }
+      else if(!cached->Probing && (!cached->Age.isValid() || cached->Age.hasExpired(RESULT_MAX_AGE_MS)))
+      {
+         StartProbe(candidate);
+      }
+   }
+
+   // Whatever is known now goes out before any probe has finished
+   ReportIfChanged();
+}
+
+void DeviceEnumerator::StartProbe(const DeviceInfo& candidate)
+{
+   Entry& entry = Cache[candidate.Identity];
+   if(!entry.Usable)
+   {
+      entry.Device = candidate;
+   }
+   entry.Probing = true;
+   entry.TimedOut = false;
+   const int generation = ++ProbeCount;
+   entry.Generation = generation;
+
+   // The probe keeps the backend alive itself, and only reports back while
+   // this object is still there to take the result
+   Pool->start([state = State, candidate, generation]() {
+      DeviceInfo device = candidate;
+      const bool usable = state->Backend->Probe(&device);
+      QMutexLocker locker(&state->Lock);
+      DeviceEnumerator* owner = state->Owner;
+      if(owner != nullptr)
+      {
+         QMetaObject::invokeMethod(owner, [owner, device, generation, usable]() {
+            owner->HandleProbeFinished(device.Identity, generation, device, usable);
+         }, Qt::QueuedConnection);
+      }
+   });
+
+   QTimer::singleShot(PROBE_TIMEOUT_MS, this, [this, identity = candidate.Identity, generation]() {
+      HandleProbeTimeout(identity, generation);
+   });
+}
+
+void DeviceEnumerator::HandleProbeFinished(const QString identity, const int generation, const DeviceInfo device,
+                                           const bool usable)
+{
+   auto it = Cache.find(identity);
+   if((it == Cache.end()) || (it->Generation != generation))
+   {
+      return;
+   }
+
+   if(it->TimedOut)
+   {
+      qInfo("Device %s answered after the probe timed out", qPrintable(device.Name));
+   }
+   it->Device = device;
+   it->Usable = usable;
+   it->Probing = false;
+   it->TimedOut = false;
+   it->Age.start();
+   ReportIfChanged();
+}
+
+void DeviceEnumerator::HandleProbeTimeout(const QString identity, const int generation)
+{
+   auto it = Cache.find(identity);
+   if((it == Cache.end()) || (it->Generation != generation) || !it->Probing)
+   {
+      return;
+   }
+
+   qWarning("Device %s did not answer within %d ms", qPrintable(it->Device.Name), PROBE_TIMEOUT_MS);
+   it->TimedOut = true;
+   ReportIfChanged();
+}
+
+void DeviceEnumerator::ReportIfChanged()
+{
+   QList<DeviceInfo> devices;
+   for(const Entry& entry : std::as_const(Cache))
+   {
+      if(entry.Usable && !entry.TimedOut)
+      {
+         devices.append(entry.Device);
+      }
+   }
+   std::sort(devices.begin(), devices.end(), [](const DeviceInfo& a, const DeviceInfo& b) {
+      return a.Name < b.Name;
+   });
+
+   if(!SameDevices(devices, Reported))
+   {
+      Reported = devices;
+      emit DevicesChanged(Reported);
+   }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "devicebackend.h"
+#include <QObject>
+#include <QHash>
+#include <QScopedPointer>
+#include <QSharedPointer>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QThreadPool>
+
+// Finds the drives the user can pick without blocking the thread it lives on.
+// Every drive is probed on its own pool thread; what is already known is
+// reported at once and the list is reported again whenever a probe changes it.
+// Results are cached under the device identity: a drive keeps being listed
+// while it is probed again, and one whose probe does not finish in time is
+// left out until it answers. A drive that is still being probed from an
+// earlier refresh is not probed again, so a hung card reader ties up one
+// thread, not one per refresh. Nothing waits for a probe, not even the
+// destructor: a probe that never returns is left behind with the backend it
+// uses, and its result goes nowhere.
+class DeviceEnumerator : public QObject
+{
+   Q_OBJECT
+
+public:
+   // Takes ownership of the backend
+   explicit DeviceEnumerator(DeviceBackend* backend, QObject* parent = nullptr);
+   ~DeviceEnumerator();
+
+   QList<DeviceInfo> GetDevices() const;
+
+public slots:
+   void Refresh();
+
+signals:
+   // The usable drives, sorted by name
+   void DevicesChanged(const QList<DeviceInfo> devices);
+
+private:
+   struct Entry
+   {
+      DeviceInfo Device;
+      bool Usable = false;
+      bool Probing = false;
+      bool TimedOut = false;
+      // Of the latest probe, so a timeout or a late result of an earlier one is ignored
+      int Generation = 0;
+      // Since the last probe finished
+      QElapsedTimer Age;
+   };
+
+   void StartProbe(const DeviceInfo& candidate);
+   void HandleProbeFinished(const QString identity, const int generation, const DeviceInfo device,
+                            const bool usable);
+   void HandleProbeTimeout(const QString identity, const int generation);
+   void ReportIfChanged();
+
+   // Shared with the probes, so it outlives this object while one is still running
+   struct ProbeState
+   {
+      QScopedPointer<DeviceBackend> Backend;
+      // Guards Owner; cleared by the destructor, after which results are dropped
+      QMutex Lock;
+      DeviceEnumerator* Owner = nullptr;
+   };
+
+   QSharedPointer<ProbeState> State;
+   QHash<QString, Entry> Cache;
+   QList<DeviceInfo> Reported;
+   int ProbeCount;
+   // Not deleted while a probe is stuck in it, as that would wait for the probe
+   QThreadPool* Pool;
+};
@@ -21,28 +21,66 @@
 #define WINVER 0x0601
 #endif
 
-#include <QtWidgets>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <windows.h>
 #include <winioctl.h>
 #include "disk.h"
-#include "mainwindow.h"
 
-HANDLE getHandleOnFile(LPCWSTR filelocation, DWORD access)
+namespace {
+thread_local DiskError lastDiskError;
+
+// GetFinalPathNameByHandle only knows files; volumes and devices are named by their handle
+QString describeHandle(HANDLE handle)
+{
+    wchar_t path[MAX_PATH + 1];
+    DWORD length = GetFinalPathNameByHandleW(handle, path, MAX_PATH, FILE_NAME_NORMALIZED);
+    if ((length > 0) && (length <= MAX_PATH))
+    {
+        return QString::fromWCharArray(path, length);
+    }
+    return QString("handle 0x%1").arg((quintptr)handle, 0, 16);
+}
+
+// Keeps the error as this thread's last disk error and, if asked to, passes it on
+// to the front end. Never blocks, so it is safe on any thread.
+void recordDiskError(DiskError::Operation op, DWORD errorCode, const QString &device,
+                     qint64 offset = -1, bool reportErrors = true)
+{
+    DiskError error;
+    error.Op = op;
+    error.ErrorCode = errorCode;
+    error.Offset = offset;
+    error.Device = device;
+    lastDiskError = error;
+    if (reportErrors)
+    {
+        DiskErrorQueue::Instance()->Post(error);
+    }
+}
+}
+
+DiskError getLastDiskError()
+{
+    return lastDiskError;
+}
+
+void clearLastDiskError()
+{
+    lastDiskError = DiskError();
+}
+
+// keepExisting opens a file for writing without truncating it (used when resuming a read)
+HANDLE getHandleOnFile(LPCWSTR filelocation, DWORD access, bool keepExisting)
 {
     HANDLE hFile;
-    hFile = CreateFileW(filelocation, access, (access == GENERIC_READ) ? FILE_SHARE_READ : 0, NULL, (access == GENERIC_READ) ? OPEN_EXISTING:CREATE_ALWAYS, 0, NULL);
+    DWORD creation = (access == GENERIC_READ) ? OPEN_EXISTING : (keepExisting ? OPEN_ALWAYS : CREATE_ALWAYS);
+    hFile = CreateFileW(filelocation, access, (access == GENERIC_READ) ? FILE_SHARE_READ : 0, NULL, creation, 0, NULL);
     if (hFile == INVALID_HANDLE_VALUE)
     {
-        wchar_t *errormessage=NULL;
-        ::FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0,
-                         (LPWSTR)&errormessage, 0, NULL);
-        QString errText = QString::fromUtf16((const char16_t *)errormessage);
-        QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("File Error"), QObject::tr("An error occurred when attempting to get a handle on the file.\n"
-                                                              "Error %1: %2").arg(GetLastError()).arg(errText));
-        LocalFree(errormessage);
+        DWORD errorCode = GetLastError();
+        recordDiskError(DiskError::Operation::OpenFile, errorCode, QString::fromWCharArray(filelocation));
     }
     return hFile;
 }
@@ -52,14 +90,8 @@ DWORD getDeviceID(HANDLE hVolume)
     DWORD bytesreturned;
     if (!DeviceIoControl(hVolume, IOCTL_VOLUME_GET_VOLUME_DISK_EXTENTS, NULL, 0, &sd, sizeof(sd), &bytesreturned, NULL))
     {
-        wchar_t *errormessage=NULL;
-        ::FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0,
-                         (LPWSTR)&errormessage, 0, NULL);
-        QString errText = QString::fromUtf16((const char16_t *)errormessage);
-        QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("Volume Error"),
-                              QObject::tr("An error occurred when attempting to get information on volume.\n"
-                                          "Error %1: %2").arg(GetLastError()).arg(errText));
-        LocalFree(errormessage);
+        DWORD errorCode = GetLastError();
+        recordDiskError(DiskError::Operation::GetDeviceId, errorCode, describeHandle(hVolume));
     }
     return sd.Extents[0].DiskNumber;
 }
@@ -71,13 +103,8 @@ HANDLE getHandleOnDevice(int device, DWORD access)
     hDevice = CreateFile(devicename.toLatin1().data(), access, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
     if (hDevice == INVALID_HANDLE_VALUE)
     {
-        wchar_t *errormessage=NULL;
-        FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-        QString errText = QString::fromUtf16((const char16_t *)errormessage);
-        QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("Device Error"),
-                              QObject::tr("An error occurred when attempting to get a handle on the device.\n"
-                                          "Error %1: %2").arg(GetLastError()).arg(errText));
-        LocalFree(errormessage);
+        DWORD errorCode = GetLastError();
+        recordDiskError(DiskError::Operation::OpenDevice, errorCode, devicename);
     }
     return hDevice;
 }
@@ -90,13 +117,8 @@ HANDLE getHandleOnVolume(int volume, DWORD access)
     hVolume = CreateFile(volumename, access, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
     if (hVolume == INVALID_HANDLE_VALUE)
     {
-        wchar_t *errormessage=NULL;
-        FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-        QString errText = QString::fromUtf16((const char16_t *)errormessage);
-        QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("Volume Error"),
-                              QObject::tr("An error occurred when attempting to get a handle on the volume.\n"
-                                          "Error %1: %2").arg(GetLastError()).arg(errText));
-        LocalFree(errormessage);
+        DWORD errorCode = GetLastError();
+        recordDiskError(DiskError::Operation::OpenVolume, errorCode, QString(volumename));
     }
     return hVolume;
 }
@@ -108,13 +130,8 @@ bool getLockOnVolume(HANDLE handle)
     bResult = DeviceIoControl(handle, FSCTL_LOCK_VOLUME, NULL, 0, NULL, 0, &bytesreturned, NULL);
     if (!bResult)
     {
-        wchar_t *errormessage=NULL;
-        FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-        QString errText = QString::fromUtf16((const char16_t *)errormessage);
-        QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("Lock Error"),
-                              QObject::tr("An error occurred when attempting to lock the volume.\n"
-                                          "Error %1: %2").arg(GetLastError()).arg(errText));
-        LocalFree(errormessage);
+        DWORD errorCode = GetLastError();
+        recordDiskError(DiskError::Operation::LockVolume, errorCode, describeHandle(handle));
     }
     return (bResult);
 }
@@ -126,13 +143,8 @@ bool removeLockOnVolume(HANDLE handle)
     bResult = DeviceIoControl(handle, FSCTL_UNLOCK_VOLUME, NULL, 0, NULL, 0, &junk, NULL);
     if (!bResult)
     {
-        wchar_t *errormessage=NULL;
-        FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-        QString errText = QString::fromUtf16((const char16_t *)errormessage);
-        QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("Unlock Error"),
-                              QObject::tr("An error occurred when attempting to unlock the volume.\n"
-                                          "Error %1: %2").arg(GetLastError()).arg(errText));
-        LocalFree(errormessage);
+        DWORD errorCode = GetLastError();
+        recordDiskError(DiskError::Operation::UnlockVolume, errorCode, describeHandle(handle));
     }
     return (bResult);
 }
@@ -144,13 +156,8 @@ bool unmountVolume(HANDLE handle)
     bResult = DeviceIoControl(handle, FSCTL_DISMOUNT_VOLUME, NULL, 0, NULL, 0, &junk, NULL);
     if (!bResult)
     {
-        wchar_t *errormessage=NULL;
-        FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-        QString errText = QString::fromUtf16((const char16_t *)errormessage);
-        QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("Dismount Error"),
-                              QObject::tr("An error occurred when attempting to dismount the volume.\n"
-                                          "Error %1: %2").arg(GetLastError()).arg(errText));
-        LocalFree(errormessage);
+        DWORD errorCode = GetLastError();
+        recordDiskError(DiskError::Operation::DismountVolume, errorCode, describeHandle(handle));
     }
     return (bResult);
 }
@@ -163,7 +170,7 @@ bool isVolumeUnmounted(HANDLE handle)
     return (!bResult);
 }
 
-char *readSectorDataFromHandle(HANDLE handle, unsigned long long startsector, unsigned long long numsectors, unsigned long long sectorsize)
+char *readSectorDataFromHandle(HANDLE handle, unsigned long long startsector, unsigned long long numsectors, unsigned long long sectorsize, bool reportErrors)
 {
     unsigned long bytesread;
     char *data = new char[sectorsize * numsectors];
@@ -172,13 +179,8 @@ char *readSectorDataFromHandle(HANDLE handle, unsigned long long startsector, un
     SetFilePointer(handle, li.LowPart, &li.HighPart, FILE_BEGIN);
     if (!ReadFile(handle, data, sectorsize * numsectors, &bytesread, NULL))
     {
-        wchar_t *errormessage=NULL;
-        FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-        QString errText = QString::fromUtf16((const char16_t *)errormessage);
-        QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("Read Error"),
-                              QObject::tr("An error occurred when attempting to read data from handle.\n"
-                                          "Error %1: %2").arg(GetLastError()).arg(errText));
-        LocalFree(errormessage);
+        DWORD errorCode = GetLastError();
+        recordDiskError(DiskError::Operation::Read, errorCode, describeHandle(handle), (qint64)(startsector * sectorsize), reportErrors);
         delete[] data;
         data = NULL;
     }
@@ -189,7 +191,7 @@ char *readSectorDataFromHandle(HANDLE handle, unsigned long long startsector, un
     return data;
 }
 
-bool writeSectorDataToHandle(HANDLE handle, char *data, unsigned long long startsector, unsigned long long numsectors, unsigned long long sectorsize)
+bool writeSectorDataToHandle(HANDLE handle, char *data, unsigned long long startsector, unsigned long long numsectors, unsigned long long sectorsize, bool reportErrors)
 {
     unsigned long byteswritten;
     BOOL bResult;
@@ -199,13 +201,8 @@ bool writeSectorDataToHandle(HANDLE handle, char *data, unsigned long long start
     bResult = WriteFile(handle, data, sectorsize * numsectors, &byteswritten, NULL);
     if (!bResult)
     {
-        wchar_t *errormessage=NULL;
-        FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-        QString errText = QString::fromUtf16((const char16_t *)errormessage);
-        QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("Write Error"),
-                              QObject::tr("An error occurred when attempting to write data to handle.\n"
-                                          "Error %1: %2").arg(GetLastError()).arg(errText));
-        LocalFree(errormessage);
+        DWORD errorCode = GetLastError();
+        recordDiskError(DiskError::Operation::Write, errorCode, describeHandle(handle), (qint64)(startsector * sectorsize), reportErrors);
     }
     return (bResult);
 }
@@ -218,13 +215,8 @@ unsigned long long getNumberOfSectors(HANDLE handle, unsigned long long *sectors
     bResult = DeviceIoControl(handle, IOCTL_DISK_GET_DRIVE_GEOMETRY_EX, NULL, 0, &diskgeometry, sizeof(diskgeometry), &junk, NULL);
     if (!bResult)
     {
-        wchar_t *errormessage=NULL;
-        FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-        QString errText = QString::fromUtf16((const char16_t *)errormessage);
-        QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("Device Error"),
-                              QObject::tr("An error occurred when attempting to get the device's geometry.\n"
-                                          "Error %1: %2").arg(GetLastError()).arg(errText));
-        LocalFree(errormessage);
+        DWORD errorCode = GetLastError();
+        recordDiskError(DiskError::Operation::GetGeometry, errorCode, describeHandle(handle));
         return 0;
     }
     if (sectorsize != NULL)
@@ -243,13 +235,8 @@ unsigned long long getFileSizeInSectors(HANDLE handle, unsigned long long sector
         if(GetFileSizeEx(handle, &filesize) == 0)
         {
             // error
-            wchar_t *errormessage=NULL;
-            FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-            QString errText = QString::fromUtf16((const char16_t *)errormessage);
-            QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("File Error"),
-                                  QObject::tr("An error occurred while getting the file size.\n"
-                                              "Error %1: %2").arg(GetLastError()).arg(errText));
-            LocalFree(errormessage);
+            DWORD errorCode = GetLastError();
+            recordDiskError(DiskError::Operation::GetFileSize, errorCode, describeHandle(handle));
             retVal = 0;
         }
         else
@@ -260,6 +247,21 @@ unsigned long long getFileSizeInSectors(HANDLE handle, unsigned long long sector
     return(retVal);
 }
 
+bool setFileSizeInSectors(HANDLE handle, unsigned long long numsectors, unsigned long long sectorsize)
+{
+    LARGE_INTEGER li;
+    li.QuadPart = numsectors * sectorsize;
+    return (SetFilePointerEx(handle, li, NULL, FILE_BEGIN) && SetEndOfFile(handle));
+}
+
+// Ranges of a sparse file that are never written take no space on disk and read as zeros.
+// Fails on file systems without sparse files (FAT, exFAT), where those ranges are simply zero-filled.
+bool setSparseFile(HANDLE handle)
+{
+    DWORD junk;
+    return DeviceIoControl(handle, FSCTL_SET_SPARSE, NULL, 0, NULL, 0, &junk, NULL);
+}
+
 bool spaceAvailable(char *location, unsigned long long spaceneeded)
 {
     ULARGE_INTEGER freespace;
@@ -267,13 +269,8 @@ bool spaceAvailable(char *location, unsigned long long spaceneeded)
     bResult = GetDiskFreeSpaceEx(location, NULL, NULL, &freespace);
     if (!bResult)
     {
-        wchar_t *errormessage=NULL;
-        FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-        QString errText = QString::fromUtf16((const char16_t *)errormessage);
-        QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("Free Space Error"),
-                              QObject::tr("Failed to get the free space on drive %1.\n"
-                                          "Error %2: %3\n"
-                                          "Checking of free space will be skipped.").arg(location).arg(GetLastError()).arg(errText));
+        DWORD errorCode = GetLastError();
+        recordDiskError(DiskError::Operation::GetFreeSpace, errorCode, QString(location));
         return true;
     }
     return (spaceneeded <= freespace.QuadPart);
@@ -333,14 +330,8 @@ BOOL GetDisksProperty(HANDLE hDevice, PSTORAGE_DEVICE_DESCRIPTOR pDevDesc,
         if (!bResult)
         {
             retVal = false;
-            wchar_t *errormessage=NULL;
-            FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-            QString errText = QString::fromUtf16((const char16_t *)errormessage);
-            QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("File Error"),
-                                  QObject::tr("An error occurred while getting the device number.\n"
-                                              "This usually means something is currently accessing the device;"
-                                              "please close all applications and try again.\n\nError %1: %2").arg(GetLastError()).arg(errText));
-            LocalFree(errormessage);
+            DWORD errorCode = GetLastError();
+            recordDiskError(DiskError::Operation::GetDeviceNumber, errorCode, describeHandle(hDevice));
         }
     }
     else
@@ -353,14 +344,8 @@ BOOL GetDisksProperty(HANDLE hDevice, PSTORAGE_DEVICE_DESCRIPTOR pDevDesc,
         }
         else
         {
-            wchar_t *errormessage=NULL;
-            FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-            QString errText = QString::fromUtf16((const char16_t *)errormessage);
-            QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("File Error"),
-                                  QObject::tr("An error occurred while querying the properties.\n"
-                                              "This usually means something is currently accessing the device;"
-                                              " please close all applications and try again.\n\nError %1: %2").arg(GetLastError()).arg(errText));
-            LocalFree(errormessage);
+            DWORD errorCode = GetLastError();
+            recordDiskError(DiskError::Operation::QueryProperties, errorCode, describeHandle(hDevice));
         }
             retVal = false;
     }
@@ -445,14 +430,9 @@ bool checkDriveType(char *name, ULONG *pid)
         if (hDevice == INVALID_HANDLE_VALUE)
         {
             // for some driver-based devices (Subst, RamDisk), AccessDenied (5) is returned.
-            // maybe that should just be skipped instead of triggering an error dialog...
-            wchar_t *errormessage=NULL;
-            FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, GetLastError(), 0, (LPWSTR)&errormessage, 0, NULL);
-            QString errText = QString::fromUtf16((const char16_t *)errormessage);
-            QMessageBox::critical(MainWindow::getInstanceIfAvailable(), QObject::tr("Volume Error"),
-                                  QObject::tr("An error occurred when attempting to get a handle on %3.\n"
-                                              "Error %1: %2").arg(GetLastError()).arg(errText).arg(nameWithSlash));
-            LocalFree(errormessage);
+            // maybe that should just be skipped instead of being reported as an error...
+            DWORD errorCode = GetLastError();
+            recordDiskError(DiskError::Operation::OpenDrive, errorCode, QString(nameWithSlash));
         }
         else
         {
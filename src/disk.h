@@ -24,12 +24,13 @@
 #define WINVER 0x0601
 #endif
 
-#include <QtWidgets>
+#include <QtCore>
 #include <QString>
 #include <cstdio>
 #include <cstdlib>
 #include <windows.h>
 #include <winioctl.h>
+#include "diskerror.h"
 #ifndef FSCTL_IS_VOLUME_MOUNTED
 #define FSCTL_IS_VOLUME_MOUNTED  CTL_CODE(FILE_DEVICE_FILE_SYSTEM, 10, METHOD_BUFFERED, FILE_ANY_ACCESS)
 #endif // FSCTL_IS_VOLUME_MOUNTED
@@ -44,7 +45,7 @@ typedef struct _DEVICE_NUMBER
 // IOCTL control code
 #define IOCTL_STORAGE_QUERY_PROPERTY   CTL_CODE(IOCTL_STORAGE_BASE, 0x0500, METHOD_BUFFERED, FILE_ANY_ACCESS)
 
-HANDLE getHandleOnFile(LPCWSTR filelocation, DWORD access);
+HANDLE getHandleOnFile(LPCWSTR filelocation, DWORD access, bool keepExisting = false);
 HANDLE getHandleOnDevice(int device, DWORD access);
 HANDLE getHandleOnVolume(int volume, DWORD access);
 QString getDriveLabel(const char *drv);
@@ -53,11 +54,19 @@ bool getLockOnVolume(HANDLE handle);
 bool removeLockOnVolume(HANDLE handle);
 bool unmountVolume(HANDLE handle);
 bool isVolumeUnmounted(HANDLE handle);
-char* readSectorDataFromHandle(HANDLE handle, unsigned long long startsector, unsigned long long numsectors, unsigned long long sectorsize);
-bool writeSectorDataToHandle(HANDLE handle, char *data, unsigned long long startsector, unsigned long long numsectors, unsigned long long sectorsize);
+char* readSectorDataFromHandle(HANDLE handle, unsigned long long startsector, unsigned long long numsectors, unsigned long long sectorsize, bool reportErrors = true);
+bool writeSectorDataToHandle(HANDLE handle, char *data, unsigned long long startsector, unsigned long long numsectors, unsigned long long sectorsize, bool reportErrors = true);
 unsigned long long getNumberOfSectors(HANDLE handle, unsigned long long *sectorsize);
 unsigned long long getFileSizeInSectors(HANDLE handle, unsigned long long sectorsize);
+bool setFileSizeInSectors(HANDLE handle, unsigned long long numsectors, unsigned long long sectorsize);
+bool setSparseFile(HANDLE handle);
 bool spaceAvailable(char *location, unsigned long long spaceneeded);
 bool checkDriveType(char *name, ULONG *pid);
 
+// None of the above show anything to the user. A failing call records a DiskError
+// for the calling thread, like GetLastError, and posts it to DiskErrorQueue unless
+// reportErrors is false.
+DiskError getLastDiskError();
+void clearLastDiskError();
+
 #endif // DISK_H
@@ -0,0 +1,227 @@
+#include "diskerror.h"
+#include <QCoreApplication>
+#include <QMutexLocker>
+
+namespace {
+// A device that fails every request would otherwise queue errors without bound
+// while the front end is busy; the oldest ones are dropped
+const int MAX_PENDING_ERRORS = 256;
+
+QString SystemErrorText(const DWORD errorCode)
+{
+   wchar_t* errorMessage = nullptr;
+   FormatMessageW(FORMAT_MESSAGE_FROM_SYSTEM | FORMAT_MESSAGE_ALLOCATE_BUFFER, NULL, errorCode, 0,
+                  (LPWSTR)&errorMessage, 0, NULL);
+   const QString text = (errorMessage != nullptr) ? QString::fromWCharArray(errorMessage).trimmed() : QString();
+   LocalFree(errorMessage);
+   return text;
+}
+}
+
+bool DiskError::IsSet() const
+{
+   return Op != Operation::None;
+}
+
+QString DiskError::OperationName(const Operation op)
+{
+   switch(op)
+   {
+   case Operation::None:
+      return "none";
+   case Operation::OpenFile:
+      return "open-file";
+   case Operation::OpenDevice:
+      return "open-device";
+   case Operation::OpenVolume:
+      return "open-volume";
+   case Operation::OpenDrive:
+      return "open-drive";
+   case Operation::GetDeviceId:
+      return "get-device-id";
+   case Operation::GetDeviceNumber:
+      return "get-device-number";
+   case Operation::QueryProperties:
+      return "query-properties";
+   case Operation::LockVolume:
+      return "lock-volume";
+   case Operation::UnlockVolume:
+      return "unlock-volume";
+   case Operation::DismountVolume:
+      return "dismount-volume";
+   case Operation::GetGeometry:
+      return "get-geometry";
+   case Operation::GetFileSize:
+      return "get-file-size";
+   case Operation::GetFreeSpace:
+      return "get-free-space";
+   case Operation::Read:
+      return "read";
+   case Operation::Write:
+      return "write";
+   }
+   return "unknown";
+}
+
+QString DiskError::Title() const
+{
+   switch(Op)
+   {
+   case Operation::OpenFile:
+   case Operation::GetFileSize:
+   case Operation::GetDeviceNumber:
+   case Operation::QueryProperties:
+      return QObject::tr("File Error");
+   case Operation::OpenDevice:
+   case Operation::GetGeometry:
+      return QObject::tr("Device Error");
+   case Operation::OpenVolume:
+   case Operation::OpenDrive:
+   case Operation::GetDeviceId:
+      return QObject::tr("Volume Error");
+   case Operation::LockVolume:
+      return QObject::tr("Lock Error");
+   case Operation::UnlockVolume:
+      return QObject::tr("Unlock Error");
+   case Operation::DismountVolume:
+      return QObject::tr("Dismount Error");
+   case Operation::GetFreeSpace:
+      return QObject::tr("Free Space Error");
+   case Operation::Read:
+      return QObject::tr("Read Error");
+   case Operation::Write:
+      return QObject::tr("Write Error");
+   case Operation::None:
+      break;
+   }
+   return QString();
+}
+
+QString DiskError::Message() const
+{
+   QString what;
+   switch(Op)
+   {
+   case Operation::OpenFile:
+      what = QObject::tr("An error occurred when attempting to get a handle on the file.");
+      break;
+   case Operation::OpenDevice:
+      what = QObject::tr("An error occurred when attempting to get a handle on the device.");
+      break;
+   case Operation::OpenVolume:
+      what = QObject::tr("An error occurred when attempting to get a handle on the volume.");
+      break;
+   case Operation::OpenDrive:
+      what = QObject::tr("An error occurred when attempting to get a handle on %1.").arg(Device);
+      break;
+   case Operation::GetDeviceId:
+      what = QObject::tr("An error occurred when attempting to get information on volume.");
+      break;
+   case Operation::GetDeviceNumber:
+      what = QObject::tr("An error occurred while getting the device number.\n"
+                         "This usually means something is currently accessing the device; "
+                         "please close all applications and try again.\n");
+      break;
+   case Operation::QueryProperties:
+      what = QObject::tr("An error occurred while querying the properties.\n"
+                         "This usually means something is currently accessing the device; "
+                         "please close all applications and try again.\n");
+      break;
+   case Operation::LockVolume:
+      what = QObject::tr("An error occurred when attempting to lock the volume.");
+      break;
+   case Operation::UnlockVolume:
+      what = QObject::tr("An error occurred when attempting to unlock the volume.");
+      break;
+   case Operation::DismountVolume:
+      what = QObject::tr("An error occurred when attempting to dismount the volume.");
+      break;
+   case Operation::GetGeometry:
+      what = QObject::tr("An error occurred when attempting to get the device's geometry.");
+      break;
+   case Operation::GetFileSize:
+      what = QObject::tr("An error occurred while getting the file size.");
+      break;
+   case Operation::GetFreeSpace:
+      what = QObject::tr("Failed to get the free space on drive %1.\n"
+                         "Checking of free space will be skipped.").arg(Device);
+      break;
+   case Operation::Read:
+      what = QObject::tr("An error occurred when attempting to read data from handle.");
+      break;
+   case Operation::Write:
+      what = QObject::tr("An error occurred when attempting to write data to handle.");
+      break;
+   case Operation::None:
+      return QString();
+   }
+
+   QString message = what + "\n" + QObject::tr("Error %1: %2").arg(ErrorCode).arg(SystemErrorText(ErrorCode));
+   if(Offset >= 0)
+   {
+      message += "\n" + QObject::tr("Offset: %1 on %2").arg(Offset).arg(Device);
+   }
+   return message;
+}
+
+QVariantMap DiskError::ToVariantMap() const
+{
+   QVariantMap map;
+   map["operation"] = OperationName(Op);
+   map["code"] = (qint64)ErrorCode;
+   map["message"] = SystemErrorText(ErrorCode);
+   if(Offset >= 0)
+   {
+      map["offset"] = Offset;
+   }
+   if(!Device.isEmpty())
+   {
+      map["device"] = Device;
+   }
+   return map;
+}
+
+DiskErrorQueue* DiskErrorQueue::Instance()
+{
+   static DiskErrorQueue queue;
+   return &queue;
+}
+
+DiskErrorQueue::DiskErrorQueue()
+   : QObject(nullptr)
+   , Lock()
+   , Pending()
+   , DeliveryQueued(false)
+{
+   // The first error may well come from an I/O thread without an event loop
+   if(QCoreApplication::instance() != nullptr)
+   {
+      moveToThread(QCoreApplication::instance()->thread());
+   }
+}
+
+void DiskErrorQueue::Post(const DiskError& error)
+{
+   QMutexLocker locker(&Lock);
+   if(Pending.size() >= MAX_PENDING_ERRORS)
+   {
+      Pending.removeFirst();
+   }
+   Pending.append(error);
+
+   // One notification per batch, however many errors end up in it
+   if(!DeliveryQueued)
+   {
+      DeliveryQueued = true;
+      QMetaObject::invokeMethod(this, [this]() { emit ErrorsPosted(); }, Qt::QueuedConnection);
+   }
+}
+
+QList<DiskError> DiskErrorQueue::TakeAll()
+{
+   QMutexLocker locker(&Lock);
+   DeliveryQueued = false;
+   QList<DiskError> errors;
+   errors.swap(Pending);
+   return errors;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QVariantMap>
+#include <windows.h>
+
+// A failed call into the disk layer (disk.h). The failing function keeps it as
+// the calling thread's last disk error (getLastDiskError) and, unless told not
+// to report errors, posts it to the DiskErrorQueue.
+struct DiskError
+{
+   enum class Operation : int
+   {
+      None = 0,
+      OpenFile,
+      OpenDevice,
+      OpenVolume,
+      OpenDrive,
+      GetDeviceId,
+      GetDeviceNumber,
+      QueryProperties,
+      LockVolume,
+      UnlockVolume,
+      DismountVolume,
+      GetGeometry,
+      GetFileSize,
+      GetFreeSpace,
+      Read,
+      Write
+   };
+
+   Operation Op = Operation::None;
+   // GetLastError() of the failing call
+   DWORD ErrorCode = 0;
+   // Byte offset of a failed read or write, -1 for everything else
+   qint64 Offset = -1;
+   // File, volume or device path, as far as it is known
+   QString Device;
+
+   bool IsSet() const;
+   static QString OperationName(const Operation op);
+   // Dialog title and text, including the system's description of ErrorCode
+   QString Title() const;
+   QString Message() const;
+   QVariantMap ToVariantMap() const;
+};
+
+// Hands disk errors from whatever thread they happen on to the front end. Posting
+// never blocks on the front end: errors are queued, and ErrorsPosted is emitted
+// once on the main thread for every batch, which the front end then takes.
+class DiskErrorQueue : public QObject
+{
+   Q_OBJECT
+
+public:
+   static DiskErrorQueue* Instance();
+
+   void Post(const DiskError& error);
+   QList<DiskError> TakeAll();
+
+signals:
+   void ErrorsPosted();
+
+private:
+   DiskErrorQueue();
+
+   QMutex Lock;
+   QList<DiskError> Pending;
+   bool DeliveryQueued;
+};
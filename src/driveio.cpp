@@ -1,8 +1,27 @@
 #include "driveio.h"
+#ifdef Q_OS_WIN
+#include "windowsdevicebackend.h"
+#else
+#include "sysfsdevicebackend.h"
+#endif
 #include <windows.h>
 #include <winioctl.h>
 #include <shlobj.h>
 
+namespace {
+// How often the progress of the running job is passed on to the user interface
+const int PROGRESS_SAMPLE_INTERVAL_MS = 100;
+
+DeviceBackend* CreateDeviceBackend()
+{
+#ifdef Q_OS_WIN
+   return new WindowsDeviceBackend();
+#else
+   return new SysfsDeviceBackend();
+#endif
+}
+}
+
 DriveIO::DriveIO(QObject* parent)
    : QObject(parent)
    , DriveLetter(' ')
@@ -10,34 +29,123 @@ DriveIO::DriveIO(QObject* parent)
    , OperationStatus(Status::Idle)
    , ReadOnlyPartitions(false)
    , SkipConfirmations(false)
-   , VolumeHandle(INVALID_HANDLE_VALUE)
-   , FileHandle(INVALID_HANDLE_VALUE)
-   , RawDiskHandle(INVALID_HANDLE_VALUE)
-   , SectorSize(0ul)
-   , SectorData(nullptr)
-   , SectorData2(nullptr)
+   , TruncateToDevice(false)
+   , HashAlgorithm(-1)
+   , Scheduler(this)
+   , Enumerator(CreateDeviceBackend(), this)
+   , CurrentJobId(0)
+   , CurrentJobType(JobType::Read)
+   , CurrentJobStarted(false)
+   , MismatchSector(-1ll)
+   , ProgressTimer(this)
+   , LastProgressSectors(0ull)
+   , ThroughputClock()
+   , LastThroughputBytes(0ull)
+   , LastRequestCount(0ull)
+   , LastRequestMicros(0ull)
    , HomeDir(GetHomeDir())
    , FileType("")
    , FileTypeList()
 {
-    GetDrives();
+    connect(&Scheduler, &JobScheduler::JobStarted,
+            this, &DriveIO::HandleJobStarted);
+    connect(&Scheduler, &JobScheduler::JobStatusChanged,
+            this, &DriveIO::HandleJobStatusChanged);
+    connect(&Scheduler, &JobScheduler::JobFailed,
+            this, &DriveIO::HandleJobFailed);
+    connect(&Scheduler, &JobScheduler::JobNotEnoughSpaceOnVolume,
+            this, &DriveIO::HandleJobNotEnoughSpaceOnVolume);
+    connect(&Scheduler, &JobScheduler::JobGeneratedHash,
+            this, &DriveIO::HandleJobGeneratedHash);
+    connect(&Scheduler, &JobScheduler::JobSummary,
+            this, &DriveIO::HandleJobSummary);
+    connect(&Scheduler, &JobScheduler::JobFinished,
+            this, &DriveIO::HandleJobFinished);
+
+    // Parented, like the scheduler, so both follow this object to its thread
+    ProgressTimer.setInterval(PROGRESS_SAMPLE_INTERVAL_MS);
+    connect(&ProgressTimer, &QTimer::timeout,
+            this, &DriveIO::SampleProgress);
+
+    // Nothing is probed here; the first refresh comes from the user interface
+    // once this object has its own thread.
+    connect(&Enumerator, &DeviceEnumerator::DevicesChanged,
+            this, &DriveIO::HandleDevicesChanged);
 }
 
 DriveIO::~DriveIO()
 {}
 
-void DriveIO::ConnectToUserInterface(const UserInterface* ui)
+void DriveIO::ConnectToUserInterface(UserInterface* ui)
 {
+   // Automatic connections, so they are queued once this object runs on its own thread
    connect(ui, &UserInterface::RequestReadOperation,
            this, &DriveIO::HandleRequestReadOperation);
    connect(ui, &UserInterface::RequestWriteOperation,
            this, &DriveIO::HandleRequestWriteOperation);
+   connect(ui, &UserInterface::RequestVerifyOperation,
+           this, &DriveIO::HandleRequestVerifyOperation);
+   connect(ui, &UserInterface::RequestCancel,
+           this, &DriveIO::DoCancel);
+   connect(ui, &UserInterface::DriveSelected,
+           this, &DriveIO::HandleDriveSelected);
+   connect(ui, &UserInterface::HashTypeSelected,
+           this, &DriveIO::HandleHashTypeSelected);
    connect(ui, &UserInterface::RequestLogicalDrives,
            this, &DriveIO::HandleRequestLogicalDrives);
    connect(ui, &UserInterface::ReadOverwriteConfirmation,
            this, &DriveIO::HandleReadOverwriteConfirmation);
    connect(ui, &UserInterface::WriteOverwriteConfirmation,
            this, &DriveIO::HandleWriteOverwriteConfirmation);
+   connect(ui, &UserInterface::ConfirmNotEnoughSpaceOnVolume,
+           this, &DriveIO::HandleNotEnoughSpaceOnVolumeConfirmation);
+
+   connect(this, &DriveIO::StatusChanged,
+           ui, &UserInterface::HandleStatusChanged);
+   connect(this, &DriveIO::WarnImageFileContainsNoData,
+           ui, &UserInterface::HandleWarnImageFileContainsNoData);
+   connect(this, &DriveIO::WarnImageFileDoesNotExist,
+           ui, &UserInterface::HandleWarnImageFileDoesNotExist);
+   connect(this, &DriveIO::WarnImageFileLocatedOnDrive,
+           ui, &UserInterface::HandleWarnImageFileLocatedOnDrive);
+   connect(this, &DriveIO::WarnImageFilePermissions,
+           ui, &UserInterface::HandleWarnImageFilePermissions);
+   connect(this, &DriveIO::WarnNoLockOnVolume,
+           ui, &UserInterface::HandleWarnNoLockOnVolume);
+   connect(this, &DriveIO::WarnFailedToUnmountVolume,
+           ui, &UserInterface::HandleWarnFailedToUnmountVolume);
+   connect(this, &DriveIO::WarnNotEnoughSpaceOnVolume,
+           ui, &UserInterface::HandleWarnNotEnoughSpaceOnVolume);
+   connect(this, &DriveIO::WarnUnspecifiedIOError,
+           ui, &UserInterface::HandleWarnUnspecifiedIOError);
+   connect(this, &DriveIO::WarnVerifyMismatch,
+           ui, &UserInterface::HandleWarnVerifyMismatch);
+   connect(this, &DriveIO::WarnBaseImageMismatch,
+           ui, &UserInterface::HandleWarnBaseImageMismatch);
+   connect(this, &DriveIO::InfoGeneratedHash,
+           ui, &UserInterface::HandleInfoGeneratedHash);
+   connect(this, &DriveIO::InfoWriteSuccessful,
+           ui, &UserInterface::HandleInfoWriteSuccessful);
+   connect(this, &DriveIO::InfoVerifySuccessful,
+           ui, &UserInterface::HandleInfoVerifySuccessful);
+   connect(this, &DriveIO::RequestReadOverwriteConfirmation,
+           ui, &UserInterface::HandleRequestReadOverwriteConfirmation);
+   connect(this, &DriveIO::RequestWriteOverwriteConfirmation,
+           ui, &UserInterface::HandleRequestWriteOverwriteConfirmation);
+   connect(this, &DriveIO::SetProgressBarRange,
+           ui, &UserInterface::HandleSetProgressBarRange);
+   connect(this, &DriveIO::ProgressBarStatus,
+           ui, &UserInterface::HandleProgressBarStatus);
+   connect(this, &DriveIO::ThroughputSample,
+           ui, &UserInterface::HandleThroughputSample);
+   connect(this, &DriveIO::OperationComplete,
+           ui, &UserInterface::HandleOperationComplete);
+   connect(this, &DriveIO::StartTimers,
+           ui, &UserInterface::HandleStartTimers);
+   connect(this, &DriveIO::DrivesDetected,
+           ui, &UserInterface::HandleLogicalDrivesDetected);
+   connect(DiskErrorQueue::Instance(), &DiskErrorQueue::ErrorsPosted,
+           ui, &UserInterface::HandleDiskErrors);
 }
 
 bool DriveIO::SetImageFile(const QString filePath)
@@ -92,451 +200,265 @@ void DriveIO::ValidateRead()
 
 void DriveIO::ValidateWrite()
 {
-   if(!ImageFilePath.isEmpty())
+   if(CheckImageFile())
    {
-      QFileInfo fileInfo(ImageFilePath);
-      if(fileInfo.exists() && fileInfo.isFile() &&
-          fileInfo.isReadable() && (fileInfo.size() > 0))
-      {
-         if(ImageFilePath.at(0) == DriveLetter)
-         {
-            emit WarnImageFileLocatedOnDrive();
-            return;
-         }
+      emit RequestWriteOverwriteConfirmation();
+   }
+}
 
-         emit RequestWriteOverwriteConfirmation();
-      }
+void DriveIO::ValidateVerify()
+{
+   if(CheckImageFile())
+   {
+      DoVerify();
    }
 }
 
+bool DriveIO::CheckImageFile()
+{
+   if(ImageFilePath.isEmpty())
+   {
+      return false;
+   }
+
+   QFileInfo fileInfo(ImageFilePath);
+   if(!fileInfo.exists() || !fileInfo.isFile())
+   {
+      emit WarnImageFileDoesNotExist();
+      return false;
+   }
+   if(!fileInfo.isReadable())
+   {
+      emit WarnImageFilePermissions();
+      return false;
+   }
+   if(fileInfo.size() == 0)
+   {
+      emit WarnImageFileContainsNoData();
+      return false;
+   }
+   if(ImageFilePath.at(0) == DriveLetter)
+   {
+      emit WarnImageFileLocatedOnDrive();
+      return false;
+   }
+
+   return true;
+}
+
 void DriveIO::DoRead()
 {
-    SetStatus(Status::Reading);
+    SubmitJob(JobType::Read);
+}
+
+void DriveIO::DoWrite()
+{
+    SubmitJob(JobType::Write);
+}
+
+void DriveIO::DoVerify()
+{
+    SubmitJob(JobType::Verify);
+}
 
-    double mbComplete;
-    unsigned long long numSectors, fileSize, spaceNeeded = 0ull;
-    int volumeID = DriveLetter - 'A';
-    VolumeHandle = getHandleOnVolume(volumeID, GENERIC_READ);
-    if(VolumeHandle == INVALID_HANDLE_VALUE)
+void DriveIO::DoCancel()
+{
+    // Only sets the job's cancellation flag; the job notices it before its next chunk
+    if(CurrentJobId != 0)
     {
-        SetStatus(Status::Idle);
-        return;
+        Scheduler.Cancel(CurrentJobId);
     }
+}
 
-    DWORD deviceID = getDeviceID(VolumeHandle);
-
-    if(!getLockOnVolume(VolumeHandle))
+void DriveIO::SampleProgress()
+{
+    const ImagingJob* job = Scheduler.GetJob(CurrentJobId);
+    if(job == nullptr)
     {
-        CloseHandle(VolumeHandle);
-        SetStatus(Status::Idle);
-        VolumeHandle = INVALID_HANDLE_VALUE;
-        emit WarnNoLockOnVolume();
         return;
     }
 
-    if (!unmountVolume(VolumeHandle))
+    unsigned long long sectorsDone, totalSectors, sectorSize;
+    job->GetProgress(&sectorsDone, &totalSectors, &sectorSize);
+    if(sectorsDone != LastProgressSectors)
     {
-        removeLockOnVolume(VolumeHandle);
-        CloseHandle(VolumeHandle);
-        SetStatus(Status::Idle);
-        VolumeHandle = INVALID_HANDLE_VALUE;
-        emit WarnFailedToUnmountVolume();
-        return;
+        LastProgressSectors = sectorsDone;
+        const double mbComplete = (double)(sectorsDone * sectorSize) / 1024.0 / 1024.0;
+        emit ProgressBarStatus(mbComplete, (int)sectorsDone);
     }
 
-    FileHandle = getHandleOnFile(LPCWSTR(ImageFilePath.data()), GENERIC_WRITE);
-    if (FileHandle == INVALID_HANDLE_VALUE)
+    // Sent every tick, stalls included; the graph averages them into its points
+    const unsigned long long bytesDone = sectorsDone * sectorSize;
+    quint64 requestCount, requestMicros;
+    job->GetStats()->GetRequestTotals(&requestCount, &requestMicros);
+    const qint64 intervalMs = ThroughputClock.restart();
+    // The verify pass counts from 0 again
+    const unsigned long long intervalBytes = (bytesDone >= LastThroughputBytes) ? (bytesDone - LastThroughputBytes) : 0ull;
+    const quint64 intervalRequests = requestCount - LastRequestCount;
+    const double mbPerSecond = (intervalMs > 0) ? (intervalBytes / 1024.0 / 1024.0) * (1000.0 / intervalMs) : 0.0;
+    const double latencyMs = (intervalRequests > 0ull) ?
+                                (requestMicros - LastRequestMicros) / 1000.0 / intervalRequests :
+                                0.0;
+    LastThroughputBytes = bytesDone;
+    LastRequestCount = requestCount;
+    LastRequestMicros = requestMicros;
+    emit ThroughputSample(mbPerSecond, latencyMs);
+}
+
+void DriveIO::SubmitJob(const JobType type)
+{
+    // The status only changes once the scheduler reports it, so also refuse
+    // while the job submitted last has not finished
+    if((Status::Idle != OperationStatus) || (CurrentJobId != 0))
     {
-        removeLockOnVolume(VolumeHandle);
-        CloseHandle(VolumeHandle);
-        SetStatus(Status::Idle);
-        VolumeHandle = INVALID_HANDLE_VALUE;
-        emit WarnUnspecifiedIOError();
         return;
     }
 
-    RawDiskHandle = getHandleOnDevice(deviceID, GENERIC_READ);
-    if (RawDiskHandle == INVALID_HANDLE_VALUE)
+    JobOptions options;
+    options.Type = type;
+    options.DriveLetter = DriveLetter;
+    options.ImageFilePath = ImageFilePath;
+    options.ReadOnlyPartitions = ReadOnlyPartitions;
+    options.TruncateToDevice = TruncateToDevice;
+    options.HashAlgorithm = HashAlgorithm;
+
+    TruncateToDevice = false;
+    CurrentJobType = type;
+    CurrentJobStarted = false;
+    MismatchSector = -1ll;
+    CurrentJobId = Scheduler.Submit(options);
+}
+
+void DriveIO::HandleJobStarted(const int jobId, const unsigned long long totalSectors)
+{
+    if(jobId != CurrentJobId)
     {
-        removeLockOnVolume(VolumeHandle);
-        CloseHandle(FileHandle);
-        CloseHandle(VolumeHandle);
-        SetStatus(Status::Idle);
-        VolumeHandle = INVALID_HANDLE_VALUE;
-        FileHandle = INVALID_HANDLE_VALUE;
-        emit WarnUnspecifiedIOError();
         return;
     }
 
-    numSectors = getNumberOfSectors(RawDiskHandle, &SectorSize);
-    if(ReadOnlyPartitions)
+    emit SetProgressBarRange(0, (totalSectors == 0ull) ? 100 : (int)totalSectors);
+    // Only once per job, so the elapsed time and the throughput graph cover all of it
+    if(!CurrentJobStarted)
     {
-        // Read MBR partition table
-        SectorData = readSectorDataFromHandle(RawDiskHandle, 0, 1ul, 512ul);
-        numSectors = 1ul;
-        // Read partition information
-        for (unsigned long long i = 0ul; i < 4ul; i++)
-        {
-            uint32_t partitionStartSector = *((uint32_t*) (SectorData + 0x1BE + 8 + 16*i));
-            uint32_t partitionNumSectors = *((uint32_t*) (SectorData + 0x1BE + 12 + 16*i));
-            // Set numSectors to end of last partition
-            if (partitionStartSector + partitionNumSectors > numSectors)
-            {
-                numSectors = partitionStartSector + partitionNumSectors;
-            }
-        }
+        CurrentJobStarted = true;
+        emit StartTimers();
+        // Request totals are kept for the whole job
+        LastRequestCount = 0ull;
+        LastRequestMicros = 0ull;
     }
+    // Progress counts from 0 again in every pass
+    LastProgressSectors = 0ull;
+    LastThroughputBytes = 0ull;
+    ThroughputClock.start();
+    ProgressTimer.start();
+}
 
-    fileSize = getFileSizeInSectors(FileHandle, SectorSize);
-    if (fileSize >= numSectors)
+void DriveIO::HandleJobStatusChanged(const int jobId, const Status newStatus)
+{
+    if(jobId == CurrentJobId)
     {
-        spaceNeeded = 0ull;
+        SetStatus(newStatus);
     }
-    else
+}
+
+void DriveIO::HandleJobFailed(const int jobId, const JobError error)
+{
+    if(jobId != CurrentJobId)
     {
-        spaceNeeded = (unsigned long long)(numSectors - fileSize) * (unsigned long long)(SectorSize);
+        return;
     }
 
-    if (!spaceAvailable(ImageFilePath.left(3).replace(QChar('/'), QChar('\\')).toLatin1().data(), spaceNeeded))
+    switch(error)
     {
+    case JobError::NoLockOnVolume:
+        emit WarnNoLockOnVolume();
+        break;
+    case JobError::FailedToUnmountVolume:
+        emit WarnFailedToUnmountVolume();
+        break;
+    case JobError::NotEnoughSpaceOnDisk:
         emit WarnNotEnoughSpaceOnDisk();
+        break;
+    case JobError::ImageFileContainsNoData:
+        emit WarnImageFileContainsNoData();
+        break;
+    case JobError::NotEnoughSpaceOnVolume:
+        // Reported with its details through HandleJobNotEnoughSpaceOnVolume
+        break;
+    case JobError::VerifyMismatch:
+        emit WarnVerifyMismatch(MismatchSector);
+        break;
+    case JobError::BaseImageMismatch:
+        emit WarnBaseImageMismatch();
+        break;
+    case JobError::UnspecifiedIOError:
+        emit WarnUnspecifiedIOError();
+        break;
+    case JobError::None:
+        break;
+    }
+}
 
-        removeLockOnVolume(VolumeHandle);
-        CloseHandle(RawDiskHandle);
-        CloseHandle(FileHandle);
-        CloseHandle(VolumeHandle);
-        SetStatus(Status::Idle);
-        SectorData = nullptr;
-        RawDiskHandle = INVALID_HANDLE_VALUE;
-        FileHandle = INVALID_HANDLE_VALUE;
-        VolumeHandle = INVALID_HANDLE_VALUE;
-        return;
+void DriveIO::HandleJobNotEnoughSpaceOnVolume(const int jobId, const unsigned long long required,
+                                              const unsigned long long availableSectors,
+                                              const unsigned long long sectorSize, const bool dataFound)
+{
+    if(jobId == CurrentJobId)
+    {
+        emit WarnNotEnoughSpaceOnVolume(required, availableSectors, sectorSize, dataFound);
     }
+}
 
-    if (numSectors == 0ul)
+void DriveIO::HandleJobGeneratedHash(const int jobId, const QString hashString)
+{
+    if(jobId == CurrentJobId)
     {
-        emit SetProgressBarRange(0, 100);
+        emit InfoGeneratedHash(hashString);
     }
-    else
+}
+
+void DriveIO::HandleJobSummary(const int jobId, const QString key, const QVariant value)
+{
+    // Reported before the failure it belongs to
+    if((jobId == CurrentJobId) && (key == "mismatchSector"))
+    {
+        MismatchSector = value.toLongLong();
+    }
+}
+
+void DriveIO::HandleJobFinished(const int jobId, const bool succeeded, const bool cancelled)
+{
+    if(jobId != CurrentJobId)
     {
-        emit SetProgressBarRange(0, (int)numSectors);
+        return;
     }
 
-    emit StartTimers();
-    for (unsigned long long sectorIter = 0ul;
-         (sectorIter < numSectors) && (OperationStatus == Status::Reading);
-         sectorIter += 1024ul)
+    ProgressTimer.stop();
+    CurrentJobId = 0;
+    emit ProgressBarStatus(0.0, 0);
+    if(succeeded && !cancelled)
     {
-        const unsigned long long numSectorsToRead = (numSectors - sectorIter >= 1024ul) ?
-                                                        1024ul :
-                                                        (numSectors - sectorIter);
-        SectorData = readSectorDataFromHandle(RawDiskHandle,
-                                              sectorIter,
-                                              numSectorsToRead,
-                                              SectorSize);
-        if (SectorData == nullptr)
+        if(CurrentJobType == JobType::Write)
         {
-            SetStatus(Status::Idle);
-            removeLockOnVolume(VolumeHandle);
-            CloseHandle(RawDiskHandle);
-            CloseHandle(FileHandle);
-            CloseHandle(VolumeHandle);
-            RawDiskHandle = INVALID_HANDLE_VALUE;
-            FileHandle = INVALID_HANDLE_VALUE;
-            VolumeHandle = INVALID_HANDLE_VALUE;
-            emit WarnUnspecifiedIOError();
-            return;
+            emit InfoWriteSuccessful();
         }
-
-        if (!writeSectorDataToHandle(FileHandle,
-                                     SectorData,
-                                     sectorIter,
-                                     numSectorsToRead,
-                                     SectorSize))
+        else if(CurrentJobType == JobType::Verify)
         {
-            delete[] SectorData;
-            removeLockOnVolume(VolumeHandle);
-            CloseHandle(RawDiskHandle);
-            CloseHandle(FileHandle);
-            CloseHandle(VolumeHandle);
-            SetStatus(Status::Idle);
-            SectorData = nullptr;
-            RawDiskHandle = INVALID_HANDLE_VALUE;
-            FileHandle = INVALID_HANDLE_VALUE;
-            VolumeHandle = INVALID_HANDLE_VALUE;
-            emit WarnUnspecifiedIOError();
-            return;
+            emit InfoVerifySuccessful();
         }
-
-        delete[] SectorData;
-        SectorData = nullptr;
-        mbComplete = SectorSize * sectorIter + 1024ul;
-        emit ProgressBarStatus(mbComplete, sectorIter);
-        QCoreApplication::processEvents();
     }
-    removeLockOnVolume(VolumeHandle);
-    CloseHandle(RawDiskHandle);
-    CloseHandle(FileHandle);
-    CloseHandle(VolumeHandle);
-    RawDiskHandle = INVALID_HANDLE_VALUE;
-    FileHandle = INVALID_HANDLE_VALUE;
-    VolumeHandle = INVALID_HANDLE_VALUE;
-    emit ProgressBarStatus(0.0, 0);
-    emit OperationComplete(Status::Canceled == OperationStatus);
-
-    // Completed successfully
+    emit OperationComplete(cancelled);
     SetStatus(Status::Idle);
 }
 
-void DriveIO::DoWrite()
+void DriveIO::HandleNotEnoughSpaceOnVolumeConfirmation(const bool confirmed)
 {
-   SetStatus(Status::Writing);
-
-   bool passfail = true;
-
-   double mbpersec;
-   unsigned long long i, lasti, availablesectors, numsectors;
-   const int volumeID = DriveLetter - 'A';
-
-   // int deviceID = ui->cboxDevice->itemData(cboxDevice->currentIndex()).toInt();
-   VolumeHandle = getHandleOnVolume(volumeID, GENERIC_WRITE);
-   if(VolumeHandle == INVALID_HANDLE_VALUE)
-   {
-      SetStatus(Status::Idle);
-      return;
-   }
-
-   DWORD deviceID = getDeviceID(VolumeHandle);
-   if(!getLockOnVolume(VolumeHandle))
-   {
-      CloseHandle(VolumeHandle);
-      SetStatus(Status::Idle);
-      VolumeHandle = INVALID_HANDLE_VALUE;
-      return;
-   }
-
-   if(!unmountVolume(VolumeHandle))
-   {
-      removeLockOnVolume(VolumeHandle);
-      CloseHandle(VolumeHandle);
-      SetStatus(Status::Idle);
-      VolumeHandle = INVALID_HANDLE_VALUE;
-      return;
-   }
-
-   FileHandle = getHandleOnFile(LPCWSTR(ImageFilePath.toStdString().c_str()), GENERIC_READ);
-   if(FileHandle == INVALID_HANDLE_VALUE)
-   {
-      removeLockOnVolume(VolumeHandle);
-      CloseHandle(VolumeHandle);
-      SetStatus(Status::Idle);
-      VolumeHandle = INVALID_HANDLE_VALUE;
-      return;
-   }
-
-   RawDiskHandle = getHandleOnDevice(deviceID, GENERIC_WRITE);
-   if(RawDiskHandle == INVALID_HANDLE_VALUE)
-   {
-      removeLockOnVolume(VolumeHandle);
-      CloseHandle(FileHandle);
-      CloseHandle(VolumeHandle);
-      SetStatus(Status::Idle);
-      VolumeHandle = INVALID_HANDLE_VALUE;
-      FileHandle = INVALID_HANDLE_VALUE;
-      return;
-   }
-
-   availablesectors = getNumberOfSectors(RawDiskHandle, &SectorSize);
-   if(!availablesectors)
-   {
-      //For external card readers you may not get device change notification when you remove the card/flash.
-      //(So no WM_DEVICECHANGE signal). Device stays but size goes to 0. [Is there special event for this on Windows??]
-      removeLockOnVolume(VolumeHandle);
-      CloseHandle(RawDiskHandle);
-      CloseHandle(FileHandle);
-      CloseHandle(VolumeHandle);
-      RawDiskHandle = INVALID_HANDLE_VALUE;
-      FileHandle = INVALID_HANDLE_VALUE;
-      VolumeHandle = INVALID_HANDLE_VALUE;
-      passfail = false;
-      SetStatus(Status::Idle);
-      return;
-
-   }
-   numsectors = getFileSizeInSectors(FileHandle, SectorSize);
-   if (!numsectors)
-   {
-      //For external card readers you may not get device change notification when you remove the card/flash.
-      //(So no WM_DEVICECHANGE signal). Device stays but size goes to 0. [Is there special event for this on Windows??]
-      removeLockOnVolume(VolumeHandle);
-      CloseHandle(RawDiskHandle);
-      CloseHandle(FileHandle);
-      CloseHandle(VolumeHandle);
-      RawDiskHandle = INVALID_HANDLE_VALUE;
-      FileHandle = INVALID_HANDLE_VALUE;
-      VolumeHandle = INVALID_HANDLE_VALUE;
-      SetStatus(Status::Idle);
-      return;
-
-   }
-   if (numsectors > availablesectors)
-   {
-      bool datafound = false;
-      i = availablesectors;
-      unsigned long nextchunksize = 0;
-      while ( (i < numsectors) && (datafound == false) )
-      {
-         nextchunksize = ((numsectors - i) >= 1024ul) ? 1024ul : (numsectors - i);
-         SectorData = readSectorDataFromHandle(FileHandle, i, nextchunksize, SectorSize);
-         if(SectorData == nullptr)
-         {
-            // if there's an error verifying the truncated data, just move on to the
-            //  write, as we don't care about an error in a section that we're not writing...
-            i = numsectors + 1;
-         } else {
-            unsigned int j = 0;
-            unsigned limit = nextchunksize * SectorSize;
-            while ( (datafound == false) && ( j < limit ) )
-            {
-               if(SectorData[j++] != 0)
-               {
-                  datafound = true;
-               }
-            }
-            i += nextchunksize;
-         }
-      }
-      // delete the allocated SectorData
-      delete[] SectorData;
-      SectorData = nullptr;
-      // build the string for the warning dialog
-      std::ostringstream msg;
-      msg << "More space required than is available:"
-          << "\n  Required: " << numsectors << " sectors"
-          << "\n  Available: " << availablesectors << " sectors"
-          << "\n  Sector Size: " << SectorSize
-          << "\n\nThe extra space " << ((datafound) ? "DOES" : "does not") << " appear to contain data"
-          << "\n\nContinue Anyway?";
-      emit WarnNotEnoughSpaceOnVolume(numsectors, availablesectors, SectorSize, datafound);
-      if(QMessageBox::warning(this, tr("Not enough available space!"),
-                               tr(msg.str().c_str()), QMessageBox::Ok, QMessageBox::Cancel) == QMessageBox::Ok)
-      {
-         // truncate the image at the device size...
-         numsectors = availablesectors;
-      }
-      else    // Cancel
-      {
-         removeLockOnVolume(VolumeHandle);
-         CloseHandle(RawDiskHandle);
-         CloseHandle(FileHandle);
-         CloseHandle(VolumeHandle);
-         SetStatus(Status::Idle);
-         VolumeHandle = INVALID_HANDLE_VALUE;
-         FileHandle = INVALID_HANDLE_VALUE;
-         RawDiskHandle = INVALID_HANDLE_VALUE;
-         ui->bCancel->setEnabled(false);
-         SetReadWriteButtonState();
-         return;
-      }
-   }
-
-   ui->progressbar->setRange(0, (numsectors == 0ul) ? 100 : (int)numsectors);
-   lasti = 0ul;
-   update_timer.start();
-   elapsed_timer->start();
-   for (i = 0ul; i < numsectors && status == STATUS_WRITING; i += 1024ul)
-   {
-      SectorData = readSectorDataFromHandle(FileHandle, i, (numsectors - i >= 1024ul) ? 1024ul:(numsectors - i), SectorSize);
-      if (SectorData == nullptr)
-      {
-         removeLockOnVolume(VolumeHandle);
-         CloseHandle(RawDiskHandle);
-         CloseHandle(FileHandle);
-         CloseHandle(VolumeHandle);
-         SetStatus(Status::Idle);
-         RawDiskHandle = INVALID_HANDLE_VALUE;
-         FileHandle = INVALID_HANDLE_VALUE;
-         VolumeHandle = INVALID_HANDLE_VALUE;
-         ui->bCancel->setEnabled(false);
-         SetReadWriteButtonState();
-         return;
-      }
-      if (!writeSectorDataToHandle(RawDiskHandle, SectorData, i, (numsectors - i >= 1024ul) ? 1024ul:(numsectors - i), SectorSize))
-      {
-         delete[] SectorData;
-         removeLockOnVolume(VolumeHandle);
-         CloseHandle(RawDiskHandle);
-         CloseHandle(FileHandle);
-         CloseHandle(VolumeHandle);
-         SetStatus(Status::Idle);
-         SectorData = nullptr;
-         RawDiskHandle = INVALID_HANDLE_VALUE;
-         FileHandle = INVALID_HANDLE_VALUE;
-         VolumeHandle = INVALID_HANDLE_VALUE;
-         ui->bCancel->setEnabled(false);
-         SetReadWriteButtonState();
-         return;
-      }
-      delete[] SectorData;
-      SectorData = nullptr;
-      QCoreApplication::processEvents();
-      if (update_timer.elapsed() >= ONE_SEC_IN_MS)
-      {
-         mbpersec = (((double)SectorSize * (i - lasti)) * ((float)ONE_SEC_IN_MS / update_timer.elapsed())) / 1024.0 / 1024.0;
-         ui->statusbar->showMessage(QString("%1 MB/s").arg(mbpersec));
-         elapsed_timer->update(i, numsectors);
-         update_timer.start();
-         lasti = i;
-      }
-      ui->progressbar->setValue(i);
-      QCoreApplication::processEvents();
-   }
-   removeLockOnVolume(VolumeHandle);
-   CloseHandle(RawDiskHandle);
-   CloseHandle(FileHandle);
-   CloseHandle(VolumeHandle);
-   RawDiskHandle = INVALID_HANDLE_VALUE;
-   FileHandle = INVALID_HANDLE_VALUE;
-   VolumeHandle = INVALID_HANDLE_VALUE;
-   if(OperationStatus == Status::Canceled)
-   {
-      passfail = false;
-   }
-}
-else if (!fileinfo.exists() || !fileinfo.isFile())
-{
-   QMessageBox::critical(this, tr("File Error"), tr("The selected file does not exist."));
-   passfail = false;
-}
-else if (!fileinfo.isReadable())
-{
-   QMessageBox::critical(this, tr("File Error"), tr("You do not have permision to read the selected file."));
-   passfail = false;
-}
-else if (fileinfo.size() == 0)
-{
-   QMessageBox::critical(this, tr("File Error"), tr("The specified file contains no data."));
-   passfail = false;
-}
-ui->progressbar->reset();
-ui->statusbar->showMessage(tr("Done."));
-ui->bCancel->setEnabled(false);
-SetReadWriteButtonState();
-if (passfail){
-   QMessageBox::information(this, tr("Complete"), tr("Write Successful."));
-}
-
-}
-else
-{
-   QMessageBox::critical(this, tr("File Error"), tr("Please specify an image file to use."));
-}
-if (status == STATUS_EXIT)
-{
-   ui->close();
-}
-status = STATUS_IDLE;
-elapsed_timer->stop();
+    if(confirmed)
+    {
+        // Retry the write, this time truncating the image at the device size
+        TruncateToDevice = true;
+        DoWrite();
+    }
 }
 
 void DriveIO::HandleReadOverwriteConfirmation(const bool confirmed)
@@ -567,55 +489,54 @@ void DriveIO::HandleRequestWriteOperation(const QString fileName)
     ValidateWrite();
 }
 
-void DriveIO::HandleRequestLogicalDrives()
+void DriveIO::HandleRequestVerifyOperation(const QString fileName)
 {
-   // If drives haven't been found, go through and find them now
-   // Then emit logical drives found signal
+    SetImageFile(fileName);
+    ValidateVerify();
 }
 
-void DriveIO::HandleleFileTextUpdated(const QString text)
+void DriveIO::HandleDriveSelected(const char driveLetter)
 {
-   ImageFilePath = text;
+    SetDriveLetter(driveLetter);
 }
 
-void DriveIO::SetStatus(const Status status)
+void DriveIO::HandleHashTypeSelected(const int hashType)
 {
-    if(status != OperationStatus)
+    // Like the drive, only taken while no job is running
+    if(Status::Idle == OperationStatus)
     {
-        OperationStatus = status;
-        emit StatusChanged(OperationStatus);
+        HashAlgorithm = hashType;
     }
 }
 
-void DriveIO::GetDrives()
+void DriveIO::HandleRequestLogicalDrives()
 {
-    // GetLogicalDrives returns 0 on failure, or a bitmask representing
-    // the drives available on the system (bit 0 = A:, bit 1 = B:, etc)
-    unsigned long driveMask = GetLogicalDrives();
-    int iter = 0;
-    ULONG pID;
+   // Returns at once; the list is reported again as probes finish
+   Enumerator.Refresh();
+}
 
-    QList<QString> driveNames;
+void DriveIO::HandleDevicesChanged(const QList<DeviceInfo> devices)
+{
+   QList<QString> driveNames;
+   for(const DeviceInfo& device : devices)
+   {
+      driveNames.append(device.Name);
+   }
+   emit DrivesDetected(driveNames);
+}
 
-    while (driveMask != 0)
-    {
-        if (driveMask & 1)
-        {
-            // the "A" in drivename will get incremented by the # of bits
-            // we've shifted
-            char drivename[] = "\\\\.\\A:\\";
-            drivename[4] += iter;
-            if (checkDriveType(drivename, &pID))
-            {
-                driveNames.insert((qulonglong)pID, (QString("[%1:\\]").arg(drivename[4])));
-            }
-        }
+void DriveIO::HandleleFileTextUpdated(const QString text)
+{
+   ImageFilePath = text;
+}
 
-        driveMask >>= 1;
-        ++iter;
+void DriveIO::SetStatus(const Status status)
+{
+    if(status != OperationStatus)
+    {
+        OperationStatus = status;
+        emit StatusChanged(OperationStatus);
     }
-
-    emit DrivesDetected(driveNames);
 }
 
 QString DriveIO::GetHomeDir()
@@ -2,6 +2,8 @@
 
 #include "common.h"
 #include <QFileInfo>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <cstdio>
 #include <cstdlib>
 #include <windows.h>
@@ -10,7 +12,13 @@
 #include <sstream>
 #include "disk.h"
 #include "userinterface.h"
+#include "jobscheduler.h"
+#include "deviceenumerator.h"
 
+// Front end for the GUI. It is meant to live on its own thread: requests from
+// the user interface reach it as queued signals, jobs run on the scheduler's
+// I/O threads, and progress is sampled from the running job at a fixed rate
+// rather than signalled for every chunk.
 class DriveIO: public QObject
 {
     Q_OBJECT
@@ -19,7 +27,7 @@ public:
     explicit DriveIO(QObject* parent = nullptr);
     ~DriveIO();
 
-    void ConnectToUserInterface(const UserInterface* ui);
+    void ConnectToUserInterface(UserInterface* ui);
 
     bool SetImageFile(const QString filePath);
     bool SetDriveLetter(const char driveLetter);
@@ -34,7 +42,11 @@ public slots:
     void HandleWriteOverwriteConfirmation(const bool confirmed);
     void HandleRequestReadOperation(const QString fileName);
     void HandleRequestWriteOperation(const QString fileName);
+    void HandleRequestVerifyOperation(const QString fileName);
+    void HandleDriveSelected(const char driveLetter);
+    void HandleHashTypeSelected(const int hashType);
     void HandleRequestLogicalDrives();
+    void HandleNotEnoughSpaceOnVolumeConfirmation(const bool confirmed);
 
     // UI field update handlers
     void HandleleFileTextUpdated(const QString textValue);
@@ -42,7 +54,21 @@ public slots:
  private slots:
     void DoRead();
     void DoWrite();
+    void DoVerify();
     void DoCancel();
+    void SampleProgress();
+
+    // Scheduler job handlers
+    void HandleJobStarted(const int jobId, const unsigned long long totalSectors);
+    void HandleJobStatusChanged(const int jobId, const Status newStatus);
+    void HandleJobFailed(const int jobId, const JobError error);
+    void HandleJobNotEnoughSpaceOnVolume(const int jobId, const unsigned long long required,
+                                         const unsigned long long availableSectors,
+                                         const unsigned long long sectorSize, const bool dataFound);
+    void HandleJobGeneratedHash(const int jobId, const QString hashString);
+    void HandleJobSummary(const int jobId, const QString key, const QVariant value);
+    void HandleJobFinished(const int jobId, const bool succeeded, const bool cancelled);
+    void HandleDevicesChanged(const QList<DeviceInfo> devices);
 
 signals:
     void StatusChanged(const Status newStatus);
@@ -57,18 +83,26 @@ signals:
                                     const bool dataFound);
     void WarnNotEnoughSpaceOnDisk();
     void WarnUnspecifiedIOError();
+    // The first sector that differs, or -1 if the job could not tell
+    void WarnVerifyMismatch(const long long sector);
+    void WarnBaseImageMismatch();
     void InfoGeneratedHash(const QString hashString);
+    void InfoWriteSuccessful();
+    void InfoVerifySuccessful();
     void RequestReadOverwriteConfirmation();
     void RequestWriteOverwriteConfirmation();
     void SetProgressBarRange(const int min, const int max);
     void ProgressBarStatus(const double mbComplete, const int completion);
+    void ThroughputSample(const double mbPerSecond, const double latencyMs);
     void OperationComplete(const bool cancelled);
     void StartTimers();
     void DrivesDetected(const QList<QString> drives);
 
 private:
     void SetStatus(const Status status);
-    void GetDrives();
+    bool CheckImageFile();
+    void ValidateVerify();
+    void SubmitJob(const JobType type);
     QString GetHomeDir();
 
     char DriveLetter;
@@ -76,12 +110,23 @@ private:
     Status OperationStatus;
     bool ReadOnlyPartitions;
     bool SkipConfirmations;
-    HANDLE VolumeHandle;
-    HANDLE FileHandle;
-    HANDLE RawDiskHandle;
-    unsigned long long SectorSize;
-    char* SectorData;
-    char* SectorData2; //for verify
+    bool TruncateToDevice;
+    // A QCryptographicHash::Algorithm, or -1 for no hash
+    int HashAlgorithm;
+    JobScheduler Scheduler;
+    DeviceEnumerator Enumerator;
+    int CurrentJobId;
+    JobType CurrentJobType;
+    // Set by the first Started; a job that makes several passes sends one per pass
+    bool CurrentJobStarted;
+    long long MismatchSector;
+    QTimer ProgressTimer;
+    unsigned long long LastProgressSectors;
+    // Where the previous throughput sample left off
+    QElapsedTimer ThroughputClock;
+    unsigned long long LastThroughputBytes;
+    quint64 LastRequestCount;
+    quint64 LastRequestMicros;
     QString HomeDir;
     QString FileType;
     QStringList FileTypeList;
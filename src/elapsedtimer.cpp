@@ -58,12 +58,17 @@ void ElapsedTimer::secsToHMS(unsigned int secs, timeStruct_t *hms)
 	}
 }
 
-void ElapsedTimer::update(unsigned long long progress, unsigned long long total)
+void ElapsedTimer::update(unsigned long long progress, unsigned long long total, ThroughputEstimator::Phase phase)
 {
     timeStruct_t tTime, eTime;
 
-    unsigned int baseSecs = timer->elapsed() / MS_PER_SEC;
-    unsigned int totalSecs = (unsigned int)((float)baseSecs * ( (float)total/(float)progress ));
+    const qint64 elapsedMs = timer->elapsed();
+    estimator.AddSample(elapsedMs, progress, total, phase);
+
+    // The total is unknown for the first seconds of every phase; show the elapsed time only
+    const qint64 remainingMs = estimator.GetRemainingMs();
+    unsigned int baseSecs = elapsedMs / MS_PER_SEC;
+    unsigned int totalSecs = (remainingMs < 0) ? baseSecs : (unsigned int)((elapsedMs + remainingMs) / MS_PER_SEC);
 
     // convert seconds to hours:minues:seconds
     secsToHMS(baseSecs, &eTime);
@@ -86,12 +91,21 @@ void ElapsedTimer::update(unsigned long long progress, unsigned long long total)
         // but this was simple and effective.
 
     // display
-    setText(qs);
+    if (qs != text())
+    {
+        setText(qs);
+    }
+}
+
+double ElapsedTimer::rate() const
+{
+    return estimator.GetRate();
 }
 
-void ElapsedTimer::start()
+void ElapsedTimer::start(bool verifyFollows)
 {
     setVisible(true);
+    estimator.Reset(verifyFollows);
     timer->start();
 }
 
@@ -28,6 +28,7 @@
 #include <QLabel>
 #include <QElapsedTimer>
 #include <QString>
+#include "throughputestimator.h"
 
 class ElapsedTimer : public QLabel
 {
@@ -37,8 +38,12 @@ public:
     ElapsedTimer(QWidget *parent = 0);
     ~ElapsedTimer();
     int ms();
-    void update(unsigned long long progress, unsigned long long total);
-    void start();
+    // Feeds the estimator; call as often as progress arrives. The text only
+    // changes when the shown times do.
+    void update(unsigned long long progress, unsigned long long total, ThroughputEstimator::Phase phase);
+    // Progress units per second over the last few seconds
+    double rate() const;
+    void start(bool verifyFollows = false);
     void stop();
 
 private:
@@ -50,6 +55,7 @@ private:
     };
 
     QElapsedTimer *timer;
+    ThroughputEstimator estimator;
     void secsToHMS(unsigned int secs, timeStruct_t *ts);
     static const unsigned short MS_PER_SEC = 1000;
     static const unsigned short SECS_PER_MIN = 60;
@@ -0,0 +1,498 @@
+#include "filesystemscanner.h"
+#include <QtEndian>
+#include <algorithm>
+
+namespace {
+const qint64 BOOT_SECTOR_BYTES = 512;
+const qint64 EXT_SUPERBLOCK_OFFSET = 1024;
+const qint64 EXT_SUPERBLOCK_BYTES = 1024;
+const quint16 EXT_MAGIC = 0xEF53;
+// ext feature flags that change where things are
+const quint32 EXT_INCOMPAT_64BIT = 0x80;
+const quint32 EXT_RO_COMPAT_SPARSE_SUPER = 0x1;
+const quint32 EXT_RO_COMPAT_GDT_CSUM = 0x10;
+const quint32 EXT_RO_COMPAT_METADATA_CSUM = 0x400;
+const quint16 EXT_BG_BLOCK_UNINIT = 0x2;
+// Features the scan is known to be right for. Anything else, notably meta_bg
+// (descriptors spread over the disk), bigalloc (a bitmap bit per cluster),
+// an external journal or one still to be replayed, and features added after
+// this was written, makes the whole partition count as used.
+// incompat: filetype, extents, 64bit, mmp, flex_bg, ea_inode, dirdata,
+// csum_seed, largedir, inline_data, encrypt, casefold
+const quint32 EXT_INCOMPAT_SUPPORTED = 0x2 | 0x40 | 0x80 | 0x100 | 0x200 | 0x400 | 0x1000 | 0x2000 | 0x4000 |
+                                       0x8000 | 0x10000 | 0x20000;
+// ro_compat: sparse_super, large_file, btree_dir, huge_file, gdt_csum,
+// dir_nlink, extra_isize, quota, metadata_csum, readonly, project, verity,
+// orphan_present
+const quint32 EXT_RO_COMPAT_SUPPORTED = 0x1 | 0x2 | 0x4 | 0x8 | 0x10 | 0x20 | 0x40 | 0x100 | 0x400 | 0x1000 |
+                                        0x2000 | 0x8000 | 0x10000;
+// Bitmaps of consecutive groups are usually next to each other (flex_bg), so they are read in batches
+const quint64 EXT_BITMAP_BATCH_BLOCKS = 256;
+// FAT chains longer than this are taken to be corrupt
+const int EXFAT_MAX_CHAIN = 1 << 20;
+
+quint16 ReadU16(const QByteArray& data, const qint64 offset)
+{
+   return qFromLittleEndian<quint16>(data.constData() + offset);
+}
+
+quint32 ReadU32(const QByteArray& data, const qint64 offset)
+{
+   return qFromLittleEndian<quint32>(data.constData() + offset);
+}
+
+quint64 ReadU64(const QByteArray& data, const qint64 offset)
+{
+   return qFromLittleEndian<quint64>(data.constData() + offset);
+}
+
+bool IsPowerOfTwo(const quint64 value)
+{
+   return (value != 0) && ((value & (value - 1)) == 0);
+}
+
+// Whether an ext block group carries a copy of the superblock and group descriptors
+bool ExtGroupHasSuper(const quint64 group, const bool sparseSuper)
+{
+   if(!sparseSuper || (group <= 1))
+   {
+      return true;
+   }
+   for(const quint64 base : {3ull, 5ull, 7ull})
+   {
+      quint64 power = base;
+      while(power < group)
+      {
+         power *= base;
+      }
+      if(power == group)
+      {
+         return true;
+      }
+   }
+   return false;
+}
+}
+
+FilesystemScanner::FilesystemScanner()
+   : PartitionBytes(0)
+   , FilesystemType(Type::Unknown)
+   , UsedRanges()
+{}
+
+bool FilesystemScanner::Scan(const ByteReader& reader, const qint64 partitionBytes)
+{
+   PartitionBytes = partitionBytes;
+   FilesystemType = Type::Unknown;
+   UsedRanges.clear();
+
+   const QByteArray bootSector = reader(0, BOOT_SECTOR_BYTES);
+   if(bootSector.size() < BOOT_SECTOR_BYTES)
+   {
+      return false;
+   }
+
+   bool scanned = false;
+   if(bootSector.mid(3, 8) == "EXFAT   ")
+   {
+      scanned = ScanExFat(reader, bootSector);
+   }
+   else if(((unsigned char)bootSector.at(510) == 0x55) && ((unsigned char)bootSector.at(511) == 0xAA))
+   {
+      scanned = ScanFat(reader, bootSector);
+   }
+
+   if(!scanned)
+   {
+      const QByteArray superblock = reader(EXT_SUPERBLOCK_OFFSET, EXT_SUPERBLOCK_BYTES);
+      scanned = (superblock.size() == EXT_SUPERBLOCK_BYTES) && (ReadU16(superblock, 56) == EXT_MAGIC) &&
+                ScanExt(reader, superblock);
+   }
+
+   if(!scanned)
+   {
+      FilesystemType = Type::Unknown;
+      UsedRanges.clear();
+      return false;
+   }
+
+   MergeUsedRanges();
+   return true;
+}
+
+bool FilesystemScanner::ScanFat(const ByteReader& reader, const QByteArray& bootSector)
+{
+   const quint64 bytesPerSector = ReadU16(bootSector, 11);
+   const quint64 sectorsPerCluster = (unsigned char)bootSector.at(13);
+   const quint64 reservedSectors = ReadU16(bootSector, 14);
+   const quint64 numFats = (unsigned char)bootSector.at(16);
+   const quint64 rootEntries = ReadU16(bootSector, 17);
+   const quint64 totalSectors = ReadU16(bootSector, 19) ? ReadU16(bootSector, 19) : ReadU32(bootSector, 32);
+   const quint64 fatSectors = ReadU16(bootSector, 22) ? ReadU16(bootSector, 22) : ReadU32(bootSector, 36);
+   if((bytesPerSector < 512) || (bytesPerSector > 4096) || !IsPowerOfTwo(bytesPerSector) ||
+      !IsPowerOfTwo(sectorsPerCluster) || (reservedSectors == 0) || (numFats == 0) || (fatSectors == 0) ||
+      (totalSectors * bytesPerSector > (quint64)PartitionBytes))
+   {
+      return false;
+   }
+
+   const quint64 rootDirSectors = (rootEntries * 32 + bytesPerSector - 1) / bytesPerSector;
+   const quint64 dataStart = reservedSectors + numFats * fatSectors + rootDirSectors;
+   if(dataStart >= totalSectors)
+   {
+      return false;
+   }
+
+   // The FAT type follows from the cluster count alone, whatever the label says
+   const quint64 clusterCount = (totalSectors - dataStart) / sectorsPerCluster;
+   FilesystemType = (clusterCount < 4085) ? Type::Fat12 : ((clusterCount < 65525) ? Type::Fat16 : Type::Fat32);
+
+   const QByteArray fat = reader(reservedSectors * bytesPerSector, fatSectors * bytesPerSector);
+   const quint64 entryBits = (FilesystemType == Type::Fat12) ? 12 : ((FilesystemType == Type::Fat16) ? 16 : 32);
+   // FAT12 entries are read two bytes at a time, so the last one needs a byte of slack
+   const quint64 slackBits = (FilesystemType == Type::Fat12) ? 8 : 0;
+   if(fat.isEmpty() || ((clusterCount + 2) * entryBits + slackBits > (quint64)fat.size() * 8))
+   {
+      return false;
+   }
+
+   // Boot sector, FATs and the FAT12/16 root directory
+   AddUsed(0, dataStart * bytesPerSector);
+
+   auto fatEntry = [&](const quint64 cluster) -> quint32 {
+      if(FilesystemType == Type::Fat12)
+      {
+         const quint16 pair = ReadU16(fat, cluster * 3 / 2);
+         return (cluster & 1) ? (pair >> 4) : (pair & 0x0FFF);
+      }
+      if(FilesystemType == Type::Fat16)
+      {
+         return ReadU16(fat, cluster * 2);
+      }
+      return ReadU32(fat, cluster * 4) & 0x0FFFFFFF;
+   };
+
+   // A cluster is in use if its FAT entry is anything but free
+   const qint64 clusterBytes = sectorsPerCluster * bytesPerSector;
+   const qint64 heapOffset = dataStart * bytesPerSector;
+   qint64 runStart = -1;
+   for(quint64 cluster = 2; cluster <= clusterCount + 2; cluster++)
+   {
+      const bool used = (cluster < clusterCount + 2) && (fatEntry(cluster) != 0);
+      if(used && (runStart < 0))
+      {
+         runStart = cluster - 2;
+      }
+      else if(!used && (runStart >= 0))
+      {
+         AddUsed(heapOffset + runStart * clusterBytes, heapOffset + (cluster - 2) * clusterBytes);
+         runStart = -1;
+      }
+   }
+   return true;
+}
+
+bool FilesystemScanner::ScanExFat(const ByteReader& reader, const QByteArray& bootSector)
+{
+   const quint64 fatOffset = ReadU32(bootSector, 80);
+   const quint64 heapOffset = ReadU32(bootSector, 88);
+   const quint64 clusterCount = ReadU32(bootSector, 92);
+   const quint32 rootCluster = ReadU32(bootSector, 96);
+   const int sectorShift = (unsigned char)bootSector.at(108);
+   const int clusterShift = (unsigned char)bootSector.at(109);
+   if((sectorShift < 9) || (sectorShift > 12) || (clusterShift > 25 - sectorShift) || (clusterCount == 0))
+   {
+      return false;
+   }
+
+   const qint64 sectorBytes = 1ll << sectorShift;
+   const qint64 clusterBytes = sectorBytes << clusterShift;
+   if((qint64)(heapOffset * sectorBytes + clusterCount * clusterBytes) > PartitionBytes)
+   {
+      return false;
+   }
+
+   const QByteArray fat = reader(fatOffset * sectorBytes, (clusterCount + 2) * 4);
+   if(fat.isEmpty())
+   {
+      return false;
+   }
+
+   // Follows a FAT chain; exFAT files can also be contiguous without one, which the caller handles
+   auto chain = [&](quint32 cluster) {
+      QList<quint32> clusters;
+      while((cluster >= 2) && (cluster < clusterCount + 2) && (clusters.size() < EXFAT_MAX_CHAIN))
+      {
+         clusters.append(cluster);
+         cluster = ReadU32(fat, cluster * 4);
+      }
+      return clusters;
+   };
+   auto clusterOffset = [&](const quint32 cluster) {
+      return (qint64)(heapOffset * sectorBytes) + (qint64)(cluster - 2) * clusterBytes;
+   };
+
+   // The allocation bitmap is described by an entry of type 0x81 in the root directory
+   quint32 bitmapCluster = 0;
+   quint64 bitmapBytes = 0;
+   for(const quint32 cluster : chain(rootCluster))
+   {
+      const QByteArray directory = reader(clusterOffset(cluster), clusterBytes);
+      if(directory.isEmpty())
+      {
+         return false;
+      }
+      for(qint64 entry = 0; (entry < clusterBytes) && !bitmapCluster; entry += 32)
+      {
+         const unsigned char entryType = directory.at(entry);
+         if(entryType == 0x00)
+         {
+            break;
+         }
+         if(entryType == 0x81)
+         {
+            bitmapCluster = ReadU32(directory, entry + 20);
+            bitmapBytes = ReadU64(directory, entry + 24);
+         }
+      }
+      if(bitmapCluster)
+      {
+         break;
+      }
+   }
+   if(!bitmapCluster || (bitmapBytes * 8 < clusterCount))
+   {
+      return false;
+   }
+
+   // The bitmap is normally contiguous, but it may be chained like any other file
+   QByteArray bitmap;
+   QList<quint32> bitmapClusters = chain(bitmapCluster);
+   const quint64 neededClusters = (bitmapBytes + clusterBytes - 1) / clusterBytes;
+   if((quint64)bitmapClusters.size() < neededClusters)
+   {
+      bitmapClusters.clear();
+      for(quint64 i = 0; i < neededClusters; i++)
+      {
+         bitmapClusters.append(bitmapCluster + i);
+      }
+   }
+   for(int i = 0; (quint64)i < neededClusters; i++)
+   {
+      const QByteArray piece = reader(clusterOffset(bitmapClusters.at(i)), clusterBytes);
+      if(piece.isEmpty())
+      {
+         return false;
+      }
+      bitmap.append(piece);
+   }
+
+   FilesystemType = Type::ExFat;
+   // Boot regions, FAT and anything else in front of the cluster heap
+   AddUsed(0, heapOffset * sectorBytes);
+   AddUsedBits(bitmap, clusterCount, heapOffset * sectorBytes, clusterBytes);
+   return true;
+}
+
+bool FilesystemScanner::ScanExt(const ByteReader& reader, const QByteArray& superblock)
+{
+   const quint32 incompat = ReadU32(superblock, 96);
+   const quint32 roCompat = ReadU32(superblock, 100);
+   // Skipping data that is in use is worse than reading free space, so
+   // anything not understood is not scanned at all
+   if(((incompat & ~EXT_INCOMPAT_SUPPORTED) != 0) || ((roCompat & ~EXT_RO_COMPAT_SUPPORTED) != 0))
+   {
+      return false;
+   }
+
+   const bool is64Bit = (incompat & EXT_INCOMPAT_64BIT) != 0;
+   const bool sparseSuper = (roCompat & EXT_RO_COMPAT_SPARSE_SUPER) != 0;
+   // Group flags are only maintained along with descriptor checksums
+   const bool groupFlagsValid = (roCompat & (EXT_RO_COMPAT_GDT_CSUM | EXT_RO_COMPAT_METADATA_CSUM)) != 0;
+   const quint64 blocksCount = ReadU32(superblock, 4) | (is64Bit ? ((quint64)ReadU32(superblock, 0x150) << 32) : 0);
+   const quint64 firstDataBlock = ReadU32(superblock, 20);
+   const quint32 logBlockSize = ReadU32(superblock, 24);
+   const quint64 blocksPerGroup = ReadU32(superblock, 32);
+   const quint64 inodesPerGroup = ReadU32(superblock, 40);
+   const quint64 inodeSize = (ReadU32(superblock, 76) >= 1) ? ReadU16(superblock, 88) : 128;
+   const quint64 reservedGdtBlocks = ReadU16(superblock, 0xCE);
+   const quint64 descSize = (is64Bit && ReadU16(superblock, 0xFE)) ? ReadU16(superblock, 0xFE) : 32;
+   if((logBlockSize > 6) || (blocksPerGroup == 0) || (blocksCount <= firstDataBlock) || (inodeSize == 0))
+   {
+      return false;
+   }
+
+   const qint64 blockBytes = 1024ll << logBlockSize;
+   if((qint64)(blocksCount * blockBytes) > PartitionBytes)
+   {
+      return false;
+   }
+
+   const quint64 groupCount = (blocksCount - firstDataBlock + blocksPerGroup - 1) / blocksPerGroup;
+   const quint64 gdtBlocks = (groupCount * descSize + blockBytes - 1) / blockBytes;
+   const QByteArray descriptors = reader((firstDataBlock + 1) * blockBytes, gdtBlocks * blockBytes);
+   if(descriptors.isEmpty())
+   {
+      return false;
+   }
+
+   struct Group
+   {
+      quint64 BlockBitmap;
+      quint64 InodeBitmap;
+      quint64 InodeTable;
+      bool Uninitialised;
+   };
+   QList<Group> groups;
+   for(quint64 g = 0; g < groupCount; g++)
+   {
+      const QByteArray desc = descriptors.mid(g * descSize, descSize);
+      const bool wide = is64Bit && (descSize >= 64);
+      groups.append({ReadU32(desc, 0) | (wide ? ((quint64)ReadU32(desc, 0x20) << 32) : 0),
+                     ReadU32(desc, 4) | (wide ? ((quint64)ReadU32(desc, 0x24) << 32) : 0),
+                     ReadU32(desc, 8) | (wide ? ((quint64)ReadU32(desc, 0x28) << 32) : 0),
+                     groupFlagsValid && ((ReadU16(desc, 0x12) & EXT_BG_BLOCK_UNINIT) != 0)});
+      if((groups.last().BlockBitmap >= blocksCount) || (groups.last().InodeTable >= blocksCount))
+      {
+         return false;
+      }
+   }
+
+   FilesystemType = Type::Ext;
+   // Everything before the first group (boot block, and the superblock on 1 KiB block filesystems)
+   AddUsed(0, (firstDataBlock + 1) * blockBytes);
+
+   // Bitmaps and inode tables of every group; with flex_bg they may live in another group
+   const qint64 inodeTableBytes = inodesPerGroup * inodeSize;
+   for(const Group& group : groups)
+   {
+      AddUsed(group.BlockBitmap * blockBytes, (group.BlockBitmap + 1) * blockBytes);
+      AddUsed(group.InodeBitmap * blockBytes, (group.InodeBitmap + 1) * blockBytes);
+      AddUsed(group.InodeTable * blockBytes, group.InodeTable * blockBytes + inodeTableBytes);
+   }
+
+   quint64 g = 0;
+   while(g < groupCount)
+   {
+      const quint64 groupStart = firstDataBlock + g * blocksPerGroup;
+      if(groups.at(g).Uninitialised)
+      {
+         // No bitmap on disk: only the superblock and descriptor copies are in use
+         if(ExtGroupHasSuper(g, sparseSuper))
+         {
+            AddUsed(groupStart * blockBytes, (groupStart + 1 + gdtBlocks + reservedGdtBlocks) * blockBytes);
+         }
+         g++;
+         continue;
+      }
+
+      // Read the bitmaps of following initialised groups in one go if they are adjacent
+      quint64 batch = 1;
+      while((g + batch < groupCount) && (batch < EXT_BITMAP_BATCH_BLOCKS) && !groups.at(g + batch).Uninitialised &&
+            (groups.at(g + batch).BlockBitmap == groups.at(g).BlockBitmap + batch))
+      {
+         batch++;
+      }
+
+      const QByteArray bitmaps = reader(groups.at(g).BlockBitmap * blockBytes, batch * blockBytes);
+      if(bitmaps.isEmpty())
+      {
+         FilesystemType = Type::Unknown;
+         return false;
+      }
+      for(quint64 i = 0; i < batch; i++)
+      {
+         const quint64 start = firstDataBlock + (g + i) * blocksPerGroup;
+         const quint64 bits = qMin(blocksPerGroup, blocksCount - start);
+         AddUsedBits(bitmaps.mid(i * blockBytes, blockBytes), bits, start * blockBytes, blockBytes);
+      }
+      g += batch;
+   }
+   return true;
+}
+
+void FilesystemScanner::AddUsed(const qint64 start, const qint64 end)
+{
+   const qint64 clippedEnd = qMin(end, PartitionBytes);
+   if(start < clippedEnd)
+   {
+      UsedRanges.append(qMakePair(start, clippedEnd));
+   }
+}
+
+void FilesystemScanner::AddUsedBits(const QByteArray& bitmap, const qint64 numBits, const qint64 firstUnitOffset,
+                                    const qint64 unitBytes)
+{
+   const qint64 bits = qMin(numBits, (qint64)bitmap.size() * 8);
+   qint64 runStart = -1;
+   for(qint64 i = 0; i <= bits; i++)
+   {
+      const bool used = (i < bits) && ((bitmap.at(i / 8) >> (i % 8)) & 1);
+      if(used && (runStart < 0))
+      {
+         runStart = i;
+      }
+      else if(!used && (runStart >= 0))
+      {
+         AddUsed(firstUnitOffset + runStart * unitBytes, firstUnitOffset + i * unitBytes);
+         runStart = -1;
+      }
+   }
+}
+
+void FilesystemScanner::MergeUsedRanges()
+{
+   std::sort(UsedRanges.begin(), UsedRanges.end());
+   QList<QPair<qint64, qint64>> merged;
+   for(const QPair<qint64, qint64>& range : UsedRanges)
+   {
+      if(!merged.isEmpty() && (range.first <= merged.last().second))
+      {
+         merged.last().second = qMax(merged.last().second, range.second);
+      }
+      else
+      {
+         merged.append(range);
+      }
+   }
+   UsedRanges = merged;
+}
+
+FilesystemScanner::Type FilesystemScanner::GetType() const
+{
+   return FilesystemType;
+}
+
+QString FilesystemScanner::TypeName(const Type type)
+{
+   switch(type)
+   {
+      case Type::Fat12:
+         return "fat12";
+      case Type::Fat16:
+         return "fat16";
+      case Type::Fat32:
+         return "fat32";
+      case Type::ExFat:
+         return "exfat";
+      case Type::Ext:
+         return "ext";
+      default:
+         return "unknown";
+   }
+}
+
+const QList<QPair<qint64, qint64>>& FilesystemScanner::GetUsedRanges() const
+{
+   return UsedRanges;
+}
+
+qint64 FilesystemScanner::GetUsedBytes() const
+{
+   qint64 used = 0;
+   for(const QPair<qint64, qint64>& range : UsedRanges)
+   {
+      used += range.second - range.first;
+   }
+   return used;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <functional>
+
+// Works out which parts of a partition its filesystem actually uses, from the
+// FAT of FAT12/16/32, the allocation bitmap of exFAT or the block bitmaps of
+// ext2/3/4. Everything else in the partition is free space that does not need
+// to be imaged. Filesystem metadata always counts as used.
+class FilesystemScanner
+{
+public:
+   enum class Type : int
+   {
+      Unknown = 0,
+      Fat12,
+      Fat16,
+      Fat32,
+      ExFat,
+      Ext
+   };
+
+   // Returns numBytes at offset (relative to the start of the partition), or an empty array on failure
+   using ByteReader = std::function<QByteArray(const qint64 offset, const qint64 numBytes)>;
+
+   FilesystemScanner();
+
+   // Fails if the filesystem is not one of the above or its metadata does not
+   // make sense, in which case the whole partition has to be treated as used
+   bool Scan(const ByteReader& reader, const qint64 partitionBytes);
+
+   Type GetType() const;
+   static QString TypeName(const Type type);
+
+   // Used byte ranges of the partition as sorted, non-overlapping [start, end) pairs
+   const QList<QPair<qint64, qint64>>& GetUsedRanges() const;
+   qint64 GetUsedBytes() const;
+
+private:
+   bool ScanFat(const ByteReader& reader, const QByteArray& bootSector);
+   bool ScanExFat(const ByteReader& reader, const QByteArray& bootSector);
+   bool ScanExt(const ByteReader& reader, const QByteArray& superblock);
+   void AddUsed(const qint64 start, const qint64 end);
+   // Adds a run of used units for every run of set bits; unit i starts at firstUnitOffset + i * unitBytes
+   void AddUsedBits(const QByteArray& bitmap, const qint64 numBits, const qint64 firstUnitOffset,
+                    const qint64 unitBytes);
+   void MergeUsedRanges();
+
+   qint64 PartitionBytes;
+   Type FilesystemType;
+   QList<QPair<qint64, qint64>> UsedRanges;
+};
@@ -24,12 +24,20 @@ public slots:
                                     const int sectorSize,
                                     const bool dataFound) override;
     void HandleWarnUnspecifiedIOError() override;
+    void HandleWarnVerifyMismatch(const long long sector) override;
+    void HandleWarnBaseImageMismatch() override;
     void HandleInfoGeneratedHash(const QString hashString) override;
+    void HandleInfoWriteSuccessful() override;
+    void HandleInfoVerifySuccessful() override;
     void HandleRequestReadOverwriteConfirmation() override;
+    void HandleRequestWriteOverwriteConfirmation() override;
     void HandleSetProgressBarRange(const int min, const int max) override;
     void HandleProgressBarStatus(const double mbpersec, const int completion) override;
+    void HandleThroughputSample(const double mbPerSecond, const double latencyMs) override;
     void HandleOperationComplete(const bool cancelled) override;
     void HandleStartTimers() override;
+    void HandleDiskErrors() override;
+    void HandleLogicalDrivesDetected(const QList<QString> drives) override;
     void HandleSettingsLoaded(const QString imageDir, const QString fileType);
 
 };
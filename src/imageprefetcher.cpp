@@ -0,0 +1,187 @@
+#include "imageprefetcher.h"
+#include "jobscheduler.h"
+#include "tracer.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <cstring>
+
+namespace {
+const qint64 PREFETCH_BLOCK_BYTES = 1024 * 1024;
+// Budget freed by other jobs is not signalled here, so check again this often
+const int BUDGET_RETRY_MS = 50;
+}
+
+ImagePrefetcher::ImagePrefetcher(const QString& filePath, const qint64 capacityBytes, JobScheduler* budget)
+   : FilePath(filePath)
+   , CapacityBytes((capacityBytes < PREFETCH_BLOCK_BYTES) ? PREFETCH_BLOCK_BYTES : capacityBytes)
+   , Budget(budget)
+   , Lock()
+   , SpaceAvailable()
+   , DataAvailable()
+   , Blocks()
+   , BufferedBytes(0)
+   , FrontOffset(0)
+   , EndOfImage(false)
+   , ReadFailed(false)
+   , Started(false)
+   , Stopping(false)
+   , Worker(nullptr)
+{}
+
+ImagePrefetcher::~ImagePrefetcher()
+{
+   Stop();
+}
+
+void ImagePrefetcher::Start()
+{
+   if(Started.exchange(true))
+   {
+      return;
+   }
+
+   Worker = QThread::create([this]() { Fill(); });
+   Worker->setObjectName("Prefetch");
+   Worker->start();
+}
+
+void ImagePrefetcher::Stop()
+{
+   Stopping = true;
+   {
+      QMutexLocker locker(&Lock);
+      SpaceAvailable.wakeAll();
+      DataAvailable.wakeAll();
+   }
+
+   if(Worker != nullptr)
+   {
+      Worker->wait();
+      delete Worker;
+      Worker = nullptr;
+   }
+
+   QMutexLocker locker(&Lock);
+   for(const QByteArray& block : std::as_const(Blocks))
+   {
+      ReleaseBlock(block.size());
+   }
+   Blocks.clear();
+   BufferedBytes = 0;
+   FrontOffset = 0;
+}
+
+qint64 ImagePrefetcher::Read(char* data, const qint64 numBytes)
+{
+   Start();
+
+   qint64 copied = 0;
+   QMutexLocker locker(&Lock);
+   while(copied < numBytes)
+   {
+      while(Blocks.isEmpty() && !EndOfImage && !ReadFailed && !Stopping)
+      {
+         DataAvailable.wait(&Lock);
+      }
+
+      if(ReadFailed)
+      {
+         return -1;
+      }
+      if(Blocks.isEmpty())
+      {
+         break;
+      }
+
+      const QByteArray& front = Blocks.head();
+      const qint64 available = front.size() - FrontOffset;
+      const qint64 toCopy = qMin(available, numBytes - copied);
+      memcpy(data + copied, front.constData() + FrontOffset, toCopy);
+      copied += toCopy;
+      FrontOffset += toCopy;
+      if(FrontOffset == front.size())
+      {
+         BufferedBytes -= front.size();
+         ReleaseBlock(front.size());
+         Blocks.dequeue();
+         FrontOffset = 0;
+         SpaceAvailable.wakeAll();
+      }
+   }
+
+   return copied;
+}
+
+const QString& ImagePrefetcher::GetFilePath() const
+{
+   return FilePath;
+}
+
+void ImagePrefetcher::ReleaseBlock(const qint64 bytes)
+{
+   if(Budget != nullptr)
+   {
+      Budget->ReleasePrefetch(bytes);
+   }
+}
+
+qint64 ImagePrefetcher::GetBufferedBytes() const
+{
+   QMutexLocker locker(&Lock);
+   return BufferedBytes;
+}
+
+void ImagePrefetcher::Fill()
+{
+   QFile file(FilePath);
+   if(!file.open(QIODevice::ReadOnly))
+   {
+      QMutexLocker locker(&Lock);
+      ReadFailed = true;
+      DataAvailable.wakeAll();
+      return;
+   }
+
+   while(!Stopping)
+   {
+      QByteArray block;
+      {
+         TraceScope trace("prefetch", "io", 0, file.pos(), PREFETCH_BLOCK_BYTES);
+         block = file.read(PREFETCH_BLOCK_BYTES);
+      }
+
+      QMutexLocker locker(&Lock);
+      if(block.isEmpty())
+      {
+         ReadFailed = (file.error() != QFileDevice::NoError);
+         EndOfImage = true;
+         DataAvailable.wakeAll();
+         return;
+      }
+
+      bool reserved = false;
+      while(!reserved && !Stopping)
+      {
+         if(BufferedBytes + block.size() > CapacityBytes)
+         {
+            SpaceAvailable.wait(&Lock);
+         }
+         else if((Budget != nullptr) && !Budget->TryAcquirePrefetch(block.size()))
+         {
+            SpaceAvailable.wait(&Lock, BUDGET_RETRY_MS);
+         }
+         else
+         {
+            reserved = true;
+         }
+      }
+      if(!reserved)
+      {
+         return;
+      }
+
+      BufferedBytes += block.size();
+      Blocks.enqueue(block);
+      DataAvailable.wakeAll();
+   }
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QQueue>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThread>
+#include <atomic>
+
+class JobScheduler;
+
+// Streams an image file into a bounded in-memory queue on its own thread, so
+// the next job's image is already loaded by the time its write starts. The
+// consumer reads the same byte stream back in whatever chunk size it needs.
+// With a scheduler, every queued block also counts against its memory budget.
+class ImagePrefetcher
+{
+public:
+   ImagePrefetcher(const QString& filePath, const qint64 capacityBytes, JobScheduler* budget = nullptr);
+   ~ImagePrefetcher();
+
+   // Safe to call more than once; only the first call starts the thread.
+   void Start();
+   void Stop();
+
+   // Blocks until numBytes are available or the end of the image is reached.
+   // Returns the number of bytes copied, or -1 if the image could not be read.
+   qint64 Read(char* data, const qint64 numBytes);
+
+   const QString& GetFilePath() const;
+   qint64 GetBufferedBytes() const;
+
+private:
+   void Fill();
+   void ReleaseBlock(const qint64 bytes);
+
+   const QString FilePath;
+   const qint64 CapacityBytes;
+   JobScheduler* const Budget;
+
+   mutable QMutex Lock;
+   QWaitCondition SpaceAvailable;
+   QWaitCondition DataAvailable;
+   QQueue<QByteArray> Blocks;
+   qint64 BufferedBytes;
+   qint64 FrontOffset;
+   bool EndOfImage;
+   bool ReadFailed;
+
+   std::atomic<bool> Started;
+   std::atomic<bool> Stopping;
+   QThread* Worker;
+};
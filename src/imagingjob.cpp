@@ -0,0 +1,2289 @@
+#include "imagingjob.h"
+#include "jobscheduler.h"
+#include "disk.h"
+#include "tracer.h"
+#include "probes.h"
+#include <QtConcurrent>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QThread>
+#include <QQueue>
+#include <QScopeGuard>
+#include <QRandomGenerator>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+const unsigned long long SECTORS_PER_CHUNK = 1024ull;
+const unsigned long long FILE_SECTOR_SIZE = 512ull;
+// How many checkpointed chunks are re-read from the destination before resuming
+const int RESUME_VERIFY_CHUNKS = 2;
+// Rescue: a read slower than this counts as a problem area, like a failed one
+const qint64 RESCUE_SLOW_READ_MS = 2000;
+// Rescue: how far the first pass jumps past a problem area; doubles while problems continue
+const qint64 RESCUE_MIN_SKIP_BYTES = 64ll * 1024;
+const qint64 RESCUE_MAX_SKIP_BYTES = 64ll * 1024 * 1024;
+const qint64 RESCUE_MAP_SAVE_INTERVAL_MS = 5000;
+// Written in place of every sector that could not be read
+const char RESCUE_BAD_SECTOR_MARKER[] = "BAD SECTOR      ";
+// Retry backoff sleeps in slices so a cancel is not held up by a long backoff
+const qint64 RETRY_SLEEP_SLICE_MS = 50;
+const int MAX_RECORDED_RETRY_OFFSETS = 100;
+const int MAX_RECORDED_STALL_OFFSETS = 100;
+// Differential write: how many device chunks are read ahead of the one being compared
+const int DIFF_READ_AHEAD_CHUNKS = 4;
+// Delta write: chunks of the device hashed against the base manifest; the first plus random ones
+const int SPOT_CHECK_CHUNKS = 8;
+
+// Opens, locks and dismounts the volume for driveLetter, then opens the
+// physical device behind it. On failure the caller still owns (and must
+// close) whatever handles were opened.
+JobError OpenDevice(const char driveLetter, const DWORD access,
+                    HANDLE* volumeHandle, HANDLE* diskHandle, bool* volumeLocked)
+{
+   const int volumeID = QChar(driveLetter).toUpper().toLatin1() - 'A';
+   *volumeHandle = getHandleOnVolume(volumeID, access);
+   if(*volumeHandle == INVALID_HANDLE_VALUE)
+   {
+      return JobError::UnspecifiedIOError;
+   }
+
+   const DWORD deviceID = getDeviceID(*volumeHandle);
+   if(!getLockOnVolume(*volumeHandle))
+   {
+      return JobError::NoLockOnVolume;
+   }
+   *volumeLocked = true;
+
+   if(!unmountVolume(*volumeHandle))
+   {
+      return JobError::FailedToUnmountVolume;
+   }
+
+   *diskHandle = getHandleOnDevice(deviceID, access);
+   if(*diskHandle == INVALID_HANDLE_VALUE)
+   {
+      return JobError::UnspecifiedIOError;
+   }
+
+   return JobError::None;
+}
+}
+
+ImagingJob::ImagingJob(const int jobId, const JobOptions& options, JobScheduler* scheduler)
+   : QObject(scheduler)
+   , JobId(jobId)
+   , Options(options)
+   , Scheduler(scheduler)
+   , OperationStatus(Status::Idle)
+   , Cancelled(false)
+   , LastError(JobError::None)
+   , ProgressSectors(0ull)
+   , ProgressTotal(0ull)
+   , ProgressSectorSize(0ull)
+   , VolumeHandle(INVALID_HANDLE_VALUE)
+   , FileHandle(INVALID_HANDLE_VALUE)
+   , RawDiskHandle(INVALID_HANDLE_VALUE)
+   , VolumeLocked(false)
+   , SectorSize(0ull)
+   , CloneEndpoints()
+   , HandleMetrics()
+   , Journal()
+   , UsePrefetcher(false)
+   , PrefetchImageBytes(0)
+   , ReplacedSectors()
+   , DataEndSector(0ull)
+   , PendingZeroBytes(0)
+   , Restore()
+   , CompareHandle(INVALID_HANDLE_VALUE)
+   , ChunksSkipped(0ull)
+   , ChunksWritten(0ull)
+   , RescueSaveTimer()
+   , RetryLock()
+   , RetryCount(0)
+   , FallbackCount(0)
+   , RetryOffsets()
+   , LastDiskError()
+   , InFlightLock()
+   , InFlightRequests()
+   , StalledRequests(0)
+   , StallCount(0)
+   , StallOffsets()
+   , HashAlgorithm(Options.HashAlgorithm)
+   , Hash()
+   , PendingHash()
+   , Stats(new JobStats())
+{
+   // Verifying a clone compares hashes, so it needs one even if none was asked for
+   if((Options.Type == JobType::Clone) && Options.VerifyClone && (HashAlgorithm < 0))
+   {
+      HashAlgorithm = QCryptographicHash::Sha256;
+   }
+
+   if(HashAlgorithm >= 0)
+   {
+      Hash.reset(new QCryptographicHash((QCryptographicHash::Algorithm)HashAlgorithm));
+   }
+}
+
+ImagingJob::~ImagingJob()
+{
+   FinishHashing();
+   CloseHandles();
+}
+
+int ImagingJob::GetId() const
+{
+   return JobId;
+}
+
+const JobOptions& ImagingJob::GetOptions() const
+{
+   return Options;
+}
+
+QStringList ImagingJob::GetDeviceKeys() const
+{
+   QStringList keys;
+   if(Options.DriveLetter != ' ')
+   {
+      keys.append(QString(QChar(Options.DriveLetter).toUpper()));
+   }
+
+   for(const QString& target : Options.CloneTargets)
+   {
+      keys.append(IsDriveName(target) ? QString(target.at(0).toUpper()) : target);
+   }
+   return keys;
+}
+
+Status ImagingJob::GetStatus() const
+{
+   return OperationStatus;
+}
+
+JobError ImagingJob::GetLastError() const
+{
+   return LastError;
+}
+
+void ImagingJob::Cancel()
+{
+   Cancelled = true;
+}
+
+bool ImagingJob::IsCancelled() const
+{
+   return Cancelled;
+}
+
+void ImagingJob::GetProgress(unsigned long long* sectorsDone, unsigned long long* totalSectors,
+                             unsigned long long* sectorSize) const
+{
+   *sectorsDone = ProgressSectors.load(std::memory_order_relaxed);
+   *totalSectors = ProgressTotal.load(std::memory_order_relaxed);
+   *sectorSize = ProgressSectorSize.load(std::memory_order_relaxed);
+}
+
+bool ImagingJob::IsDriveName(const QString& name)
+{
+   // "E", "E:" or "E:\"
+   return (name.size() >= 1) && (name.size() <= 3) && name.at(0).isLetter() &&
+          ((name.size() == 1) || (name.at(1) == ':'));
+}
+
+void ImagingJob::Run()
+{
+   bool succeeded = false;
+   // Pool threads are shared between jobs; don't blame this one for an earlier job's error
+   clearLastDiskError();
+   Stats->Start();
+   const QByteArray probeDevice = (Options.DriveLetter != ' ') ?
+                                     QString("%1:").arg(Options.DriveLetter).toUtf8() :
+                                     Options.ImageFilePath.toUtf8();
+   PROBE_JOB_START(JobId, (int)Options.Type, probeDevice.constData());
+
+   if(!IsCancelled())
+   {
+      switch(Options.Type)
+      {
+      case JobType::Read:
+         succeeded = DoRead();
+         break;
+      case JobType::Write:
+         succeeded = DoWrite();
+         break;
+      case JobType::Verify:
+         succeeded = DoVerify();
+         break;
+      case JobType::Clone:
+         succeeded = DoClone();
+         break;
+      case JobType::Rescue:
+         succeeded = DoRescue();
+         break;
+      }
+   }
+
+   FinishHashing();
+   CloseHandles();
+   if(Options.Prefetcher)
+   {
+      Options.Prefetcher->Stop();
+   }
+
+   if((Options.Type == JobType::Read) && !Options.IncrementalBase.isEmpty())
+   {
+      const QString manifestPath = ChunkManifest::PathForImage(Options.ImageFilePath);
+      if(succeeded && !IsCancelled())
+      {
+         QFile::remove(manifestPath);
+         if(!QFile::rename(GetPendingManifestPath(), manifestPath))
+         {
+            succeeded = Fail(JobError::UnspecifiedIOError);
+         }
+      }
+      QFile::remove(GetPendingManifestPath());
+   }
+
+   if(succeeded && !IsCancelled() && Hash)
+   {
+      emit GeneratedHash(JobId, QString(Hash->result().toHex()));
+   }
+   // The bottleneck verdict in the metrics needs the final wall time
+   Stats->Finish();
+   ReportMetrics();
+
+   const bool cancelled = IsCancelled();
+   PROBE_JOB_DONE(JobId, (int)(succeeded && !cancelled), Stats->GetWallNanos());
+   Metrics::Instance()->RecordJob(Options.Type, succeeded && !cancelled, cancelled, Stats->GetWallNanos() / 1e9);
+   SetStatus(cancelled ? Status::Canceled : Status::Idle);
+   emit Finished(JobId, succeeded && !cancelled, cancelled);
+}
+
+bool ImagingJob::DoRead()
+{
+   SetStatus(Status::Reading);
+
+   // Loaded before the image file or the manifest next to it is touched
+   ChunkManifest base;
+   QString baseImagePath;
+   if(!Options.IncrementalBase.isEmpty() && !LoadIncrementalBase(&base, &baseImagePath))
+   {
+      return false;
+   }
+
+   // A resumed read checks what it wrote before through the same file handle
+   if(!OpenHandles(GENERIC_READ, Options.Resumable ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_WRITE))
+   {
+      return false;
+   }
+
+   unsigned long long numSectors = getNumberOfSectors(RawDiskHandle, &SectorSize);
+   // Trimming stops at the end of the partitions too, nothing after them is worth reading
+   if((Options.ReadOnlyPartitions || Options.TrimTrailingZeros) && !LimitToPartitions(&numSectors))
+   {
+      return false;
+   }
+
+   // Whatever manifest or block map described the old contents of the image file no longer applies
+   QFile::remove(ChunkManifest::PathForImage(Options.ImageFilePath));
+   QFile::remove(BmapFile::PathForImage(Options.ImageFilePath));
+
+   // Also the worst case of an incremental backup: changed chunks are packed
+   // together, so even if every one changed they take no more than the device
+   const unsigned long long fileSize = getFileSizeInSectors(FileHandle, SectorSize);
+   const unsigned long long spaceNeeded = (fileSize >= numSectors) ?
+                                             0ull :
+                                             (numSectors - fileSize) * SectorSize;
+
+   if(!spaceAvailable(Options.ImageFilePath.left(3).replace(QChar('/'), QChar('\\')).toLatin1().data(), spaceNeeded))
+   {
+      return Fail(JobError::NotEnoughSpaceOnDisk);
+   }
+
+   if(!Options.IncrementalBase.isEmpty())
+   {
+      return ReadIncremental(numSectors, base, baseImagePath);
+   }
+
+   if(Options.SkipFreeBlocks)
+   {
+      return ReadUsedBlocks(numSectors);
+   }
+
+   if(!CopySectors(RawDiskHandle, FileHandle, numSectors))
+   {
+      return false;
+   }
+   return !Options.TrimTrailingZeros || SetImageSize(numSectors);
+}
+
+bool ImagingJob::LimitToPartitions(unsigned long long* numSectors)
+{
+   PartitionTable table;
+   if(!ReadPartitionTable(RawDiskHandle, *numSectors, &table))
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   // Without a partition table there is nothing to go by, so the whole device is read
+   const unsigned long long allocatedEnd = table.GetAllocatedEnd();
+   const unsigned long long backupSectors = table.GetBackupGptSectors();
+   QByteArray primaryGptHeader;
+   QByteArray backupGpt;
+   if(!table.HasGpt() && (table.GetScheme() != PartitionTable::Scheme::None))
+   {
+      *numSectors = qMin(*numSectors, allocatedEnd);
+   }
+   else if(table.HasGpt() && (allocatedEnd + backupSectors < *numSectors) &&
+           table.RelocateBackupGpt(allocatedEnd + backupSectors, &primaryGptHeader, &backupGpt))
+   {
+      // The backup GPT has to stay the last thing on the disk, so the image
+      // gets one of its own right after the partitions
+      *numSectors = allocatedEnd + backupSectors;
+      ReplacedSectors.insert(1ull, primaryGptHeader);
+      ReplacedSectors.insert(allocatedEnd, backupGpt);
+   }
+   return true;
+}
+
+unsigned long long ImagingJob::GetImageEndSector(const unsigned long long numSectors) const
+{
+   // At least the first sector is kept, so an all-zero device still gives an image
+   return Options.TrimTrailingZeros ? qMin(qMax(DataEndSector, 1ull), numSectors) : numSectors;
+}
+
+bool ImagingJob::SetImageSize(const unsigned long long numSectors)
+{
+   const unsigned long long endSector = GetImageEndSector(numSectors);
+   if(!setFileSizeInSectors(FileHandle, endSector, SectorSize))
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+   if(Options.TrimTrailingZeros)
+   {
+      emit SummaryReported(JobId, "bytesTrimmed", (numSectors - endSector) * SectorSize);
+   }
+   return true;
+}
+
+bool ImagingJob::DoWrite()
+{
+   SetStatus(Status::Writing);
+
+   if(!OpenHandles(GENERIC_WRITE, GENERIC_READ))
+   {
+      return false;
+   }
+
+   const unsigned long long availableSectors = getNumberOfSectors(RawDiskHandle, &SectorSize);
+   if(!availableSectors)
+   {
+      //For external card readers you may not get device change notification when you remove the card/flash.
+      //(So no WM_DEVICECHANGE signal). Device stays but size goes to 0. [Is there special event for this on Windows??]
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   if(!OpenRestoreStream())
+   {
+      return false;
+   }
+
+   unsigned long long numSectors = GetImageSizeInSectors();
+   if(!numSectors)
+   {
+      return Fail(JobError::ImageFileContainsNoData);
+   }
+
+   if(numSectors > availableSectors)
+   {
+      if(!Options.TruncateToDevice)
+      {
+         bool dataFound = false;
+         unsigned long long i = availableSectors;
+         while((i < numSectors) && !dataFound)
+         {
+            const unsigned long long nextChunkSize = ((numSectors - i) >= SECTORS_PER_CHUNK) ?
+                                                        SECTORS_PER_CHUNK :
+                                                        (numSectors - i);
+            char* data = ReadChunk(FileHandle, i, nextChunkSize);
+            if(data == nullptr)
+            {
+               // if there's an error verifying the truncated data, just move on,
+               //  as we don't care about an error in a section that we're not writing...
+               break;
+            }
+
+            const unsigned long long limit = nextChunkSize * SectorSize;
+            for(unsigned long long j = 0ull; (j < limit) && !dataFound; j++)
+            {
+               dataFound = (data[j] != 0);
+            }
+            delete[] data;
+            i += nextChunkSize;
+         }
+
+         emit NotEnoughSpaceOnVolume(JobId, numSectors, availableSectors, SectorSize, dataFound);
+         return Fail(JobError::NotEnoughSpaceOnVolume);
+      }
+
+      // truncate the image at the device size...
+      numSectors = availableSectors;
+   }
+
+   if(!Options.BaseImagePath.isEmpty())
+   {
+      return WriteDelta(numSectors);
+   }
+
+   if(Options.WritePartitionsOnly)
+   {
+      return WritePartitionExtents(numSectors);
+   }
+
+   if(Options.DifferentialWrite)
+   {
+      // Reads through their own handle do not disturb the file pointer of the writes
+      CompareHandle = getHandleOnDevice(getDeviceID(VolumeHandle), GENERIC_READ);
+      if(CompareHandle == INVALID_HANDLE_VALUE)
+      {
+         return Fail(JobError::UnspecifiedIOError);
+      }
+      RegisterMetrics(CompareHandle, QString("%1:").arg(Options.DriveLetter));
+   }
+
+   const bool copied = CopySectors(FileHandle, RawDiskHandle, numSectors);
+   if(Options.DifferentialWrite)
+   {
+      emit SummaryReported(JobId, "chunksSkipped", ChunksSkipped);
+      emit SummaryReported(JobId, "chunksWritten", ChunksWritten);
+   }
+   return copied;
+}
+
+QString ImagingJob::GetPendingManifestPath() const
+{
+   return ChunkManifest::PathForImage(Options.ImageFilePath) + ".new";
+}
+
+bool ImagingJob::LoadIncrementalBase(ChunkManifest* base, QString* baseImagePath)
+{
+   if(!base->LoadOrBuildForImage(Options.IncrementalBase, ChunkManifest::GetDefaultChunkBytes(),
+                                 Scheduler->GetCpuPool(), &Cancelled))
+   {
+      return IsCancelled() ? false : Fail(JobError::UnspecifiedIOError);
+   }
+
+   // The chain refers to backup images; a manifest path names the image next to it
+   *baseImagePath = Options.IncrementalBase;
+   if(baseImagePath->endsWith(".manifest", Qt::CaseInsensitive))
+   {
+      baseImagePath->chop(QString(".manifest").size());
+   }
+
+   // The unchanged chunks are taken from the base, so it cannot be overwritten by its own
+   // increment, even when only its manifest is at hand
+   const QString baseFile = QFileInfo(*baseImagePath).absoluteFilePath();
+   if(baseFile.compare(QFileInfo(Options.ImageFilePath).absoluteFilePath(), Qt::CaseInsensitive) == 0)
+   {
+      emit SummaryReported(JobId, "incrementalBaseIsImage", Options.ImageFilePath);
+      return Fail(JobError::UnspecifiedIOError);
+   }
+   return true;
+}
+
+bool ImagingJob::ReadIncremental(const unsigned long long numSectors, const ChunkManifest& base,
+                                 const QString& baseImagePath)
+{
+   if(base.GetChunkBytes() % SectorSize != 0ull)
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   ChunkManifest manifest;
+   manifest.StartIncremental(baseImagePath, base.GetChunkBytes(), numSectors * SectorSize);
+
+   // Changed chunks are packed one after another into the image file
+   const unsigned long long chunkSectors = base.GetChunkBytes() / SectorSize;
+   int storedChunks = 0;
+   unsigned long long storedEndSector = 0ull;
+   emit Started(JobId, numSectors);
+   for(unsigned long long i = 0ull; i < numSectors; i += chunkSectors)
+   {
+      if(IsCancelled())
+      {
+         return false;
+      }
+
+      const int chunk = i / chunkSectors;
+      const unsigned long long sectors = qMin(chunkSectors, numSectors - i);
+      const qint64 bytes = sectors * SectorSize;
+
+      AcquireBuffer(bytes);
+      char* data = ReadChunk(RawDiskHandle, i, sectors);
+      if(data == nullptr)
+      {
+         Scheduler->ReleaseBuffer(bytes);
+         return Fail(JobError::UnspecifiedIOError);
+      }
+
+      const QByteArray chunkHash = ChunkManifest::HashChunk(data, bytes);
+      const bool unchanged = (chunk < base.GetChunkCount()) && (base.GetChunkSize(chunk) == bytes) &&
+                             (base.GetChunkHash(chunk) == chunkHash);
+      int slot = -1;
+      if(!unchanged)
+      {
+         slot = storedChunks++;
+         if(!WriteWithRetry(FileHandle, data, slot * chunkSectors, sectors))
+         {
+            delete[] data;
+            Scheduler->ReleaseBuffer(bytes);
+            return Fail(JobError::UnspecifiedIOError);
+         }
+         storedEndSector = slot * chunkSectors + sectors;
+      }
+      manifest.AddChunk(chunkHash, slot);
+
+      // HashChunk takes ownership of the buffer and its share of the memory budget
+      HashChunk(data, bytes);
+      ReportProgress(i + sectors, numSectors);
+   }
+
+   // An older, larger image at the same path must not leave its tail behind
+   if(!setFileSizeInSectors(FileHandle, storedEndSector, SectorSize))
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   // The manifest is what turns the packed chunks into a backup, so it goes
+   // last, and only takes its real name once the job has succeeded (Run)
+   FlushHandle(FileHandle);
+   if(!manifest.Save(GetPendingManifestPath()))
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   emit SummaryReported(JobId, "chunksStored", storedChunks);
+   emit SummaryReported(JobId, "chunksTotal", manifest.GetChunkCount());
+   emit SummaryReported(JobId, "bytesStored", storedChunks * base.GetChunkBytes());
+   return true;
+}
+
+bool ImagingJob::ReadUsedBlocks(const unsigned long long numSectors)
+{
+   PartitionTable table;
+   if(!ReadPartitionTable(RawDiskHandle, numSectors, &table))
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   // Free space of every partition whose filesystem could be scanned, in whole sectors
+   QList<QPair<unsigned long long, unsigned long long>> freeExtents;
+   QStringList filesystems;
+   for(const PartitionTable::Partition& partition : table.GetPartitions())
+   {
+      if(partition.FirstSector >= numSectors)
+      {
+         continue;
+      }
+
+      const qint64 partitionStart = partition.FirstSector * SectorSize;
+      const qint64 partitionBytes = qMin(partition.NumSectors, numSectors - partition.FirstSector) * SectorSize;
+      FilesystemScanner scanner;
+      const bool scanned = scanner.Scan([this, partitionStart](const qint64 offset, const qint64 numBytes) {
+         return ReadBytes(RawDiskHandle, partitionStart + offset, numBytes);
+      }, partitionBytes);
+      if(IsCancelled())
+      {
+         return false;
+      }
+      if(!scanned)
+      {
+         // Unknown or damaged filesystems are read in full
+         continue;
+      }
+      filesystems.append(FilesystemScanner::TypeName(scanner.GetType()));
+
+      qint64 pos = 0;
+      QList<QPair<qint64, qint64>> usedRanges = scanner.GetUsedRanges();
+      usedRanges.append(qMakePair(partitionBytes, partitionBytes));
+      for(const QPair<qint64, qint64>& used : usedRanges)
+      {
+         const unsigned long long first = (pos + SectorSize - 1) / SectorSize;
+         const unsigned long long end = used.first / SectorSize;
+         if(first < end)
+         {
+            freeExtents.append(qMakePair(partition.FirstSector + first, partition.FirstSector + end));
+         }
+         pos = used.second;
+      }
+   }
+   std::sort(freeExtents.begin(), freeExtents.end());
+
+   // Nothing may be left over from an earlier image in the ranges that are not written
+   setFileSizeInSectors(FileHandle, 0ull, SectorSize);
+   setSparseFile(FileHandle);
+
+   emit Started(JobId, numSectors);
+   qint64 bytesSkipped = 0;
+   int nextFree = 0;
+   for(unsigned long long i = 0ull; i < numSectors; i += SECTORS_PER_CHUNK)
+   {
+      if(IsCancelled())
+      {
+         return false;
+      }
+
+      const unsigned long long chunkSectors = qMin(SECTORS_PER_CHUNK, numSectors - i);
+      const unsigned long long chunkEnd = i + chunkSectors;
+      const qint64 chunkBytes = chunkSectors * SectorSize;
+      AcquireBuffer(chunkBytes);
+      char* data = new char[chunkBytes]();
+
+      // Read the pieces of the chunk that are not free space; the rest stays zero
+      bool hasData = false;
+      unsigned long long pos = i;
+      while(pos < chunkEnd)
+      {
+         while((nextFree < freeExtents.size()) && (freeExtents.at(nextFree).second <= pos))
+         {
+            nextFree++;
+         }
+         const bool inFree = (nextFree < freeExtents.size()) && (freeExtents.at(nextFree).first <= pos);
+         if(inFree)
+         {
+            const unsigned long long skipEnd = qMin(freeExtents.at(nextFree).second, chunkEnd);
+            bytesSkipped += (skipEnd - pos) * SectorSize;
+            pos = skipEnd;
+            continue;
+         }
+
+         const unsigned long long readEnd = (nextFree < freeExtents.size()) ?
+                                               qMin(freeExtents.at(nextFree).first, chunkEnd) :
+                                               chunkEnd;
+         char* piece = ReadChunk(RawDiskHandle, pos, readEnd - pos);
+         if(piece == nullptr)
+         {
+            delete[] data;
+            Scheduler->ReleaseBuffer(chunkBytes);
+            return Fail(JobError::UnspecifiedIOError);
+         }
+         memcpy(data + (pos - i) * SectorSize, piece, (readEnd - pos) * SectorSize);
+         delete[] piece;
+         hasData = true;
+         pos = readEnd;
+      }
+
+      // A chunk that is entirely free space is left as a hole
+      if(hasData && !WriteWithRetry(FileHandle, data, i, chunkSectors))
+      {
+         delete[] data;
+         Scheduler->ReleaseBuffer(chunkBytes);
+         return Fail(JobError::UnspecifiedIOError);
+      }
+
+      // HashReadChunk takes ownership of the buffer and its share of the memory budget
+      HashReadChunk(data, i, chunkSectors);
+      ReportProgress(chunkEnd, numSectors);
+   }
+
+   if(!SetImageSize(numSectors))
+   {
+      return false;
+   }
+
+   // The block map lists everything that is not free space
+   const unsigned long long imageSectors = GetImageEndSector(numSectors);
+   QList<QPair<qint64, qint64>> mappedRanges;
+   unsigned long long mappedStart = 0ull;
+   freeExtents.append(qMakePair(imageSectors, imageSectors));
+   for(const QPair<unsigned long long, unsigned long long>& extent : freeExtents)
+   {
+      const unsigned long long mappedEnd = qMin(extent.first, imageSectors);
+      if(mappedStart < mappedEnd)
+      {
+         mappedRanges.append(qMakePair((qint64)(mappedStart * SectorSize), (qint64)(mappedEnd * SectorSize)));
+      }
+      mappedStart = qMax(mappedStart, extent.second);
+   }
+   if(!BmapFile::Save(BmapFile::PathForImage(Options.ImageFilePath), imageSectors * SectorSize, mappedRanges))
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   emit SummaryReported(JobId, "filesystems", filesystems.join(','));
+   emit SummaryReported(JobId, "bytesSkipped", bytesSkipped);
+   return true;
+}
+
+bool ImagingJob::WriteDelta(const unsigned long long numSectors)
+{
+   // Only changed chunks are read from the image, so no hash of the whole image is produced
+   FinishHashing();
+   Hash.reset();
+
+   ChunkManifest base;
+   ChunkManifest image;
+   if(!base.LoadOrBuildForImage(Options.BaseImagePath, ChunkManifest::GetDefaultChunkBytes(),
+                                Scheduler->GetCpuPool(), &Cancelled) ||
+      !image.LoadOrBuildForImage(Options.ImageFilePath, base.GetChunkBytes(),
+                                 Scheduler->GetCpuPool(), &Cancelled))
+   {
+      return IsCancelled() ? false : Fail(JobError::UnspecifiedIOError);
+   }
+
+   if(base.GetChunkBytes() % SectorSize != 0ull)
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   if(Options.SpotCheckBase && !SpotCheckBase(base))
+   {
+      return IsCancelled() ? false : Fail(JobError::BaseImageMismatch);
+   }
+
+   // Chunks past a truncated end of the image are not written at all
+   const unsigned long long chunkSectors = base.GetChunkBytes() / SectorSize;
+   QList<int> changed = image.ChangedSince(base);
+   changed.removeIf([&](const int chunk) { return chunk * chunkSectors >= numSectors; });
+
+   unsigned long long totalSectors = 0ull;
+   for(const int chunk : std::as_const(changed))
+   {
+      totalSectors += qMin(chunkSectors, numSectors - chunk * chunkSectors);
+   }
+
+   emit Started(JobId, totalSectors);
+   unsigned long long sectorsDone = 0ull;
+   for(const int chunk : std::as_const(changed))
+   {
+      if(IsCancelled())
+      {
+         return false;
+      }
+
+      const unsigned long long startSector = chunk * chunkSectors;
+      const unsigned long long sectors = qMin(chunkSectors, numSectors - startSector);
+      const qint64 bytes = sectors * SectorSize;
+
+      AcquireBuffer(bytes);
+      char* data = ReadChunk(FileHandle, startSector, sectors);
+      const bool written = (data != nullptr) && WriteWithRetry(RawDiskHandle, data, startSector, sectors);
+      delete[] data;
+      Scheduler->ReleaseBuffer(bytes);
+      if(!written)
+      {
+         return Fail(JobError::UnspecifiedIOError);
+      }
+
+      sectorsDone += sectors;
+      ReportProgress(sectorsDone, totalSectors);
+   }
+
+   FlushHandle(RawDiskHandle);
+   emit SummaryReported(JobId, "chunksChanged", changed.size());
+   emit SummaryReported(JobId, "chunksTotal", image.GetChunkCount());
+   return true;
+}
+
+bool ImagingJob::WritePartitionExtents(const unsigned long long numSectors)
+{
+   PartitionTable table;
+   if(!ReadPartitionTable(FileHandle, numSectors, &table))
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+   if(table.GetScheme() == PartitionTable::Scheme::None)
+   {
+      // Without a partition table there is nothing to go by
+      return CopySectors(FileHandle, RawDiskHandle, numSectors);
+   }
+
+   // Tables, the boot area in front of the first partition and the partitions themselves
+   QList<QPair<unsigned long long, unsigned long long>> extents = table.GetTableExtents();
+   unsigned long long firstPartition = numSectors;
+   for(const PartitionTable::Partition& partition : table.GetPartitions())
+   {
+      firstPartition = qMin(firstPartition, partition.FirstSector);
+      extents.append(qMakePair(partition.FirstSector, partition.FirstSector + partition.NumSectors));
+   }
+   extents.append(qMakePair(0ull, firstPartition));
+   extents.append(table.GetBackupGptExtent());
+   std::sort(extents.begin(), extents.end());
+
+   QList<QPair<unsigned long long, unsigned long long>> merged;
+   for(const QPair<unsigned long long, unsigned long long>& extent : extents)
+   {
+      const unsigned long long end = qMin(extent.second, numSectors);
+      if(extent.first >= end)
+      {
+         continue;
+      }
+      if(!merged.isEmpty() && (extent.first <= merged.last().second))
+      {
+         merged.last().second = qMax(merged.last().second, end);
+      }
+      else
+      {
+         merged.append(qMakePair(extent.first, end));
+      }
+   }
+
+   QVariantList skippedRanges;
+   unsigned long long sectorsToWrite = 0ull;
+   unsigned long long previousEnd = 0ull;
+   merged.append(qMakePair(numSectors, numSectors));
+   for(const QPair<unsigned long long, unsigned long long>& extent : merged)
+   {
+      if(previousEnd < extent.first)
+      {
+         skippedRanges.append(QVariantMap{{"offset", previousEnd * SectorSize},
+                                          {"bytes", (extent.first - previousEnd) * SectorSize}});
+      }
+      sectorsToWrite += extent.second - extent.first;
+      previousEnd = extent.second;
+   }
+
+   // Only part of the image is written, so a hash of the whole image cannot be produced
+   FinishHashing();
+   Hash.reset();
+
+   emit Started(JobId, sectorsToWrite);
+   unsigned long long sectorsDone = 0ull;
+   for(const QPair<unsigned long long, unsigned long long>& extent : merged)
+   {
+      for(unsigned long long i = extent.first; i < extent.second; i += SECTORS_PER_CHUNK)
+      {
+         if(IsCancelled())
+         {
+            return false;
+         }
+
+         const unsigned long long chunkSectors = qMin(SECTORS_PER_CHUNK, extent.second - i);
+         const qint64 chunkBytes = chunkSectors * SectorSize;
+         AcquireBuffer(chunkBytes);
+         char* data = ReadChunk(FileHandle, i, chunkSectors);
+         const bool written = (data != nullptr) && WriteWithRetry(RawDiskHandle, data, i, chunkSectors);
+         delete[] data;
+         Scheduler->ReleaseBuffer(chunkBytes);
+         if(!written)
+         {
+            return Fail(JobError::UnspecifiedIOError);
+         }
+
+         sectorsDone += chunkSectors;
+         ReportProgress(sectorsDone, sectorsToWrite);
+      }
+   }
+
+   emit SummaryReported(JobId, "skippedRanges", skippedRanges);
+   return true;
+}
+
+bool ImagingJob::SpotCheckBase(const ChunkManifest& base)
+{
+   QList<int> chunks = {0};
+   for(int i = 1; (i < SPOT_CHECK_CHUNKS) && (i < base.GetChunkCount()); i++)
+   {
+      chunks.append(QRandomGenerator::global()->bounded(base.GetChunkCount()));
+   }
+
+   const unsigned long long chunkSectors = base.GetChunkBytes() / SectorSize;
+   for(const int chunk : std::as_const(chunks))
+   {
+      if(IsCancelled())
+      {
+         return false;
+      }
+
+      const qint64 chunkBytes = base.GetChunkSize(chunk);
+      const unsigned long long sectors = (chunkBytes + SectorSize - 1) / SectorSize;
+      AcquireBuffer(sectors * SectorSize);
+      char* data = ReadWithRetry(RawDiskHandle, chunk * chunkSectors, sectors);
+      const bool matches = (data != nullptr) &&
+                           (ChunkManifest::HashChunk(data, chunkBytes) == base.GetChunkHash(chunk));
+      delete[] data;
+      Scheduler->ReleaseBuffer(sectors * SectorSize);
+      if(!matches)
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+bool ImagingJob::DoVerify()
+{
+   SetStatus(Status::Verifying);
+
+   if(!OpenHandles(GENERIC_READ, GENERIC_READ))
+   {
+      return false;
+   }
+
+   const unsigned long long availableSectors = getNumberOfSectors(RawDiskHandle, &SectorSize);
+   if(!OpenRestoreStream())
+   {
+      return false;
+   }
+
+   unsigned long long numSectors = GetImageSizeInSectors();
+   if(!numSectors)
+   {
+      return Fail(JobError::ImageFileContainsNoData);
+   }
+
+   if(numSectors > availableSectors)
+   {
+      numSectors = availableSectors;
+   }
+
+   emit Started(JobId, numSectors);
+   for(unsigned long long i = 0ull; i < numSectors; i += SECTORS_PER_CHUNK)
+   {
+      if(IsCancelled())
+      {
+         return false;
+      }
+
+      const unsigned long long chunkSectors = (numSectors - i >= SECTORS_PER_CHUNK) ?
+                                                 SECTORS_PER_CHUNK :
+                                                 (numSectors - i);
+      const qint64 chunkBytes = chunkSectors * SectorSize;
+
+      AcquireBuffer(2 * chunkBytes);
+      char* imageData = ReadChunk(FileHandle, i, chunkSectors);
+      char* deviceData = (imageData == nullptr) ?
+                            nullptr :
+                            ReadWithRetry(RawDiskHandle, i, chunkSectors);
+
+      const bool readOk = (imageData != nullptr) && (deviceData != nullptr);
+      bool matches = false;
+      unsigned long long mismatchSector = i;
+      if(readOk)
+      {
+         TraceScope trace("compare", "cpu", JobId, i * SectorSize, chunkBytes);
+         matches = (memcmp(imageData, deviceData, chunkBytes) == 0);
+         while(!matches && (memcmp(imageData + (mismatchSector - i) * SectorSize,
+                                   deviceData + (mismatchSector - i) * SectorSize, SectorSize) == 0))
+         {
+            mismatchSector++;
+         }
+      }
+      if(matches && Hash)
+      {
+         Hash->addData(QByteArrayView(imageData, chunkBytes));
+      }
+
+      delete[] imageData;
+      delete[] deviceData;
+      Scheduler->ReleaseBuffer(2 * chunkBytes);
+
+      if(!readOk)
+      {
+         return Fail(JobError::UnspecifiedIOError);
+      }
+      if(!matches)
+      {
+         PROBE_VERIFY_MISMATCH(JobId, (qint64)(i * SectorSize), chunkBytes);
+         Metrics::Instance()->AddVerifyMismatch();
+         emit SummaryReported(JobId, "mismatchSector", mismatchSector);
+         return Fail(JobError::VerifyMismatch);
+      }
+
+      ReportProgress(i + chunkSectors, numSectors);
+   }
+
+   return true;
+}
+
+bool ImagingJob::DoClone()
+{
+   SetStatus(Status::Writing);
+
+   if(Options.CloneTargets.isEmpty())
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   const QString sourceName = (Options.DriveLetter == ' ') ?
+                                 Options.ImageFilePath :
+                                 QString(QChar(Options.DriveLetter));
+   CloneEndpoints.append(Endpoint());
+   if(!OpenEndpoint(sourceName, GENERIC_READ, &CloneEndpoints.last()))
+   {
+      return false;
+   }
+
+   SectorSize = CloneEndpoints.first().SectorSize;
+   const unsigned long long numSectors = CloneEndpoints.first().NumSectors;
+   if(numSectors == 0ull)
+   {
+      return Fail(JobError::ImageFileContainsNoData);
+   }
+
+   // The verify pass reads the targets back through the same handles
+   const DWORD targetAccess = Options.VerifyClone ? (GENERIC_READ | GENERIC_WRITE) : GENERIC_WRITE;
+   for(const QString& target : Options.CloneTargets)
+   {
+      CloneEndpoints.append(Endpoint());
+      Endpoint& endpoint = CloneEndpoints.last();
+      if(!OpenEndpoint(target, targetAccess, &endpoint))
+      {
+         return false;
+      }
+
+      // Every target is written at the source's sector offsets and in pieces of
+      // its sectors, which a device with other sectors may not accept. Files
+      // take any offset.
+      if(IsDriveName(target) && (endpoint.SectorSize != SectorSize))
+      {
+         emit SummaryReported(JobId, "sectorSizeMismatch", target);
+         return Fail(JobError::UnspecifiedIOError);
+      }
+
+      // Targets may use a different sector size, so compare capacities in bytes
+      const unsigned long long capacityBytes = (endpoint.NumSectors == ~0ull) ?
+                                                  ~0ull :
+                                                  endpoint.NumSectors * endpoint.SectorSize;
+      if(capacityBytes / SectorSize < numSectors)
+      {
+         emit NotEnoughSpaceOnVolume(JobId, numSectors, capacityBytes / SectorSize, SectorSize, true);
+         return Fail(JobError::NotEnoughSpaceOnVolume);
+      }
+   }
+
+   HANDLE sourceHandle = CloneEndpoints.first().Handle;
+   QList<HANDLE> targetHandles;
+   for(int t = 1; t < CloneEndpoints.size(); t++)
+   {
+      targetHandles.append(CloneEndpoints.at(t).Handle);
+   }
+
+   // Every target is written in parallel from the same buffer
+   QThreadPool fanOutPool;
+   fanOutPool.setMaxThreadCount(targetHandles.size());
+
+   emit Started(JobId, numSectors);
+   for(unsigned long long i = 0ull; i < numSectors; i += SECTORS_PER_CHUNK)
+   {
+      if(IsCancelled())
+      {
+         return false;
+      }
+
+      const unsigned long long chunkSectors = (numSectors - i >= SECTORS_PER_CHUNK) ?
+                                                 SECTORS_PER_CHUNK :
+                                                 (numSectors - i);
+      const qint64 chunkBytes = chunkSectors * SectorSize;
+
+      AcquireBuffer(chunkBytes);
+      char* data = ReadWithRetry(sourceHandle, i, chunkSectors);
+      if(data == nullptr)
+      {
+         Scheduler->ReleaseBuffer(chunkBytes);
+         return Fail(JobError::UnspecifiedIOError);
+      }
+
+      std::atomic<bool> writesOk(true);
+      QList<QFuture<void>> writes;
+      for(HANDLE target : targetHandles)
+      {
+         writes.append(QtConcurrent::run(&fanOutPool, [&, target]() {
+            if(!WriteWithRetry(target, data, i, chunkSectors))
+            {
+               writesOk = false;
+            }
+         }));
+      }
+      for(QFuture<void>& write : writes)
+      {
+         write.waitForFinished();
+      }
+
+      if(!writesOk)
+      {
+         delete[] data;
+         Scheduler->ReleaseBuffer(chunkBytes);
+         return Fail(JobError::UnspecifiedIOError);
+      }
+
+      HashChunk(data, chunkBytes);
+      ReportProgress(i + chunkSectors, numSectors);
+   }
+
+   for(HANDLE target : targetHandles)
+   {
+      FlushHandle(target);
+   }
+
+   if(!Options.VerifyClone)
+   {
+      return true;
+   }
+
+   FinishHashing();
+   return VerifyCloneTargets(numSectors, Hash->result());
+}
+
+bool ImagingJob::VerifyCloneTargets(const unsigned long long numSectors, const QByteArray& expectedHash)
+{
+   SetStatus(Status::Verifying);
+   emit Started(JobId, numSectors);
+
+   const int targetCount = CloneEndpoints.size() - 1;
+   std::atomic<unsigned long long> sectorsVerified(0ull);
+   std::atomic<bool> readsOk(true);
+   QThreadPool verifyPool;
+   verifyPool.setMaxThreadCount(targetCount);
+
+   QList<QFuture<bool>> results;
+   for(int t = 1; t < CloneEndpoints.size(); t++)
+   {
+      HANDLE target = CloneEndpoints.at(t).Handle;
+      results.append(QtConcurrent::run(&verifyPool, [&, target]() -> bool {
+         QCryptographicHash hash((QCryptographicHash::Algorithm)HashAlgorithm);
+         for(unsigned long long i = 0ull; i < numSectors; i += SECTORS_PER_CHUNK)
+         {
+            if(IsCancelled())
+            {
+               return false;
+            }
+
+            const unsigned long long chunkSectors = (numSectors - i >= SECTORS_PER_CHUNK) ?
+                                                       SECTORS_PER_CHUNK :
+                                                       (numSectors - i);
+            const qint64 chunkBytes = chunkSectors * SectorSize;
+
+            AcquireBuffer(chunkBytes);
+            char* data = ReadWithRetry(target, i, chunkSectors);
+            if(data == nullptr)
+            {
+               Scheduler->ReleaseBuffer(chunkBytes);
+               readsOk = false;
+               return false;
+            }
+            hash.addData(QByteArrayView(data, chunkBytes));
+            delete[] data;
+            Scheduler->ReleaseBuffer(chunkBytes);
+
+            sectorsVerified += chunkSectors;
+            ReportProgress(sectorsVerified / targetCount, numSectors);
+         }
+         return hash.result() == expectedHash;
+      }));
+   }
+
+   bool allMatch = true;
+   for(QFuture<bool>& result : results)
+   {
+      allMatch = result.result() && allMatch;
+   }
+
+   if(IsCancelled())
+   {
+      return false;
+   }
+   // A target that cannot be read back is not known to differ
+   if(!readsOk)
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+   if(!allMatch)
+   {
+      PROBE_VERIFY_MISMATCH(JobId, -1ll, (qint64)(numSectors * SectorSize));
+      Metrics::Instance()->AddVerifyMismatch();
+      return Fail(JobError::VerifyMismatch);
+   }
+   return true;
+}
+
+bool ImagingJob::DoRescue()
+{
+   SetStatus(Status::Reading);
+
+   if(!OpenHandles(GENERIC_READ, GENERIC_WRITE))
+   {
+      return false;
+   }
+
+   const unsigned long long numSectors = getNumberOfSectors(RawDiskHandle, &SectorSize);
+   if(!numSectors)
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   // Only areas the map does not list as finished are read again; sectors that
+   // were bad last time get one more single-sector attempt
+   RescueMap map(Options.ImageFilePath);
+   if(!map.Load(numSectors * SectorSize))
+   {
+      map.Reset(numSectors * SectorSize);
+   }
+   map.ChangeStatus(RescueMap::BlockStatus::BadSector, RescueMap::BlockStatus::NonTrimmed);
+   if(!map.Save())
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+   RescueSaveTimer.start();
+
+   emit Started(JobId, numSectors);
+   ReportProgress(map.GetBytes(RescueMap::BlockStatus::Finished) / SectorSize,
+                  numSectors);
+
+   // 1: large reads over the easy areas, jumping past anything failing or slow
+   // 2: large reads over whatever the first pass jumped past
+   // 3: ever smaller reads over the failed areas, down to single sectors
+   const bool completed = RescueCopyPass(&map, true) &&
+                          RescueCopyPass(&map, false) &&
+                          RescueTrimPass(&map);
+
+   FlushHandle(FileHandle);
+   RescueCheckpoint(&map, numSectors * SectorSize, 3);
+   if(!map.Save() && completed)
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   emit SummaryReported(JobId, "rescueMap", map.GetFilePath());
+   emit SummaryReported(JobId, "rescuedBytes", map.GetBytes(RescueMap::BlockStatus::Finished));
+   emit SummaryReported(JobId, "badBytes", map.GetBytes(RescueMap::BlockStatus::BadSector));
+   emit SummaryReported(JobId, "untriedBytes", map.GetBytes(RescueMap::BlockStatus::NonTried) +
+                                               map.GetBytes(RescueMap::BlockStatus::NonTrimmed));
+
+   // Bad sectors are an expected outcome of a rescue, not a failure of the job
+   return completed;
+}
+
+bool ImagingJob::RescueCopyPass(RescueMap* map, const bool skipProblemAreas)
+{
+   const int pass = skipProblemAreas ? 1 : 2;
+   const qint64 transferBytes = SECTORS_PER_CHUNK * SectorSize;
+   qint64 skipBytes = 0;
+
+   for(const RescueMap::Block& block : map->GetBlocks(RescueMap::BlockStatus::NonTried))
+   {
+      const qint64 end = block.Pos + block.Size;
+      qint64 pos = block.Pos;
+      while(pos < end)
+      {
+         if(IsCancelled() || (LastError != JobError::None))
+         {
+            return false;
+         }
+
+         const qint64 size = qMin(transferBytes, end - pos);
+         QElapsedTimer readTimer;
+         readTimer.start();
+         const bool readOk = RescueReadBlock(pos, size);
+         const bool slow = readTimer.elapsed() > RESCUE_SLOW_READ_MS;
+         map->SetStatus(pos, size, readOk ? RescueMap::BlockStatus::Finished :
+                                            RescueMap::BlockStatus::NonTrimmed);
+         pos += size;
+
+         if(skipProblemAreas && (!readOk || slow))
+         {
+            // Whatever is skipped stays non-tried for the second pass
+            skipBytes = (skipBytes == 0) ? RESCUE_MIN_SKIP_BYTES : qMin(skipBytes * 2, RESCUE_MAX_SKIP_BYTES);
+            pos += qMin(skipBytes, end - pos);
+         }
+         else if(readOk)
+         {
+            skipBytes = 0;
+         }
+
+         RescueCheckpoint(map, pos, pass);
+      }
+   }
+
+   return LastError == JobError::None;
+}
+
+bool ImagingJob::RescueTrimPass(RescueMap* map)
+{
+   QByteArray marker(SectorSize, '\0');
+   for(unsigned long long i = 0ull; i < SectorSize; i++)
+   {
+      marker[i] = RESCUE_BAD_SECTOR_MARKER[i % (sizeof(RESCUE_BAD_SECTOR_MARKER) - 1)];
+   }
+
+   // Halve the transfer size each round; only the last round gives up on a sector
+   for(unsigned long long transferSectors = SECTORS_PER_CHUNK / 2; transferSectors >= 1ull; transferSectors /= 2)
+   {
+      const qint64 transferBytes = transferSectors * SectorSize;
+      const bool lastRound = (transferSectors == 1ull);
+      for(const RescueMap::Block& block : map->GetBlocks(RescueMap::BlockStatus::NonTrimmed))
+      {
+         const qint64 end = block.Pos + block.Size;
+         for(qint64 pos = block.Pos; pos < end; pos += transferBytes)
+         {
+            if(IsCancelled() || (LastError != JobError::None))
+            {
+               return false;
+            }
+
+            const qint64 size = qMin(transferBytes, end - pos);
+            if(RescueReadBlock(pos, size))
+            {
+               map->SetStatus(pos, size, RescueMap::BlockStatus::Finished);
+            }
+            else if(lastRound && (LastError == JobError::None))
+            {
+               if(!WriteSectors(FileHandle, marker.data(), pos / SectorSize, 1ull, SectorSize))
+               {
+                  return Fail(JobError::UnspecifiedIOError);
+               }
+               map->SetStatus(pos, size, RescueMap::BlockStatus::BadSector);
+            }
+
+            RescueCheckpoint(map, pos + size, 3);
+         }
+      }
+   }
+
+   return true;
+}
+
+bool ImagingJob::RescueReadBlock(const qint64 pos, const qint64 size)
+{
+   const unsigned long long startSector = pos / SectorSize;
+   const unsigned long long numSectors = size / SectorSize;
+
+   AcquireBuffer(size);
+   char* data = ReadSectors(RawDiskHandle, startSector, numSectors, SectorSize, false);
+   if(data == nullptr)
+   {
+      Scheduler->ReleaseBuffer(size);
+      return false;
+   }
+
+   // Failing to write the output is fatal, unlike failing to read the device
+   const bool written = WriteSectors(FileHandle, data, startSector, numSectors, SectorSize);
+   delete[] data;
+   Scheduler->ReleaseBuffer(size);
+   if(!written)
+   {
+      Fail(JobError::UnspecifiedIOError);
+   }
+   return written;
+}
+
+void ImagingJob::RescueCheckpoint(RescueMap* map, const qint64 pos, const int pass)
+{
+   map->SetCurrentPos(pos, pass);
+   ReportProgress(map->GetBytes(RescueMap::BlockStatus::Finished) / SectorSize,
+                  map->GetDeviceSize() / SectorSize);
+
+   // The map may only claim data that has really reached the image file
+   if(RescueSaveTimer.elapsed() >= RESCUE_MAP_SAVE_INTERVAL_MS)
+   {
+      FlushHandle(FileHandle);
+      map->Save();
+      RescueSaveTimer.restart();
+   }
+}
+
+char* ImagingJob::ReadWithRetry(HANDLE source, const unsigned long long startSector,
+                                const unsigned long long numSectors)
+{
+   // The whole chunk comes back in its own buffer; pieces are gathered into one
+   char* data = nullptr;
+   const RetryRunner::Transfer read = [&](const unsigned long long pieceStart, const unsigned long long pieceSectors,
+                                          const bool lastChance) {
+      // Only a failure the job cannot recover from is worth a message box
+      char* piece = ReadSectors(source, pieceStart, pieceSectors, SectorSize, lastChance);
+      if(piece == nullptr)
+      {
+         return false;
+      }
+      if(pieceSectors == numSectors)
+      {
+         data = piece;
+         return true;
+      }
+      if(data == nullptr)
+      {
+         data = new char[numSectors * SectorSize];
+      }
+      memcpy(data + (pieceStart - startSector) * SectorSize, piece, pieceSectors * SectorSize);
+      delete[] piece;
+      return true;
+   };
+
+   if(!RunWithRetries(startSector, numSectors, read))
+   {
+      delete[] data;
+      return nullptr;
+   }
+   return data;
+}
+
+bool ImagingJob::WriteWithRetry(HANDLE destination, char* data, const unsigned long long startSector,
+                                const unsigned long long numSectors)
+{
+   const RetryRunner::Transfer write = [&](const unsigned long long pieceStart, const unsigned long long pieceSectors,
+                                           const bool lastChance) {
+      return WriteSectors(destination, data + (pieceStart - startSector) * SectorSize, pieceStart,
+                          pieceSectors, SectorSize, lastChance);
+   };
+   return RunWithRetries(startSector, numSectors, write);
+}
+
+bool ImagingJob::RunWithRetries(const unsigned long long startSector, const unsigned long long numSectors,
+                                const RetryRunner::Transfer& transfer)
+{
+   const RetryRunner runner(Options.Retry, [this](const int attempt, const unsigned long long sector) {
+      return WaitBeforeRetry(attempt, sector);
+   });
+   bool fellBack = false;
+   const bool done = runner.Run(startSector, numSectors, transfer, &fellBack);
+   if(fellBack)
+   {
+      QMutexLocker locker(&RetryLock);
+      FallbackCount++;
+   }
+   return done;
+}
+
+bool ImagingJob::WaitBeforeRetry(const int attempt, const unsigned long long startSector)
+{
+   PROBE_RETRY(JobId, (qint64)(startSector * SectorSize), attempt);
+   Metrics::Instance()->AddRetry();
+   {
+      QMutexLocker locker(&RetryLock);
+      RetryCount++;
+      if(RetryOffsets.size() < MAX_RECORDED_RETRY_OFFSETS)
+      {
+         RetryOffsets.append(startSector * SectorSize);
+      }
+   }
+
+   const qint64 backoffMs = RetryRunner::BackoffMs(Options.Retry, attempt);
+   QElapsedTimer waited;
+   waited.start();
+   while(!IsCancelled())
+   {
+      const qint64 remainingMs = backoffMs - waited.elapsed();
+      if(remainingMs <= 0)
+      {
+         break;
+      }
+      QThread::msleep(qMin(RETRY_SLEEP_SLICE_MS, remainingMs));
+   }
+   return !IsCancelled();
+}
+
+void ImagingJob::ReportMetrics()
+{
+   {
+      QMutexLocker locker(&RetryLock);
+      if(RetryCount > 0)
+      {
+         QVariantList offsets;
+         for(const qint64 offset : std::as_const(RetryOffsets))
+         {
+            offsets.append(offset);
+         }
+         emit SummaryReported(JobId, "retries", RetryCount);
+         emit SummaryReported(JobId, "fallbackTransfers", FallbackCount);
+         emit SummaryReported(JobId, "retryOffsets", offsets);
+      }
+      if(LastDiskError.IsSet())
+      {
+         emit SummaryReported(JobId, "diskError", LastDiskError.ToVariantMap());
+      }
+   }
+
+   QMutexLocker locker(&InFlightLock);
+   if(StallCount > 0)
+   {
+      QVariantList offsets;
+      for(const qint64 offset : std::as_const(StallOffsets))
+      {
+         offsets.append(offset);
+      }
+      emit SummaryReported(JobId, "stalls", StallCount);
+      emit SummaryReported(JobId, "stallOffsets", offsets);
+   }
+   locker.unlock();
+
+   emit SummaryReported(JobId, "bottleneck", Stats->Verdict());
+   emit SummaryReported(JobId, "stageUtilisation", Stats->UtilisationPercentages());
+}
+
+char* ImagingJob::ReadSectors(HANDLE handle, const unsigned long long startSector,
+                              const unsigned long long numSectors, const unsigned long long sectorSize,
+                              const bool reportErrors)
+{
+   TraceScope trace("read", "io", JobId, startSector * sectorSize, numSectors * sectorSize);
+   const qint64 offset = startSector * sectorSize;
+   const qint64 length = numSectors * sectorSize;
+   PROBE_READ_START(JobId, offset, length);
+   BeginRequest(offset);
+   QElapsedTimer latency;
+   latency.start();
+   char* data = readSectorDataFromHandle(handle, startSector, numSectors, sectorSize, reportErrors);
+   const qint64 latencyNs = latency.nsecsElapsed();
+   PROBE_READ_DONE(JobId, offset, length, latencyNs, (int)(data != nullptr));
+   DeviceMetrics* metrics = MetricsFor(handle);
+   if((metrics != nullptr) && (data != nullptr))
+   {
+      metrics->BytesRead.fetch_add(length, std::memory_order_relaxed);
+   }
+   else if(metrics != nullptr)
+   {
+      metrics->ReadErrors.fetch_add(1ull, std::memory_order_relaxed);
+   }
+   // Reads while verifying are their own stage, so a slow verify pass is not blamed on the source
+   Stats->RecordRead(latencyNs, (GetStatus() == Status::Verifying) ?
+                                   JobStats::Stage::VerifyRead :
+                                   JobStats::Stage::Read);
+   EndRequest();
+   if(data == nullptr)
+   {
+      RecordDiskError();
+   }
+   return data;
+}
+
+bool ImagingJob::WriteSectors(HANDLE handle, char* data, const unsigned long long startSector,
+                              const unsigned long long numSectors, const unsigned long long sectorSize,
+                              const bool reportErrors)
+{
+   TraceScope trace("write", "io", JobId, startSector * sectorSize, numSectors * sectorSize);
+   const qint64 offset = startSector * sectorSize;
+   const qint64 length = numSectors * sectorSize;
+   PROBE_WRITE_START(JobId, offset, length);
+   BeginRequest(offset);
+   QElapsedTimer latency;
+   latency.start();
+   const bool written = writeSectorDataToHandle(handle, data, startSector, numSectors, sectorSize, reportErrors);
+   const qint64 latencyNs = latency.nsecsElapsed();
+   PROBE_WRITE_DONE(JobId, offset, length, latencyNs, (int)written);
+   DeviceMetrics* metrics = MetricsFor(handle);
+   if((metrics != nullptr) && written)
+   {
+      metrics->BytesWritten.fetch_add(length, std::memory_order_relaxed);
+   }
+   else if(metrics != nullptr)
+   {
+      metrics->WriteErrors.fetch_add(1ull, std::memory_order_relaxed);
+   }
+   Stats->RecordWrite(latencyNs);
+   EndRequest();
+   if(!written)
+   {
+      RecordDiskError();
+   }
+   return written;
+}
+
+void ImagingJob::AcquireBuffer(const qint64 bytes)
+{
+   QElapsedTimer waitTime;
+   waitTime.start();
+   Scheduler->AcquireBuffer(bytes);
+   Stats->AddBusyTime(JobStats::Stage::BufferWait, waitTime.nsecsElapsed());
+}
+
+void ImagingJob::FlushHandle(HANDLE handle)
+{
+   TraceScope trace("flush", "io", JobId);
+   QElapsedTimer latency;
+   latency.start();
+   FlushFileBuffers(handle);
+   PROBE_FLUSH(JobId, latency.nsecsElapsed());
+}
+
+void ImagingJob::RegisterMetrics(HANDLE handle, const QString& device)
+{
+   HandleMetrics.append(qMakePair(handle, Metrics::Instance()->ForDevice(device)));
+}
+
+DeviceMetrics* ImagingJob::MetricsFor(HANDLE handle) const
+{
+   // A job has a handful of handles at most
+   for(const QPair<HANDLE, DeviceMetrics*>& entry : HandleMetrics)
+   {
+      if(entry.first == handle)
+      {
+         return entry.second;
+      }
+   }
+   return nullptr;
+}
+
+void ImagingJob::RecordDiskError()
+{
+   const DiskError error = getLastDiskError();
+   if(error.IsSet())
+   {
+      QMutexLocker locker(&RetryLock);
+      LastDiskError = error;
+   }
+}
+
+void ImagingJob::BeginRequest(const qint64 offset)
+{
+   Stats->BeginRequest();
+   if(Options.Stall.TimeoutMs <= 0)
+   {
+      return;
+   }
+
+   // A real handle to this thread, so the watchdog can abort its synchronous I/O
+   InFlightRequest request;
+   DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &request.Thread,
+                   THREAD_TERMINATE, FALSE, 0);
+   request.Offset = offset;
+   request.Age.start();
+
+   QMutexLocker locker(&InFlightLock);
+   InFlightRequests.insert(GetCurrentThreadId(), request);
+}
+
+void ImagingJob::EndRequest()
+{
+   Stats->EndRequest();
+   if(Options.Stall.TimeoutMs <= 0)
+   {
+      return;
+   }
+
+   QMutexLocker locker(&InFlightLock);
+   const InFlightRequest request = InFlightRequests.take(GetCurrentThreadId());
+   if(request.Stalled)
+   {
+      --StalledRequests;
+   }
+   if(request.Thread != nullptr)
+   {
+      CloseHandle(request.Thread);
+   }
+}
+
+void ImagingJob::CheckForStall()
+{
+   if(Options.Stall.TimeoutMs <= 0)
+   {
+      return;
+   }
+
+   QMutexLocker locker(&InFlightLock);
+   for(InFlightRequest& request : InFlightRequests)
+   {
+      const qint64 ageMs = request.Age.elapsed();
+      if(request.Stalled || (ageMs < Options.Stall.TimeoutMs))
+      {
+         continue;
+      }
+
+      request.Stalled = true;
+      ++StalledRequests;
+      StallCount++;
+      Metrics::Instance()->AddStall();
+      if(StallOffsets.size() < MAX_RECORDED_STALL_OFFSETS)
+      {
+         StallOffsets.append(request.Offset);
+      }
+      emit Stalled(JobId, request.Offset, ageMs);
+
+      if(Options.Stall.OnStall == StallPolicy::Action::Cancel)
+      {
+         Cancel();
+      }
+      if((Options.Stall.OnStall != StallPolicy::Action::Report) && (request.Thread != nullptr))
+      {
+         // The blocked ReadFile/WriteFile returns ERROR_OPERATION_ABORTED
+         CancelSynchronousIo(request.Thread);
+      }
+   }
+}
+
+bool ImagingJob::IsStalled() const
+{
+   return StalledRequests > 0;
+}
+
+void ImagingJob::SampleStats()
+{
+   if(!Options.CollectStats)
+   {
+      return;
+   }
+
+   unsigned long long sectorsDone, totalSectors, sectorSize;
+   GetProgress(&sectorsDone, &totalSectors, &sectorSize);
+   const qint64 prefetchBytes = Options.Prefetcher ? Options.Prefetcher->GetBufferedBytes() : 0;
+   Stats->AddSample(sectorsDone * sectorSize, prefetchBytes, Scheduler->GetBufferBytesInUse());
+}
+
+const JobStats* ImagingJob::GetStats() const
+{
+   return Stats.data();
+}
+
+bool ImagingJob::OpenHandles(const DWORD deviceAccess, const DWORD fileAccess)
+{
+   const JobError error = OpenDevice(Options.DriveLetter, deviceAccess,
+                                     &VolumeHandle, &RawDiskHandle, &VolumeLocked);
+   if(error != JobError::None)
+   {
+      return Fail(error);
+   }
+
+   // A resumable read or a rescue continues into the partially written output file
+   FileHandle = getHandleOnFile(reinterpret_cast<LPCWSTR>(Options.ImageFilePath.utf16()), fileAccess,
+                                Options.Resumable || (Options.Type == JobType::Rescue));
+   if(FileHandle == INVALID_HANDLE_VALUE)
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   RegisterMetrics(RawDiskHandle, QString("%1:").arg(Options.DriveLetter));
+   RegisterMetrics(FileHandle, Options.ImageFilePath);
+   return true;
+}
+
+bool ImagingJob::OpenRestoreStream()
+{
+   if(!BackupReader::IsIncremental(Options.ImageFilePath))
+   {
+      return true;
+   }
+
+   Restore.reset(new BackupReader());
+   return Restore->Open(Options.ImageFilePath) || Fail(JobError::UnspecifiedIOError);
+}
+
+unsigned long long ImagingJob::GetImageSizeInSectors()
+{
+   if(Restore)
+   {
+      return (Restore->GetTotalBytes() + SectorSize - 1) / SectorSize;
+   }
+   return getFileSizeInSectors(FileHandle, SectorSize);
+}
+
+void ImagingJob::CloseHandles()
+{
+   if(VolumeLocked)
+   {
+      removeLockOnVolume(VolumeHandle);
+      VolumeLocked = false;
+   }
+
+   for(HANDLE* handle : {&CompareHandle, &RawDiskHandle, &FileHandle, &VolumeHandle})
+   {
+      if(*handle != INVALID_HANDLE_VALUE)
+      {
+         CloseHandle(*handle);
+         *handle = INVALID_HANDLE_VALUE;
+      }
+   }
+
+   for(Endpoint& endpoint : CloneEndpoints)
+   {
+      CloseEndpoint(&endpoint);
+   }
+   CloneEndpoints.clear();
+   HandleMetrics.clear();
+   Restore.reset();
+}
+
+bool ImagingJob::OpenEndpoint(const QString& name, const DWORD access, Endpoint* endpoint)
+{
+   endpoint->Name = name;
+
+   if(IsDriveName(name))
+   {
+      const JobError error = OpenDevice(name.at(0).toLatin1(), access, &endpoint->VolumeHandle,
+                                        &endpoint->Handle, &endpoint->VolumeLocked);
+      if(error != JobError::None)
+      {
+         return Fail(error);
+      }
+
+      endpoint->NumSectors = getNumberOfSectors(endpoint->Handle, &endpoint->SectorSize);
+      if(endpoint->NumSectors == 0ull)
+      {
+         return Fail(JobError::UnspecifiedIOError);
+      }
+      RegisterMetrics(endpoint->Handle, QString("%1:").arg(name.at(0).toUpper()));
+      return true;
+   }
+
+   // Plain files stand in for devices, so clones can be tested without hardware
+   endpoint->Handle = getHandleOnFile(reinterpret_cast<LPCWSTR>(name.utf16()), access);
+   if(endpoint->Handle == INVALID_HANDLE_VALUE)
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   endpoint->SectorSize = FILE_SECTOR_SIZE;
+   // A file being written to grows as needed, so it has no fixed capacity
+   endpoint->NumSectors = (access == GENERIC_READ) ?
+                             getFileSizeInSectors(endpoint->Handle, FILE_SECTOR_SIZE) :
+                             ~0ull;
+   RegisterMetrics(endpoint->Handle, name);
+   return true;
+}
+
+void ImagingJob::CloseEndpoint(Endpoint* endpoint)
+{
+   if(endpoint->VolumeLocked)
+   {
+      removeLockOnVolume(endpoint->VolumeHandle);
+      endpoint->VolumeLocked = false;
+   }
+
+   for(HANDLE* handle : {&endpoint->Handle, &endpoint->VolumeHandle})
+   {
+      if(*handle != INVALID_HANDLE_VALUE)
+      {
+         CloseHandle(*handle);
+         *handle = INVALID_HANDLE_VALUE;
+      }
+   }
+}
+
+bool ImagingJob::CopySectors(HANDLE source, HANDLE destination, const unsigned long long numSectors)
+{
+   unsigned long long startSector = 0ull;
+   if(Options.Resumable && !PrepareJournal(source, destination, numSectors, &startSector))
+   {
+      return false;
+   }
+
+   // The prefetcher streams from the start of the image, so it is of no use when resuming
+   UsePrefetcher = Options.Prefetcher && (startSector == 0ull) && !Restore;
+   if(UsePrefetcher)
+   {
+      // Without the size a short stream could not be told from the end of the image
+      LARGE_INTEGER fileSize;
+      UsePrefetcher = (GetFileSizeEx(FileHandle, &fileSize) != 0);
+      PrefetchImageBytes = UsePrefetcher ? fileSize.QuadPart : 0;
+   }
+   if(startSector > 0ull)
+   {
+      // Only the tail is copied, so a hash of the whole image cannot be produced
+      FinishHashing();
+      Hash.reset();
+      // Whatever was copied before is kept when trimming
+      DataEndSector = startSector;
+   }
+
+   // Differential write: the current destination contents are read ahead on
+   // another thread, and chunks that already match the source are not written
+   struct PendingCompare
+   {
+      QFuture<char*> Data;
+      qint64 Bytes;
+   };
+   QThreadPool readAheadPool;
+   readAheadPool.setMaxThreadCount(1);
+   QQueue<PendingCompare> pendingCompares;
+   unsigned long long nextCompareSector = startSector;
+   auto discardPendingCompares = qScopeGuard([&]() {
+      while(!pendingCompares.isEmpty())
+      {
+         PendingCompare pending = pendingCompares.dequeue();
+         delete[] pending.Data.result();
+         Scheduler->ReleaseBuffer(pending.Bytes);
+      }
+   });
+
+   emit Started(JobId, numSectors);
+   ReportProgress(startSector, numSectors);
+
+   for(unsigned long long i = startSector; i < numSectors; i += SECTORS_PER_CHUNK)
+   {
+      if(IsCancelled())
+      {
+         return false;
+      }
+
+      const unsigned long long chunkSectors = (numSectors - i >= SECTORS_PER_CHUNK) ?
+                                                 SECTORS_PER_CHUNK :
+                                                 (numSectors - i);
+      const qint64 chunkBytes = chunkSectors * SectorSize;
+
+      while((CompareHandle != INVALID_HANDLE_VALUE) && (pendingCompares.size() < DIFF_READ_AHEAD_CHUNKS) &&
+            (nextCompareSector < numSectors))
+      {
+         const unsigned long long compareStart = nextCompareSector;
+         const unsigned long long compareSectors = qMin(SECTORS_PER_CHUNK, numSectors - compareStart);
+         AcquireBuffer(compareSectors * SectorSize);
+         pendingCompares.enqueue({QtConcurrent::run(&readAheadPool, [this, compareStart, compareSectors]() {
+                                     // An unreadable chunk is simply written, so no message box
+                                     return ReadSectors(CompareHandle, compareStart, compareSectors, SectorSize, false);
+                                  }),
+                                  (qint64)(compareSectors * SectorSize)});
+         nextCompareSector += compareSectors;
+      }
+
+      AcquireBuffer(chunkBytes);
+      char* data = ReadChunk(source, i, chunkSectors);
+      if(data == nullptr)
+      {
+         Scheduler->ReleaseBuffer(chunkBytes);
+         return Fail(JobError::UnspecifiedIOError);
+      }
+
+      bool needsWrite = true;
+      if(!pendingCompares.isEmpty())
+      {
+         PendingCompare pending = pendingCompares.dequeue();
+         char* current = pending.Data.result();
+         // memcmp is already vectorised by the C runtime and stops at the first difference
+         if(current != nullptr)
+         {
+            TraceScope trace("compare", "cpu", JobId, i * SectorSize, chunkBytes);
+            needsWrite = (memcmp(current, data, chunkBytes) != 0);
+         }
+         delete[] current;
+         Scheduler->ReleaseBuffer(pending.Bytes);
+         if(needsWrite)
+         {
+            ChunksWritten++;
+         }
+         else
+         {
+            ChunksSkipped++;
+         }
+      }
+
+      if(needsWrite && !WriteWithRetry(destination, data, i, chunkSectors))
+      {
+         delete[] data;
+         Scheduler->ReleaseBuffer(chunkBytes);
+         return Fail(JobError::UnspecifiedIOError);
+      }
+
+      if(Journal)
+      {
+         Journal->AddData(data, chunkBytes);
+         const unsigned long long written = i + chunkSectors;
+         if((written % Journal->GetChunkSectors() == 0ull) || (written == numSectors))
+         {
+            // The high-water mark may only move once the data is really on the destination
+            FlushHandle(destination);
+            Journal->CompleteChunk(written);
+            Journal->Save();
+         }
+      }
+
+      // HashReadChunk takes ownership of the buffer and its share of the memory budget
+      HashReadChunk(data, i, chunkSectors);
+      ReportProgress(i + chunkSectors, numSectors);
+   }
+
+   if(Journal && !IsCancelled())
+   {
+      Journal->Remove();
+      Journal.reset();
+   }
+
+   return true;
+}
+
+bool ImagingJob::PrepareJournal(HANDLE source, HANDLE destination, const unsigned long long numSectors,
+                                unsigned long long* startSector)
+{
+   // A write resumes only onto the same image file; a read only from the same medium
+   qint64 sourceStamp = 0;
+   if(Options.Type == JobType::Write)
+   {
+      sourceStamp = QFileInfo(Options.ImageFilePath).lastModified().toMSecsSinceEpoch();
+   }
+   else if(!GetMediumStamp(source, numSectors, &sourceStamp))
+   {
+      return Fail(JobError::UnspecifiedIOError);
+   }
+
+   Journal.reset(new CheckpointJournal(Options.ImageFilePath));
+   const auto startOver = [&]() {
+      Journal->Reset(Options.Type, SectorSize, numSectors, sourceStamp);
+      *startSector = 0ull;
+      return Journal->Save() || Fail(JobError::UnspecifiedIOError);
+   };
+
+   // Chunks are checkpointed between two transfers, so a journal chunk must
+   // hold a whole number of them
+   const unsigned long long chunkSectors = Journal->GetChunkSectors();
+   if(!Journal->Load() || !Journal->Matches(Options.Type, SectorSize, numSectors, sourceStamp) ||
+      (chunkSectors % SECTORS_PER_CHUNK != 0ull))
+   {
+      return startOver();
+   }
+
+   // The destination handle is open for writing only. A write is checked
+   // through a read handle on the device of its own, like a differential
+   // write compares; a read opens its image file for reading as well.
+   HANDLE checkHandle = destination;
+   if(destination == RawDiskHandle)
+   {
+      checkHandle = getHandleOnDevice(getDeviceID(VolumeHandle), GENERIC_READ);
+      if(checkHandle == INVALID_HANDLE_VALUE)
+      {
+         return Fail(JobError::UnspecifiedIOError);
+      }
+   }
+   auto closeCheckHandle = qScopeGuard([&]() {
+      if(checkHandle != destination)
+      {
+         CloseHandle(checkHandle);
+      }
+   });
+
+   // Re-check the last few checkpointed chunks on the destination, and fall
+   // back to the first one that does not hold what the journal says it should.
+   // A read checks the source as well: if it no longer holds the same data,
+   // nothing of the image so far can be kept.
+   const bool checkSource = (Options.Type == JobType::Read);
+   const int completed = Journal->GetCompletedChunks();
+   const int firstToCheck = (completed > RESUME_VERIFY_CHUNKS) ? (completed - RESUME_VERIFY_CHUNKS) : 0;
+   for(int chunk = firstToCheck; chunk < completed; chunk++)
+   {
+      QCryptographicHash written(CheckpointJournal::GetHashAlgorithm());
+      QCryptographicHash read(CheckpointJournal::GetHashAlgorithm());
+      const unsigned long long chunkStart = chunk * chunkSectors;
+      for(unsigned long long i = chunkStart; i < chunkStart + chunkSectors; i += SECTORS_PER_CHUNK)
+      {
+         if(!HashSectors(checkHandle, i, SECTORS_PER_CHUNK, &written) ||
+            (checkSource && !HashSectors(source, i, SECTORS_PER_CHUNK, &read)))
+         {
+            return Fail(JobError::UnspecifiedIOError);
+         }
+      }
+
+      if(checkSource && (read.result() != Journal->GetChunkHash(chunk)))
+      {
+         return startOver();
+      }
+      if(written.result() != Journal->GetChunkHash(chunk))
+      {
+         Journal->Truncate(chunk);
+         break;
+      }
+   }
+
+   // Anything past the last complete chunk was never checkpointed
+   Journal->Truncate(Journal->GetCompletedChunks());
+   *startSector = Journal->GetHighWaterSector();
+   return true;
+}
+
+bool ImagingJob::GetMediumStamp(HANDLE source, const unsigned long long numSectors, qint64* stamp)
+{
+   // The partition table and the boot sectors at the start of a medium carry
+   // its disk signature or GUID and the volume serials, which tell two cards of
+   // the same size apart
+   const unsigned long long stampSectors = qMin(SECTORS_PER_CHUNK, numSectors);
+   QCryptographicHash hash(CheckpointJournal::GetHashAlgorithm());
+   if(!HashSectors(source, 0ull, stampSectors, &hash))
+   {
+      return false;
+   }
+   // Kept in the journal as a JSON number, which holds 53 bits exactly
+   *stamp = qFromLittleEndian<qint64>(hash.result().constData()) & ((1ll << 53) - 1);
+   return true;
+}
+
+bool ImagingJob::HashSectors(HANDLE handle, const unsigned long long startSector, const unsigned long long numSectors,
+                             QCryptographicHash* hash)
+{
+   char* data = ReadSectors(handle, startSector, numSectors, SectorSize);
+   if(data == nullptr)
+   {
+      return false;
+   }
+   hash->addData(QByteArrayView(data, numSectors * SectorSize));
+   delete[] data;
+   return true;
+}
+
+char* ImagingJob::ReadChunk(HANDLE source, const unsigned long long startSector, const unsigned long long numSectors)
+{
+   TraceScope trace("readChunk", "io", JobId, startSector * SectorSize, numSectors * SectorSize);
+   QElapsedTimer streamTime;
+   streamTime.start();
+   auto recordStreamTime = qScopeGuard([&]() {
+      if((source == FileHandle) && (Restore || UsePrefetcher))
+      {
+         Stats->AddBusyTime(JobStats::Stage::StreamRead, streamTime.nsecsElapsed());
+      }
+   });
+
+   if((source == FileHandle) && Restore)
+   {
+      const qint64 numBytes = numSectors * SectorSize;
+      char* data = new char[numBytes];
+      if(!Restore->Read(startSector * SectorSize, data, numBytes))
+      {
+         delete[] data;
+         return nullptr;
+      }
+      return data;
+   }
+
+   if((source != FileHandle) || !UsePrefetcher)
+   {
+      char* data = ReadWithRetry(source, startSector, numSectors);
+      if((data != nullptr) && (source == RawDiskHandle))
+      {
+         ApplyReplacedSectors(data, startSector, numSectors);
+      }
+      return data;
+   }
+
+   // The prefetcher is a sequential stream, which matches how CopySectors walks the image
+   const qint64 numBytes = numSectors * SectorSize;
+   char* data = new char[numBytes];
+   const qint64 bytesRead = Options.Prefetcher->Read(data, numBytes);
+   // Only the image's own final partial sector may come up short; anything
+   // else means the prefetcher stopped or the file shrank or was replaced
+   const qint64 offset = startSector * SectorSize;
+   const qint64 expectedBytes = qBound<qint64>(0, PrefetchImageBytes - offset, numBytes);
+   if(bytesRead < expectedBytes)
+   {
+      delete[] data;
+      return nullptr;
+   }
+   if(bytesRead < numBytes)
+   {
+      memset(data + bytesRead, 0, numBytes - bytesRead);
+   }
+   return data;
+}
+
+void ImagingJob::ApplyReplacedSectors(char* data, const unsigned long long startSector,
+                                      const unsigned long long numSectors)
+{
+   for(auto it = ReplacedSectors.cbegin(); it != ReplacedSectors.cend(); ++it)
+   {
+      const unsigned long long first = it.key();
+      const unsigned long long from = qMax(first, startSector);
+      const unsigned long long to = qMin(first + it.value().size() / SectorSize, startSector + numSectors);
+      if(from < to)
+      {
+         memcpy(data + (from - startSector) * SectorSize, it.value().constData() + (from - first) * SectorSize,
+                (to - from) * SectorSize);
+      }
+   }
+}
+
+QByteArray ImagingJob::ReadBytes(HANDLE source, const qint64 offset, const qint64 numBytes)
+{
+   // Devices can only be read in whole sectors
+   const unsigned long long firstSector = offset / SectorSize;
+   const unsigned long long endSector = (offset + numBytes + SectorSize - 1) / SectorSize;
+   char* data = ReadChunk(source, firstSector, endSector - firstSector);
+   if(data == nullptr)
+   {
+      return QByteArray();
+   }
+   const QByteArray bytes(data + (offset - firstSector * SectorSize), numBytes);
+   delete[] data;
+   return bytes;
+}
+
+bool ImagingJob::ReadPartitionTable(HANDLE source, const unsigned long long numSectors, PartitionTable* table)
+{
+   return table->Read([this, source](const unsigned long long startSector, const unsigned long long sectors) {
+      return ReadBytes(source, startSector * SectorSize, sectors * SectorSize);
+   }, SectorSize, numSectors);
+}
+
+void ImagingJob::HashReadChunk(char* data, const unsigned long long startSector, const unsigned long long numSectors)
+{
+   const qint64 numBytes = numSectors * SectorSize;
+   if((Options.Type != JobType::Read) || !Options.TrimTrailingZeros)
+   {
+      HashChunk(data, numBytes);
+      return;
+   }
+
+   // Zeros are only hashed once data follows them, so the hash matches the
+   // image after it has been cut after its last non-zero sector
+   const qint64 lastByte = FindLastNonZeroByte(data, numBytes);
+   if(lastByte < 0)
+   {
+      PendingZeroBytes += numBytes;
+      HashChunk(data, numBytes, 0);
+      return;
+   }
+
+   const unsigned long long dataSectors = lastByte / SectorSize + 1ull;
+   DataEndSector = startSector + dataSectors;
+   while(Hash && (PendingZeroBytes > 0))
+   {
+      const qint64 zeroBytes = qMin(PendingZeroBytes, (qint64)(SECTORS_PER_CHUNK * SectorSize));
+      AcquireBuffer(zeroBytes);
+      HashChunk(new char[zeroBytes](), zeroBytes);
+      PendingZeroBytes -= zeroBytes;
+   }
+   PendingZeroBytes = (numSectors - dataSectors) * SectorSize;
+   HashChunk(data, numBytes, dataSectors * SectorSize);
+}
+
+void ImagingJob::HashChunk(char* data, const unsigned long long numBytes, const qint64 hashedBytes)
+{
+   if(!Hash || (hashedBytes == 0))
+   {
+      delete[] data;
+      Scheduler->ReleaseBuffer(numBytes);
+      return;
+   }
+
+   // Chunks must be hashed in order, so at most one chunk is in flight on the
+   // CPU pool while the I/O thread moves on to the next one.
+   PendingHash.waitForFinished();
+   QCryptographicHash* hash = Hash.data();
+   JobScheduler* scheduler = Scheduler;
+   const qint64 bytesToHash = (hashedBytes < 0) ? (qint64)numBytes : hashedBytes;
+   JobStats* stats = Stats.data();
+   const int jobId = JobId;
+   PendingHash = QtConcurrent::run(Scheduler->GetCpuPool(), [hash, scheduler, stats, jobId, data, numBytes, bytesToHash]() {
+      TraceScope trace("hash", "cpu", jobId, -1, bytesToHash);
+      QElapsedTimer hashTime;
+      hashTime.start();
+      hash->addData(QByteArrayView(data, bytesToHash));
+      stats->AddBusyTime(JobStats::Stage::Hash, hashTime.nsecsElapsed());
+      delete[] data;
+      scheduler->ReleaseBuffer(numBytes);
+   });
+}
+
+void ImagingJob::FinishHashing()
+{
+   PendingHash.waitForFinished();
+}
+
+bool ImagingJob::Fail(const JobError error)
+{
+   // Covers failures outside ReadSectors and WriteSectors, such as opening the device
+   RecordDiskError();
+   LastError = error;
+   emit Failed(JobId, error);
+   return false;
+}
+
+void ImagingJob::SetStatus(const Status status)
+{
+   if(status != OperationStatus.exchange(status))
+   {
+      emit StatusChanged(JobId, status);
+   }
+}
+
+void ImagingJob::ReportProgress(const unsigned long long sectorsDone, const unsigned long long totalSectors)
+{
+   // Called once per chunk, so this stays a few plain stores; readers only need
+   // each value to be whole, not the three to be consistent with each other
+   ProgressSectors.store(sectorsDone, std::memory_order_relaxed);
+   ProgressTotal.store(totalSectors, std::memory_order_relaxed);
+   ProgressSectorSize.store(SectorSize, std::memory_order_relaxed);
+}
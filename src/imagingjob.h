@@ -0,0 +1,300 @@
+#pragma once
+
+#include "common.h"
+#include "imageprefetcher.h"
+#include "checkpointjournal.h"
+#include "rescuemap.h"
+#include "chunkmanifest.h"
+#include "backupreader.h"
+#include "partitiontable.h"
+#include "filesystemscanner.h"
+#include "bmapfile.h"
+#include "zeroscan.h"
+#include "diskerror.h"
+#include "jobstats.h"
+#include "metrics.h"
+#include "retryrunner.h"
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QCryptographicHash>
+#include <QFuture>
+#include <QScopedPointer>
+#include <QElapsedTimer>
+#include <QVariant>
+#include <QMutex>
+#include <QHash>
+#include <QMap>
+#include <QSharedPointer>
+#include <atomic>
+#include <windows.h>
+
+class JobScheduler;
+
+// What the scheduler's watchdog does about a single read or write that takes too long
+struct StallPolicy
+{
+   enum class Action : int
+   {
+      // Only report the stall; the request keeps waiting
+      Report = 0,
+      // Abort the request, so the retry policy can have another go at it
+      Retry,
+      // Abort the request and cancel the job
+      Cancel
+   };
+
+   // 0 disables the watchdog for the job
+   int TimeoutMs = 30000;
+   Action OnStall = Action::Report;
+};
+
+struct JobOptions
+{
+   JobType Type = JobType::Read;
+   char DriveLetter = ' ';
+   QString ImageFilePath;
+   bool ReadOnlyPartitions = false;
+   // Write only: truncate an image that is larger than the device instead of failing
+   bool TruncateToDevice = false;
+   // Write only: read the device first and only write the chunks that differ from the image
+   bool DifferentialWrite = false;
+   // Write only: the device holds this image (or the image described by this
+   // .manifest file), so only the chunks the new image changes are written
+   QString BaseImagePath;
+   // Write only: only write the partition tables, anything in front of the first
+   // partition (boot loaders) and the partitions, not the gaps between them
+   bool WritePartitionsOnly = false;
+   // Delta write only: hash a few chunks of the device against the base first
+   bool SpotCheckBase = false;
+   // Read only: an earlier backup of the device (or its .manifest file); only
+   // chunks changed since then are stored, plus a manifest referring to it
+   QString IncrementalBase;
+   // Read only: skip the free space of FAT, exFAT and ext filesystems in the
+   // partitions; it becomes holes in a sparse image and a .bmap is saved with it
+   bool SkipFreeBlocks = false;
+   // Read only: cut the image after its last non-zero sector; reading also
+   // stops at the end of the partitions, as with ReadOnlyPartitions
+   bool TrimTrailingZeros = false;
+   // QCryptographicHash::Algorithm, or -1 to skip hashing
+   int HashAlgorithm = -1;
+   // Write only: if set, image data is taken from this stream instead of the file
+   QSharedPointer<ImagePrefetcher> Prefetcher;
+   // Clone only: the source is DriveLetter, or ImageFilePath when DriveLetter is ' '.
+   // Each target is either a drive letter ("E" or "E:") or a plain file path.
+   QStringList CloneTargets;
+   // Clone only: read every target back and compare it against the source hash
+   bool VerifyClone = false;
+   // Read and write: keep a checkpoint journal next to the image, and continue
+   // from it if one is left over from an interrupted run
+   bool Resumable = false;
+   RetryPolicy Retry;
+   StallPolicy Stall;
+   // Also sample throughput and queue depths every 100 ms (GetStats)
+   bool CollectStats = false;
+};
+
+// One read, write, verify, clone or rescue operation against one device. Every
+// job owns its handles, status and cancellation flag, so several jobs can run
+// at once on the scheduler's I/O threads.
+class ImagingJob : public QObject
+{
+   Q_OBJECT
+
+public:
+   ImagingJob(const int jobId, const JobOptions& options, JobScheduler* scheduler);
+   ~ImagingJob();
+
+   int GetId() const;
+   const JobOptions& GetOptions() const;
+   QStringList GetDeviceKeys() const;
+   Status GetStatus() const;
+   JobError GetLastError() const;
+
+   void Cancel();
+   bool IsCancelled() const;
+
+   // Progress of the current phase; safe to call from any thread at any rate,
+   // which is how front ends poll it instead of being signalled per chunk
+   void GetProgress(unsigned long long* sectorsDone, unsigned long long* totalSectors,
+                    unsigned long long* sectorSize) const;
+
+   // Called periodically by the scheduler's watchdog, from another thread
+   void CheckForStall();
+   bool IsStalled() const;
+
+   // Called every 100 ms by the scheduler, from another thread, if stats are collected
+   void SampleStats();
+   // Latencies and stage times are always kept; samples only with JobOptions::CollectStats
+   const JobStats* GetStats() const;
+
+   // Blocks until the operation is finished; called on an I/O thread.
+   void Run();
+
+   static bool IsDriveName(const QString& name);
+
+signals:
+   void StatusChanged(const int jobId, const Status newStatus);
+   void Started(const int jobId, const unsigned long long totalSectors);
+   void Failed(const int jobId, const JobError error);
+   void NotEnoughSpaceOnVolume(const int jobId, const unsigned long long required,
+                               const unsigned long long availableSectors,
+                               const unsigned long long sectorSize, const bool dataFound);
+   void GeneratedHash(const int jobId, const QString hashString);
+   // Job-type specific results that belong in the job's summary, e.g. rescue statistics
+   void SummaryReported(const int jobId, const QString key, const QVariant value);
+   void Stalled(const int jobId, const qint64 offset, const qint64 ageMs);
+   void Finished(const int jobId, const bool succeeded, const bool cancelled);
+
+private:
+   struct Endpoint
+   {
+      QString Name;
+      HANDLE VolumeHandle = INVALID_HANDLE_VALUE;
+      HANDLE Handle = INVALID_HANDLE_VALUE;
+      bool VolumeLocked = false;
+      unsigned long long SectorSize = 0ull;
+      unsigned long long NumSectors = 0ull;
+   };
+
+   struct InFlightRequest
+   {
+      HANDLE Thread = nullptr;
+      QElapsedTimer Age;
+      qint64 Offset = 0;
+      bool Stalled = false;
+   };
+
+   bool DoRead();
+   bool DoWrite();
+   bool DoVerify();
+   bool DoClone();
+   bool VerifyCloneTargets(const unsigned long long numSectors, const QByteArray& expectedHash);
+   bool LimitToPartitions(unsigned long long* numSectors);
+   unsigned long long GetImageEndSector(const unsigned long long numSectors) const;
+   bool SetImageSize(const unsigned long long numSectors);
+   bool LoadIncrementalBase(ChunkManifest* base, QString* baseImagePath);
+   bool ReadIncremental(const unsigned long long numSectors, const ChunkManifest& base,
+                        const QString& baseImagePath);
+   // Where an incremental read saves its manifest until the job has succeeded
+   QString GetPendingManifestPath() const;
+   bool ReadUsedBlocks(const unsigned long long numSectors);
+   bool WriteDelta(const unsigned long long numSectors);
+   bool WritePartitionExtents(const unsigned long long numSectors);
+   bool SpotCheckBase(const ChunkManifest& base);
+   bool DoRescue();
+   bool RescueCopyPass(RescueMap* map, const bool skipProblemAreas);
+   bool RescueTrimPass(RescueMap* map);
+   bool RescueReadBlock(const qint64 pos, const qint64 size);
+   void RescueCheckpoint(RescueMap* map, const qint64 pos, const int pass);
+
+   char* ReadWithRetry(HANDLE source, const unsigned long long startSector, const unsigned long long numSectors);
+   bool WriteWithRetry(HANDLE destination, char* data, const unsigned long long startSector,
+                       const unsigned long long numSectors);
+   bool RunWithRetries(const unsigned long long startSector, const unsigned long long numSectors,
+                       const RetryRunner::Transfer& transfer);
+   bool WaitBeforeRetry(const int attempt, const unsigned long long startSector);
+   void ReportMetrics();
+
+   // Every device and file transfer goes through these, so the watchdog can see it
+   char* ReadSectors(HANDLE handle, const unsigned long long startSector, const unsigned long long numSectors,
+                     const unsigned long long sectorSize, const bool reportErrors = true);
+   bool WriteSectors(HANDLE handle, char* data, const unsigned long long startSector,
+                     const unsigned long long numSectors, const unsigned long long sectorSize,
+                     const bool reportErrors = true);
+   void BeginRequest(const qint64 offset);
+   void EndRequest();
+   // Waits for the scheduler's memory budget; the time counts as the job's buffer wait
+   void AcquireBuffer(const qint64 bytes);
+   void FlushHandle(HANDLE handle);
+   void RegisterMetrics(HANDLE handle, const QString& device);
+   DeviceMetrics* MetricsFor(HANDLE handle) const;
+   // Keeps this thread's last disk error for the job's summary
+   void RecordDiskError();
+
+   bool OpenHandles(const DWORD deviceAccess, const DWORD fileAccess);
+   bool OpenRestoreStream();
+   unsigned long long GetImageSizeInSectors();
+   void CloseHandles();
+   bool OpenEndpoint(const QString& name, const DWORD access, Endpoint* endpoint);
+   void CloseEndpoint(Endpoint* endpoint);
+   bool CopySectors(HANDLE source, HANDLE destination, const unsigned long long numSectors);
+   bool PrepareJournal(HANDLE source, HANDLE destination, const unsigned long long numSectors,
+                       unsigned long long* startSector);
+   // Tells the medium being read apart from another of the same size
+   bool GetMediumStamp(HANDLE source, const unsigned long long numSectors, qint64* stamp);
+   bool HashSectors(HANDLE handle, const unsigned long long startSector, const unsigned long long numSectors,
+                    QCryptographicHash* hash);
+   char* ReadChunk(HANDLE source, const unsigned long long startSector, const unsigned long long numSectors);
+   void ApplyReplacedSectors(char* data, const unsigned long long startSector, const unsigned long long numSectors);
+   QByteArray ReadBytes(HANDLE source, const qint64 offset, const qint64 numBytes);
+   bool ReadPartitionTable(HANDLE source, const unsigned long long numSectors, PartitionTable* table);
+   // Both take ownership of data; HashChunk hashes the first hashedBytes of it (-1 for all)
+   void HashReadChunk(char* data, const unsigned long long startSector, const unsigned long long numSectors);
+   void HashChunk(char* data, const unsigned long long numBytes, const qint64 hashedBytes = -1);
+   void FinishHashing();
+   bool Fail(const JobError error);
+   void SetStatus(const Status status);
+   void ReportProgress(const unsigned long long sectorsDone, const unsigned long long totalSectors);
+
+   const int JobId;
+   const JobOptions Options;
+   JobScheduler* Scheduler;
+
+   std::atomic<Status> OperationStatus;
+   std::atomic<bool> Cancelled;
+   JobError LastError;
+   std::atomic<unsigned long long> ProgressSectors;
+   std::atomic<unsigned long long> ProgressTotal;
+   std::atomic<unsigned long long> ProgressSectorSize;
+
+   HANDLE VolumeHandle;
+   HANDLE FileHandle;
+   HANDLE RawDiskHandle;
+   bool VolumeLocked;
+   unsigned long long SectorSize;
+   // Clone only: the source followed by every target
+   QList<Endpoint> CloneEndpoints;
+   // Device counters of every open handle; only added to before I/O on the handle starts
+   QList<QPair<HANDLE, DeviceMetrics*>> HandleMetrics;
+   QScopedPointer<CheckpointJournal> Journal;
+   bool UsePrefetcher;
+   // Size of the image when the prefetched copy started; the stream must deliver all of it
+   qint64 PrefetchImageBytes;
+   // Read only: image contents that differ from the device, by first sector
+   // (the GPT of an image cut down to its partitions)
+   QMap<unsigned long long, QByteArray> ReplacedSectors;
+   // Read with trimming: end of the data read so far, and the zeros after it not hashed yet
+   unsigned long long DataEndSector;
+   qint64 PendingZeroBytes;
+   // Write and verify of an incremental backup: the reconstructed full image
+   QScopedPointer<BackupReader> Restore;
+   // Differential write only: a second read handle on the device, for reading ahead
+   HANDLE CompareHandle;
+   unsigned long long ChunksSkipped;
+   unsigned long long ChunksWritten;
+   // Rescue only: when the map was last written to disk
+   QElapsedTimer RescueSaveTimer;
+
+   // Retry metrics; clone targets are written from several threads at once
+   QMutex RetryLock;
+   int RetryCount;
+   int FallbackCount;
+   QList<qint64> RetryOffsets;
+   // Last failed disk call of any of the job's threads; guarded by RetryLock as well
+   DiskError LastDiskError;
+
+   // Requests in flight by thread id, plus stall metrics
+   QMutex InFlightLock;
+   QHash<DWORD, InFlightRequest> InFlightRequests;
+   std::atomic<int> StalledRequests;
+   int StallCount;
+   QList<qint64> StallOffsets;
+
+   int HashAlgorithm;
+   QScopedPointer<QCryptographicHash> Hash;
+   QFuture<void> PendingHash;
+
+   QScopedPointer<JobStats> Stats;
+};
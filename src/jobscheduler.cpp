@@ -0,0 +1,380 @@
+#include "jobscheduler.h"
+#include "tracer.h"
+#include <QMutexLocker>
+#include <QDeadlineTimer>
+
+namespace {
+// The memory budget is tracked in 64 KiB units so that QSemaphore's int
+// counter comfortably covers multi-gigabyte budgets.
+const qint64 BUDGET_UNIT_BYTES = 64 * 1024;
+const qint64 DEFAULT_MEMORY_BUDGET = 256ll * 1024 * 1024;
+const int DEFAULT_MAX_CONCURRENT_IO = 8;
+const int STALL_CHECK_INTERVAL_MS = 500;
+const int STATS_SAMPLE_INTERVAL_MS = 100;
+}
+
+JobScheduler::JobScheduler(QObject* parent)
+   : QObject(parent)
+   , Lock()
+   , Jobs()
+   , PendingJobs()
+   , BusyDevices()
+   , NextJobId(1)
+   , RunningJobs(0)
+   , MaxConcurrentIO(DEFAULT_MAX_CONCURRENT_IO)
+   , MemoryBudgetUnits(DEFAULT_MEMORY_BUDGET / BUDGET_UNIT_BYTES)
+   , PrefetchUnits(0)
+   , IoPool()
+   , CpuPool()
+   , MemoryBudget(DEFAULT_MEMORY_BUDGET / BUDGET_UNIT_BYTES)
+   , StallWatchdog(this)
+   , StatsSampler(this)
+{
+   // Pool threads take these names, which is what the trace shows them as
+   IoPool.setObjectName("I/O");
+   CpuPool.setObjectName("CPU");
+   IoPool.setMaxThreadCount(MaxConcurrentIO);
+   CpuPool.setMaxThreadCount(QThread::idealThreadCount());
+
+   // Started with the first job: the scheduler may be built before the
+   // application, and a timer started without an event dispatcher never fires
+   StallWatchdog.setInterval(STALL_CHECK_INTERVAL_MS);
+   connect(&StallWatchdog, &QTimer::timeout, this, &JobScheduler::CheckForStalls);
+   StatsSampler.setInterval(STATS_SAMPLE_INTERVAL_MS);
+   connect(&StatsSampler, &QTimer::timeout, this, &JobScheduler::SampleStats);
+}
+
+JobScheduler::~JobScheduler()
+{
+   CancelAll();
+   WaitForAll();
+   CpuPool.waitForDone();
+   // Every job is a child of this scheduler, removed jobs waiting for
+   // deleteLater included. They go here rather than in ~QObject, as their
+   // prefetchers still hand memory back to the budget, which has to be alive
+   // for that.
+   qDeleteAll(findChildren<ImagingJob*>(Qt::FindDirectChildrenOnly));
+}
+
+int JobScheduler::Submit(const JobOptions& options)
+{
+   // Submit runs on this scheduler's thread, where the timers have to be started
+   if(!StallWatchdog.isActive())
+   {
+      StallWatchdog.start();
+      StatsSampler.start();
+   }
+
+   int jobId;
+   {
+      QMutexLocker locker(&Lock);
+      jobId = NextJobId++;
+
+      ImagingJob* job = new ImagingJob(jobId, options, this);
+      connect(job, &ImagingJob::Started, this, &JobScheduler::JobStarted, Qt::DirectConnection);
+      connect(job, &ImagingJob::StatusChanged, this, &JobScheduler::JobStatusChanged, Qt::DirectConnection);
+      connect(job, &ImagingJob::Failed, this, &JobScheduler::JobFailed, Qt::DirectConnection);
+      connect(job, &ImagingJob::NotEnoughSpaceOnVolume, this, &JobScheduler::JobNotEnoughSpaceOnVolume, Qt::DirectConnection);
+      connect(job, &ImagingJob::GeneratedHash, this, &JobScheduler::JobGeneratedHash, Qt::DirectConnection);
+      connect(job, &ImagingJob::SummaryReported, this, &JobScheduler::JobSummary, Qt::DirectConnection);
+      connect(job, &ImagingJob::Stalled, this, &JobScheduler::JobStalled, Qt::DirectConnection);
+
+      Jobs[jobId] = job;
+      PendingJobs.append(jobId);
+   }
+
+   emit JobQueued(jobId);
+   Dispatch();
+   return jobId;
+}
+
+bool JobScheduler::Cancel(const int jobId)
+{
+   QMutexLocker locker(&Lock);
+   ImagingJob* job = Jobs.value(jobId, nullptr);
+   if(job == nullptr)
+   {
+      return false;
+   }
+
+   job->Cancel();
+   // A job that never started is finished right away, for listeners on the
+   // job as well as on the scheduler
+   if(PendingJobs.removeOne(jobId))
+   {
+      const bool allFinished = (RunningJobs == 0) && PendingJobs.isEmpty();
+      locker.unlock();
+      emit job->Finished(jobId, false, true);
+      emit JobFinished(jobId, false, true);
+      QueueRemoval(jobId);
+      if(allFinished)
+      {
+         emit AllJobsFinished();
+      }
+   }
+   return true;
+}
+
+void JobScheduler::CancelAll()
+{
+   QList<int> jobIds;
+   {
+      QMutexLocker locker(&Lock);
+      jobIds = Jobs.keys();
+   }
+
+   for(const int jobId : jobIds)
+   {
+      Cancel(jobId);
+   }
+}
+
+bool JobScheduler::WaitForAll(const int msecs)
+{
+   // Jobs unblocked by a finishing job are started from that job's I/O thread
+   // before it returns, so draining the pool drains the queue as well.
+   return IoPool.waitForDone(msecs < 0 ? QDeadlineTimer(QDeadlineTimer::Forever) : QDeadlineTimer(msecs));
+}
+
+ImagingJob* JobScheduler::GetJob(const int jobId) const
+{
+   QMutexLocker locker(&Lock);
+   return Jobs.value(jobId, nullptr);
+}
+
+bool JobScheduler::IsIdle() const
+{
+   QMutexLocker locker(&Lock);
+   return (RunningJobs == 0) && PendingJobs.isEmpty();
+}
+
+bool JobScheduler::SetMaxConcurrentIO(const int maxJobs)
+{
+   if(!IsIdle() || (maxJobs < 1))
+   {
+      return false;
+   }
+
+   MaxConcurrentIO = maxJobs;
+   IoPool.setMaxThreadCount(maxJobs);
+   return true;
+}
+
+bool JobScheduler::SetMemoryBudget(const qint64 bytes)
+{
+   if(!IsIdle() || (bytes < BUDGET_UNIT_BYTES))
+   {
+      return false;
+   }
+
+   const int units = bytes / BUDGET_UNIT_BYTES;
+   QMutexLocker locker(&Lock);
+   // Prefetched data may outlive the jobs, and is released in units of the old budget
+   if(PrefetchUnits > 0)
+   {
+      return false;
+   }
+   if(units > MemoryBudgetUnits)
+   {
+      MemoryBudget.release(units - MemoryBudgetUnits);
+   }
+   // Never wait here for buffers to come back; shrinking only takes units nobody holds
+   else if(!MemoryBudget.tryAcquire(MemoryBudgetUnits - units))
+   {
+      return false;
+   }
+   MemoryBudgetUnits = units;
+   return true;
+}
+
+bool JobScheduler::SetCpuThreadCount(const int threads)
+{
+   if(!IsIdle() || (threads < 1))
+   {
+      return false;
+   }
+
+   CpuPool.setMaxThreadCount(threads);
+   return true;
+}
+
+QThreadPool* JobScheduler::GetCpuPool()
+{
+   return &CpuPool;
+}
+
+void JobScheduler::AcquireBuffer(const qint64 bytes)
+{
+   // Time spent here is a stage waiting for the next one to hand buffers back
+   TraceScope trace("waitBuffer", "wait", 0, -1, bytes);
+   MemoryBudget.acquire(BytesToBudgetUnits(bytes));
+}
+
+void JobScheduler::ReleaseBuffer(const qint64 bytes)
+{
+   MemoryBudget.release(BytesToBudgetUnits(bytes));
+}
+
+bool JobScheduler::TryAcquirePrefetch(const qint64 bytes)
+{
+   const int units = BytesToBudgetUnits(bytes);
+   QMutexLocker locker(&Lock);
+   if((PrefetchUnits + units > MemoryBudgetUnits / 2) || !MemoryBudget.tryAcquire(units))
+   {
+      return false;
+   }
+   PrefetchUnits += units;
+   return true;
+}
+
+void JobScheduler::ReleasePrefetch(const qint64 bytes)
+{
+   const int units = BytesToBudgetUnits(bytes);
+   QMutexLocker locker(&Lock);
+   PrefetchUnits -= units;
+   MemoryBudget.release(units);
+}
+
+qint64 JobScheduler::GetBufferBytesInUse() const
+{
+   return (qint64)(MemoryBudgetUnits - MemoryBudget.available()) * BUDGET_UNIT_BYTES;
+}
+
+void JobScheduler::GetQueueDepths(int* pendingJobs, int* runningJobs, int* requestsInFlight) const
+{
+   QMutexLocker locker(&Lock);
+   *pendingJobs = PendingJobs.size();
+   *runningJobs = RunningJobs;
+   *requestsInFlight = 0;
+   for(const ImagingJob* job : Jobs)
+   {
+      *requestsInFlight += job->GetStats()->GetRequestsInFlight();
+   }
+}
+
+int JobScheduler::BytesToBudgetUnits(const qint64 bytes) const
+{
+   const qint64 units = (bytes + BUDGET_UNIT_BYTES - 1) / BUDGET_UNIT_BYTES;
+   // A single request larger than what prefetching leaves over would never be granted
+   const int maxUnits = MemoryBudgetUnits - MemoryBudgetUnits / 2;
+   return (units > maxUnits) ? maxUnits : (int)units;
+}
+
+void JobScheduler::QueueRemoval(const int jobId)
+{
+   // Listeners on this thread get JobFinished queued ahead of this, so they
+   // can still look the job up while they handle it
+   QMetaObject::invokeMethod(this, [this, jobId]() {
+      ImagingJob* job;
+      {
+         QMutexLocker locker(&Lock);
+         job = Jobs.take(jobId);
+      }
+      if(job != nullptr)
+      {
+         job->deleteLater();
+      }
+   }, Qt::QueuedConnection);
+}
+
+void JobScheduler::CheckForStalls()
+{
+   // Jobs are only removed on this thread, so checking them outside the lock is safe
+   QList<ImagingJob*> jobs;
+   {
+      QMutexLocker locker(&Lock);
+      if(RunningJobs == 0)
+      {
+         return;
+      }
+      jobs = Jobs.values();
+   }
+
+   for(ImagingJob* job : jobs)
+   {
+      job->CheckForStall();
+   }
+}
+
+void JobScheduler::SampleStats()
+{
+   QList<ImagingJob*> jobs;
+   {
+      QMutexLocker locker(&Lock);
+      if(RunningJobs == 0)
+      {
+         return;
+      }
+      jobs = Jobs.values();
+   }
+
+   // Jobs that are not running ignore the sample
+   for(ImagingJob* job : jobs)
+   {
+      job->SampleStats();
+   }
+}
+
+void JobScheduler::Dispatch()
+{
+   QList<ImagingJob*> toStart;
+   {
+      QMutexLocker locker(&Lock);
+      for(auto iter = PendingJobs.begin(); (iter != PendingJobs.end()) && (RunningJobs < MaxConcurrentIO);)
+      {
+         ImagingJob* job = Jobs.value(*iter);
+         const QStringList devices = job->GetDeviceKeys();
+         bool deviceBusy = false;
+         for(const QString& device : devices)
+         {
+            deviceBusy = deviceBusy || BusyDevices.contains(device);
+         }
+         if(deviceBusy)
+         {
+            ++iter;
+            continue;
+         }
+
+         for(const QString& device : devices)
+         {
+            BusyDevices.insert(device);
+         }
+         ++RunningJobs;
+         toStart.append(job);
+         iter = PendingJobs.erase(iter);
+      }
+   }
+
+   for(ImagingJob* job : toStart)
+   {
+      IoPool.start([this, job]() { RunJob(job); });
+   }
+}
+
+void JobScheduler::RunJob(ImagingJob* job)
+{
+   job->Run();
+
+   const int jobId = job->GetId();
+   const bool cancelled = job->IsCancelled();
+   const bool succeeded = !cancelled && (job->GetLastError() == JobError::None);
+   bool allFinished;
+   {
+      QMutexLocker locker(&Lock);
+      for(const QString& device : job->GetDeviceKeys())
+      {
+         BusyDevices.remove(device);
+      }
+      --RunningJobs;
+      allFinished = (RunningJobs == 0) && PendingJobs.isEmpty();
+   }
+
+   emit JobFinished(jobId, succeeded, cancelled);
+   QueueRemoval(jobId);
+   Dispatch();
+
+   if(allFinished)
+   {
+      emit AllJobsFinished();
+   }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "common.h"
+#include "imagingjob.h"
+#include <QObject>
+#include <QMap>
+#include <QList>
+#include <QSet>
+#include <QMutex>
+#include <QSemaphore>
+#include <QThreadPool>
+#include <QTimer>
+
+// Runs independent imaging jobs concurrently, never two on the same device.
+// I/O jobs each get a thread from the I/O pool, while hashing work from all
+// jobs shares one CPU pool. A memory budget caps the chunk buffers that may be
+// in flight across every running job. A watchdog timer checks running jobs
+// for reads and writes that have stalled, and another one samples the stats of
+// jobs that collect them.
+class JobScheduler : public QObject
+{
+   Q_OBJECT
+
+public:
+   explicit JobScheduler(QObject* parent = nullptr);
+   ~JobScheduler();
+
+   int Submit(const JobOptions& options);
+   bool Cancel(const int jobId);
+   void CancelAll();
+   bool WaitForAll(const int msecs = -1);
+
+   // Null once the job has finished and its JobFinished has been handled
+   ImagingJob* GetJob(const int jobId) const;
+   bool IsIdle() const;
+
+   // Changing limits is only allowed while no jobs are running. The memory
+   // budget also stays as it is while any of it is held
+   bool SetMaxConcurrentIO(const int maxJobs);
+   bool SetMemoryBudget(const qint64 bytes);
+   bool SetCpuThreadCount(const int threads);
+
+   QThreadPool* GetCpuPool();
+   void AcquireBuffer(const qint64 bytes);
+   void ReleaseBuffer(const qint64 bytes);
+   // Prefetched image data counts against the same budget, but never blocks
+   // and never holds more than half of it, so an idle prefetch for a later
+   // job cannot starve the running ones
+   bool TryAcquirePrefetch(const qint64 bytes);
+   void ReleasePrefetch(const qint64 bytes);
+   // Chunk buffers currently held across all jobs, in whole budget units
+   qint64 GetBufferBytesInUse() const;
+   void GetQueueDepths(int* pendingJobs, int* runningJobs, int* requestsInFlight) const;
+
+signals:
+   void JobQueued(const int jobId);
+   void JobStarted(const int jobId, const unsigned long long totalSectors);
+   void JobStatusChanged(const int jobId, const Status newStatus);
+   void JobFailed(const int jobId, const JobError error);
+   void JobNotEnoughSpaceOnVolume(const int jobId, const unsigned long long required,
+                                  const unsigned long long availableSectors,
+                                  const unsigned long long sectorSize, const bool dataFound);
+   void JobGeneratedHash(const int jobId, const QString hashString);
+   void JobSummary(const int jobId, const QString key, const QVariant value);
+   void JobStalled(const int jobId, const qint64 offset, const qint64 ageMs);
+   void JobFinished(const int jobId, const bool succeeded, const bool cancelled);
+   void AllJobsFinished();
+
+private slots:
+   void CheckForStalls();
+   void SampleStats();
+
+private:
+   void Dispatch();
+   void RunJob(ImagingJob* job);
+   // Finished jobs are dropped once JobFinished has been handled, so a
+   // long-running scheduler does not keep every job it ever ran
+   void QueueRemoval(const int jobId);
+   int BytesToBudgetUnits(const qint64 bytes) const;
+
+   mutable QMutex Lock;
+   QMap<int, ImagingJob*> Jobs;
+   QList<int> PendingJobs;
+   QSet<QString> BusyDevices;
+   int NextJobId;
+   int RunningJobs;
+   int MaxConcurrentIO;
+   int MemoryBudgetUnits;
+   int PrefetchUnits;
+
+   QThreadPool IoPool;
+   QThreadPool CpuPool;
+   QSemaphore MemoryBudget;
+   QTimer StallWatchdog;
+   QTimer StatsSampler;
+};
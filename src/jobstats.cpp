@@ -0,0 +1,355 @@
+#include "jobstats.h"
+#include <QJsonArray>
+#include <QMutexLocker>
+#include <limits>
+
+namespace {
+const qint64 NANOS_PER_MICRO = 1000;
+const double NANOS_PER_SECOND = 1e9;
+// A stage busy for less of the wall time than this doesn't explain the job's speed on its own
+const double BOUND_UTILISATION = 0.5;
+}
+
+LatencyHistogram::LatencyHistogram()
+   : Count(0ull)
+   , SumMicros(0ull)
+   , MinMicros(std::numeric_limits<qint64>::max())
+   , MaxMicros(0)
+{
+   for(std::atomic<quint64>& count : Counts)
+   {
+      count.store(0ull, std::memory_order_relaxed);
+   }
+}
+
+int LatencyHistogram::BucketIndex(const qint64 micros)
+{
+   if(micros < SUB_BUCKETS)
+   {
+      return (micros < 0) ? 0 : (int)micros;
+   }
+
+   // Magnitude m >= 4; the 4 bits below the top one pick the sub-bucket
+   const int magnitude = 63 - qCountLeadingZeroBits((quint64)micros);
+   const int index = (magnitude - 3) * SUB_BUCKETS + (int)((micros >> (magnitude - 4)) - SUB_BUCKETS);
+   return qMin(index, BUCKET_COUNT - 1);
+}
+
+qint64 LatencyHistogram::BucketLowerBound(const int index)
+{
+   if(index < 2 * SUB_BUCKETS)
+   {
+      return index;
+   }
+
+   const int magnitude = index / SUB_BUCKETS + 3;
+   return (qint64)(SUB_BUCKETS + index % SUB_BUCKETS) << (magnitude - 4);
+}
+
+void LatencyHistogram::Record(const qint64 micros)
+{
+   Counts[BucketIndex(micros)].fetch_add(1ull, std::memory_order_relaxed);
+   Count.fetch_add(1ull, std::memory_order_relaxed);
+   SumMicros.fetch_add((quint64)qMax(0ll, micros), std::memory_order_relaxed);
+
+   qint64 current = MinMicros.load(std::memory_order_relaxed);
+   while((micros < current) && !MinMicros.compare_exchange_weak(current, micros, std::memory_order_relaxed))
+   {
+   }
+   current = MaxMicros.load(std::memory_order_relaxed);
+   while((micros > current) && !MaxMicros.compare_exchange_weak(current, micros, std::memory_order_relaxed))
+   {
+   }
+}
+
+quint64 LatencyHistogram::GetCount() const
+{
+   return Count.load(std::memory_order_relaxed);
+}
+
+quint64 LatencyHistogram::GetSumMicros() const
+{
+   return SumMicros.load(std::memory_order_relaxed);
+}
+
+qint64 LatencyHistogram::GetPercentile(const double fraction) const
+{
+   const quint64 total = GetCount();
+   if(total == 0ull)
+   {
+      return 0;
+   }
+
+   const quint64 rank = qMax(1ull, (quint64)(fraction * total + 0.5));
+   quint64 seen = 0ull;
+   for(int i = 0; i < BUCKET_COUNT; i++)
+   {
+      seen += Counts[i].load(std::memory_order_relaxed);
+      if(seen >= rank)
+      {
+         // Never report more than was actually seen
+         return qMin(BucketLowerBound(i + 1) - 1, MaxMicros.load(std::memory_order_relaxed));
+      }
+   }
+   return MaxMicros.load(std::memory_order_relaxed);
+}
+
+QJsonObject LatencyHistogram::ToJson() const
+{
+   const quint64 count = GetCount();
+   QJsonObject object;
+   object["count"] = (qint64)count;
+   if(count == 0ull)
+   {
+      return object;
+   }
+
+   object["minUs"] = MinMicros.load(std::memory_order_relaxed);
+   object["meanUs"] = (double)SumMicros.load(std::memory_order_relaxed) / count;
+   object["p50Us"] = GetPercentile(0.5);
+   object["p90Us"] = GetPercentile(0.9);
+   object["p99Us"] = GetPercentile(0.99);
+   object["p999Us"] = GetPercentile(0.999);
+   object["maxUs"] = MaxMicros.load(std::memory_order_relaxed);
+
+   // Only the buckets that were hit, as [upper bound in us, count] pairs
+   QJsonArray buckets;
+   for(int i = 0; i < BUCKET_COUNT; i++)
+   {
+      const quint64 bucketCount = Counts[i].load(std::memory_order_relaxed);
+      if(bucketCount > 0ull)
+      {
+         buckets.append(QJsonArray{BucketLowerBound(i + 1) - 1, (qint64)bucketCount});
+      }
+   }
+   object["buckets"] = buckets;
+   return object;
+}
+
+JobStats::JobStats()
+   : Wall()
+   , Running(false)
+   , WallNanos(0)
+   , ReadLatency()
+   , WriteLatency()
+   , RequestsInFlight(0)
+   , SampleLock()
+   , Samples()
+{
+   for(std::atomic<qint64>& busy : BusyNanos)
+   {
+      busy.store(0, std::memory_order_relaxed);
+   }
+}
+
+void JobStats::Start()
+{
+   Wall.start();
+   Running.store(true, std::memory_order_release);
+}
+
+void JobStats::Finish()
+{
+   WallNanos = Wall.nsecsElapsed();
+   Running.store(false, std::memory_order_release);
+}
+
+bool JobStats::IsRunning() const
+{
+   return Running.load(std::memory_order_acquire);
+}
+
+qint64 JobStats::GetWallNanos() const
+{
+   return WallNanos;
+}
+
+void JobStats::RecordRead(const qint64 nanos, const Stage stage)
+{
+   ReadLatency.Record(nanos / NANOS_PER_MICRO);
+   AddBusyTime(stage, nanos);
+}
+
+void JobStats::RecordWrite(const qint64 nanos)
+{
+   WriteLatency.Record(nanos / NANOS_PER_MICRO);
+   AddBusyTime(Stage::Write, nanos);
+}
+
+void JobStats::AddBusyTime(const Stage stage, const qint64 nanos)
+{
+   BusyNanos[(int)stage].fetch_add(nanos, std::memory_order_relaxed);
+}
+
+void JobStats::BeginRequest()
+{
+   RequestsInFlight.fetch_add(1, std::memory_order_relaxed);
+}
+
+void JobStats::EndRequest()
+{
+   RequestsInFlight.fetch_sub(1, std::memory_order_relaxed);
+}
+
+int JobStats::GetRequestsInFlight() const
+{
+   return RequestsInFlight.load(std::memory_order_relaxed);
+}
+
+void JobStats::GetRequestTotals(quint64* count, quint64* sumMicros) const
+{
+   *count = ReadLatency.GetCount() + WriteLatency.GetCount();
+   *sumMicros = ReadLatency.GetSumMicros() + WriteLatency.GetSumMicros();
+}
+
+void JobStats::AddSample(const qint64 bytesDone, const qint64 prefetchBytes, const qint64 bufferBytes)
+{
+   if(!IsRunning())
+   {
+      return;
+   }
+
+   const Sample sample = {Wall.elapsed(), bytesDone, RequestsInFlight.load(std::memory_order_relaxed),
+                          prefetchBytes, bufferBytes};
+   QMutexLocker locker(&SampleLock);
+   Samples.append(sample);
+}
+
+QString JobStats::StageName(const Stage stage)
+{
+   switch(stage)
+   {
+   case Stage::Read:
+      return "read";
+   case Stage::Write:
+      return "write";
+   case Stage::VerifyRead:
+      return "verifyRead";
+   case Stage::StreamRead:
+      return "streamRead";
+   case Stage::Hash:
+      return "hash";
+   case Stage::BufferWait:
+      return "bufferWait";
+   case Stage::Count:
+      break;
+   }
+   return "unknown";
+}
+
+QString JobStats::StageDescription(const Stage stage)
+{
+   switch(stage)
+   {
+   case Stage::Read:
+      return "source read";
+   case Stage::Write:
+      return "destination write";
+   case Stage::VerifyRead:
+      return "verify read";
+   case Stage::StreamRead:
+      return "image stream";
+   case Stage::Hash:
+      return "hash";
+   case Stage::BufferWait:
+      return "buffer wait";
+   case Stage::Count:
+      break;
+   }
+   return "unknown";
+}
+
+QVariantMap JobStats::UtilisationPercentages() const
+{
+   QVariantMap percentages;
+   for(int i = 0; i < (int)Stage::Count; i++)
+   {
+      const qint64 busy = BusyNanos[i].load(std::memory_order_relaxed);
+      percentages[StageName((Stage)i)] = (WallNanos > 0) ? qRound(100.0 * busy / WallNanos) : 0;
+   }
+   return percentages;
+}
+
+QString JobStats::Verdict() const
+{
+   if(WallNanos <= 0)
+   {
+      return "not measured";
+   }
+
+   // Waiting for buffers is a symptom of a slow later stage, never the cause
+   Stage busiest = Stage::Read;
+   qint64 busiestNanos = -1;
+   for(int i = 0; i < (int)Stage::Count; i++)
+   {
+      const qint64 busy = BusyNanos[i].load(std::memory_order_relaxed);
+      if(((Stage)i != Stage::BufferWait) && (busy > busiestNanos))
+      {
+         busiest = (Stage)i;
+         busiestNanos = busy;
+      }
+   }
+
+   // Parallel clone targets can add up to more than the wall time
+   const double utilisation = qMin(1.0, (double)busiestNanos / WallNanos);
+   const int percent = qRound(100.0 * utilisation);
+   if(utilisation < BOUND_UTILISATION)
+   {
+      return QString("no single stage bound: busiest is %1 at %2% of wall time")
+         .arg(StageDescription(busiest)).arg(percent);
+   }
+   return QString("%1 bound: %2% of wall time").arg(StageDescription(busiest)).arg(percent);
+}
+
+QJsonObject JobStats::ToJson() const
+{
+   QJsonObject object;
+   object["wallSeconds"] = WallNanos / NANOS_PER_SECOND;
+
+   QJsonObject latency;
+   latency["read"] = ReadLatency.ToJson();
+   latency["write"] = WriteLatency.ToJson();
+   object["latency"] = latency;
+
+   // Stages with several threads (clone targets, read-ahead) can be busy for longer than the job ran
+   QJsonObject stages;
+   for(int i = 0; i < (int)Stage::Count; i++)
+   {
+      const qint64 busy = BusyNanos[i].load(std::memory_order_relaxed);
+      QJsonObject stage;
+      stage["busySeconds"] = busy / NANOS_PER_SECOND;
+      stage["idleSeconds"] = qMax(0ll, WallNanos - busy) / NANOS_PER_SECOND;
+      stage["utilisation"] = (WallNanos > 0) ? (double)busy / WallNanos : 0.0;
+      stages[StageName((Stage)i)] = stage;
+   }
+   object["stages"] = stages;
+
+   // One column per value keeps long jobs readable and compact
+   QJsonArray times, bytes, rates, inFlight, prefetch, buffers;
+   {
+      QMutexLocker locker(&SampleLock);
+      qint64 lastMs = 0;
+      qint64 lastBytes = 0;
+      for(const Sample& sample : Samples)
+      {
+         const qint64 intervalMs = sample.Ms - lastMs;
+         times.append(sample.Ms);
+         bytes.append(sample.Bytes);
+         rates.append((intervalMs > 0) ? (double)(sample.Bytes - lastBytes) * 1000.0 / intervalMs : 0.0);
+         inFlight.append(sample.RequestsInFlight);
+         prefetch.append(sample.PrefetchBytes);
+         buffers.append(sample.BufferBytes);
+         lastMs = sample.Ms;
+         lastBytes = sample.Bytes;
+      }
+   }
+   QJsonObject samples;
+   samples["ms"] = times;
+   samples["bytes"] = bytes;
+   samples["bytesPerSecond"] = rates;
+   samples["requestsInFlight"] = inFlight;
+   samples["prefetchBytes"] = prefetch;
+   samples["bufferBytes"] = buffers;
+   object["samples"] = samples;
+   return object;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QList>
+#include <QVariantMap>
+#include <QMutex>
+#include <QElapsedTimer>
+#include <atomic>
+
+// Latencies in microseconds, bucketed the way an HDR histogram does it: exact
+// below 16 us, then 16 buckets per power of two, so every value is kept to
+// within about 6%. Recording is a handful of relaxed atomic operations and
+// safe from any number of threads.
+class LatencyHistogram
+{
+public:
+   LatencyHistogram();
+
+   void Record(const qint64 micros);
+   quint64 GetCount() const;
+   quint64 GetSumMicros() const;
+   // Upper bound of the bucket that holds the given fraction (0..1) of all values
+   qint64 GetPercentile(const double fraction) const;
+   QJsonObject ToJson() const;
+
+private:
+   static constexpr int SUB_BUCKETS = 16;
+   // Up to 2^40 us, about 12 days
+   static constexpr int BUCKET_COUNT = (40 - 3) * SUB_BUCKETS + SUB_BUCKETS;
+
+   static int BucketIndex(const qint64 micros);
+   static qint64 BucketLowerBound(const int index);
+
+   std::atomic<quint64> Counts[BUCKET_COUNT];
+   std::atomic<quint64> Count;
+   std::atomic<quint64> SumMicros;
+   std::atomic<qint64> MinMicros;
+   std::atomic<qint64> MaxMicros;
+};
+
+// Performance counters of one job: per-request read and write latencies, how
+// long each stage of the pipeline was busy, and, if JobOptions::CollectStats
+// is set, a time series of throughput and queue depths that the scheduler
+// samples every 100 ms while the job runs.
+class JobStats
+{
+public:
+   enum class Stage : int
+   {
+      // Reads and writes through the disk layer, from any of the job's threads
+      Read = 0,
+      Write,
+      // Reads of the device and image while verifying
+      VerifyRead,
+      // Waiting on the prefetcher or the incremental backup reader for image data
+      StreamRead,
+      // Hashing on the CPU pool
+      Hash,
+      // Waiting for a later stage to hand chunk buffers back
+      BufferWait,
+      Count
+   };
+
+   JobStats();
+
+   void Start();
+   void Finish();
+   bool IsRunning() const;
+   // Set by Finish
+   qint64 GetWallNanos() const;
+
+   // A read or write request that took this long; counts as busy time of its stage
+   void RecordRead(const qint64 nanos, const Stage stage = Stage::Read);
+   void RecordWrite(const qint64 nanos);
+   void AddBusyTime(const Stage stage, const qint64 nanos);
+
+   void BeginRequest();
+   void EndRequest();
+   int GetRequestsInFlight() const;
+   // Reads and writes completed so far, and their summed latency
+   void GetRequestTotals(quint64* count, quint64* sumMicros) const;
+
+   // Called by the scheduler's sampler thread only
+   void AddSample(const qint64 bytesDone, const qint64 prefetchBytes, const qint64 bufferBytes);
+
+   // Only meaningful once the job has finished
+   QJsonObject ToJson() const;
+   // Busy time of every stage as a percentage of the wall time
+   QVariantMap UtilisationPercentages() const;
+   // One line naming the stage that limited the job, such as
+   // "write bound: 92% of wall time"
+   QString Verdict() const;
+
+   static QString StageName(const Stage stage);
+   static QString StageDescription(const Stage stage);
+
+private:
+   struct Sample
+   {
+      qint64 Ms;
+      qint64 Bytes;
+      int RequestsInFlight;
+      qint64 PrefetchBytes;
+      qint64 BufferBytes;
+   };
+
+   QElapsedTimer Wall;
+   std::atomic<bool> Running;
+   qint64 WallNanos;
+   LatencyHistogram ReadLatency;
+   LatencyHistogram WriteLatency;
+   std::atomic<qint64> BusyNanos[(int)Stage::Count];
+   std::atomic<int> RequestsInFlight;
+
+   mutable QMutex SampleLock;
+   QList<Sample> Samples;
+};
@@ -24,9 +24,12 @@
 #include "mainwindow.h"
 #include "driveio.h"
 #include "argsmanager.h"
+#include "batchrunner.h"
 
 #include <QApplication>
+#include <QThread>
 #include <cstdlib>
+#include <iostream>
 #include <cxxopts.hpp>
 #include <windows.h>
 #include <winioctl.h>
@@ -46,9 +49,8 @@ QCoreApplication* createApp(const bool headlessMode, int argc, char* argv[])
 int main(int argc, char* argv[])
 {
    ArgsManager args(argc, argv);
-   const bool headlessMode = args.GetArgValue(ArgID::Headless).toBool();
-
-   DriveIO driveIO;
+   const QString jobFile = args.GetArgValue(ArgID::Jobs).toString();
+   const bool headlessMode = args.GetArgValue(ArgID::Headless).toBool() || !jobFile.isEmpty();
 
    QScopedPointer<QCoreApplication> app(createApp(headlessMode, argc, argv));
 
@@ -63,13 +65,82 @@ int main(int argc, char* argv[])
          theApp.get()->installTranslator(&translator);
 
       MainWindow* mainwindow = MainWindow::getInstance();
+
+      // Keep DriveIO, its scheduler and its progress sampling off the GUI thread;
+      // the window only sees queued requests and results going back and forth.
+      // It is deleted on that thread as it finishes, before the thread object goes.
+      QThread driveThread;
+      DriveIO* driveIO = new DriveIO();
+      driveIO->moveToThread(&driveThread);
+      QObject::connect(&driveThread, &QThread::finished, driveIO, &QObject::deleteLater);
+      driveIO->ConnectToUserInterface(mainwindow);
+      driveThread.start();
+      // Fills the device list as drives answer, without holding up the window
+      QMetaObject::invokeMethod(driveIO, &DriveIO::HandleRequestLogicalDrives, Qt::QueuedConnection);
+
       mainwindow->show();
+      const int exitCode = app.get()->exec();
+
+      driveThread.quit();
+      driveThread.wait();
+      return exitCode;
    }
    else
    {
+      BatchRunner runner;
+      QString errorMessage;
+      const bool loaded = jobFile.isEmpty() ?
+                             runner.AddJobFromArgs(args, &errorMessage) :
+                             runner.LoadJobFile(jobFile, &errorMessage);
+      if(!loaded)
+      {
+         std::cerr << errorMessage.toStdString() << std::endl;
+         return 1;
+      }
+      const QString statsOut = args.GetArgValue(ArgID::StatsOut).toString();
+      if(!statsOut.isEmpty())
+      {
+         runner.SetStatsOutPath(statsOut);
+      }
+      const QString traceOut = args.GetArgValue(ArgID::TraceOut).toString();
+      if(!traceOut.isEmpty())
+      {
+         runner.SetTraceOutPath(traceOut);
+      }
+      const QVariant metricsPort = args.GetArgValue(ArgID::MetricsPort);
+      if(!metricsPort.isNull())
+      {
+         bool portValid = false;
+         const int port = metricsPort.toString().toInt(&portValid);
+         portValid = portValid && (port > 0) && (port <= 65535);
+         if(!portValid || !runner.ServeMetrics(port, &errorMessage))
+         {
+            std::cerr << (portValid ? errorMessage : QString("Invalid metrics port.")).toStdString() << std::endl;
+            return 1;
+         }
+      }
+      const QString progress = args.GetArgValue(ArgID::Progress).toString();
+      if(!progress.isEmpty())
+      {
+         bool fdValid = true;
+         const QVariant progressFd = args.GetArgValue(ArgID::ProgressFd);
+         const int fd = progressFd.isNull() ? 1 : progressFd.toString().toInt(&fdValid);
+         if(progress != "jsonl")
+         {
+            std::cerr << "Unknown progress format " << progress.toStdString() << "; only jsonl is supported." << std::endl;
+            return 1;
+         }
+         if(!fdValid || !runner.SetProgressStream(fd, &errorMessage))
+         {
+            std::cerr << (fdValid ? errorMessage : QString("Invalid progress file descriptor.")).toStdString() << std::endl;
+            return 1;
+         }
+      }
 
-      return 0;
+      QObject::connect(&runner, &BatchRunner::Finished, app.get(),
+                       [](const int exitCode) { QCoreApplication::exit(exitCode); },
+                       Qt::QueuedConnection);
+      runner.Start();
+      return app.get()->exec();
    }
-
-   return app.get()->exec();
 }
@@ -39,16 +39,21 @@
 #include "mainwindow.h"
 #include "elapsedtimer.h"
 
+namespace {
+const qint64 ONE_SEC_IN_MS = 1000;
+}
+
 MainWindow* MainWindow::instance = nullptr;
 
 MainWindow::MainWindow(QWidget* parent)
 {
    setParent(parent);
    ui->setupUi(TheWindow.get());
+   throughput_graph = new ThroughputGraph();
+   ui->statusbar->addPermanentWidget(throughput_graph);
    elapsed_timer = new ElapsedTimer();
    ui->statusbar->addPermanentWidget(elapsed_timer);   // "addpermanent" puts it on the RHS of the statusbar
 
-   emit RequestLogicalDrives();
    ui->progressbar->reset();
    clipboard = QApplication::clipboard();
    ui->statusbar->showMessage(tr("Waiting for a task."));
@@ -73,6 +78,12 @@ MainWindow::~MainWindow()
         elapsed_timer = nullptr;
     }
 
+    if (throughput_graph != nullptr)
+    {
+        delete throughput_graph;
+        throughput_graph = nullptr;
+    }
+
     if (ui->cboxHashType != nullptr)
     {
         ui->cboxHashType->clear();
@@ -239,598 +250,83 @@ void MainWindow::HandleleFileEditingFinished()
 
 void MainWindow::HandlebCancelClicked()
 {
-    if ( (status == STATUS_READING) || (status == STATUS_WRITING) )
+    if ( (CurrentStatus == Status::Reading) || (CurrentStatus == Status::Writing) )
     {
         if (QMessageBox::warning(this, tr("Cancel?"), tr("Canceling now will result in a corrupt destination.\n"
                                                          "Are you sure you want to cancel?"),
                                  QMessageBox::Yes|QMessageBox::No, QMessageBox::No) == QMessageBox::Yes)
         {
-            status = STATUS_CANCELED;
+            emit RequestCancel();
         }
     }
-    else if (status == STATUS_VERIFYING)
+    else if (CurrentStatus == Status::Verifying)
     {
         if (QMessageBox::warning(this, tr("Cancel?"), tr("Cancel Verify.\n"
                                                          "Are you sure you want to cancel?"),
                                  QMessageBox::Yes|QMessageBox::No, QMessageBox::No) == QMessageBox::Yes)
         {
-            status = STATUS_CANCELED;
+            emit RequestCancel();
         }
 
     }
 }
 
+// Read, write and verify only hand the request to DriveIO; the transfer runs
+// on the I/O threads and reports back through the Handle* slots below
 void MainWindow::HandlebWriteClicked()
 {
-    bool passfail = true;
     if (!ui->leFile->text().isEmpty())
     {
-        QFileInfo fileinfo(ui->leFile->text());
-        if (fileinfo.exists() && fileinfo.isFile() &&
-            fileinfo.isReadable() && (fileinfo.size() > 0) )
-        {
-            if (ui->leFile->text().at(0) == ui->cboxDevice->currentText().at(1))
-            {
-                QMessageBox::critical(this, tr("Write Error"), tr("Image file cannot be located on the target device."));
-                return;
-            }
-
-            // build the drive letter as a const char *
-            //   (without the surrounding brackets)
-            QString qs = ui->cboxDevice->currentText();
-            qs.replace(QRegularExpression("[\\[\\]]"), "");
-            QByteArray qba = qs.toLocal8Bit();
-            const char *ltr = qba.data();
-            if (QMessageBox::warning(this, tr("Confirm overwrite"), tr("Writing to a physical device can corrupt the device.\n"
-                                                                       "(Target Device: %1 \"%2\")\n"
-                                                                       "Are you sure you want to continue?").arg(ui->cboxDevice->currentText()).arg(getDriveLabel(ltr)),
-                                     QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::No)
-            {
-                return;
-            }
-            status = STATUS_WRITING;
-            ui->bCancel->setEnabled(true);
-            ui->bWrite->setEnabled(false);
-            ui->bRead->setEnabled(false);
-            ui->bVerify->setEnabled(false);
-            double mbpersec;
-            unsigned long long i, lasti, availablesectors, numsectors;
-            int volumeID = ui->cboxDevice->currentText().at(1).toLatin1() - 'A';
-            // int deviceID = ui->cboxDevice->itemData(cboxDevice->currentIndex()).toInt();
-            hVolume = getHandleOnVolume(volumeID, GENERIC_WRITE);
-            if (hVolume == INVALID_HANDLE_VALUE)
-            {
-                status = STATUS_IDLE;
-                ui->bCancel->setEnabled(false);
-                SetReadWriteButtonState();
-                return;
-            }
-            DWORD deviceID = getDeviceID(hVolume);
-            if (!getLockOnVolume(hVolume))
-            {
-                CloseHandle(hVolume);
-                status = STATUS_IDLE;
-                hVolume = INVALID_HANDLE_VALUE;
-                ui->bCancel->setEnabled(false);
-                SetReadWriteButtonState();
-                return;
-            }
-            if (!unmountVolume(hVolume))
-            {
-                removeLockOnVolume(hVolume);
-                CloseHandle(hVolume);
-                status = STATUS_IDLE;
-                hVolume = INVALID_HANDLE_VALUE;
-                ui->bCancel->setEnabled(false);
-                SetReadWriteButtonState();
-                return;
-            }
-            hFile = getHandleOnFile(LPCWSTR(ui->leFile->text().data()), GENERIC_READ);
-            if (hFile == INVALID_HANDLE_VALUE)
-            {
-                removeLockOnVolume(hVolume);
-                CloseHandle(hVolume);
-                status = STATUS_IDLE;
-                hVolume = INVALID_HANDLE_VALUE;
-                ui->bCancel->setEnabled(false);
-                SetReadWriteButtonState();
-                return;
-            }
-            hRawDisk = getHandleOnDevice(deviceID, GENERIC_WRITE);
-            if (hRawDisk == INVALID_HANDLE_VALUE)
-            {
-                removeLockOnVolume(hVolume);
-                CloseHandle(hFile);
-                CloseHandle(hVolume);
-                status = STATUS_IDLE;
-                hVolume = INVALID_HANDLE_VALUE;
-                hFile = INVALID_HANDLE_VALUE;
-                ui->bCancel->setEnabled(false);
-                SetReadWriteButtonState();
-                return;
-            }
-            availablesectors = getNumberOfSectors(hRawDisk, &sectorsize);
-            if (!availablesectors)
-            {
-                //For external card readers you may not get device change notification when you remove the card/flash.
-                //(So no WM_DEVICECHANGE signal). Device stays but size goes to 0. [Is there special event for this on Windows??]
-                removeLockOnVolume(hVolume);
-                CloseHandle(hRawDisk);
-                CloseHandle(hFile);
-                CloseHandle(hVolume);
-                hRawDisk = INVALID_HANDLE_VALUE;
-                hFile = INVALID_HANDLE_VALUE;
-                hVolume = INVALID_HANDLE_VALUE;
-                passfail = false;
-                status = STATUS_IDLE;
-                return;
-
-            }
-            numsectors = getFileSizeInSectors(hFile, sectorsize);
-            if (!numsectors)
-            {
-                //For external card readers you may not get device change notification when you remove the card/flash.
-                //(So no WM_DEVICECHANGE signal). Device stays but size goes to 0. [Is there special event for this on Windows??]
-                removeLockOnVolume(hVolume);
-                CloseHandle(hRawDisk);
-                CloseHandle(hFile);
-                CloseHandle(hVolume);
-                hRawDisk = INVALID_HANDLE_VALUE;
-                hFile = INVALID_HANDLE_VALUE;
-                hVolume = INVALID_HANDLE_VALUE;
-                status = STATUS_IDLE;
-                return;
-
-            }
-            if (numsectors > availablesectors)
-            {
-                bool datafound = false;
-                i = availablesectors;
-                unsigned long nextchunksize = 0;
-                while ( (i < numsectors) && (datafound == false) )
-                {
-                    nextchunksize = ((numsectors - i) >= 1024ul) ? 1024ul : (numsectors - i);
-                    sectorData = readSectorDataFromHandle(hFile, i, nextchunksize, sectorsize);
-                    if(sectorData == nullptr)
-                    {
-                        // if there's an error verifying the truncated data, just move on to the
-                        //  write, as we don't care about an error in a section that we're not writing...
-                        i = numsectors + 1;
-                    } else {
-                        unsigned int j = 0;
-                        unsigned limit = nextchunksize * sectorsize;
-                        while ( (datafound == false) && ( j < limit ) )
-                        {
-                            if(sectorData[j++] != 0)
-                            {
-                                datafound = true;
-                            }
-                        }
-                        i += nextchunksize;
-                    }
-                }
-                // delete the allocated sectorData
-                delete[] sectorData;
-                sectorData = nullptr;
-                // build the string for the warning dialog
-                std::ostringstream msg;
-                msg << "More space required than is available:"
-                    << "\n  Required: " << numsectors << " sectors"
-                    << "\n  Available: " << availablesectors << " sectors"
-                    << "\n  Sector Size: " << sectorsize
-                    << "\n\nThe extra space " << ((datafound) ? "DOES" : "does not") << " appear to contain data"
-                    << "\n\nContinue Anyway?";
-                if(QMessageBox::warning(this, tr("Not enough available space!"),
-                                         tr(msg.str().c_str()), QMessageBox::Ok, QMessageBox::Cancel) == QMessageBox::Ok)
-                {
-                    // truncate the image at the device size...
-                    numsectors = availablesectors;
-                }
-                else    // Cancel
-                {
-                    removeLockOnVolume(hVolume);
-                    CloseHandle(hRawDisk);
-                    CloseHandle(hFile);
-                    CloseHandle(hVolume);
-                    status = STATUS_IDLE;
-                    hVolume = INVALID_HANDLE_VALUE;
-                    hFile = INVALID_HANDLE_VALUE;
-                    hRawDisk = INVALID_HANDLE_VALUE;
-                    ui->bCancel->setEnabled(false);
-                    SetReadWriteButtonState();
-                    return;
-                }
-            }
-
-            ui->progressbar->setRange(0, (numsectors == 0ul) ? 100 : (int)numsectors);
-            lasti = 0ul;
-            update_timer.start();
-            elapsed_timer->start();
-            for (i = 0ul; i < numsectors && status == STATUS_WRITING; i += 1024ul)
-            {
-                sectorData = readSectorDataFromHandle(hFile, i, (numsectors - i >= 1024ul) ? 1024ul:(numsectors - i), sectorsize);
-                if (sectorData == nullptr)
-                {
-                    removeLockOnVolume(hVolume);
-                    CloseHandle(hRawDisk);
-                    CloseHandle(hFile);
-                    CloseHandle(hVolume);
-                    status = STATUS_IDLE;
-                    hRawDisk = INVALID_HANDLE_VALUE;
-                    hFile = INVALID_HANDLE_VALUE;
-                    hVolume = INVALID_HANDLE_VALUE;
-                    ui->bCancel->setEnabled(false);
-                    SetReadWriteButtonState();
-                    return;
-                }
-                if (!writeSectorDataToHandle(hRawDisk, sectorData, i, (numsectors - i >= 1024ul) ? 1024ul:(numsectors - i), sectorsize))
-                {
-                    delete[] sectorData;
-                    removeLockOnVolume(hVolume);
-                    CloseHandle(hRawDisk);
-                    CloseHandle(hFile);
-                    CloseHandle(hVolume);
-                    status = STATUS_IDLE;
-                    sectorData = nullptr;
-                    hRawDisk = INVALID_HANDLE_VALUE;
-                    hFile = INVALID_HANDLE_VALUE;
-                    hVolume = INVALID_HANDLE_VALUE;
-                    ui->bCancel->setEnabled(false);
-                    SetReadWriteButtonState();
-                    return;
-                }
-                delete[] sectorData;
-                sectorData = nullptr;
-                QCoreApplication::processEvents();
-                if (update_timer.elapsed() >= ONE_SEC_IN_MS)
-                {
-                    mbpersec = (((double)sectorsize * (i - lasti)) * ((float)ONE_SEC_IN_MS / update_timer.elapsed())) / 1024.0 / 1024.0;
-                    ui->statusbar->showMessage(QString("%1 MB/s").arg(mbpersec));
-                    elapsed_timer->update(i, numsectors);
-                    update_timer.start();
-                    lasti = i;
-                }
-                ui->progressbar->setValue(i);
-                QCoreApplication::processEvents();
-            }
-            removeLockOnVolume(hVolume);
-            CloseHandle(hRawDisk);
-            CloseHandle(hFile);
-            CloseHandle(hVolume);
-            hRawDisk = INVALID_HANDLE_VALUE;
-            hFile = INVALID_HANDLE_VALUE;
-            hVolume = INVALID_HANDLE_VALUE;
-            if (status == STATUS_CANCELED){
-                passfail = false;
-            }
-        }
-        else if (!fileinfo.exists() || !fileinfo.isFile())
-        {
-            QMessageBox::critical(this, tr("File Error"), tr("The selected file does not exist."));
-            passfail = false;
-        }
-        else if (!fileinfo.isReadable())
-        {
-            QMessageBox::critical(this, tr("File Error"), tr("You do not have permision to read the selected file."));
-            passfail = false;
-        }
-        else if (fileinfo.size() == 0)
-        {
-            QMessageBox::critical(this, tr("File Error"), tr("The specified file contains no data."));
-            passfail = false;
-        }
-        ui->progressbar->reset();
-        ui->statusbar->showMessage(tr("Done."));
-        ui->bCancel->setEnabled(false);
-        SetReadWriteButtonState();
-        if (passfail){
-            QMessageBox::information(this, tr("Complete"), tr("Write Successful."));
-        }
-
+        emit DriveSelected(SelectedDriveLetter());
+        emit HashTypeSelected(SelectedHashType());
+        emit RequestWriteOperation(ui->leFile->text());
     }
     else
     {
         QMessageBox::critical(this, tr("File Error"), tr("Please specify an image file to use."));
     }
-    if (status == STATUS_EXIT)
-    {
-        ui->close();
-    }
-    status = STATUS_IDLE;
-    elapsed_timer->stop();
 }
 
 void MainWindow::HandlebReadClicked()
 {
-    QString myFile;
     if (!ui->leFile->text().isEmpty())
     {
+        emit DriveSelected(SelectedDriveLetter());
+        emit HashTypeSelected(SelectedHashType());
         emit RequestReadOperation(ui->leFile->text());
     }
     else
     {
         QMessageBox::critical(this, tr("File Info"), tr("Please specify a file to save data to."));
     }
-
-    elapsed_timer->stop();
 }
 
 // Verify image with device
 void MainWindow::HandlebVerifyClicked()
 {
-    bool passfail = true;
     if (!ui->leFile->text().isEmpty())
     {
-        QFileInfo fileinfo(ui->leFile->text());
-        if (fileinfo.exists() && fileinfo.isFile() &&
-            fileinfo.isReadable() && (fileinfo.size() > 0) )
-        {
-            if (ui->leFile->text().at(0) == ui->cboxDevice->currentText().at(1))
-            {
-                QMessageBox::critical(this, tr("Verify Error"), tr("Image file cannot be located on the target device."));
-                return;
-            }
-            status = STATUS_VERIFYING;
-            ui->bCancel->setEnabled(true);
-            ui->bWrite->setEnabled(false);
-            ui->bRead->setEnabled(false);
-            ui->bVerify->setEnabled(false);
-            double mbpersec;
-            unsigned long long i, lasti, availablesectors, numsectors, result;
-            int volumeID = ui->cboxDevice->currentText().at(1).toLatin1() - 'A';
-            hVolume = getHandleOnVolume(volumeID, GENERIC_READ);
-            if (hVolume == INVALID_HANDLE_VALUE)
-            {
-                status = STATUS_IDLE;
-                ui->bCancel->setEnabled(false);
-                SetReadWriteButtonState();
-                return;
-            }
-            DWORD deviceID = getDeviceID(hVolume);
-            if (!getLockOnVolume(hVolume))
-            {
-                CloseHandle(hVolume);
-                status = STATUS_IDLE;
-                hVolume = INVALID_HANDLE_VALUE;
-                ui->bCancel->setEnabled(false);
-                SetReadWriteButtonState();
-                return;
-            }
-            if (!unmountVolume(hVolume))
-            {
-                removeLockOnVolume(hVolume);
-                CloseHandle(hVolume);
-                status = STATUS_IDLE;
-                hVolume = INVALID_HANDLE_VALUE;
-                ui->bCancel->setEnabled(false);
-                SetReadWriteButtonState();
-                return;
-            }
-            hFile = getHandleOnFile(LPCWSTR(ui->leFile->text().data()), GENERIC_READ);
-            if (hFile == INVALID_HANDLE_VALUE)
-            {
-                removeLockOnVolume(hVolume);
-                CloseHandle(hVolume);
-                status = STATUS_IDLE;
-                hVolume = INVALID_HANDLE_VALUE;
-                ui->bCancel->setEnabled(false);
-                SetReadWriteButtonState();
-                return;
-            }
-            hRawDisk = getHandleOnDevice(deviceID, GENERIC_READ);
-            if (hRawDisk == INVALID_HANDLE_VALUE)
-            {
-                removeLockOnVolume(hVolume);
-                CloseHandle(hFile);
-                CloseHandle(hVolume);
-                status = STATUS_IDLE;
-                hVolume = INVALID_HANDLE_VALUE;
-                hFile = INVALID_HANDLE_VALUE;
-                ui->bCancel->setEnabled(false);
-                SetReadWriteButtonState();
-                return;
-            }
-            availablesectors = getNumberOfSectors(hRawDisk, &sectorsize);
-            if (!availablesectors)
-            {
-                //For external card readers you may not get device change notification when you remove the card/flash.
-                //(So no WM_DEVICECHANGE signal). Device stays but size goes to 0. [Is there special event for this on Windows??]
-                removeLockOnVolume(hVolume);
-                CloseHandle(hRawDisk);
-                CloseHandle(hFile);
-                CloseHandle(hVolume);
-                hRawDisk = INVALID_HANDLE_VALUE;
-                hFile = INVALID_HANDLE_VALUE;
-                hVolume = INVALID_HANDLE_VALUE;
-                passfail = false;
-                status = STATUS_IDLE;
-                return;
-
-            }
-            numsectors = getFileSizeInSectors(hFile, sectorsize);
-            if (!numsectors)
-            {
-                //For external card readers you may not get device change notification when you remove the card/flash.
-                //(So no WM_DEVICECHANGE signal). Device stays but size goes to 0. [Is there special event for this on Windows??]
-                removeLockOnVolume(hVolume);
-                CloseHandle(hRawDisk);
-                CloseHandle(hFile);
-                CloseHandle(hVolume);
-                hRawDisk = INVALID_HANDLE_VALUE;
-                hFile = INVALID_HANDLE_VALUE;
-                hVolume = INVALID_HANDLE_VALUE;
-                status = STATUS_IDLE;
-                return;
-
-            }
-            if (numsectors > availablesectors)
-            {
-                bool datafound = false;
-                i = availablesectors;
-                unsigned long nextchunksize = 0;
-                while ( (i < numsectors) && (datafound == false) )
-                {
-                    nextchunksize = ((numsectors - i) >= 1024ul) ? 1024ul : (numsectors - i);
-                    sectorData = readSectorDataFromHandle(hFile, i, nextchunksize, sectorsize);
-                    if(sectorData == nullptr)
-                    {
-                        // if there's an error verifying the truncated data, just move on to the
-                        //  write, as we don't care about an error in a section that we're not writing...
-                        i = numsectors + 1;
-                    } else {
-                        unsigned int j = 0;
-                        unsigned limit = nextchunksize * sectorsize;
-                        while ( (datafound == false) && ( j < limit ) )
-                        {
-                            if(sectorData[j++] != 0)
-                            {
-                                datafound = true;
-                            }
-                        }
-                        i += nextchunksize;
-                    }
-                }
-                // delete the allocated sectorData
-                delete[] sectorData;
-                sectorData = nullptr;
-                // build the string for the warning dialog
-                std::ostringstream msg;
-                msg << "Size of image larger than device:"
-                    << "\n  Image: " << numsectors << " sectors"
-                    << "\n  Device: " << availablesectors << " sectors"
-                    << "\n  Sector Size: " << sectorsize
-                    << "\n\nThe extra space " << ((datafound) ? "DOES" : "does not") << " appear to contain data"
-                    << "\n\nContinue Anyway?";
-                if(QMessageBox::warning(this, tr("Size Mismatch!"),
-                                         tr(msg.str().c_str()), QMessageBox::Ok, QMessageBox::Cancel) == QMessageBox::Ok)
-                {
-                    // truncate the image at the device size...
-                    numsectors = availablesectors;
-                }
-                else    // Cancel
-                {
-                    removeLockOnVolume(hVolume);
-                    CloseHandle(hRawDisk);
-                    CloseHandle(hFile);
-                    CloseHandle(hVolume);
-                    status = STATUS_IDLE;
-                    hVolume = INVALID_HANDLE_VALUE;
-                    hFile = INVALID_HANDLE_VALUE;
-                    hRawDisk = INVALID_HANDLE_VALUE;
-                    ui->bCancel->setEnabled(false);
-                    SetReadWriteButtonState();
-                    return;
-                }
-            }
-            ui->progressbar->setRange(0, (numsectors == 0ul) ? 100 : (int)numsectors);
-            update_timer.start();
-            elapsed_timer->start();
-            lasti = 0ul;
-            for (i = 0ul; i < numsectors && status == STATUS_VERIFYING; i += 1024ul)
-            {
-                sectorData = readSectorDataFromHandle(hFile, i, (numsectors - i >= 1024ul) ? 1024ul:(numsectors - i), sectorsize);
-                if (sectorData == nullptr)
-                {
-                    removeLockOnVolume(hVolume);
-                    CloseHandle(hRawDisk);
-                    CloseHandle(hFile);
-                    CloseHandle(hVolume);
-                    status = STATUS_IDLE;
-                    hRawDisk = INVALID_HANDLE_VALUE;
-                    hFile = INVALID_HANDLE_VALUE;
-                    hVolume = INVALID_HANDLE_VALUE;
-                    ui->bCancel->setEnabled(false);
-                    SetReadWriteButtonState();
-                    return;
-                }
-                sectorData2 = readSectorDataFromHandle(hRawDisk, i, (numsectors - i >= 1024ul) ? 1024ul:(numsectors - i), sectorsize);
-                if (sectorData2 == nullptr)
-                {
-                    QMessageBox::critical(this, tr("Verify Failure"), tr("Verification failed at sector: %1").arg(i));
-                    removeLockOnVolume(hVolume);
-                    CloseHandle(hRawDisk);
-                    CloseHandle(hFile);
-                    CloseHandle(hVolume);
-                    status = STATUS_IDLE;
-                    hRawDisk = INVALID_HANDLE_VALUE;
-                    hFile = INVALID_HANDLE_VALUE;
-                    hVolume = INVALID_HANDLE_VALUE;
-                    ui->bCancel->setEnabled(false);
-                    SetReadWriteButtonState();
-                    return;
-                }
-                result = memcmp(sectorData, sectorData2, ((numsectors - i >= 1024ul) ? 1024ul:(numsectors - i)) * sectorsize);
-                if (result)
-                {
-                    QMessageBox::critical(this, tr("Verify Failure"), tr("Verification failed at sector: %1").arg(i));
-                    passfail = false;
-                    break;
-
-                }
-                if (update_timer.elapsed() >= ONE_SEC_IN_MS)
-                {
-                    mbpersec = (((double)sectorsize * (i - lasti)) * ((float)ONE_SEC_IN_MS / update_timer.elapsed())) / 1024.0 / 1024.0;
-                    ui->statusbar->showMessage(QString("%1MB/s").arg(mbpersec));
-                    update_timer.start();
-                    elapsed_timer->update(i, numsectors);
-                    lasti = i;
-                }
-                delete[] sectorData;
-                delete[] sectorData2;
-                sectorData = nullptr;
-                sectorData2 = nullptr;
-                ui->progressbar->setValue(i);
-                QCoreApplication::processEvents();
-            }
-            removeLockOnVolume(hVolume);
-            CloseHandle(hRawDisk);
-            CloseHandle(hFile);
-            CloseHandle(hVolume);
-            delete[] sectorData;
-            delete[] sectorData2;
-            sectorData = nullptr;
-            sectorData2 = nullptr;
-            hRawDisk = INVALID_HANDLE_VALUE;
-            hFile = INVALID_HANDLE_VALUE;
-            hVolume = INVALID_HANDLE_VALUE;
-            if (status == STATUS_CANCELED){
-                passfail = false;
-            }
-
-        }
-        else if (!fileinfo.exists() || !fileinfo.isFile())
-        {
-            QMessageBox::critical(this, tr("File Error"), tr("The selected file does not exist."));
-            passfail = false;
-        }
-        else if (!fileinfo.isReadable())
-        {
-            QMessageBox::critical(this, tr("File Error"), tr("You do not have permision to read the selected file."));
-            passfail = false;
-        }
-        else if (fileinfo.size() == 0)
-        {
-            QMessageBox::critical(this, tr("File Error"), tr("The specified file contains no data."));
-            passfail = false;
-        }
-        ui->progressbar->reset();
-        ui->statusbar->showMessage(tr("Done."));
-        ui->bCancel->setEnabled(false);
-        SetReadWriteButtonState();
-        if (passfail){
-            QMessageBox::information(this, tr("Complete"), tr("Verify Successful."));
-        }
+        emit DriveSelected(SelectedDriveLetter());
+        emit HashTypeSelected(SelectedHashType());
+        emit RequestVerifyOperation(ui->leFile->text());
     }
     else
     {
         QMessageBox::critical(this, tr("File Error"), tr("Please specify an image file to use."));
     }
-    if (status == STATUS_EXIT)
-    {
-        ui->close();
-    }
-    status = STATUS_IDLE;
-    elapsed_timer->stop();
+}
+
+char MainWindow::SelectedDriveLetter() const
+{
+    // Entries look like "[E:\]"
+    const QString device = ui->cboxDevice->currentText();
+    return (device.size() > 1) ? device.at(1).toLatin1() : ' ';
+}
+
+int MainWindow::SelectedHashType() const
+{
+    // Entry 0 is "None"
+    return (ui->cboxHashType->currentIndex() > 0) ? ui->cboxHashType->currentData().toInt() : -1;
 }
 
 // getLogicalDrives sets cBoxDevice with any logical drives found, as long
@@ -900,20 +396,11 @@ bool MainWindow::nativeEvent(const QByteArray &type, void *vMsg, long long *resu
                 if(DBTF_NET)
                 {
                     char ALET = FirstDriveFromMask(lpdbv->dbcv_unitmask);
-                    // add device to combo box (after sanity check that
-                    // it's not already there, which it shouldn't be)
-                    QString qs = QString("[%1:\\]").arg(ALET);
-                    if (ui->cboxDevice->findText(qs) == -1)
+                    // the new drive is probed off this thread and shows up
+                    // in the combo box once it answers
+                    if (ui->cboxDevice->findText(QString("[%1:\\]").arg(ALET)) == -1)
                     {
-                        ULONG pID;
-                        char longname[] = "\\\\.\\A:\\";
-                        longname[4] = ALET;
-                        // checkDriveType gets the physicalID
-                        if (checkDriveType(longname, &pID))
-                        {
-                            ui->cboxDevice->addItem(qs, (qulonglong)pID);
-                            SetReadWriteButtonState();
-                        }
+                        emit RequestLogicalDrives();
                     }
                 }
             }
@@ -931,6 +418,8 @@ bool MainWindow::nativeEvent(const QByteArray &type, void *vMsg, long long *resu
                     //  out of range, and findText returns -1 if the item isn't found.
                     ui->cboxDevice->removeItem(ui->cboxDevice->findText(QString("[%1:\\]").arg(ALET)));
                     SetReadWriteButtonState();
+                    // and have DriveIO drop it from its cache
+                    emit RequestLogicalDrives();
                 }
             }
             break;
@@ -977,22 +466,22 @@ void MainWindow::HandleStatusChanged(const Status newStatus)
 
 void MainWindow::HandleWarnImageFileContainsNoData()
 {
-
+    QMessageBox::critical(this, tr("File Error"), tr("The specified file contains no data."));
 }
 
 void MainWindow::HandleWarnImageFileDoesNotExist()
 {
-
+    QMessageBox::critical(this, tr("File Error"), tr("The selected file does not exist."));
 }
 
 void MainWindow::HandleWarnImageFileLocatedOnDrive()
 {
-
+    QMessageBox::critical(this, tr("File Error"), tr("Image file cannot be located on the target device."));
 }
 
 void MainWindow::HandleWarnImageFilePermissions()
 {
-
+    QMessageBox::critical(this, tr("File Error"), tr("You do not have permision to read the selected file."));
 }
 
 void MainWindow::HandleWarnNoLockOnVolume()
@@ -1029,35 +518,129 @@ void MainWindow::HandleWarnUnspecifiedIOError()
 
 }
 
+void MainWindow::HandleWarnVerifyMismatch(const long long sector)
+{
+    if (sector >= 0)
+    {
+        QMessageBox::critical(this, tr("Verify Failure"), tr("Verification failed at sector: %1").arg(sector));
+    }
+    else
+    {
+        QMessageBox::critical(this, tr("Verify Failure"), tr("Verification failed."));
+    }
+}
+
+void MainWindow::HandleWarnBaseImageMismatch()
+{
+    QMessageBox::critical(this, tr("Read Error"), tr("The base image does not match the device."));
+}
+
 void MainWindow::HandleInfoGeneratedHash(const QString hashString)
 {
+    ui->hashLabel->setText(hashString);
+    ui->bHashCopy->setEnabled(true);
+}
+
+void MainWindow::HandleInfoWriteSuccessful()
+{
+    QMessageBox::information(this, tr("Complete"), tr("Write Successful."));
+}
 
+void MainWindow::HandleInfoVerifySuccessful()
+{
+    QMessageBox::information(this, tr("Complete"), tr("Verify Successful."));
 }
 
 void MainWindow::HandleRequestReadOverwriteConfirmation()
 {
+    const bool confirmed = (QMessageBox::warning(this, tr("Confirm Overwrite"), tr("Are you sure you want to overwrite the specified file?"),
+                                                 QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::Yes);
+    emit ReadOverwriteConfirmation(confirmed);
+}
 
+void MainWindow::HandleRequestWriteOverwriteConfirmation()
+{
+    // build the drive letter as a const char *
+    //   (without the surrounding brackets)
+    QString qs = ui->cboxDevice->currentText();
+    qs.replace(QRegularExpression("[\\[\\]]"), "");
+    QByteArray qba = qs.toLocal8Bit();
+    const char *ltr = qba.data();
+    const bool confirmed = (QMessageBox::warning(this, tr("Confirm overwrite"), tr("Writing to a physical device can corrupt the device.\n"
+                                                                                   "(Target Device: %1 \"%2\")\n"
+                                                                                   "Are you sure you want to continue?").arg(ui->cboxDevice->currentText()).arg(getDriveLabel(ltr)),
+                                                 QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::Yes);
+    emit WriteOverwriteConfirmation(confirmed);
 }
 
 void MainWindow::HandleSetProgressBarRange(const int min, const int max)
 {
-
+    ui->progressbar->setRange(min, max);
 }
 
-void MainWindow::HandleProgressBarStatus(const double mbpersec, const int completion)
+void MainWindow::HandleProgressBarStatus(const double mbComplete, const int completion)
 {
+    // Arrives at most ten times a second. Every sample goes to the estimator,
+    // the rate shown (averaged over the last few seconds) changes once a second.
+    ui->progressbar->setValue(completion);
+    ThroughputEstimator::Phase phase = ThroughputEstimator::Phase::Transfer;
+    if (CurrentStatus == Status::Verifying)
+    {
+        phase = ThroughputEstimator::Phase::Verify;
+    }
+    else if (completion >= ui->progressbar->maximum())
+    {
+        phase = ThroughputEstimator::Phase::Flush;
+    }
+    elapsed_timer->update(completion, ui->progressbar->maximum(), phase);
 
+    if (update_timer.elapsed() >= ONE_SEC_IN_MS)
+    {
+        // The estimator counts sectors; mbComplete tells how many MB one is
+        const double mbPerSector = (completion > 0) ? (mbComplete / completion) : 0.0;
+        ui->statusbar->showMessage(QString("%1 MB/s").arg(elapsed_timer->rate() * mbPerSector, 0, 'f', 1));
+        update_timer.start();
+    }
 }
 
-void MainWindow::HandleOperationComplete(const bool cancelled)
+void MainWindow::HandleThroughputSample(const double mbPerSecond, const double latencyMs)
 {
+    throughput_graph->AddSample(mbPerSecond, latencyMs);
+}
 
+void MainWindow::HandleOperationComplete(const bool cancelled)
+{
+    ui->progressbar->reset();
+    ui->statusbar->showMessage(cancelled ? tr("Canceled.") : tr("Done."));
+    elapsed_timer->stop();
+    SetReadWriteButtonState();
 }
 
 void MainWindow::HandleStartTimers()
 {
     update_timer.start();
     elapsed_timer->start();
+    // Sent once per job, as it starts. The graph of the previous job stays up
+    // until then, after the job has completed.
+    throughput_graph->Reset();
+}
+
+void MainWindow::HandleDiskErrors()
+{
+    // Posted from the I/O threads, which carry on without waiting for this dialog;
+    // the first error is usually the cause of the rest
+    const QList<DiskError> errors = DiskErrorQueue::Instance()->TakeAll();
+    if (errors.isEmpty())
+    {
+        return;
+    }
+
+    QString message = errors.first().Message();
+    if (errors.size() > 1)
+    {
+        message += "\n\n" + tr("%1 further errors occurred.").arg(errors.size() - 1);
+    }
+    QMessageBox::critical(this, errors.first().Title(), message);
 }
 
 void MainWindow::HandleSettingsLoaded(const QString imageDir, const QString fileType)
@@ -1076,6 +659,17 @@ void MainWindow::HandleSettingsLoaded(const QString imageDir, const QString file
     FileTypeList << tr("Disk Images (*.img *.IMG)") << "*.*";
 }
 
+void MainWindow::HandleLogicalDrivesDetected(const QList<QString> drives)
+{
+    // Sent again as each drive answers, so keep whatever the user picked
+    const QString selected = ui->cboxDevice->currentText();
+    ui->cboxDevice->clear();
+    ui->cboxDevice->addItems(drives);
+    const int index = ui->cboxDevice->findText(selected);
+    ui->cboxDevice->setCurrentIndex((index >= 0) ? index : 0);
+    SetReadWriteButtonState();
+}
+
 void MainWindow::UpdateHashControls()
 {
     QFileInfo fileinfo(ui->leFile->text());
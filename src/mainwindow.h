@@ -29,6 +29,7 @@
 #include <windows.h>
 #include "ui_mainwindow.h"
 #include "elapsedtimer.h"
+#include "throughputgraph.h"
 
 class MainWindow : public UserInterface
 {
@@ -66,13 +67,21 @@ public slots:
                                          const int sectorSize,
                                          const bool dataFound) override;
    void HandleWarnUnspecifiedIOError() override;
+   void HandleWarnVerifyMismatch(const long long sector) override;
+   void HandleWarnBaseImageMismatch() override;
    void HandleInfoGeneratedHash(const QString hashString) override;
+   void HandleInfoWriteSuccessful() override;
+   void HandleInfoVerifySuccessful() override;
    void HandleRequestReadOverwriteConfirmation() override;
+   void HandleRequestWriteOverwriteConfirmation() override;
    void HandleSetProgressBarRange(const int min, const int max) override;
-   void HandleProgressBarStatus(const double mbpersec, const int completion) override;
+   void HandleProgressBarStatus(const double mbComplete, const int completion) override;
+   void HandleThroughputSample(const double mbPerSecond, const double latencyMs) override;
    void HandleOperationComplete(const bool cancelled) override;
    void HandleStartTimers() override;
+   void HandleDiskErrors() override;
    void HandleSettingsLoaded(const QString imageDir, const QString fileType) override;
+   void HandleLogicalDrivesDetected(const QList<QString> drives) override;
 
 protected slots:
    void HandletbBrowseClicked();
@@ -96,12 +105,15 @@ private:
    void SetReadWriteButtonState();
    void SetUpUIConnections();
    void UpdateHashControls();
+   char SelectedDriveLetter() const;
+   int SelectedHashType() const;
 
    Ui::MainWindow* ui;
 
    QScopedPointer<QMainWindow> TheWindow;
    QElapsedTimer update_timer;
    ElapsedTimer *elapsed_timer = NULL;
+   ThroughputGraph *throughput_graph = NULL;
    QClipboard *clipboard;
    void generateHash(char *filename, int hashish);
    QString HomeDir;
@@ -0,0 +1,176 @@
+#include "metrics.h"
+#include <QMutexLocker>
+
+namespace {
+// Upper bounds of the job duration buckets in seconds; +Inf is implied
+const double DURATION_BUCKETS[] = {10.0, 30.0, 60.0, 120.0, 300.0, 600.0, 1200.0, 1800.0, 3600.0, 7200.0};
+
+QString TypeLabel(const JobType type)
+{
+   switch(type)
+   {
+   case JobType::Read:
+      return "read";
+   case JobType::Write:
+      return "write";
+   case JobType::Verify:
+      return "verify";
+   case JobType::Clone:
+      return "clone";
+   case JobType::Rescue:
+      return "rescue";
+   }
+   return "unknown";
+}
+
+// Label values are quoted; image paths are full of backslashes
+QByteArray EscapeLabel(const QString& value)
+{
+   QByteArray escaped = value.toUtf8();
+   escaped.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+   return escaped;
+}
+
+void AppendFamily(QByteArray* out, const char* name, const char* type, const char* help)
+{
+   *out += QByteArray("# TYPE ") + name + " " + type + "\n";
+   *out += QByteArray("# HELP ") + name + " " + help + "\n";
+}
+
+void AppendSample(QByteArray* out, const QByteArray& name, const QByteArray& labels, const QByteArray& value)
+{
+   *out += name;
+   if(!labels.isEmpty())
+   {
+      *out += "{" + labels + "}";
+   }
+   *out += " " + value + "\n";
+}
+}
+
+Metrics* Metrics::Instance()
+{
+   static Metrics metrics;
+   return &metrics;
+}
+
+Metrics::Metrics()
+   : Lock()
+   , Devices()
+   , Jobs()
+   , Retries(0ull)
+   , Stalls(0ull)
+   , VerifyMismatches(0ull)
+{
+   static_assert(sizeof(DURATION_BUCKETS) / sizeof(DURATION_BUCKETS[0]) == DURATION_BUCKET_COUNT,
+                 "one count per bucket bound");
+}
+
+DeviceMetrics* Metrics::ForDevice(const QString& device)
+{
+   QMutexLocker locker(&Lock);
+   DeviceMetrics*& metrics = Devices[device];
+   if(metrics == nullptr)
+   {
+      metrics = new DeviceMetrics();
+   }
+   return metrics;
+}
+
+void Metrics::AddRetry()
+{
+   Retries.fetch_add(1ull, std::memory_order_relaxed);
+}
+
+void Metrics::AddStall()
+{
+   Stalls.fetch_add(1ull, std::memory_order_relaxed);
+}
+
+void Metrics::AddVerifyMismatch()
+{
+   VerifyMismatches.fetch_add(1ull, std::memory_order_relaxed);
+}
+
+void Metrics::RecordJob(const JobType type, const bool succeeded, const bool cancelled, const double seconds)
+{
+   const QString result = succeeded ? "succeeded" : (cancelled ? "cancelled" : "failed");
+   QMutexLocker locker(&Lock);
+   JobDurations& durations = Jobs[qMakePair(TypeLabel(type), result)];
+   for(int i = 0; i < DURATION_BUCKET_COUNT; i++)
+   {
+      if(seconds <= DURATION_BUCKETS[i])
+      {
+         durations.Buckets[i]++;
+      }
+   }
+   durations.Count++;
+   durations.SumSeconds += seconds;
+}
+
+QByteArray Metrics::RenderOpenMetrics(const QueueDepths& depths) const
+{
+   QByteArray out;
+
+   QMutexLocker locker(&Lock);
+   struct DeviceCounter
+   {
+      const char* Name;
+      const char* Help;
+      std::atomic<quint64> DeviceMetrics::*Counter;
+   };
+   const DeviceCounter deviceCounters[] = {
+      {"diskimager_device_read_bytes", "Bytes read from the device or image file.", &DeviceMetrics::BytesRead},
+      {"diskimager_device_written_bytes", "Bytes written to the device or image file.", &DeviceMetrics::BytesWritten},
+      {"diskimager_device_read_errors", "Reads that failed, including ones retried later.", &DeviceMetrics::ReadErrors},
+      {"diskimager_device_write_errors", "Writes that failed, including ones retried later.", &DeviceMetrics::WriteErrors},
+   };
+   for(const DeviceCounter& counter : deviceCounters)
+   {
+      AppendFamily(&out, counter.Name, "counter", counter.Help);
+      for(auto it = Devices.cbegin(); it != Devices.cend(); ++it)
+      {
+         const quint64 value = (it.value()->*counter.Counter).load(std::memory_order_relaxed);
+         AppendSample(&out, QByteArray(counter.Name) + "_total", "device=\"" + EscapeLabel(it.key()) + "\"",
+                      QByteArray::number(value));
+      }
+   }
+
+   AppendFamily(&out, "diskimager_job_duration_seconds", "histogram", "Duration of finished jobs.");
+   for(auto it = Jobs.cbegin(); it != Jobs.cend(); ++it)
+   {
+      const QByteArray labels = "type=\"" + EscapeLabel(it.key().first) + "\",result=\"" + EscapeLabel(it.key().second) + "\"";
+      const JobDurations& durations = it.value();
+      for(int i = 0; i < DURATION_BUCKET_COUNT; i++)
+      {
+         AppendSample(&out, "diskimager_job_duration_seconds_bucket",
+                      labels + ",le=\"" + QByteArray::number(DURATION_BUCKETS[i], 'f', 1) + "\"",
+                      QByteArray::number(durations.Buckets[i]));
+      }
+      AppendSample(&out, "diskimager_job_duration_seconds_bucket", labels + ",le=\"+Inf\"",
+                   QByteArray::number(durations.Count));
+      AppendSample(&out, "diskimager_job_duration_seconds_count", labels, QByteArray::number(durations.Count));
+      AppendSample(&out, "diskimager_job_duration_seconds_sum", labels, QByteArray::number(durations.SumSeconds, 'f', 3));
+   }
+   locker.unlock();
+
+   AppendFamily(&out, "diskimager_retries", "counter", "Reads and writes that were retried.");
+   AppendSample(&out, "diskimager_retries_total", QByteArray(), QByteArray::number(Retries.load(std::memory_order_relaxed)));
+   AppendFamily(&out, "diskimager_stalls", "counter", "Reads and writes the watchdog found stalled.");
+   AppendSample(&out, "diskimager_stalls_total", QByteArray(), QByteArray::number(Stalls.load(std::memory_order_relaxed)));
+   AppendFamily(&out, "diskimager_verify_mismatches", "counter", "Verifications that found different data.");
+   AppendSample(&out, "diskimager_verify_mismatches_total", QByteArray(),
+                QByteArray::number(VerifyMismatches.load(std::memory_order_relaxed)));
+
+   AppendFamily(&out, "diskimager_jobs_pending", "gauge", "Jobs waiting for a free device or I/O thread.");
+   AppendSample(&out, "diskimager_jobs_pending", QByteArray(), QByteArray::number(depths.PendingJobs));
+   AppendFamily(&out, "diskimager_jobs_running", "gauge", "Jobs running now.");
+   AppendSample(&out, "diskimager_jobs_running", QByteArray(), QByteArray::number(depths.RunningJobs));
+   AppendFamily(&out, "diskimager_requests_in_flight", "gauge", "Reads and writes submitted and not yet completed.");
+   AppendSample(&out, "diskimager_requests_in_flight", QByteArray(), QByteArray::number(depths.RequestsInFlight));
+   AppendFamily(&out, "diskimager_buffer_bytes", "gauge", "Chunk buffers held across all jobs.");
+   AppendSample(&out, "diskimager_buffer_bytes", QByteArray(), QByteArray::number(depths.BufferBytesInUse));
+
+   out += "# EOF\n";
+   return out;
+}
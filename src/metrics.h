@@ -0,0 +1,63 @@
+#pragma once
+
+#include "common.h"
+#include <QString>
+#include <QMap>
+#include <QMutex>
+#include <atomic>
+
+// Counters of one drive or image file, updated from the I/O threads
+struct DeviceMetrics
+{
+   std::atomic<quint64> BytesRead{0ull};
+   std::atomic<quint64> BytesWritten{0ull};
+   std::atomic<quint64> ReadErrors{0ull};
+   std::atomic<quint64> WriteErrors{0ull};
+};
+
+// Process-wide counters for the OpenMetrics endpoint. Everything the I/O path
+// touches is a relaxed atomic; the mutex only guards adding a device, which
+// happens when a job opens it, and the job duration histograms, which are
+// updated once per job.
+class Metrics
+{
+public:
+   static Metrics* Instance();
+
+   // The returned counters live as long as the process
+   DeviceMetrics* ForDevice(const QString& device);
+   void AddRetry();
+   void AddStall();
+   void AddVerifyMismatch();
+   void RecordJob(const JobType type, const bool succeeded, const bool cancelled, const double seconds);
+
+   // Queue depths are not kept here; whoever renders passes them in
+   struct QueueDepths
+   {
+      int PendingJobs = 0;
+      int RunningJobs = 0;
+      int RequestsInFlight = 0;
+      qint64 BufferBytesInUse = 0;
+   };
+   QByteArray RenderOpenMetrics(const QueueDepths& depths) const;
+
+private:
+   Metrics();
+
+   static constexpr int DURATION_BUCKET_COUNT = 10;
+
+   struct JobDurations
+   {
+      quint64 Buckets[DURATION_BUCKET_COUNT] = {};
+      quint64 Count = 0ull;
+      double SumSeconds = 0.0;
+   };
+
+   mutable QMutex Lock;
+   QMap<QString, DeviceMetrics*> Devices;
+   // Keyed by job type and result, e.g. "write" and "succeeded"
+   QMap<QPair<QString, QString>, JobDurations> Jobs;
+   std::atomic<quint64> Retries;
+   std::atomic<quint64> Stalls;
+   std::atomic<quint64> VerifyMismatches;
+};
@@ -0,0 +1,73 @@
+#include "metricsserver.h"
+#include "metrics.h"
+#include "jobscheduler.h"
+#include <QTcpSocket>
+
+namespace {
+// Anything larger is not a scrape
+const qint64 MAX_REQUEST_BYTES = 8 * 1024;
+const char* CONTENT_TYPE = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+QByteArray Response(const QByteArray& status, const QByteArray& contentType, const QByteArray& body)
+{
+   return "HTTP/1.1 " + status + "\r\n"
+          "Content-Type: " + contentType + "\r\n"
+          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+          "Connection: close\r\n"
+          "\r\n" + body;
+}
+}
+
+MetricsServer::MetricsServer(JobScheduler* scheduler, QObject* parent)
+   : QObject(parent)
+   , Scheduler(scheduler)
+   , Server(this)
+{
+   connect(&Server, &QTcpServer::newConnection, this, &MetricsServer::HandleNewConnection);
+}
+
+bool MetricsServer::Listen(const quint16 port, QString* errorMessage)
+{
+   if(!Server.listen(QHostAddress::LocalHost, port))
+   {
+      *errorMessage = QString("Cannot serve metrics on port %1: %2").arg(port).arg(Server.errorString());
+      return false;
+   }
+   return true;
+}
+
+void MetricsServer::HandleNewConnection()
+{
+   while(QTcpSocket* socket = Server.nextPendingConnection())
+   {
+      connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+      connect(socket, &QTcpSocket::readyRead, this, [this, socket]() { HandleRequest(socket); });
+   }
+}
+
+void MetricsServer::HandleRequest(QTcpSocket* socket)
+{
+   // Only the request line matters, but wait for the whole header before answering
+   const QByteArray request = socket->peek(MAX_REQUEST_BYTES);
+   if(!request.contains("\r\n\r\n") && (request.size() < MAX_REQUEST_BYTES))
+   {
+      return;
+   }
+   socket->disconnect(this);
+
+   const QList<QByteArray> requestLine = request.left(request.indexOf("\r\n")).split(' ');
+   const bool isGet = (requestLine.size() >= 2) && (requestLine.at(0) == "GET");
+   const QByteArray path = isGet ? requestLine.at(1).split('?').first() : QByteArray();
+   if(path == "/metrics")
+   {
+      Metrics::QueueDepths depths;
+      Scheduler->GetQueueDepths(&depths.PendingJobs, &depths.RunningJobs, &depths.RequestsInFlight);
+      depths.BufferBytesInUse = Scheduler->GetBufferBytesInUse();
+      socket->write(Response("200 OK", CONTENT_TYPE, Metrics::Instance()->RenderOpenMetrics(depths)));
+   }
+   else
+   {
+      socket->write(Response(isGet ? "404 Not Found" : "405 Method Not Allowed", "text/plain", "Try GET /metrics\n"));
+   }
+   socket->disconnectFromHost();
+}
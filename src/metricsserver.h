@@ -0,0 +1,29 @@
+#pragma once
+
+#include <QObject>
+#include <QTcpServer>
+
+class JobScheduler;
+class QTcpSocket;
+
+// Serves the process's Metrics as OpenMetrics text on GET /metrics, on
+// localhost only. Scrapes are answered on this object's thread from the
+// atomic counters, so the I/O threads never wait for them.
+class MetricsServer : public QObject
+{
+   Q_OBJECT
+
+public:
+   MetricsServer(JobScheduler* scheduler, QObject* parent = nullptr);
+
+   bool Listen(const quint16 port, QString* errorMessage);
+
+private slots:
+   void HandleNewConnection();
+
+private:
+   void HandleRequest(QTcpSocket* socket);
+
+   JobScheduler* Scheduler;
+   QTcpServer Server;
+};
@@ -0,0 +1,380 @@
+#include "partitiontable.h"
+#include <QSet>
+#include <QtEndian>
+
+namespace {
+const int MBR_ENTRY_OFFSET = 0x1BE;
+const int MBR_ENTRY_SIZE = 16;
+const int MBR_ENTRIES = 4;
+const unsigned char MBR_TYPE_PROTECTIVE = 0xEE;
+// Guards against an EBR chain that loops back on itself
+const int MAX_LOGICAL_PARTITIONS = 128;
+
+const char GPT_SIGNATURE[] = "EFI PART";
+const quint32 GPT_MIN_HEADER_SIZE = 92;
+const quint32 GPT_MIN_ENTRY_SIZE = 128;
+// Far more than any real table (128 entries of 128 bytes is the usual)
+const quint64 GPT_MAX_ENTRY_BYTES = 4ull * 1024 * 1024;
+
+// Offsets of the GPT header fields
+const int GPT_HEADER_SIZE = 12;
+const int GPT_HEADER_CRC = 16;
+const int GPT_MY_LBA = 24;
+const int GPT_ALTERNATE_LBA = 32;
+const int GPT_LAST_USABLE_LBA = 48;
+const int GPT_ENTRIES_LBA = 72;
+const int GPT_NUM_ENTRIES = 80;
+const int GPT_ENTRY_SIZE = 84;
+const int GPT_ENTRIES_CRC = 88;
+
+bool IsExtendedType(const unsigned char type)
+{
+   return (type == 0x05) || (type == 0x0F) || (type == 0x85);
+}
+
+bool HasBootSignature(const QByteArray& sector)
+{
+   return (sector.size() >= 512) && ((unsigned char)sector.at(510) == 0x55) && ((unsigned char)sector.at(511) == 0xAA);
+}
+
+// CRC-32 as used by the UEFI spec (the zlib one)
+quint32 Crc32(const char* data, const qint64 numBytes)
+{
+   static quint32 table[256] = {};
+   static const bool tableReady = [] {
+      for(quint32 i = 0; i < 256; i++)
+      {
+         quint32 crc = i;
+         for(int bit = 0; bit < 8; bit++)
+         {
+            crc = (crc & 1) ? (0xEDB88320u ^ (crc >> 1)) : (crc >> 1);
+         }
+         table[i] = crc;
+      }
+      return true;
+   }();
+   Q_UNUSED(tableReady);
+
+   quint32 crc = 0xFFFFFFFFu;
+   for(qint64 i = 0; i < numBytes; i++)
+   {
+      crc = table[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+   }
+   return crc ^ 0xFFFFFFFFu;
+}
+
+quint32 HeaderCrc(QByteArray header)
+{
+   const quint32 headerSize = qFromLittleEndian<quint32>(header.constData() + GPT_HEADER_SIZE);
+   qToLittleEndian<quint32>(0, header.data() + GPT_HEADER_CRC);
+   return Crc32(header.constData(), headerSize);
+}
+
+quint64 ReadU64(const QByteArray& data, const int offset)
+{
+   return qFromLittleEndian<quint64>(data.constData() + offset);
+}
+
+quint32 ReadU32(const QByteArray& data, const int offset)
+{
+   return qFromLittleEndian<quint32>(data.constData() + offset);
+}
+}
+
+PartitionTable::PartitionTable()
+   : SectorSize(512ull)
+   , DiskSectors(0ull)
+   , TableScheme(Scheme::None)
+   , Partitions()
+   , TableExtents()
+   , ExtendedExtents()
+   , GptHeader()
+   , GptEntries()
+   , PrimaryGptValid(false)
+{}
+
+bool PartitionTable::Read(const SectorReader& reader, const unsigned long long sectorSize,
+                          const unsigned long long diskSectors)
+{
+   SectorSize = sectorSize;
+   DiskSectors = diskSectors;
+   TableScheme = Scheme::None;
+   Partitions.clear();
+   TableExtents.clear();
+   ExtendedExtents.clear();
+   GptHeader.clear();
+   GptEntries.clear();
+   PrimaryGptValid = false;
+
+   const QByteArray mbr = reader(0ull, 1ull);
+   if(mbr.isEmpty())
+   {
+      return false;
+   }
+   if(!HasBootSignature(mbr))
+   {
+      return true;
+   }
+   AddTableExtent(0ull, 1ull);
+
+   bool protective = false;
+   if(!ReadMbr(reader, mbr, &protective))
+   {
+      return false;
+   }
+   if(!protective)
+   {
+      TableScheme = Partitions.isEmpty() ? Scheme::None : Scheme::Mbr;
+      return true;
+   }
+
+   // Fall back to the backup GPT at the end of the disk if the primary one is damaged
+   const QList<Partition> mbrPartitions = Partitions;
+   Partitions.clear();
+   PrimaryGptValid = ReadGpt(reader, 1ull);
+   if(!PrimaryGptValid && !ReadGpt(reader, DiskSectors - 1ull))
+   {
+      // Without a usable GPT the protective entry is the best there is: the whole disk
+      Partitions = mbrPartitions;
+      TableScheme = Scheme::Mbr;
+      return true;
+   }
+
+   TableScheme = Scheme::Gpt;
+   for(const Partition& partition : mbrPartitions)
+   {
+      if(partition.MbrType != MBR_TYPE_PROTECTIVE)
+      {
+         TableScheme = Scheme::HybridMbr;
+         AddPartition(partition);
+      }
+   }
+   return true;
+}
+
+bool PartitionTable::ReadMbr(const SectorReader& reader, const QByteArray& mbr, bool* protective)
+{
+   for(int i = 0; i < MBR_ENTRIES; i++)
+   {
+      const int entry = MBR_ENTRY_OFFSET + i * MBR_ENTRY_SIZE;
+      Partition partition;
+      partition.MbrType = (unsigned char)mbr.at(entry + 4);
+      partition.FirstSector = ReadU32(mbr, entry + 8);
+      partition.NumSectors = ReadU32(mbr, entry + 12);
+      if((partition.MbrType == 0) || (partition.NumSectors == 0ull))
+      {
+         continue;
+      }
+
+      *protective = *protective || (partition.MbrType == MBR_TYPE_PROTECTIVE);
+      if(IsExtendedType(partition.MbrType))
+      {
+         // The container counts as allocated too, the EBRs live inside it
+         ExtendedExtents.append(qMakePair(partition.FirstSector, partition.FirstSector + partition.NumSectors));
+         if(!ReadExtendedPartition(reader, partition.FirstSector))
+         {
+            return false;
+         }
+         continue;
+      }
+      AddPartition(partition);
+   }
+   return true;
+}
+
+bool PartitionTable::ReadExtendedPartition(const SectorReader& reader, const unsigned long long extendedStart)
+{
+   // Each EBR holds one logical partition (relative to the EBR) and a link
+   // to the next EBR (relative to the start of the extended partition)
+   QSet<unsigned long long> visited;
+   unsigned long long ebrSector = extendedStart;
+   while((visited.size() < MAX_LOGICAL_PARTITIONS) && !visited.contains(ebrSector) && (ebrSector < DiskSectors))
+   {
+      visited.insert(ebrSector);
+      const QByteArray ebr = reader(ebrSector, 1ull);
+      if(ebr.isEmpty())
+      {
+         return false;
+      }
+      if(!HasBootSignature(ebr))
+      {
+         break;
+      }
+      AddTableExtent(ebrSector, 1ull);
+
+      Partition logical;
+      logical.MbrType = (unsigned char)ebr.at(MBR_ENTRY_OFFSET + 4);
+      logical.FirstSector = ebrSector + ReadU32(ebr, MBR_ENTRY_OFFSET + 8);
+      logical.NumSectors = ReadU32(ebr, MBR_ENTRY_OFFSET + 12);
+      logical.Logical = true;
+      if((logical.MbrType != 0) && (logical.NumSectors != 0ull))
+      {
+         AddPartition(logical);
+      }
+
+      const int link = MBR_ENTRY_OFFSET + MBR_ENTRY_SIZE;
+      if(!IsExtendedType((unsigned char)ebr.at(link + 4)) || (ReadU32(ebr, link + 12) == 0u))
+      {
+         break;
+      }
+      ebrSector = extendedStart + ReadU32(ebr, link + 8);
+   }
+   return true;
+}
+
+bool PartitionTable::ReadGpt(const SectorReader& reader, const unsigned long long headerSector)
+{
+   const QByteArray header = reader(headerSector, 1ull);
+   if((header.size() < (int)GPT_MIN_HEADER_SIZE) || !header.startsWith(GPT_SIGNATURE))
+   {
+      return false;
+   }
+
+   const quint32 headerSize = ReadU32(header, GPT_HEADER_SIZE);
+   if((headerSize < GPT_MIN_HEADER_SIZE) || (headerSize > (quint32)header.size()) ||
+      (HeaderCrc(header) != ReadU32(header, GPT_HEADER_CRC)) || (ReadU64(header, GPT_MY_LBA) != headerSector))
+   {
+      return false;
+   }
+
+   const quint64 entriesSector = ReadU64(header, GPT_ENTRIES_LBA);
+   const quint32 numEntries = ReadU32(header, GPT_NUM_ENTRIES);
+   const quint32 entrySize = ReadU32(header, GPT_ENTRY_SIZE);
+   const quint64 entryBytes = (quint64)numEntries * entrySize;
+   if((entrySize < GPT_MIN_ENTRY_SIZE) || (entrySize % 8 != 0) || (entryBytes > GPT_MAX_ENTRY_BYTES))
+   {
+      return false;
+   }
+
+   const unsigned long long entrySectors = (entryBytes + SectorSize - 1) / SectorSize;
+   const QByteArray entries = reader(entriesSector, entrySectors);
+   if(entries.isEmpty() || (Crc32(entries.constData(), entryBytes) != ReadU32(header, GPT_ENTRIES_CRC)))
+   {
+      return false;
+   }
+
+   GptHeader = header;
+   GptEntries = entries.left(entryBytes);
+   AddTableExtent(headerSector, 1ull);
+   AddTableExtent(entriesSector, entrySectors);
+
+   const QByteArray unused(16, '\0');
+   for(quint32 i = 0; i < numEntries; i++)
+   {
+      const int entry = i * entrySize;
+      Partition partition;
+      partition.GptType = GptEntries.mid(entry, 16);
+      const quint64 firstSector = ReadU64(GptEntries, entry + 32);
+      const quint64 lastSector = ReadU64(GptEntries, entry + 40);
+      if((partition.GptType == unused) || (lastSector < firstSector))
+      {
+         continue;
+      }
+      partition.FirstSector = firstSector;
+      partition.NumSectors = lastSector - firstSector + 1ull;
+      AddPartition(partition);
+   }
+   return true;
+}
+
+void PartitionTable::AddPartition(const Partition& partition)
+{
+   // A hybrid MBR lists partitions that are in the GPT already
+   for(const Partition& known : Partitions)
+   {
+      if((known.FirstSector == partition.FirstSector) && (known.NumSectors == partition.NumSectors))
+      {
+         return;
+      }
+   }
+   Partitions.append(partition);
+}
+
+void PartitionTable::AddTableExtent(const unsigned long long firstSector, const unsigned long long numSectors)
+{
+   TableExtents.append(qMakePair(firstSector, firstSector + numSectors));
+}
+
+PartitionTable::Scheme PartitionTable::GetScheme() const
+{
+   return TableScheme;
+}
+
+bool PartitionTable::HasGpt() const
+{
+   return (TableScheme == Scheme::Gpt) || (TableScheme == Scheme::HybridMbr);
+}
+
+const QList<PartitionTable::Partition>& PartitionTable::GetPartitions() const
+{
+   return Partitions;
+}
+
+const QList<QPair<unsigned long long, unsigned long long>>& PartitionTable::GetTableExtents() const
+{
+   return TableExtents;
+}
+
+QPair<unsigned long long, unsigned long long> PartitionTable::GetBackupGptExtent() const
+{
+   if(!PrimaryGptValid)
+   {
+      return qMakePair(0ull, 0ull);
+   }
+
+   // The backup entries normally sit right in front of the backup header
+   const unsigned long long headerSector = ReadU64(GptHeader, GPT_ALTERNATE_LBA);
+   const unsigned long long entrySectors = GetBackupGptSectors() - 1ull;
+   return (headerSector >= entrySectors) ? qMakePair(headerSector - entrySectors, headerSector + 1ull) :
+                                           qMakePair(0ull, 0ull);
+}
+
+unsigned long long PartitionTable::GetAllocatedEnd() const
+{
+   unsigned long long end = 0ull;
+   for(const Partition& partition : Partitions)
+   {
+      end = qMax(end, partition.FirstSector + partition.NumSectors);
+   }
+   for(const QPair<unsigned long long, unsigned long long>& extent : TableExtents + ExtendedExtents)
+   {
+      end = qMax(end, extent.second);
+   }
+   return (DiskSectors > 0ull) ? qMin(end, DiskSectors) : end;
+}
+
+unsigned long long PartitionTable::GetBackupGptSectors() const
+{
+   return HasGpt() ? ((GptEntries.size() + SectorSize - 1) / SectorSize + 1ull) : 0ull;
+}
+
+bool PartitionTable::RelocateBackupGpt(const unsigned long long imageSectors, QByteArray* primaryHeader,
+                                       QByteArray* backupGpt) const
+{
+   // The primary entries are copied from the device as they are, so they have to be valid
+   const unsigned long long backupSectors = GetBackupGptSectors();
+   if(!PrimaryGptValid || (imageSectors < GetAllocatedEnd() + backupSectors))
+   {
+      return false;
+   }
+
+   const unsigned long long backupHeaderSector = imageSectors - 1ull;
+   const unsigned long long backupEntriesSector = imageSectors - backupSectors;
+
+   QByteArray primary = GptHeader;
+   qToLittleEndian<quint64>(backupHeaderSector, primary.data() + GPT_ALTERNATE_LBA);
+   qToLittleEndian<quint64>(backupEntriesSector - 1ull, primary.data() + GPT_LAST_USABLE_LBA);
+   qToLittleEndian<quint32>(HeaderCrc(primary), primary.data() + GPT_HEADER_CRC);
+
+   QByteArray backupHeader = primary;
+   qToLittleEndian<quint64>(backupHeaderSector, backupHeader.data() + GPT_MY_LBA);
+   qToLittleEndian<quint64>(1ull, backupHeader.data() + GPT_ALTERNATE_LBA);
+   qToLittleEndian<quint64>(backupEntriesSector, backupHeader.data() + GPT_ENTRIES_LBA);
+   qToLittleEndian<quint32>(HeaderCrc(backupHeader), backupHeader.data() + GPT_HEADER_CRC);
+
+   *primaryHeader = primary;
+   *backupGpt = GptEntries;
+   backupGpt->append(QByteArray((backupSectors - 1ull) * SectorSize - GptEntries.size(), '\0'));
+   backupGpt->append(backupHeader);
+   return true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <functional>
+
+// The partitions of a disk or image, from an MBR (including the logical
+// partitions in an extended partition), a GPT, or a hybrid of both. Used to
+// find how much of a device actually has to be imaged.
+class PartitionTable
+{
+public:
+   enum class Scheme : int
+   {
+      // No partition table was found
+      None = 0,
+      Mbr,
+      Gpt,
+      // A GPT whose protective MBR also lists some of its partitions
+      HybridMbr
+   };
+
+   struct Partition
+   {
+      unsigned long long FirstSector = 0ull;
+      unsigned long long NumSectors = 0ull;
+      // MBR partition type; 0 for a partition only found in the GPT
+      unsigned char MbrType = 0;
+      // GPT partition type GUID as stored on disk; empty for MBR partitions
+      QByteArray GptType;
+      bool Logical = false;
+   };
+
+   // Returns numSectors sectors starting at startSector, or an empty array if they cannot be read
+   using SectorReader = std::function<QByteArray(const unsigned long long startSector,
+                                                 const unsigned long long numSectors)>;
+
+   PartitionTable();
+
+   // Only fails if the disk cannot be read; a disk without a partition table
+   // is read successfully with the scheme None
+   bool Read(const SectorReader& reader, const unsigned long long sectorSize,
+             const unsigned long long diskSectors);
+
+   Scheme GetScheme() const;
+   bool HasGpt() const;
+   const QList<Partition>& GetPartitions() const;
+   // Sectors holding the partition tables themselves (MBR, EBRs, primary GPT), as [first, end) pairs
+   const QList<QPair<unsigned long long, unsigned long long>>& GetTableExtents() const;
+   // GPT only: where the primary header says the backup GPT is, as a [first, end) pair
+   QPair<unsigned long long, unsigned long long> GetBackupGptExtent() const;
+
+   // First sector after every partition, extended partition and the primary tables
+   unsigned long long GetAllocatedEnd() const;
+
+   // GPT only: the backup GPT (entries followed by header) has to be the last
+   // thing on the disk. For an image of imageSectors sectors this builds a
+   // primary header pointing at the new location and the backup to put
+   // there, which is GetBackupGptSectors() long.
+   unsigned long long GetBackupGptSectors() const;
+   bool RelocateBackupGpt(const unsigned long long imageSectors, QByteArray* primaryHeader,
+                          QByteArray* backupGpt) const;
+
+private:
+   bool ReadMbr(const SectorReader& reader, const QByteArray& mbr, bool* protective);
+   bool ReadExtendedPartition(const SectorReader& reader, const unsigned long long extendedStart);
+   bool ReadGpt(const SectorReader& reader, const unsigned long long headerSector);
+   void AddPartition(const Partition& partition);
+   void AddTableExtent(const unsigned long long firstSector, const unsigned long long numSectors);
+
+   unsigned long long SectorSize;
+   unsigned long long DiskSectors;
+   Scheme TableScheme;
+   QList<Partition> Partitions;
+   QList<QPair<unsigned long long, unsigned long long>> TableExtents;
+   QList<QPair<unsigned long long, unsigned long long>> ExtendedExtents;
+   // GPT only: the valid header and the whole entry array
+   QByteArray GptHeader;
+   QByteArray GptEntries;
+   bool PrimaryGptValid;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+// Static tracepoints (USDT) for bpftrace, perf and SystemTap, in the
+// "diskimager" provider. Where <sys/sdt.h> is available each one compiles to a
+// single nop plus a note in the binary, so it costs nothing until a tool
+// attaches; elsewhere, as in the Windows build, they compile to nothing.
+// Offsets and lengths are in bytes, latencies in nanoseconds. Example scripts
+// are in tools/bpftrace.
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define DISKIMAGER_HAVE_SDT 1
+#endif
+#endif
+
+#ifdef DISKIMAGER_HAVE_SDT
+
+// device: the drive ("E:") or image file the job works on, as a C string
+#define PROBE_JOB_START(job, type, device) DTRACE_PROBE3(diskimager, job__start, job, type, device)
+#define PROBE_JOB_DONE(job, succeeded, wallNs) DTRACE_PROBE3(diskimager, job__done, job, succeeded, wallNs)
+#define PROBE_READ_START(job, offset, length) DTRACE_PROBE3(diskimager, read__start, job, offset, length)
+#define PROBE_READ_DONE(job, offset, length, latencyNs, ok) \
+   DTRACE_PROBE5(diskimager, read__done, job, offset, length, latencyNs, ok)
+#define PROBE_WRITE_START(job, offset, length) DTRACE_PROBE3(diskimager, write__start, job, offset, length)
+#define PROBE_WRITE_DONE(job, offset, length, latencyNs, ok) \
+   DTRACE_PROBE5(diskimager, write__done, job, offset, length, latencyNs, ok)
+#define PROBE_FLUSH(job, latencyNs) DTRACE_PROBE2(diskimager, flush, job, latencyNs)
+#define PROBE_RETRY(job, offset, attempt) DTRACE_PROBE3(diskimager, retry, job, offset, attempt)
+// offset is -1 when only a whole-device hash was compared
+#define PROBE_VERIFY_MISMATCH(job, offset, length) DTRACE_PROBE3(diskimager, verify__mismatch, job, offset, length)
+
+#else
+
+#define PROBE_JOB_START(job, type, device) do {} while(0)
+#define PROBE_JOB_DONE(job, succeeded, wallNs) do {} while(0)
+#define PROBE_READ_START(job, offset, length) do {} while(0)
+#define PROBE_READ_DONE(job, offset, length, latencyNs, ok) do {} while(0)
+#define PROBE_WRITE_START(job, offset, length) do {} while(0)
+#define PROBE_WRITE_DONE(job, offset, length, latencyNs, ok) do {} while(0)
+#define PROBE_FLUSH(job, latencyNs) do {} while(0)
+#define PROBE_RETRY(job, offset, attempt) do {} while(0)
+#define PROBE_VERIFY_MISMATCH(job, offset, length) do {} while(0)
+
+#endif
@@ -0,0 +1,237 @@
+#include "rescuemap.h"
+#include <QFile>
+#include <QRegularExpression>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QStringList>
+
+RescueMap::RescueMap(const QString& imageFilePath)
+   : MapPath(PathForImage(imageFilePath))
+   , DeviceSize(0)
+   , CurrentPos(0)
+   , CurrentPass(1)
+   , Blocks()
+{}
+
+QString RescueMap::PathForImage(const QString& imageFilePath)
+{
+   return imageFilePath + ".map";
+}
+
+bool RescueMap::Load(const qint64 deviceSize)
+{
+   QFile file(MapPath);
+   if(!file.open(QIODevice::ReadOnly | QIODevice::Text))
+   {
+      return false;
+   }
+
+   QList<Block> blocks;
+   bool haveStatusLine = false;
+   QTextStream in(&file);
+   while(!in.atEnd())
+   {
+      const QString line = in.readLine().trimmed();
+      if(line.isEmpty() || line.startsWith('#'))
+      {
+         continue;
+      }
+
+      const QStringList fields = line.split(QRegularExpression("\\s+"));
+      bool posOk = false;
+      bool sizeOk = false;
+      if(!haveStatusLine)
+      {
+         // "current_pos current_status [current_pass]"
+         CurrentPos = fields.value(0).toLongLong(&posOk, 0);
+         CurrentPass = fields.value(2, "1").toInt();
+         haveStatusLine = posOk;
+         continue;
+      }
+
+      if(fields.size() < 3)
+      {
+         return false;
+      }
+
+      Block block;
+      block.Pos = fields.at(0).toLongLong(&posOk, 0);
+      block.Size = fields.at(1).toLongLong(&sizeOk, 0);
+      const char status = fields.at(2).at(0).toLatin1();
+      if(!posOk || !sizeOk)
+      {
+         return false;
+      }
+
+      switch(status)
+      {
+      case '?':
+      case '*':
+      case '-':
+      case '+':
+         block.Status = (BlockStatus)status;
+         break;
+      case '/':
+         // ddrescue's "non-scraped" is retried here the same way as non-trimmed
+         block.Status = BlockStatus::NonTrimmed;
+         break;
+      default:
+         return false;
+      }
+      blocks.append(block);
+   }
+
+   if(blocks.isEmpty() || (blocks.last().Pos + blocks.last().Size != deviceSize))
+   {
+      return false;
+   }
+
+   DeviceSize = deviceSize;
+   Blocks = blocks;
+   Merge();
+   return true;
+}
+
+bool RescueMap::Save()
+{
+   QSaveFile file(MapPath);
+   if(!file.open(QIODevice::WriteOnly | QIODevice::Text))
+   {
+      return false;
+   }
+
+   QTextStream out(&file);
+   out << "# Rescue mapfile. Created by Win32DiskImager\n";
+   out << "# current_pos  current_status  current_pass\n";
+   out << QString("0x%1     ?               %2\n").arg(CurrentPos, 8, 16, QChar('0')).arg(CurrentPass);
+   out << "#      pos        size  status\n";
+   for(const Block& block : Blocks)
+   {
+      out << QString("0x%1  0x%2  %3\n")
+                .arg(block.Pos, 8, 16, QChar('0'))
+                .arg(block.Size, 8, 16, QChar('0'))
+                .arg(QChar((char)block.Status));
+   }
+   out.flush();
+   return file.commit();
+}
+
+void RescueMap::Reset(const qint64 deviceSize)
+{
+   DeviceSize = deviceSize;
+   CurrentPos = 0;
+   CurrentPass = 1;
+   Blocks.clear();
+   Blocks.append({0, deviceSize, BlockStatus::NonTried});
+}
+
+void RescueMap::SetStatus(const qint64 pos, const qint64 size, const BlockStatus status)
+{
+   const qint64 end = pos + size;
+   QList<Block> updated;
+   bool inserted = false;
+   for(const Block& block : std::as_const(Blocks))
+   {
+      const qint64 blockEnd = block.Pos + block.Size;
+      if((blockEnd <= pos) || (block.Pos >= end))
+      {
+         updated.append(block);
+         continue;
+      }
+
+      // Keep whatever part of this block lies outside the new range
+      if(block.Pos < pos)
+      {
+         updated.append({block.Pos, pos - block.Pos, block.Status});
+      }
+      if(!inserted)
+      {
+         updated.append({pos, size, status});
+         inserted = true;
+      }
+      if(blockEnd > end)
+      {
+         updated.append({end, blockEnd - end, block.Status});
+      }
+   }
+
+   Blocks = updated;
+   Merge();
+}
+
+void RescueMap::ChangeStatus(const BlockStatus from, const BlockStatus to)
+{
+   for(Block& block : Blocks)
+   {
+      if(block.Status == from)
+      {
+         block.Status = to;
+      }
+   }
+   Merge();
+}
+
+QList<RescueMap::Block> RescueMap::GetBlocks(const BlockStatus status) const
+{
+   QList<Block> blocks;
+   for(const Block& block : Blocks)
+   {
+      if(block.Status == status)
+      {
+         blocks.append(block);
+      }
+   }
+   return blocks;
+}
+
+qint64 RescueMap::GetBytes(const BlockStatus status) const
+{
+   qint64 bytes = 0;
+   for(const Block& block : Blocks)
+   {
+      if(block.Status == status)
+      {
+         bytes += block.Size;
+      }
+   }
+   return bytes;
+}
+
+qint64 RescueMap::GetDeviceSize() const
+{
+   return DeviceSize;
+}
+
+const QString& RescueMap::GetFilePath() const
+{
+   return MapPath;
+}
+
+void RescueMap::SetCurrentPos(const qint64 pos, const int pass)
+{
+   CurrentPos = pos;
+   CurrentPass = pass;
+}
+
+void RescueMap::Merge()
+{
+   QList<Block> merged;
+   for(const Block& block : std::as_const(Blocks))
+   {
+      if(block.Size <= 0)
+      {
+         continue;
+      }
+
+      if(!merged.isEmpty() && (merged.last().Status == block.Status) &&
+         (merged.last().Pos + merged.last().Size == block.Pos))
+      {
+         merged.last().Size += block.Size;
+      }
+      else
+      {
+         merged.append(block);
+      }
+   }
+   Blocks = merged;
+}
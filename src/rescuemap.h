@@ -0,0 +1,53 @@
+#pragma once
+
+#include <QString>
+#include <QList>
+
+// Persistent record of which parts of a failing device have been copied, in
+// GNU ddrescue's mapfile format so the file can also be inspected or reused
+// with ddrescue itself. Positions and sizes are in bytes.
+class RescueMap
+{
+public:
+   enum class BlockStatus : char
+   {
+      NonTried = '?',
+      NonTrimmed = '*',
+      BadSector = '-',
+      Finished = '+'
+   };
+
+   struct Block
+   {
+      qint64 Pos;
+      qint64 Size;
+      BlockStatus Status;
+   };
+
+   explicit RescueMap(const QString& imageFilePath);
+
+   static QString PathForImage(const QString& imageFilePath);
+
+   // Fails if there is no map, it cannot be parsed or it is for another size of device
+   bool Load(const qint64 deviceSize);
+   bool Save();
+   void Reset(const qint64 deviceSize);
+
+   void SetStatus(const qint64 pos, const qint64 size, const BlockStatus status);
+   void ChangeStatus(const BlockStatus from, const BlockStatus to);
+   QList<Block> GetBlocks(const BlockStatus status) const;
+   qint64 GetBytes(const BlockStatus status) const;
+
+   qint64 GetDeviceSize() const;
+   const QString& GetFilePath() const;
+   void SetCurrentPos(const qint64 pos, const int pass);
+
+private:
+   void Merge();
+
+   const QString MapPath;
+   qint64 DeviceSize;
+   qint64 CurrentPos;
+   int CurrentPass;
+   QList<Block> Blocks;
+};
@@ -0,0 +1,81 @@
+#include "retryrunner.h"
+#include <climits>
+
+QString RetryPolicy::Validate() const
+{
+   if(MaxRetries < 0)
+   {
+      return "The retry count must not be negative.";
+   }
+   if((InitialBackoffMs < 0) || (MaxBackoffMs < 0))
+   {
+      return "The pauses between retries must not be negative.";
+   }
+   // Also what a negative count read into the unsigned field turns into
+   if((FallbackSectors == 0ull) || (FallbackSectors > (unsigned long long)INT_MAX))
+   {
+      return "The fallback transfer size must be between 1 and 2147483647 sectors.";
+   }
+   return QString();
+}
+
+RetryRunner::RetryRunner(const RetryPolicy& policy, const Wait& waitBeforeRetry)
+   : Policy(policy)
+   , WaitBeforeRetry(waitBeforeRetry)
+{}
+
+bool RetryRunner::Run(const unsigned long long startSector, const unsigned long long numSectors,
+                      const Transfer& transfer, bool* fellBack) const
+{
+   const bool canFallBack = (Policy.FallbackSectors > 0ull) && (numSectors > Policy.FallbackSectors);
+   if(fellBack != nullptr)
+   {
+      *fellBack = false;
+   }
+
+   const Outcome whole = TryWithRetries(startSector, numSectors, transfer, !canFallBack);
+   if((whole != Outcome::Failed) || !canFallBack)
+   {
+      return whole == Outcome::Done;
+   }
+
+   // The whole chunk keeps failing, so transfer it piece by piece
+   if(fellBack != nullptr)
+   {
+      *fellBack = true;
+   }
+   for(unsigned long long i = 0ull; i < numSectors; i += Policy.FallbackSectors)
+   {
+      const unsigned long long pieceSectors = qMin(Policy.FallbackSectors, numSectors - i);
+      if(TryWithRetries(startSector + i, pieceSectors, transfer, true) != Outcome::Done)
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+qint64 RetryRunner::BackoffMs(const RetryPolicy& policy, const int attempt)
+{
+   return qMin((qint64)policy.InitialBackoffMs << qMin(attempt - 1, 20), (qint64)policy.MaxBackoffMs);
+}
+
+RetryRunner::Outcome RetryRunner::TryWithRetries(const unsigned long long startSector,
+                                                 const unsigned long long numSectors,
+                                                 const Transfer& transfer, const bool reportFailure) const
+{
+   // Every transfer is tried at least once, whatever the policy says
+   const int maxRetries = qMax(Policy.MaxRetries, 0);
+   for(int attempt = 0; attempt <= maxRetries; attempt++)
+   {
+      if((attempt > 0) && !WaitBeforeRetry(attempt, startSector))
+      {
+         return Outcome::GaveUp;
+      }
+      if(transfer(startSector, numSectors, reportFailure && (attempt == maxRetries)))
+      {
+         return Outcome::Done;
+      }
+   }
+   return Outcome::Failed;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QtGlobal>
+#include <QString>
+#include <functional>
+
+// How a failed chunk transfer is retried before the job gives up on it
+struct RetryPolicy
+{
+   // Further attempts at the whole chunk after the first one failed
+   int MaxRetries = 3;
+   // Wait before the first retry; doubles for every further retry up to MaxBackoffMs
+   int InitialBackoffMs = 100;
+   int MaxBackoffMs = 5000;
+   // Once the whole chunk keeps failing, transfer it in pieces of this many
+   // sectors, each with its own retries; no smaller than the chunk disables
+   // the fallback
+   unsigned long long FallbackSectors = 64ull;
+
+   // What is wrong with the settings, empty if nothing is
+   QString Validate() const;
+};
+
+// Retries one chunk transfer under a RetryPolicy. It knows nothing of handles
+// or devices: the transfer and the wait between attempts are passed in, so
+// the same logic runs against a device in a job and against a plain file in
+// the tests.
+class RetryRunner
+{
+public:
+   // Transfers numSectors from startSector on. lastChance is set on the attempt
+   // after which the runner gives up, when a failure is worth reporting.
+   using Transfer = std::function<bool(const unsigned long long startSector,
+                                       const unsigned long long numSectors, const bool lastChance)>;
+   // Waits before the given attempt, 1 being the first retry; false gives up,
+   // e.g. because the job was cancelled
+   using Wait = std::function<bool(const int attempt, const unsigned long long startSector)>;
+
+   RetryRunner(const RetryPolicy& policy, const Wait& waitBeforeRetry);
+
+   // fellBack is set if the chunk had to be split into pieces
+   bool Run(const unsigned long long startSector, const unsigned long long numSectors,
+            const Transfer& transfer, bool* fellBack = nullptr) const;
+
+   static qint64 BackoffMs(const RetryPolicy& policy, const int attempt);
+
+private:
+   enum class Outcome
+   {
+      Done,
+      Failed,
+      GaveUp
+   };
+
+   Outcome TryWithRetries(const unsigned long long startSector, const unsigned long long numSectors,
+                          const Transfer& transfer, const bool reportFailure) const;
+
+   const RetryPolicy Policy;
+   const Wait WaitBeforeRetry;
+};
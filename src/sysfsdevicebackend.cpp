@@ -0,0 +1,85 @@
+#include "sysfsdevicebackend.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+namespace {
+// sysfs gives sizes in 512-byte units whatever the logical sector size
+const qint64 SYSFS_SECTOR_BYTES = 512;
+// Virtual and optical devices are never offered
+const char* const SKIPPED_PREFIXES[] = {"loop", "ram", "zram", "dm-", "md", "sr", "nbd", "fd"};
+}
+
+SysfsDeviceBackend::SysfsDeviceBackend(const QString& sysfsRoot, const QString& devRoot)
+   : SysfsRoot(sysfsRoot)
+   , DevRoot(devRoot)
+{}
+
+QList<DeviceInfo> SysfsDeviceBackend::ListCandidates() const
+{
+   QList<DeviceInfo> candidates;
+
+   // The entries are symlinks into the device tree
+   const QStringList disks = QDir(SysfsRoot + "/block").entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+   for(const QString& disk : disks)
+   {
+      bool skipped = false;
+      for(const char* prefix : SKIPPED_PREFIXES)
+      {
+         skipped = skipped || disk.startsWith(QLatin1String(prefix));
+      }
+      if(skipped)
+      {
+         continue;
+      }
+
+      // Card readers keep their node when the card is pulled, but the size
+      // drops to 0, so the identity changes with the medium
+      DeviceInfo device;
+      device.Name = DevRoot + "/" + disk;
+      QString serial = ReadAttribute(disk, "device/wwid");
+      if(serial.isEmpty())
+      {
+         serial = ReadAttribute(disk, "device/serial");
+      }
+      device.Identity = QString("%1|%2|%3|%4").arg(disk, ReadAttribute(disk, "dev"),
+                                                   ReadAttribute(disk, "size"), serial);
+      candidates.append(device);
+   }
+   return candidates;
+}
+
+bool SysfsDeviceBackend::Probe(DeviceInfo* device) const
+{
+   const QString disk = QFileInfo(device->Name).fileName();
+
+   // No medium in the slot
+   device->SizeBytes = ReadAttribute(disk, "size").toLongLong() * SYSFS_SECTOR_BYTES;
+   if(device->SizeBytes <= 0)
+   {
+      return false;
+   }
+
+   device->Model = (ReadAttribute(disk, "device/vendor") + " " + ReadAttribute(disk, "device/model")).simplified();
+
+   // Same rule as on Windows: removable, or fixed but on USB or a card
+   const bool removable = (ReadAttribute(disk, "removable") == "1");
+   const bool onUsb = QFileInfo(BlockPath(disk)).canonicalFilePath().contains("/usb");
+   const bool onCard = disk.startsWith("mmcblk");
+   return removable || onUsb || onCard;
+}
+
+QString SysfsDeviceBackend::BlockPath(const QString& disk) const
+{
+   return SysfsRoot + "/block/" + disk;
+}
+
+QString SysfsDeviceBackend::ReadAttribute(const QString& disk, const QString& attribute) const
+{
+   QFile file(BlockPath(disk) + "/" + attribute);
+   if(!file.open(QIODevice::ReadOnly))
+   {
+      return QString();
+   }
+   return QString::fromUtf8(file.readAll()).trimmed();
+}
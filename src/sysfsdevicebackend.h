@@ -0,0 +1,23 @@
+#pragma once
+
+#include "devicebackend.h"
+
+// Whole disks under <sysfs root>/block that are removable, on USB or MMC
+// cards, and have a medium in them. Everything comes from sysfs attribute
+// files, so pointing the roots at a directory tree laid out like /sys and /dev
+// is enough to exercise it without the hardware.
+class SysfsDeviceBackend : public DeviceBackend
+{
+public:
+   explicit SysfsDeviceBackend(const QString& sysfsRoot = "/sys", const QString& devRoot = "/dev");
+
+   QList<DeviceInfo> ListCandidates() const override;
+   bool Probe(DeviceInfo* device) const override;
+
+private:
+   QString BlockPath(const QString& disk) const;
+   QString ReadAttribute(const QString& disk, const QString& attribute) const;
+
+   const QString SysfsRoot;
+   const QString DevRoot;
+};
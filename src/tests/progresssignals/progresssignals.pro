@@ -0,0 +1,7 @@
+QT += testlib
+QT -= gui
+CONFIG += testcase console
+CONFIG -= app_bundle
+TARGET = tst_progresssignals
+
+SOURCES += tst_progresssignals.cpp
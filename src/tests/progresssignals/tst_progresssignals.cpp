@@ -0,0 +1,133 @@
+#include <QtTest>
+#include <QEventLoop>
+#include <QThread>
+#include <QTimer>
+#include <atomic>
+
+namespace {
+// 1 MiB chunks of 512 byte sectors, so one run is a 4 GiB image
+const unsigned long long CHUNKS = 4096ull;
+const unsigned long long SECTORS_PER_CHUNK = 2048ull;
+const unsigned long long SECTOR_SIZE = 512ull;
+const unsigned long long TOTAL_SECTORS = CHUNKS * SECTORS_PER_CHUNK;
+// Same as DriveIO's sampling interval
+const int SAMPLE_INTERVAL_MS = 100;
+}
+
+// Stands in for an imaging job that reports every chunk from its I/O thread
+class ChunkEmitter : public QObject
+{
+   Q_OBJECT
+
+signals:
+   void ProgressChanged(const int jobId, const unsigned long long sectorsDone,
+                        const unsigned long long totalSectors, const unsigned long long sectorSize);
+};
+
+// Compares the two ways an I/O thread can hand its progress to the thread that shows it.
+// Build in release mode for meaningful numbers.
+class ProgressSignalsTest : public QObject
+{
+   Q_OBJECT
+
+private slots:
+   void queuedSignalPerChunk();
+   void countersSampledByTimer();
+};
+
+void ProgressSignalsTest::queuedSignalPerChunk()
+{
+   unsigned long long updates = 0ull;
+   unsigned long long lastSectors = 0ull;
+   QBENCHMARK
+   {
+      updates = 0ull;
+      ChunkEmitter emitter;
+      QEventLoop loop;
+      // Queued, as between the scheduler's I/O threads and DriveIO
+      connect(&emitter, &ChunkEmitter::ProgressChanged, &loop,
+              [&](const int jobId, const unsigned long long sectorsDone,
+                  const unsigned long long totalSectors, const unsigned long long sectorSize)
+              {
+                 Q_UNUSED(jobId);
+                 Q_UNUSED(sectorSize);
+                 ++updates;
+                 lastSectors = sectorsDone;
+                 if(sectorsDone == totalSectors)
+                 {
+                    loop.quit();
+                 }
+              }, Qt::QueuedConnection);
+
+      QThread* worker = QThread::create([&emitter]()
+      {
+         for(unsigned long long chunk = 1ull; chunk <= CHUNKS; chunk++)
+         {
+            emit emitter.ProgressChanged(1, chunk * SECTORS_PER_CHUNK, TOTAL_SECTORS, SECTOR_SIZE);
+         }
+      });
+      worker->start();
+      loop.exec();
+      worker->wait();
+      delete worker;
+   }
+   QCOMPARE(updates, CHUNKS);
+   QCOMPARE(lastSectors, TOTAL_SECTORS);
+}
+
+void ProgressSignalsTest::countersSampledByTimer()
+{
+   unsigned long long samples = 0ull;
+   unsigned long long lastSectors = 0ull;
+   QBENCHMARK
+   {
+      samples = 0ull;
+      lastSectors = 0ull;
+      // The counters ImagingJob publishes through GetProgress
+      std::atomic<unsigned long long> progressSectors(0ull);
+      std::atomic<unsigned long long> progressTotal(0ull);
+      std::atomic<unsigned long long> progressSectorSize(0ull);
+      const auto sample = [&]()
+      {
+         const unsigned long long sectorsDone = progressSectors.load(std::memory_order_relaxed);
+         const unsigned long long totalSectors = progressTotal.load(std::memory_order_relaxed);
+         const unsigned long long sectorSize = progressSectorSize.load(std::memory_order_relaxed);
+         Q_UNUSED(totalSectors);
+         Q_UNUSED(sectorSize);
+         if(sectorsDone != lastSectors)
+         {
+            lastSectors = sectorsDone;
+            ++samples;
+         }
+      };
+
+      QEventLoop loop;
+      QTimer sampler;
+      sampler.setInterval(SAMPLE_INTERVAL_MS);
+      connect(&sampler, &QTimer::timeout, &loop, sample);
+
+      QThread* worker = QThread::create([&]()
+      {
+         for(unsigned long long chunk = 1ull; chunk <= CHUNKS; chunk++)
+         {
+            progressSectors.store(chunk * SECTORS_PER_CHUNK, std::memory_order_relaxed);
+            progressTotal.store(TOTAL_SECTORS, std::memory_order_relaxed);
+            progressSectorSize.store(SECTOR_SIZE, std::memory_order_relaxed);
+         }
+      });
+      connect(worker, &QThread::finished, &loop, &QEventLoop::quit);
+      sampler.start();
+      worker->start();
+      loop.exec();
+      sampler.stop();
+      worker->wait();
+      delete worker;
+      // Read once more at the end, as BatchRunner does when a job finishes
+      sample();
+   }
+   QVERIFY(samples >= 1ull);
+   QCOMPARE(lastSectors, TOTAL_SECTORS);
+}
+
+QTEST_GUILESS_MAIN(ProgressSignalsTest)
+#include "tst_progresssignals.moc"
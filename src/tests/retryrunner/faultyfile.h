@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QFile>
+#include <QMap>
+#include <QList>
+
+// A plain file whose transfers fail on demand. A transfer fails if it covers
+// a sector set to fail and is at least that fault's minimum length; every
+// failure uses up one of the fault's remaining failures.
+class FaultyFile
+{
+public:
+   struct Attempt
+   {
+      qint64 StartSector;
+      qint64 NumSectors;
+      bool LastChance;
+      bool Succeeded;
+   };
+
+   FaultyFile(const QString& filePath, const int sectorSize)
+      : Attempts()
+      , File(filePath)
+      , SectorSize(sectorSize)
+      , Faults()
+   {}
+
+   bool Open()
+   {
+      return File.open(QIODevice::ReadWrite | QIODevice::Truncate);
+   }
+
+   // times < 0 fails for good
+   void FailSector(const qint64 sector, const int times, const qint64 minSectors = 1)
+   {
+      Faults[sector] = {times, minSectors};
+   }
+
+   bool Write(const qint64 startSector, const qint64 numSectors, const char* data, const bool lastChance)
+   {
+      const bool ok = !Fails(startSector, numSectors) && File.seek(startSector * SectorSize) &&
+                      (File.write(data, numSectors * SectorSize) == numSectors * SectorSize);
+      Attempts.append({startSector, numSectors, lastChance, ok});
+      return ok;
+   }
+
+   QByteArray ReadAll()
+   {
+      File.flush();
+      File.seek(0);
+      return File.readAll();
+   }
+
+   QList<Attempt> Attempts;
+
+private:
+   struct Fault
+   {
+      int Remaining;
+      qint64 MinSectors;
+   };
+
+   bool Fails(const qint64 startSector, const qint64 numSectors)
+   {
+      for(auto it = Faults.begin(); it != Faults.end(); ++it)
+      {
+         const bool covered = (it.key() >= startSector) && (it.key() < startSector + numSectors);
+         if(covered && (numSectors >= it->MinSectors) && (it->Remaining != 0))
+         {
+            if(it->Remaining > 0)
+            {
+               it->Remaining--;
+            }
+            return true;
+         }
+      }
+      return false;
+   }
+
+   QFile File;
+   const int SectorSize;
+   QMap<qint64, Fault> Faults;
+};
@@ -0,0 +1,12 @@
+QT += testlib
+QT -= gui
+CONFIG += testcase console
+CONFIG -= app_bundle
+TARGET = tst_retryrunner
+INCLUDEPATH += ../..
+
+HEADERS += ../../retryrunner.h \
+           faultyfile.h
+
+SOURCES += tst_retryrunner.cpp \
+           ../../retryrunner.cpp
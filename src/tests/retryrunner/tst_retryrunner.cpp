@@ -0,0 +1,198 @@
+#include "retryrunner.h"
+#include "faultyfile.h"
+#include <QtTest>
+#include <QTemporaryDir>
+
+namespace {
+const int SECTOR_SIZE = 512;
+const qint64 CHUNK_SECTORS = 16;
+}
+
+class RetryRunnerTest : public QObject
+{
+   Q_OBJECT
+
+private slots:
+   void init();
+   void retriesWithBackoff();
+   void backoffIsCapped();
+   void fallsBackToSmallerTransfers();
+   void failsWhenAPieceKeepsFailing();
+   void givesUpWhenTheWaitIsRefused();
+   void rejectsInvalidPolicies();
+   void triesOnceWhateverTheRetryCount();
+
+private:
+   // Writes the test chunk to the file through a runner with the given policy
+   bool WriteChunk(const RetryPolicy& policy, bool* fellBack = nullptr);
+
+   QTemporaryDir Dir;
+   QScopedPointer<FaultyFile> File;
+   QByteArray Chunk;
+   QList<int> WaitedAttempts;
+   bool RefuseWait = false;
+};
+
+void RetryRunnerTest::init()
+{
+   QVERIFY(Dir.isValid());
+   File.reset(new FaultyFile(Dir.filePath("target.img"), SECTOR_SIZE));
+   QVERIFY(File->Open());
+
+   Chunk.resize(CHUNK_SECTORS * SECTOR_SIZE);
+   for(int i = 0; i < Chunk.size(); i++)
+   {
+      Chunk[i] = (char)(i * 7);
+   }
+   WaitedAttempts.clear();
+   RefuseWait = false;
+}
+
+bool RetryRunnerTest::WriteChunk(const RetryPolicy& policy, bool* fellBack)
+{
+   const RetryRunner runner(policy, [this](const int attempt, const unsigned long long startSector) {
+      Q_UNUSED(startSector);
+      WaitedAttempts.append(attempt);
+      return !RefuseWait;
+   });
+   const RetryRunner::Transfer write = [this](const unsigned long long startSector,
+                                              const unsigned long long numSectors, const bool lastChance) {
+      return File->Write(startSector, numSectors, Chunk.constData() + startSector * SECTOR_SIZE, lastChance);
+   };
+   return runner.Run(0ull, CHUNK_SECTORS, write, fellBack);
+}
+
+void RetryRunnerTest::retriesWithBackoff()
+{
+   RetryPolicy policy;
+   policy.MaxRetries = 3;
+   File->FailSector(3, 2);
+
+   bool fellBack = true;
+   QVERIFY(WriteChunk(policy, &fellBack));
+   QVERIFY(!fellBack);
+   QCOMPARE(File->Attempts.size(), 3);
+   QCOMPARE(WaitedAttempts, QList<int>({1, 2}));
+   QCOMPARE(File->ReadAll(), Chunk);
+}
+
+void RetryRunnerTest::backoffIsCapped()
+{
+   RetryPolicy policy;
+   policy.InitialBackoffMs = 100;
+   policy.MaxBackoffMs = 500;
+   QCOMPARE(RetryRunner::BackoffMs(policy, 1), 100ll);
+   QCOMPARE(RetryRunner::BackoffMs(policy, 2), 200ll);
+   QCOMPARE(RetryRunner::BackoffMs(policy, 3), 400ll);
+   QCOMPARE(RetryRunner::BackoffMs(policy, 4), 500ll);
+   QCOMPARE(RetryRunner::BackoffMs(policy, 100), 500ll);
+}
+
+void RetryRunnerTest::fallsBackToSmallerTransfers()
+{
+   RetryPolicy policy;
+   policy.MaxRetries = 2;
+   policy.FallbackSectors = 4;
+   // Whole-chunk writes over sector 9 always fail; pieces of 4 go through
+   File->FailSector(9, -1, 5);
+
+   bool fellBack = false;
+   QVERIFY(WriteChunk(policy, &fellBack));
+   QVERIFY(fellBack);
+   QCOMPARE(File->ReadAll(), Chunk);
+
+   // Three whole attempts, none reported, then four pieces that succeed at once
+   QCOMPARE(File->Attempts.size(), 3 + 4);
+   for(int i = 0; i < 3; i++)
+   {
+      QCOMPARE(File->Attempts.at(i).NumSectors, CHUNK_SECTORS);
+      QVERIFY(!File->Attempts.at(i).LastChance);
+   }
+   for(int i = 3; i < File->Attempts.size(); i++)
+   {
+      QCOMPARE(File->Attempts.at(i).StartSector, (qint64)(i - 3) * 4);
+      QCOMPARE(File->Attempts.at(i).NumSectors, 4ll);
+      QVERIFY(File->Attempts.at(i).Succeeded);
+   }
+}
+
+void RetryRunnerTest::failsWhenAPieceKeepsFailing()
+{
+   RetryPolicy policy;
+   policy.MaxRetries = 1;
+   policy.FallbackSectors = 8;
+   File->FailSector(10, -1);
+
+   bool fellBack = false;
+   QVERIFY(!WriteChunk(policy, &fellBack));
+   QVERIFY(fellBack);
+
+   // Two whole attempts, the first piece, then two attempts at the bad piece,
+   // the last of which is the one worth reporting
+   QCOMPARE(File->Attempts.size(), 2 + 1 + 2);
+   const FaultyFile::Attempt last = File->Attempts.last();
+   QCOMPARE(last.StartSector, 8ll);
+   QVERIFY(!last.Succeeded);
+   QVERIFY(last.LastChance);
+   QCOMPARE(WaitedAttempts, QList<int>({1, 1}));
+}
+
+void RetryRunnerTest::givesUpWhenTheWaitIsRefused()
+{
+   RetryPolicy policy;
+   policy.FallbackSectors = 4;
+   File->FailSector(0, -1);
+   RefuseWait = true;
+
+   bool fellBack = true;
+   QVERIFY(!WriteChunk(policy, &fellBack));
+   // A cancelled job does not go on to try the pieces
+   QVERIFY(!fellBack);
+   QCOMPARE(File->Attempts.size(), 1);
+}
+
+void RetryRunnerTest::rejectsInvalidPolicies()
+{
+   QVERIFY(RetryPolicy().Validate().isEmpty());
+
+   RetryPolicy noRetries;
+   noRetries.MaxRetries = 0;
+   QVERIFY(noRetries.Validate().isEmpty());
+
+   RetryPolicy negativeCount;
+   negativeCount.MaxRetries = -1;
+   QVERIFY(!negativeCount.Validate().isEmpty());
+
+   RetryPolicy negativeBackoff;
+   negativeBackoff.InitialBackoffMs = -100;
+   QVERIFY(!negativeBackoff.Validate().isEmpty());
+
+   RetryPolicy noFallbackSectors;
+   noFallbackSectors.FallbackSectors = 0ull;
+   QVERIFY(!noFallbackSectors.Validate().isEmpty());
+
+   // A negative size read from a job file wraps around in the unsigned field
+   RetryPolicy negativeFallback;
+   negativeFallback.FallbackSectors = (unsigned long long)(long long)-8;
+   QVERIFY(!negativeFallback.Validate().isEmpty());
+}
+
+void RetryRunnerTest::triesOnceWhateverTheRetryCount()
+{
+   RetryPolicy policy;
+   policy.MaxRetries = -1;
+   policy.FallbackSectors = CHUNK_SECTORS;
+
+   QVERIFY(WriteChunk(policy));
+   QCOMPARE(File->Attempts.size(), 1);
+   QVERIFY(WaitedAttempts.isEmpty());
+
+   // And a failure is still the last chance, so it gets reported
+   File->FailSector(0, -1);
+   QVERIFY(!WriteChunk(policy));
+   QCOMPARE(File->Attempts.size(), 2);
+   QVERIFY(File->Attempts.last().LastChance);
+}
+
+QTEST_APPLESS_MAIN(RetryRunnerTest)
+#include "tst_retryrunner.moc"
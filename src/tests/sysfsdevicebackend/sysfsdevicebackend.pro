@@ -0,0 +1,12 @@
+QT += testlib
+QT -= gui
+CONFIG += testcase console
+CONFIG -= app_bundle
+TARGET = tst_sysfsdevicebackend
+INCLUDEPATH += ../..
+
+HEADERS += ../../devicebackend.h \
+           ../../sysfsdevicebackend.h
+
+SOURCES += tst_sysfsdevicebackend.cpp \
+           ../../sysfsdevicebackend.cpp
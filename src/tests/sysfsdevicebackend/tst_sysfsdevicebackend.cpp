@@ -0,0 +1,150 @@
+#include "sysfsdevicebackend.h"
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+namespace {
+const char* const USB_PORT = "devices/pci0000:00/0000:00:14.0/usb1";
+}
+
+// Runs the backend against a tree laid out like /sys: the block entries are
+// symlinks to the disks in the device tree, as on a real system
+class SysfsDeviceBackendTest : public QObject
+{
+   Q_OBJECT
+
+private slots:
+   void initTestCase();
+   void listsWholeDisksOnly();
+   void identityFollowsTheMedium();
+   void acceptsUsbAndCardDisks();
+   void rejectsFixedDisksAndEmptySlots();
+
+private:
+   // Creates the disk under devicePath in the device tree and links it from block
+   void AddDisk(const QString& devicePath, const QString& disk, const QMap<QString, QString>& attributes);
+   void WriteAttribute(const QString& path, const QString& value);
+   DeviceInfo Candidate(const QString& disk) const;
+
+   QTemporaryDir Root;
+   QScopedPointer<SysfsDeviceBackend> Backend;
+};
+
+void SysfsDeviceBackendTest::initTestCase()
+{
+#ifdef Q_OS_WIN
+   QSKIP("The fake sysfs tree needs symlinks, which QFile::link does not create on Windows");
+#endif
+   QVERIFY(Root.isValid());
+   QVERIFY(QDir(Root.path()).mkpath("sys/block"));
+
+   AddDisk("devices/pci0000:00/0000:00:1f.2/ata1/host0/target0:0:0/0:0:0:0/block", "sda",
+           {{"dev", "8:0"}, {"size", "500118192"}, {"removable", "0"},
+            {"device/vendor", "ATA"}, {"device/model", "Samsung SSD"}});
+   AddDisk(QString(USB_PORT) + "/1-1/1-1:1.0/host6/target6:0:0/6:0:0:0/block", "sdb",
+           {{"dev", "8:16"}, {"size", "62333952"}, {"removable", "0"},
+            {"device/vendor", "SanDisk"}, {"device/model", "Ultra Fit"}, {"device/wwid", "t10.SanDisk 4C53"}});
+   // A card reader slot without a card
+   AddDisk(QString(USB_PORT) + "/1-2/1-2:1.0/host7/target7:0:0/7:0:0:0/block", "sdc",
+           {{"dev", "8:32"}, {"size", "0"}, {"removable", "1"},
+            {"device/vendor", "Generic"}, {"device/model", "SD Reader"}});
+   AddDisk("devices/platform/mmc0/mmc_host/mmc0/mmc0:0001/block", "mmcblk0",
+           {{"dev", "179:0"}, {"size", "31116288"}, {"removable", "0"}, {"device/serial", "0x1234abcd"}});
+   AddDisk("devices/virtual/block", "loop0",
+           {{"dev", "7:0"}, {"size", "2048"}, {"removable", "0"}});
+   AddDisk("devices/virtual/block", "dm-0",
+           {{"dev", "253:0"}, {"size", "2048"}, {"removable", "0"}});
+
+   Backend.reset(new SysfsDeviceBackend(Root.filePath("sys"), "/dev"));
+}
+
+void SysfsDeviceBackendTest::AddDisk(const QString& devicePath, const QString& disk,
+                                     const QMap<QString, QString>& attributes)
+{
+   const QString diskPath = Root.filePath("sys/" + devicePath + "/" + disk);
+   QVERIFY(QDir().mkpath(diskPath));
+   for(auto it = attributes.constBegin(); it != attributes.constEnd(); ++it)
+   {
+      WriteAttribute(diskPath + "/" + it.key(), it.value());
+   }
+   QVERIFY(QFile::link(diskPath, Root.filePath("sys/block/" + disk)));
+}
+
+void SysfsDeviceBackendTest::WriteAttribute(const QString& path, const QString& value)
+{
+   QVERIFY(QDir().mkpath(QFileInfo(path).absolutePath()));
+   QFile file(path);
+   QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+   // Attribute files end in a newline
+   file.write(value.toUtf8() + '\n');
+}
+
+DeviceInfo SysfsDeviceBackendTest::Candidate(const QString& disk) const
+{
+   for(const DeviceInfo& candidate : Backend->ListCandidates())
+   {
+      if(candidate.Name == "/dev/" + disk)
+      {
+         return candidate;
+      }
+   }
+   return DeviceInfo();
+}
+
+void SysfsDeviceBackendTest::listsWholeDisksOnly()
+{
+   QStringList names;
+   for(const DeviceInfo& candidate : Backend->ListCandidates())
+   {
+      names.append(candidate.Name);
+   }
+   // Loop and device mapper nodes are never offered
+   QCOMPARE(names, QStringList({"/dev/mmcblk0", "/dev/sda", "/dev/sdb", "/dev/sdc"}));
+
+   QCOMPARE(Candidate("sdb").Identity, QString("sdb|8:16|62333952|t10.SanDisk 4C53"));
+   QCOMPARE(Candidate("mmcblk0").Identity, QString("mmcblk0|179:0|31116288|0x1234abcd"));
+}
+
+void SysfsDeviceBackendTest::identityFollowsTheMedium()
+{
+   const QString sdc = Root.filePath("sys/block/sdc/size");
+   const QString empty = Candidate("sdc").Identity;
+
+   // A card goes into the reader
+   WriteAttribute(sdc, "3862528");
+   const QString inserted = Candidate("sdc").Identity;
+   QVERIFY(inserted != empty);
+
+   WriteAttribute(sdc, "0");
+   QCOMPARE(Candidate("sdc").Identity, empty);
+}
+
+void SysfsDeviceBackendTest::acceptsUsbAndCardDisks()
+{
+   // Fixed, but on USB
+   DeviceInfo sdb = Candidate("sdb");
+   QVERIFY(Backend->Probe(&sdb));
+   QCOMPARE(sdb.SizeBytes, 62333952ll * 512);
+   QCOMPARE(sdb.Model, QString("SanDisk Ultra Fit"));
+
+   DeviceInfo mmcblk0 = Candidate("mmcblk0");
+   QVERIFY(Backend->Probe(&mmcblk0));
+   QCOMPARE(mmcblk0.SizeBytes, 31116288ll * 512);
+   QCOMPARE(mmcblk0.Model, QString());
+}
+
+void SysfsDeviceBackendTest::rejectsFixedDisksAndEmptySlots()
+{
+   DeviceInfo sda = Candidate("sda");
+   QVERIFY(!Backend->Probe(&sda));
+
+   // Removable, but there is nothing in it
+   DeviceInfo sdc = Candidate("sdc");
+   QVERIFY(!Backend->Probe(&sdc));
+   QCOMPARE(sdc.SizeBytes, 0ll);
+}
+
+QTEST_APPLESS_MAIN(SysfsDeviceBackendTest)
+#include "tst_sysfsdevicebackend.moc"
@@ -0,0 +1,6 @@
+# Unit tests for the parts that do not need a device: qmake && make check
+TEMPLATE = subdirs
+SUBDIRS += retryrunner \
+           throughputestimator \
+           progresssignals \
+           sysfsdevicebackend
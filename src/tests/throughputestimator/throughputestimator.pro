@@ -0,0 +1,11 @@
+QT += testlib
+QT -= gui
+CONFIG += testcase console
+CONFIG -= app_bundle
+TARGET = tst_throughputestimator
+INCLUDEPATH += ../..
+
+HEADERS += ../../throughputestimator.h
+
+SOURCES += tst_throughputestimator.cpp \
+           ../../throughputestimator.cpp
@@ -0,0 +1,126 @@
+#include "throughputestimator.h"
+#include <QtTest>
+
+namespace {
+// Amounts are in MB, so a rate of 10 is 10 MB/s
+const qint64 TOTAL = 1000;
+const qint64 SAMPLE_INTERVAL_MS = 1000;
+}
+
+class ThroughputEstimatorTest : public QObject
+{
+   Q_OBJECT
+
+private slots:
+   void init();
+   void ignoresTheSlowStart();
+   void flushPausesHardlyMoveTheEta();
+   void etaCoversTransferFlushAndVerify();
+   void restartCountsFromZero();
+
+private:
+   // One sample a second after fromMs up to toMs, perSecond more done each
+   void Feed(const qint64 fromMs, const qint64 toMs, const qint64 perSecond, const qint64 total,
+             const ThroughputEstimator::Phase phase = ThroughputEstimator::Phase::Transfer);
+
+   ThroughputEstimator Estimator;
+   qint64 Done = 0;
+};
+
+void ThroughputEstimatorTest::init()
+{
+   Estimator.Reset(false);
+   Done = 0;
+}
+
+void ThroughputEstimatorTest::Feed(const qint64 fromMs, const qint64 toMs, const qint64 perSecond,
+                                   const qint64 total, const ThroughputEstimator::Phase phase)
+{
+   for(qint64 ms = fromMs + SAMPLE_INTERVAL_MS; ms <= toMs; ms += SAMPLE_INTERVAL_MS)
+   {
+      Done += perSecond;
+      Estimator.AddSample(ms, Done, total, phase);
+   }
+}
+
+void ThroughputEstimatorTest::ignoresTheSlowStart()
+{
+   Estimator.AddSample(0, 0, TOTAL, ThroughputEstimator::Phase::Transfer);
+   Feed(0, 2000, 1, TOTAL);
+   QCOMPARE(Estimator.GetRemainingMs(), -1ll);
+
+   // The first two seconds ran at a tenth of the speed and count for nothing
+   Feed(2000, 3000, 10, TOTAL);
+   QCOMPARE(Estimator.GetSmoothedRate(), 10.0);
+   Feed(3000, 10000, 10, TOTAL);
+   QCOMPARE(Done, 82ll);
+   QCOMPARE(Estimator.GetRemainingMs(), (TOTAL - 82) * 1000 / 10);
+}
+
+void ThroughputEstimatorTest::flushPausesHardlyMoveTheEta()
+{
+   Estimator.AddSample(0, 0, TOTAL, ThroughputEstimator::Phase::Transfer);
+   Feed(0, 30000, 10, TOTAL);
+   const qint64 before = Estimator.GetRemainingMs();
+   QCOMPARE(before, (TOTAL - 300) * 1000 / 10);
+
+   // The device stops for three seconds to flush its write cache
+   Feed(30000, 33000, 0, TOTAL);
+   QVERIFY(Estimator.GetRate() < 5.0);
+   const qint64 after = Estimator.GetRemainingMs();
+   QVERIFY(after > before);
+   QVERIFY(after < before * 12 / 10);
+
+   // And then carries on at its old speed
+   Feed(33000, 40000, 10, TOTAL);
+   QCOMPARE(Estimator.GetRate(), 10.0);
+}
+
+void ThroughputEstimatorTest::etaCoversTransferFlushAndVerify()
+{
+   const qint64 total = 100;
+   Estimator.Reset(true);
+   Estimator.AddSample(0, 0, total, ThroughputEstimator::Phase::Transfer);
+   Feed(0, 5000, 10, total);
+   // The rest of the transfer, and a verify pass taken to be as fast
+   QCOMPARE(Estimator.GetRemainingMs(), 5000ll + 10000ll);
+
+   Feed(5000, 9000, 10, total);
+   Feed(9000, 10000, 10, total, ThroughputEstimator::Phase::Flush);
+   QCOMPARE(Done, total);
+   QCOMPARE(Estimator.GetRemainingMs(), 10000ll);
+   // Flushing moves nothing, and must not count as a slow transfer
+   Feed(10000, 12000, 0, total, ThroughputEstimator::Phase::Flush);
+   QCOMPARE(Estimator.GetSmoothedRate(), 10.0);
+   QCOMPARE(Estimator.GetRemainingMs(), 10000ll);
+
+   // Verifying counts from 0 again, at twice the speed
+   Done = 0;
+   Estimator.AddSample(13000, 0, total, ThroughputEstimator::Phase::Verify);
+   QCOMPARE(Estimator.GetRemainingMs(), -1ll);
+   Feed(13000, 15000, 20, total, ThroughputEstimator::Phase::Verify);
+   QCOMPARE(Estimator.GetRemainingMs(), -1ll);
+   Feed(15000, 16000, 20, total, ThroughputEstimator::Phase::Verify);
+   QCOMPARE(Estimator.GetSmoothedRate(), 20.0);
+   QCOMPARE(Estimator.GetRemainingMs(), (total - 60) * 1000 / 20);
+}
+
+void ThroughputEstimatorTest::restartCountsFromZero()
+{
+   Estimator.AddSample(0, 0, TOTAL, ThroughputEstimator::Phase::Transfer);
+   Feed(0, 10000, 10, TOTAL);
+
+   // A job that starts its transfer over keeps the rate it measured
+   Done = 0;
+   Estimator.AddSample(11000, 0, TOTAL, ThroughputEstimator::Phase::Transfer);
+   QCOMPARE(Estimator.GetRate(), 0.0);
+   QCOMPARE(Estimator.GetSmoothedRate(), 10.0);
+   QCOMPARE(Estimator.GetRemainingMs(), TOTAL * 1000 / 10);
+
+   Feed(11000, 12000, 10, TOTAL);
+   QCOMPARE(Estimator.GetRate(), 10.0);
+   QCOMPARE(Estimator.GetRemainingMs(), (TOTAL - 10) * 1000 / 10);
+}
+
+QTEST_APPLESS_MAIN(ThroughputEstimatorTest)
+#include "tst_throughputestimator.moc"
@@ -0,0 +1,163 @@
+#include "throughputestimator.h"
+#include <cmath>
+
+namespace {
+const qint64 WINDOW_MS = 5000;
+// Opening the device, the first reads into an empty cache and the like make
+// the start of every phase much slower than the rest
+const qint64 WARMUP_MS = 2000;
+// Long enough that a cache flush pause of a few seconds moves the ETA by a
+// few percent, short enough to follow a card that really slows down
+const double SMOOTHING_TIME_CONSTANT_MS = 20000.0;
+const double MS_PER_SECOND = 1000.0;
+}
+
+ThroughputEstimator::ThroughputEstimator()
+   : VerifyFollows(false)
+   , CurrentPhase(Phase::Transfer)
+   , PhaseStartMs(0)
+   , Total(0)
+   , LastMs(0)
+   , LastDone(0)
+   , TransferRate(-1.0)
+   , VerifyRate(-1.0)
+   , Window()
+   , WindowFirst(0)
+   , WindowCount(0)
+{}
+
+void ThroughputEstimator::Reset(const bool verifyFollows)
+{
+   *this = ThroughputEstimator();
+   VerifyFollows = verifyFollows;
+}
+
+void ThroughputEstimator::StartPhase(const qint64 ms, const qint64 done, const Phase phase)
+{
+   CurrentPhase = phase;
+   PhaseStartMs = ms;
+   LastMs = ms;
+   LastDone = done;
+   WindowCount = 0;
+   AddToWindow(ms, done);
+}
+
+void ThroughputEstimator::AddToWindow(const qint64 ms, const qint64 done)
+{
+   while((WindowCount > 0) && ((ms - Window[WindowFirst].Ms > WINDOW_MS) || (WindowCount == WINDOW_SAMPLES)))
+   {
+      WindowFirst = (WindowFirst + 1) % WINDOW_SAMPLES;
+      WindowCount--;
+   }
+   Window[(WindowFirst + WindowCount) % WINDOW_SAMPLES] = {ms, done};
+   WindowCount++;
+}
+
+void ThroughputEstimator::AddSample(const qint64 ms, const qint64 done, const qint64 total, const Phase phase)
+{
+   Total = total;
+   // The verify pass counts from 0 again; so does a job that restarts its transfer
+   if((phase != CurrentPhase) || (done < LastDone) || (WindowCount == 0))
+   {
+      StartPhase(ms, done, phase);
+      return;
+   }
+
+   const qint64 intervalMs = ms - LastMs;
+   if(intervalMs <= 0)
+   {
+      return;
+   }
+   AddToWindow(ms, done);
+
+   // Flushing moves no data, and must not drag the transfer rate down
+   double* rate = (phase == Phase::Verify) ? &VerifyRate : &TransferRate;
+   if((phase != Phase::Flush) && (ms - PhaseStartMs >= WARMUP_MS))
+   {
+      const double current = (done - LastDone) * MS_PER_SECOND / intervalMs;
+      if(*rate < 0.0)
+      {
+         // Seeded from the window rather than one interval, which may be a pause,
+         // but only from the part of it past the warm-up
+         *rate = GetWindowRateSince(PhaseStartMs + WARMUP_MS);
+      }
+      else
+      {
+         const double weight = 1.0 - std::exp(-intervalMs / SMOOTHING_TIME_CONSTANT_MS);
+         *rate += weight * (current - *rate);
+      }
+   }
+   LastMs = ms;
+   LastDone = done;
+}
+
+double ThroughputEstimator::GetRate() const
+{
+   if(WindowCount < 2)
+   {
+      return 0.0;
+   }
+
+   const Sample& first = Window[WindowFirst];
+   const Sample& last = Window[(WindowFirst + WindowCount - 1) % WINDOW_SAMPLES];
+   return (last.Ms > first.Ms) ? (last.Done - first.Done) * MS_PER_SECOND / (last.Ms - first.Ms) : 0.0;
+}
+
+double ThroughputEstimator::GetWindowRateSince(const qint64 fromMs) const
+{
+   int first = 0;
+   while((first < WindowCount) && (Window[(WindowFirst + first) % WINDOW_SAMPLES].Ms < fromMs))
+   {
+      first++;
+   }
+   if(WindowCount - first < 2)
+   {
+      return -1.0;
+   }
+
+   const Sample& from = Window[(WindowFirst + first) % WINDOW_SAMPLES];
+   const Sample& last = Window[(WindowFirst + WindowCount - 1) % WINDOW_SAMPLES];
+   return (last.Ms > from.Ms) ? (last.Done - from.Done) * MS_PER_SECOND / (last.Ms - from.Ms) : 0.0;
+}
+
+double ThroughputEstimator::GetSmoothedRate() const
+{
+   const double rate = (CurrentPhase == Phase::Verify) ? VerifyRate : TransferRate;
+   return qMax(0.0, rate);
+}
+
+qint64 ThroughputEstimator::GetRemainingMs() const
+{
+   // Until it has been measured, verifying is taken to be as fast as the transfer
+   const double verifyRate = (VerifyRate > 0.0) ? VerifyRate : TransferRate;
+   double remainingMs = 0.0;
+   switch(CurrentPhase)
+   {
+   case Phase::Transfer:
+      if(TransferRate <= 0.0)
+      {
+         return -1;
+      }
+      remainingMs = qMax(0ll, Total - LastDone) * MS_PER_SECOND / TransferRate;
+      if(VerifyFollows)
+      {
+         remainingMs += Total * MS_PER_SECOND / verifyRate;
+      }
+      break;
+   case Phase::Flush:
+      if(VerifyFollows && (verifyRate <= 0.0))
+      {
+         return -1;
+      }
+      remainingMs = VerifyFollows ? Total * MS_PER_SECOND / verifyRate : 0.0;
+      break;
+   case Phase::Verify:
+      if(VerifyRate <= 0.0)
+      {
+         return -1;
+      }
+      remainingMs = qMax(0ll, Total - LastDone) * MS_PER_SECOND / VerifyRate;
+      break;
+   }
+   return (qint64)remainingMs;
+}
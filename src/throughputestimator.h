@@ -0,0 +1,66 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Turns progress samples into a throughput and a time left that hold steady
+// through the slow start of a transfer and the pauses of write cache flushes.
+// The rate to show is the average over the last few seconds. The time left
+// uses an exponentially weighted average with a long time constant, ignores
+// the first seconds of every phase, and covers the phases still to come: the
+// rest of the transfer, the flush, and a verify pass over the same amount of
+// data if one follows. Amounts may be in any unit, bytes or sectors, as long
+// as every call uses the same one.
+class ThroughputEstimator
+{
+public:
+   enum class Phase : int
+   {
+      Transfer = 0,
+      // Everything is transferred but the job has not finished or started verifying
+      Flush,
+      Verify
+   };
+
+   ThroughputEstimator();
+
+   void Reset(const bool verifyFollows);
+   // done counts up from 0 in each of the transfer and the verify pass
+   void AddSample(const qint64 ms, const qint64 done, const qint64 total, const Phase phase);
+
+   // Per second, over the last WINDOW_MS; 0 until there are two samples
+   double GetRate() const;
+   // Per second, smoothed over much longer; what the time left is based on
+   double GetSmoothedRate() const;
+   // Milliseconds, or -1 while there is too little data. A flush takes as
+   // long as it takes; its time is not known until it is over.
+   qint64 GetRemainingMs() const;
+
+private:
+   static constexpr int WINDOW_SAMPLES = 64;
+
+   struct Sample
+   {
+      qint64 Ms;
+      qint64 Done;
+   };
+
+   void StartPhase(const qint64 ms, const qint64 done, const Phase phase);
+   void AddToWindow(const qint64 ms, const qint64 done);
+   // Like GetRate, over the samples of the window taken at fromMs or later; -1 with fewer than two
+   double GetWindowRateSince(const qint64 fromMs) const;
+
+   bool VerifyFollows;
+   Phase CurrentPhase;
+   qint64 PhaseStartMs;
+   qint64 Total;
+   qint64 LastMs;
+   qint64 LastDone;
+   // Per phase; negative until the phase is past its warm-up
+   double TransferRate;
+   double VerifyRate;
+
+   // Ring buffer of the samples of the last WINDOW_MS
+   Sample Window[WINDOW_SAMPLES];
+   int WindowFirst;
+   int WindowCount;
+};
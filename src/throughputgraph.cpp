@@ -0,0 +1,123 @@
+#include "throughputgraph.h"
+#include <QPainter>
+#include <QTimer>
+
+namespace {
+// The progress samples of DriveIO come ten times a second, so a point starts out as a second
+const int INITIAL_SAMPLES_PER_POINT = 10;
+const int MIN_REPAINT_INTERVAL_MS = 500;
+const int GRAPH_WIDTH = 120;
+}
+
+ThroughputGraph::ThroughputGraph(QWidget* parent)
+   : QWidget(parent)
+   , Rates()
+   , Latencies()
+   , Count(0)
+   , MaxRate(0.0f)
+   , MaxLatency(0.0f)
+   , SamplesPerPoint(INITIAL_SAMPLES_PER_POINT)
+   , PendingSamples(0)
+   , PendingRate(0.0)
+   , PendingLatency(0.0)
+   , LastRepaint()
+   , RepaintPending(false)
+   , Points()
+{
+   LastRepaint.start();
+   setToolTip(tr("Throughput (MB/s) and request latency (ms) of the current job"));
+}
+
+void ThroughputGraph::Reset()
+{
+   Count = 0;
+   MaxRate = 0.0f;
+   MaxLatency = 0.0f;
+   SamplesPerPoint = INITIAL_SAMPLES_PER_POINT;
+   PendingSamples = 0;
+   PendingRate = 0.0;
+   PendingLatency = 0.0;
+   update();
+}
+
+void ThroughputGraph::AddSample(const double mbPerSecond, const double latencyMs)
+{
+   PendingRate += mbPerSecond;
+   PendingLatency += latencyMs;
+   if(++PendingSamples < SamplesPerPoint)
+   {
+      return;
+   }
+
+   AppendPoint(PendingRate / PendingSamples, PendingLatency / PendingSamples);
+   PendingSamples = 0;
+   PendingRate = 0.0;
+   PendingLatency = 0.0;
+
+   if(LastRepaint.elapsed() >= MIN_REPAINT_INTERVAL_MS)
+   {
+      update();
+   }
+   else if(!RepaintPending)
+   {
+      RepaintPending = true;
+      QTimer::singleShot(MIN_REPAINT_INTERVAL_MS - LastRepaint.elapsed(), this, [this]() { update(); });
+   }
+}
+
+void ThroughputGraph::AppendPoint(const float mbPerSecond, const float latencyMs)
+{
+   if(Count == CAPACITY)
+   {
+      // Halve the resolution rather than forget the start of the job
+      for(int i = 0; i < CAPACITY / 2; i++)
+      {
+         Rates[i] = (Rates[2 * i] + Rates[2 * i + 1]) / 2.0f;
+         Latencies[i] = (Latencies[2 * i] + Latencies[2 * i + 1]) / 2.0f;
+      }
+      Count = CAPACITY / 2;
+      SamplesPerPoint *= 2;
+   }
+
+   Rates[Count] = mbPerSecond;
+   Latencies[Count] = latencyMs;
+   Count++;
+   // Peaks are kept even once merged away, so the scale never jumps down mid-job
+   MaxRate = qMax(MaxRate, mbPerSecond);
+   MaxLatency = qMax(MaxLatency, latencyMs);
+}
+
+QSize ThroughputGraph::sizeHint() const
+{
+   return QSize(GRAPH_WIDTH, fontMetrics().height());
+}
+
+void ThroughputGraph::DrawSeries(QPainter* painter, const float* values, const float maximum)
+{
+   const QRectF area = QRectF(rect()).adjusted(1.0, 1.0, -1.0, -1.0);
+   const qreal step = area.width() / (CAPACITY - 1);
+   for(int i = 0; i < Count; i++)
+   {
+      const qreal fraction = (maximum > 0.0f) ? values[i] / maximum : 0.0;
+      Points[i] = QPointF(area.left() + i * step, area.bottom() - fraction * area.height());
+   }
+   painter->drawPolyline(Points, Count);
+}
+
+void ThroughputGraph::paintEvent(QPaintEvent* event)
+{
+   Q_UNUSED(event);
+   RepaintPending = false;
+   LastRepaint.start();
+   if(Count < 2)
+   {
+      return;
+   }
+
+   QPainter painter(this);
+   painter.setRenderHint(QPainter::Antialiasing);
+   painter.setPen(QPen(palette().color(QPalette::Disabled, QPalette::WindowText), 1.0));
+   DrawSeries(&painter, Latencies, MaxLatency);
+   painter.setPen(QPen(palette().color(QPalette::Highlight), 1.5));
+   DrawSeries(&painter, Rates, MaxRate);
+}
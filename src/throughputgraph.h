@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QWidget>
+#include <QElapsedTimer>
+
+// A sparkline of throughput (and request latency, fainter) for the status bar.
+// It holds the whole job in a fixed number of points: once they are all used,
+// neighbouring points are merged and each point from then on covers twice as
+// many samples. Nothing is allocated per sample or per paint, and it repaints
+// at most every MIN_REPAINT_INTERVAL_MS however fast samples arrive.
+class ThroughputGraph : public QWidget
+{
+   Q_OBJECT
+
+public:
+   explicit ThroughputGraph(QWidget* parent = nullptr);
+
+   void Reset();
+   // Throughput and mean request latency since the previous sample
+   void AddSample(const double mbPerSecond, const double latencyMs);
+
+   QSize sizeHint() const override;
+
+protected:
+   void paintEvent(QPaintEvent* event) override;
+
+private:
+   static constexpr int CAPACITY = 120;
+
+   void AppendPoint(const float mbPerSecond, const float latencyMs);
+   void DrawSeries(QPainter* painter, const float* values, const float maximum);
+
+   float Rates[CAPACITY];
+   float Latencies[CAPACITY];
+   int Count;
+   float MaxRate;
+   float MaxLatency;
+
+   // The point being filled
+   int SamplesPerPoint;
+   int PendingSamples;
+   double PendingRate;
+   double PendingLatency;
+
+   QElapsedTimer LastRepaint;
+   bool RepaintPending;
+   QPointF Points[CAPACITY];
+};
@@ -0,0 +1,134 @@
+#include "tracer.h"
+#include <QSaveFile>
+#include <QThread>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QList>
+#include <QVector>
+#include <chrono>
+
+namespace {
+// Events are written to the file in pieces of about this size
+const int WRITE_BUFFER_BYTES = 1024 * 1024;
+
+struct ThreadBuffer
+{
+   QVector<Tracer::Event> Events;
+   // Events ever written; slot is Written % Events.size()
+   std::atomic<quint64> Written;
+   int ThreadIndex;
+   QString ThreadName;
+};
+
+QMutex BuffersLock;
+// Kept until the process ends, since pool threads outlive any single save
+QList<ThreadBuffer*> Buffers;
+int EventsPerThread = 0;
+std::chrono::steady_clock::time_point Origin;
+thread_local ThreadBuffer* CurrentBuffer = nullptr;
+
+ThreadBuffer* RegisterThread()
+{
+   ThreadBuffer* buffer = new ThreadBuffer();
+   buffer->Events.resize(EventsPerThread);
+   buffer->Written.store(0ull, std::memory_order_relaxed);
+
+   QMutexLocker locker(&BuffersLock);
+   buffer->ThreadIndex = Buffers.size() + 1;
+   const QString threadName = QThread::currentThread()->objectName();
+   buffer->ThreadName = QString("%1 #%2").arg(threadName.isEmpty() ? QString("Thread") : threadName)
+                                         .arg(buffer->ThreadIndex);
+   Buffers.append(buffer);
+   return buffer;
+}
+
+QByteArray Micros(const qint64 nanos)
+{
+   return QByteArray::number(nanos / 1000.0, 'f', 3);
+}
+}
+
+std::atomic<bool> Tracer::Enabled(false);
+
+void Tracer::Enable(const int eventsPerThread)
+{
+   EventsPerThread = qMax(1, eventsPerThread);
+   Origin = std::chrono::steady_clock::now();
+   Enabled.store(true, std::memory_order_release);
+}
+
+void Tracer::Disable()
+{
+   Enabled.store(false, std::memory_order_release);
+}
+
+qint64 Tracer::Now()
+{
+   return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Origin).count();
+}
+
+void Tracer::Record(const Event& event)
+{
+   if(CurrentBuffer == nullptr)
+   {
+      CurrentBuffer = RegisterThread();
+   }
+
+   // Only this thread writes to its buffer, so a plain store is enough
+   const quint64 index = CurrentBuffer->Written.load(std::memory_order_relaxed);
+   CurrentBuffer->Events[index % CurrentBuffer->Events.size()] = event;
+   CurrentBuffer->Written.store(index + 1, std::memory_order_release);
+}
+
+bool Tracer::Save(const QString& filePath)
+{
+   QSaveFile file(filePath);
+   if(!file.open(QIODevice::WriteOnly))
+   {
+      return false;
+   }
+
+   QByteArray out = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+   bool first = true;
+   auto append = [&](const QByteArray& line) {
+      out += first ? "" : ",\n";
+      out += line;
+      first = false;
+      if(out.size() >= WRITE_BUFFER_BYTES)
+      {
+         file.write(out);
+         out.clear();
+      }
+   };
+
+   QMutexLocker locker(&BuffersLock);
+   for(const ThreadBuffer* buffer : std::as_const(Buffers))
+   {
+      const QByteArray tid = QByteArray::number(buffer->ThreadIndex);
+      append("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid +
+             ",\"args\":{\"name\":\"" + buffer->ThreadName.toUtf8() + "\"}}");
+
+      const quint64 written = buffer->Written.load(std::memory_order_acquire);
+      const quint64 capacity = buffer->Events.size();
+      for(quint64 i = (written > capacity) ? (written - capacity) : 0ull; i < written; i++)
+      {
+         const Event& event = buffer->Events.at(i % capacity);
+         QByteArray line = "{\"name\":\"" + QByteArray(event.Name) + "\",\"cat\":\"" + QByteArray(event.Category) +
+                           "\",\"ph\":\"X\",\"ts\":" + Micros(event.StartNs) + ",\"dur\":" + Micros(event.DurationNs) +
+                           ",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"job\":" + QByteArray::number(event.JobId);
+         if(event.Offset >= 0)
+         {
+            line += ",\"offset\":" + QByteArray::number(event.Offset);
+         }
+         if(event.Bytes > 0)
+         {
+            line += ",\"bytes\":" + QByteArray::number(event.Bytes);
+         }
+         append(line + "}}");
+      }
+   }
+
+   out += "\n]}\n";
+   file.write(out);
+   return file.commit();
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QString>
+#include <atomic>
+
+// Records what the threads of the imaging pipeline do and when, for viewing as a
+// timeline in Perfetto (ui.perfetto.dev) or chrome://tracing. Every thread
+// writes complete events (start and duration) into its own fixed-size ring
+// buffer without taking a lock; once a buffer is full its oldest events are
+// overwritten. While tracing is off, a TraceScope costs one relaxed load.
+class Tracer
+{
+public:
+   struct Event
+   {
+      // Both must be string literals; only the pointers are kept
+      const char* Name;
+      const char* Category;
+      qint64 StartNs;
+      qint64 DurationNs;
+      int JobId;
+      // Byte offset and length the operation worked on; -1 and 0 if it has none
+      qint64 Offset;
+      qint64 Bytes;
+   };
+
+   static bool IsEnabled()
+   {
+      return Enabled.load(std::memory_order_relaxed);
+   }
+
+   // Meant to be called once, before the work to be traced starts
+   static void Enable(const int eventsPerThread = 1 << 16);
+   static void Disable();
+
+   // Nanoseconds since tracing was enabled
+   static qint64 Now();
+   static void Record(const Event& event);
+
+   // Writes everything recorded so far in the Chrome trace event format. The
+   // traced work has to be finished, as the buffers are read without locking.
+   static bool Save(const QString& filePath);
+
+private:
+   static std::atomic<bool> Enabled;
+};
+
+// Records the time from its construction to its destruction as one event
+class TraceScope
+{
+public:
+   TraceScope(const char* name, const char* category, const int jobId = 0,
+              const qint64 offset = -1, const qint64 bytes = 0)
+      : Active(Tracer::IsEnabled())
+   {
+      if(Active)
+      {
+         Event = {name, category, Tracer::Now(), 0, jobId, offset, bytes};
+      }
+   }
+
+   ~TraceScope()
+   {
+      if(Active)
+      {
+         Event.DurationNs = Tracer::Now() - Event.StartNs;
+         Tracer::Record(Event);
+      }
+   }
+
+   TraceScope(const TraceScope&) = delete;
+   TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+   bool Active;
+   Tracer::Event Event;
+};
@@ -20,20 +20,38 @@ public slots:
                                                  const int sectorSize,
                                                  const bool dataFound) = 0;
    virtual void HandleWarnUnspecifiedIOError() = 0;
+   // The first sector that differs, or -1 if it is not known
+   virtual void HandleWarnVerifyMismatch(const long long sector) = 0;
+   virtual void HandleWarnBaseImageMismatch() = 0;
    virtual void HandleInfoGeneratedHash(const QString hashString) = 0;
+   virtual void HandleInfoWriteSuccessful() = 0;
+   virtual void HandleInfoVerifySuccessful() = 0;
    virtual void HandleRequestReadOverwriteConfirmation() = 0;
+   virtual void HandleRequestWriteOverwriteConfirmation() = 0;
    virtual void HandleSetProgressBarRange(const int min, const int max) = 0;
-   virtual void HandleProgressBarStatus(const double mbpersec, const int completion) = 0;
+   // Sampled by DriveIO at a fixed rate, not sent for every chunk
+   virtual void HandleProgressBarStatus(const double mbComplete, const int completion) = 0;
+   // Throughput and mean request latency of the running job, at the same rate
+   virtual void HandleThroughputSample(const double mbPerSecond, const double latencyMs) = 0;
    virtual void HandleOperationComplete(const bool cancelled) = 0;
    virtual void HandleStartTimers() = 0;
+   // Errors of the disk layer, to be taken from DiskErrorQueue
+   virtual void HandleDiskErrors() = 0;
    virtual void HandleSettingsLoaded(const QString imageDir, const QString fileType);
-   virtual void HandleLogicalDrivesDetected(/*Need args defined!*/);
+   // The whole list of drives, sent again whenever it changes
+   virtual void HandleLogicalDrivesDetected(const QList<QString> drives) = 0;
 
 signals:
    void ReadOverwriteConfirmation(const bool confirmed);
    void WriteOverwriteConfirmation(const bool confirmed);
+   void ConfirmNotEnoughSpaceOnVolume(const bool confirmed);
    void RequestReadOperation(const QString fileName);
    void RequestWriteOperation(const QString fileName);
+   void RequestVerifyOperation(const QString fileName);
+   void RequestCancel();
+   void DriveSelected(const char driveLetter);
+   // A QCryptographicHash::Algorithm to hash the image with, or -1 for none
+   void HashTypeSelected(const int hashType);
    void RequestLoadSettings();
    void RequestSaveSettings();
    void RequestLogicalDrives();
@@ -0,0 +1,45 @@
+#include "windowsdevicebackend.h"
+#include "disk.h"
+#include <windows.h>
+
+QList<DeviceInfo> WindowsDeviceBackend::ListCandidates() const
+{
+   QList<DeviceInfo> candidates;
+
+   // Bit 0 is A:, bit 1 is B: and so on
+   const DWORD driveMask = GetLogicalDrives();
+   for(int i = 0; i < 26; i++)
+   {
+      if((driveMask & (1ul << i)) == 0)
+      {
+         continue;
+      }
+
+      const char letter = static_cast<char>('A' + i);
+      DeviceInfo device;
+      device.Name = QString("[%1:\\]").arg(letter);
+
+      // The volume GUID changes when another drive takes over the letter
+      const char mountPoint[] = {letter, ':', '\\', '\0'};
+      char volumeName[MAX_PATH];
+      if(GetVolumeNameForVolumeMountPointA(mountPoint, volumeName, MAX_PATH))
+      {
+         device.Identity = QString::fromLatin1(volumeName);
+      }
+      else
+      {
+         device.Identity = device.Name;
+      }
+      candidates.append(device);
+   }
+   return candidates;
+}
+
+bool WindowsDeviceBackend::Probe(DeviceInfo* device) const
+{
+   // checkDriveType wants "\\.\E:\"
+   char driveName[] = "\\\\.\\A:\\";
+   driveName[4] = device->Name.at(1).toLatin1();
+   ULONG deviceNumber = 0;
+   return checkDriveType(driveName, &deviceNumber);
+}
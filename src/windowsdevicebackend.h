@@ -0,0 +1,14 @@
+#pragma once
+
+#include "devicebackend.h"
+
+// Drive letters of removable drives and of fixed ones on USB, SD or MMC, as
+// checkDriveType decides. Listing only asks the mount manager for the volume
+// behind each letter; the IOCTLs that can stall on an empty card reader slot
+// happen in Probe.
+class WindowsDeviceBackend : public DeviceBackend
+{
+public:
+   QList<DeviceInfo> ListCandidates() const override;
+   bool Probe(DeviceInfo* device) const override;
+};
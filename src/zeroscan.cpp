@@ -0,0 +1,33 @@
+#include "zeroscan.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define ZEROSCAN_SSE2
+#endif
+
+qint64 FindLastNonZeroByte(const char* data, const qint64 numBytes)
+{
+   qint64 end = numBytes;
+#ifdef ZEROSCAN_SSE2
+   // OR four 16-byte loads together, so there is only one compare per 64 bytes
+   const __m128i zero = _mm_setzero_si128();
+   while(end >= 64)
+   {
+      const __m128i* block = reinterpret_cast<const __m128i*>(data + end - 64);
+      const __m128i any = _mm_or_si128(_mm_or_si128(_mm_loadu_si128(block), _mm_loadu_si128(block + 1)),
+                                       _mm_or_si128(_mm_loadu_si128(block + 2), _mm_loadu_si128(block + 3)));
+      if(_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) != 0xFFFF)
+      {
+         break;
+      }
+      end -= 64;
+   }
+#endif
+
+   // The block with the last non-zero byte, and whatever did not fill a whole block
+   while((end > 0) && (data[end - 1] == 0))
+   {
+      end--;
+   }
+   return end - 1;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Offset of the last non-zero byte in data, or -1 if it is all zeros. Scans
+// backwards, 64 bytes at a time with SSE2 where available, so trailing zeros
+// of a large buffer are cheap to find.
+qint64 FindLastNonZeroByte(const char* data, const qint64 numBytes);